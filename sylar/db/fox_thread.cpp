@@ -3,6 +3,7 @@
 #include "sylar/log.h"
 #include "sylar/util.h"
 #include "sylar/macro.h"
+#include "sylar/trace.h"
 #include "sylar/config.h"
 #include <iomanip>
 
@@ -176,6 +177,8 @@ void FoxThread::thread_cb() {
 
 // 将一个回调任务添加到线程的任务队列中，并通过 socket 激活事件循环，使子线程去处理这个任务。
 bool FoxThread::dispatch(callback cb) {
+    //采样的请求记录在队列里的等待和执行时间
+    cb = Tracer::Wrap("fox", cb);
     RWMutex::WriteLock lock(m_mutex);
     m_callbacks.push_back(cb);
     lock.unlock();
@@ -193,7 +196,7 @@ bool FoxThread::dispatch(uint32_t id, callback cb) {
 bool FoxThread::batchDispatch(const std::vector<callback>& cbs) {
     RWMutex::WriteLock lock(m_mutex);
     for (auto i : cbs) {
-        m_callbacks.push_back(i);
+        m_callbacks.push_back(Tracer::Wrap("fox", i));
     }
     lock.unlock();
     uint8_t cmd = 1;
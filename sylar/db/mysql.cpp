@@ -987,26 +987,32 @@ MySQL::ptr MySQLManager::get(const std::string& name) {
     auto it = m_conns.find(name);
     if (it != m_conns.end()) {
         if (!it->second.empty()) {
+            PoolMetrics::ptr pm = getMetrics(name);
             MySQL* rt = it->second.front();
             it->second.pop_front();
+            pm->setIdle(it->second.size());
             lock.unlock();
             if (!rt->isNeedCheck()) {
                 rt->m_lastUsedTime = time(0);
+                pm->onAcquire(PoolMetrics::REUSE);
                 // 实际等价于 auto f = [&](MySQL* m) { this->freeMySQL(name, m); }
                 // 这里的 m 是由 shared_ptr 的删除器机制自动传入的。
                 // 当构造 shared_ptr 时手动指定删除器，
                 // 在 shared_ptr 最后一个引用被销毁时，它会调用指定的删除器，
                 // 并将自己所托管的原始指针（即 m）作为参数传入。
-                return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL, this, name, std::placeholders::_1));
+                return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL, this, name, pm, std::placeholders::_1));
             } 
             if (rt->ping()) {
                 rt->m_lastUsedTime = time(0);
-                return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL, this, name, std::placeholders::_1));
+                pm->onAcquire(PoolMetrics::REUSE);
+                return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL, this, name, pm, std::placeholders::_1));
             } else if (rt->connect()) {
                 rt->m_lastUsedTime = time(0);
+                pm->onAcquire(PoolMetrics::REUSE);
                 return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL,
-                            this, name, std::placeholders::_1));
+                            this, name, pm, std::placeholders::_1));
             } else {
+                pm->onAcquire(PoolMetrics::FAIL);
                 return nullptr;
             }
         }
@@ -1026,17 +1032,28 @@ MySQL::ptr MySQLManager::get(const std::string& name) {
             return nullptr;
         }
     }
+    PoolMetrics::ptr pm = getMetrics(name);
     lock.unlock();
     MySQL* rt = new MySQL(args);
     if (rt->connect()) {
         rt->m_lastUsedTime = time(0);
-        return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL, this, name, std::placeholders::_1));
+        pm->onAcquire(PoolMetrics::CREATE);
+        return MySQL::ptr(rt, std::bind(&MySQLManager::freeMySQL, this, name, pm, std::placeholders::_1));
     } else {
+        pm->onAcquire(PoolMetrics::FAIL);
         delete rt;
         return nullptr;
     }
 }
 
+PoolMetrics::ptr MySQLManager::getMetrics(const std::string& name) {
+    auto& pm = m_metrics[name];
+    if (!pm) {
+        pm = std::make_shared<PoolMetrics>("mysql", name);
+    }
+    return pm;
+}
+
 void MySQLManager::registerMySQL(const std::string& name, const std::map<std::string, std::string>& params) {
     MutexType::Lock lock(m_mutex);
     m_dbDefines[name] = params;
@@ -1047,13 +1064,15 @@ void MySQLManager::checkConnection(int sec) {
     std::vector<MySQL*> conns;
     MutexType::Lock lock(m_mutex);
     for (auto& i : m_conns) {
-        for (auto it = i.second.begin(); it != i.second.end(); ++it) {
+        for (auto it = i.second.begin(); it != i.second.end();) {
             if ((int)(now - (*it)->m_lastUsedTime) >= sec) {
-                auto tmp = *it;
-                i.second.erase(it);
-                conns.push_back(tmp);
+                conns.push_back(*it);
+                it = i.second.erase(it);
+            } else {
+                ++it;
             }
         }
+        getMetrics(i.first)->idle->set(i.second.size());
     }
     lock.unlock();
     for (auto& i : conns) {
@@ -1128,11 +1147,13 @@ MySQLTransaction::ptr MySQLManager::openTransaction(const std::string& name, boo
     return trans;
 }
 
-void MySQLManager::freeMySQL(const std::string& name, MySQL* m) {
+void MySQLManager::freeMySQL(const std::string& name, PoolMetrics::ptr pm, MySQL* m) {
+    pm->onRelease();
     if (m->m_mysql) { //连接还有效
         MutexType::Lock lock(m_mutex);
         if (m_conns[name].size() < (size_t)m->m_poolSize) {    //检查连接池是否已满
             m_conns[name].push_back(m);
+            pm->setIdle(m_conns[name].size());
             return;
         }
     }
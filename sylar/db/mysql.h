@@ -10,6 +10,7 @@
 #include <list>
 #include "sylar/mutex.h"
 #include "db.h"
+#include "pool_metrics.h"
 #include "sylar/singleton.h"
 
 namespace sylar {
@@ -376,7 +377,9 @@ public:
 
 private:
     //释放 MySQL 连接，并将其放回连接池，或者在连接池已满时删除该连接
-    void freeMySQL(const std::string& name, MySQL* m);
+    void freeMySQL(const std::string& name, PoolMetrics::ptr pm, MySQL* m);
+    //name对应连接池的指标，第一次使用时创建，调用方需持有m_mutex
+    PoolMetrics::ptr getMetrics(const std::string& name);
 
 private:
     // 最大连接数。如果 m_maxConn = 100，那不管你注册了多少个数据库，每个数据库有多少连接，加起来最多只能存在 100 个连接。
@@ -387,6 +390,8 @@ private:
     std::map<std::string, std::list<MySQL*>> m_conns;
     // 存储数据库连接的配置定义，std::map<std::string, std::string> 用于存储配置项。
     std::map<std::string, std::map<std::string, std::string>> m_dbDefines;
+    // 每个连接池的指标(sylar_db_pool_*)，借还连接时直接使用，不再按标签查找
+    std::map<std::string, PoolMetrics::ptr> m_metrics;
 };
 
 typedef sylar::Singleton<MySQLManager> MySQLMgr;
@@ -0,0 +1,25 @@
+#include "pool_metrics.h"
+
+namespace sylar {
+
+static const char* s_results[] = {"reuse", "new", "shared", "fail"};
+
+PoolMetrics::PoolMetrics(const std::string& type, const std::string& name) {
+    auto mgr = metrics::MetricsMgr::GetInstance();
+    metrics::Labels labels = {{"type", type}, {"name", name}};
+    m_inUse = mgr->getGauge("sylar_db_pool_in_use", "db connections borrowed from pool", labels);
+    m_idle = mgr->getGauge("sylar_db_pool_idle", "idle db connections in pool", labels);
+    for (int i = REUSE; i <= FAIL; ++i) {
+        labels["result"] = s_results[i];
+        m_acquire[i] = mgr->getCounter("sylar_db_pool_acquire_total", "db connections acquired", labels);
+    }
+}
+
+void PoolMetrics::onAcquire(Result result) {
+    if (result == REUSE || result == CREATE) {
+        m_inUse->inc();
+    }
+    m_acquire[result]->inc();
+}
+
+}
@@ -0,0 +1,50 @@
+/**
+ * @file pool_metrics.h
+ * @brief 数据库连接池的指标(sylar_db_pool_*)
+ * @date 2025-07-24
+ * @copyright Copyright (c) All rights reserved
+ */
+
+#ifndef __SYLAR_DB_POOL_METRICS_H__
+#define __SYLAR_DB_POOL_METRICS_H__
+
+#include <memory>
+#include <string>
+#include "sylar/metrics.h"
+
+namespace sylar {
+
+//一个连接池的指标，连接池第一次使用时从MetricsRegistry取出来，之后借还连接不再按标签查找
+//标签为type(mysql/redis)和name(连接池名)，MySQLManager和RedisManager共用
+class PoolMetrics {
+public:
+    typedef std::shared_ptr<PoolMetrics> ptr;
+
+    //sylar_db_pool_acquire_total的result标签
+    enum Result {
+        //从池中取出
+        REUSE = 0,
+        //新建连接
+        CREATE = 1,
+        //线程安全的连接，不占用
+        SHARED = 2,
+        FAIL = 3
+    };
+
+    PoolMetrics(const std::string& type, const std::string& name);
+
+    //记录一次acquire，REUSE和CREATE算作借出
+    void onAcquire(Result result);
+    //归还一个借出的连接
+    void onRelease() { m_inUse->dec();}
+    void setIdle(size_t v) { m_idle->set(v);}
+
+private:
+    metrics::Gauge::ptr m_inUse;
+    metrics::Gauge::ptr m_idle;
+    metrics::Counter::ptr m_acquire[FAIL + 1];
+};
+
+}
+
+#endif
@@ -1127,7 +1127,9 @@ IRedis::ptr RedisManager::get(const std::string& name) {
     if(it == m_datas.end()) {
         return nullptr;
     }
+    PoolMetrics::ptr pm = getMetrics(name);
     if(it->second.empty()) {
+        pm->onAcquire(PoolMetrics::FAIL);
         return nullptr;
     }
     auto r = it->second.front();
@@ -1137,12 +1139,14 @@ IRedis::ptr RedisManager::get(const std::string& name) {
             || r->getType() == IRedis::FOX_REDIS_CLUSTER) {
         // 线程安全连接不需要独占使用，立刻放回池中可供复用
         it->second.push_back(r);
+        pm->onAcquire(PoolMetrics::SHARED);
         // 返回一个 shared_ptr，使用空 deleter，防止自动 delete
         // 表示这个对象由池管理，调用方不能销毁，只是临时借用
         return std::shared_ptr<IRedis>(r, sylar::nop<IRedis>);
     }
 
     //非线程安全的 Redis（即同步 Redis），需要独占使用，释放锁避免死锁
+    pm->setIdle(it->second.size());
     lock.unlock();
     // 尝试进行健康检查
     auto rr = dynamic_cast<ISyncRedis*>(r);
@@ -1152,22 +1156,37 @@ IRedis::ptr RedisManager::get(const std::string& name) {
             if(!rr->reconnect()) {
                 // 重连失败，将连接重新放回池中
                 sylar::RWMutex::WriteLock lock(m_mutex);
-                m_datas[name].push_back(r);
+                auto& pool = m_datas[name];
+                pool.push_back(r);
+                pm->setIdle(pool.size());
+                pm->onAcquire(PoolMetrics::FAIL);
                 return nullptr;
             }
         }
     }
     // 更新活跃时间
     rr->setLastActiveTime(time(0));
+    pm->onAcquire(PoolMetrics::REUSE);
     // 返回一个 shared_ptr，传入自定义 deleter，
     // 用于在引用计数归零时将连接归还给连接池
     return std::shared_ptr<IRedis>(r, std::bind(&RedisManager::freeRedis,
-                        this, std::placeholders::_1));
+                        this, pm, std::placeholders::_1));
 }
 
-void RedisManager::freeRedis(IRedis* r) {
+void RedisManager::freeRedis(PoolMetrics::ptr pm, IRedis* r) {
     sylar::RWMutex::WriteLock lock(m_mutex);
-    m_datas[r->getName()].push_back(r);
+    auto& pool = m_datas[r->getName()];
+    pool.push_back(r);
+    pm->onRelease();
+    pm->setIdle(pool.size());
+}
+
+PoolMetrics::ptr RedisManager::getMetrics(const std::string& name) {
+    auto& pm = m_metrics[name];
+    if(!pm) {
+        pm = std::make_shared<PoolMetrics>("redis", name);
+    }
+    return pm;
 }
 
 RedisManager::RedisManager() {
@@ -1180,6 +1199,11 @@ void RedisManager::init() {
     size_t total = 0;  // 所有需要初始化的实例总数
 
     for(auto& i : m_config) {
+        {
+            //连接池的指标在这里一次创建好
+            sylar::RWMutex::WriteLock lock(m_mutex);
+            getMetrics(i.first);
+        }
         auto type = get_value(i.second, "type");           
         auto pool = sylar::TypeUtil::Atoi(get_value(i.second, "pool")); // 获取连接池数量（多少个实例）
         auto passwd = get_value(i.second, "passwd"); 
@@ -65,6 +65,7 @@
 #include <memory>
 #include "sylar/mutex.h"
 #include "sylar/db/fox_thread.h"
+#include "sylar/db/pool_metrics.h"
 #include "sylar/singleton.h"
 
 namespace sylar {
@@ -745,7 +746,12 @@ private:
     /**
      * @brief 对象复用（资源池回收）。
      */
-    void freeRedis(IRedis* r);
+    void freeRedis(PoolMetrics::ptr pm, IRedis* r);
+
+    /**
+     * @brief name对应连接池的指标，不存在时创建，调用方需持有m_mutex的写锁
+     */
+    PoolMetrics::ptr getMetrics(const std::string& name);
 
     /**
      * @brief 初始化 Redis 客户端池（从配置中加载）
@@ -760,6 +766,11 @@ private:
      */
     std::map<std::string, std::list<IRedis*> > m_datas;
 
+    /**
+     * @brief 每个连接池的指标（name -> sylar_db_pool_*），借还连接时直接使用
+     */
+    std::map<std::string, PoolMetrics::ptr > m_metrics;
+
     /**
      * @brief 配置项（name -> conf map）
      */
@@ -0,0 +1,81 @@
+#include "dns.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+#include <sys/socket.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_dns_cache_ttl =
+    sylar::Config::Lookup("dns.cache.ttl", (uint64_t)(60 * 1000), "dns cache ttl ms");
+
+//返回拷贝并设置端口，缓存中的地址对象不会被调用方修改
+static void CopyAddrs(const std::vector<IPAddress::ptr>& src, uint16_t port
+                      ,std::vector<IPAddress::ptr>& dst) {
+    dst.clear();
+    for (auto& i : src) {
+        IPAddress::ptr addr = std::dynamic_pointer_cast<IPAddress>(
+                Address::Create(i->getAddr(), i->getAddrLen()));
+        if (addr) {
+            addr->setPort(port);
+            dst.push_back(addr);
+        }
+    }
+}
+
+bool DnsCache::lookup(const std::string& host, uint16_t port, std::vector<IPAddress::ptr>& addrs) {
+    uint64_t now = sylar::GetCurrentMS();
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_items.find(host);
+        if (it != m_items.end() && it->second.expire > now) {
+            CopyAddrs(it->second.addrs, port, addrs);
+            return !addrs.empty();
+        }
+    }
+
+    //解析时不持有锁，同一个域名同时过期时可能重复解析，不影响结果
+    std::vector<Address::ptr> result;
+    std::vector<IPAddress::ptr> ips;
+    if (Address::Lookup(result, host, AF_INET, SOCK_STREAM)) {
+        for (auto& i : result) {
+            IPAddress::ptr v = std::dynamic_pointer_cast<IPAddress>(i);
+            if (v) {
+                ips.push_back(v);
+            }
+        }
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    Item& item = m_items[host];
+    if (ips.empty()) {
+        if (item.addrs.empty()) {
+            m_items.erase(host);
+            SYLAR_LOG_ERROR(g_logger) << "dns lookup fail host=" << host;
+            return false;
+        }
+        //解析失败时使用旧的结果，过一个ttl再重新解析
+        SYLAR_LOG_WARN(g_logger) << "dns lookup fail host=" << host
+            << ", use stale result size=" << item.addrs.size();
+    } else {
+        item.addrs.swap(ips);
+    }
+    item.expire = now + g_dns_cache_ttl->getValue();
+    CopyAddrs(item.addrs, port, addrs);
+    return !addrs.empty();
+}
+
+void DnsCache::invalidate(const std::string& host) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_items.erase(host);
+}
+
+size_t DnsCache::size() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_items.size();
+}
+
+}
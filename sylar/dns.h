@@ -0,0 +1,58 @@
+/**
+ * @file dns.h
+ * @brief 域名解析结果缓存
+ * @date 2025-07-20
+ * @copyright Copyright (c) All rights reserved
+ */
+
+#ifndef __SYLAR_DNS_H__
+#define __SYLAR_DNS_H__
+
+#include "address.h"
+#include "mutex.h"
+#include "singleton.h"
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sylar {
+
+//Address::Lookup每次都调用getaddrinfo，会阻塞整个线程(和LookupAnyIPAddress一样只解析IPv4)
+//DnsCache按域名缓存解析结果，过期时间由dns.cache.ttl(毫秒)配置
+//过期后重新解析失败时继续使用旧的结果，避免DNS短暂不可用时所有新连接都失败
+class DnsCache {
+public:
+    typedef RWMutex RWMutexType;
+
+    /**
+     * @brief 解析host(只取TCP地址)
+     * @param[in] host 域名或者ip
+     * @param[in] port 结果中设置的端口
+     * @param[out] addrs 解析结果，每次返回新的地址对象，调用方可以修改
+     * @return 是否解析成功
+     */
+    bool lookup(const std::string& host, uint16_t port, std::vector<IPAddress::ptr>& addrs);
+
+    //删除缓存，下次lookup重新解析
+    void invalidate(const std::string& host);
+
+    size_t size();
+
+private:
+    struct Item {
+        std::vector<IPAddress::ptr> addrs;
+        uint64_t expire = 0;
+    };
+
+private:
+    RWMutexType m_mutex;
+    std::unordered_map<std::string, Item> m_items;
+};
+
+typedef sylar::Singleton<DnsCache> DnsCacheMgr;
+
+}
+
+#endif
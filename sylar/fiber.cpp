@@ -31,6 +31,7 @@
 #include "log.h"
 #include "util.h"
 #include "scheduler.h"
+#include "metrics.h"
 #include <atomic>
 
 namespace sylar {
@@ -38,6 +39,10 @@ namespace sylar {
 static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 static std::atomic<uint64_t> s_fiber_id{ 0 };             //全局递增的id，每个新创建的协程都会有一个唯一的id
 static std::atomic<uint64_t> s_fiber_count{ 0 };          //当前存在的fiber总数
+static metrics::FuncMetric::ptr s_fiber_count_metric = metrics::MetricsMgr::GetInstance()->addFunc(
+        "sylar_fibers", "fibers alive", metrics::Labels(), metrics::Metric::GAUGE, []() {
+    return (double)s_fiber_count;
+});
 static thread_local Fiber* t_fiber = nullptr;             //当前正在运行的协程
 static thread_local Fiber::ptr t_thread_fiber = nullptr;  //当前线程的主协程
 
@@ -66,6 +71,12 @@ uint64_t Fiber::GetFiberId() {
     return 0;
 }
 
+TraceContext* Fiber::GetTraceContext() {
+    //没有协程的线程(如FoxThread)用线程自己的上下文
+    static thread_local TraceContext t_thread_trace;
+    return t_fiber ? &t_fiber->m_trace : &t_thread_trace;
+}
+
 Fiber::Fiber() {
     m_state = EXEC;
     SetThis(this);
@@ -138,6 +149,7 @@ void Fiber::reset(std::function<void()> cb) {
     SYLAR_ASSERT(m_state == EXCEPT || m_state == INIT || m_state == TERM);
 
     m_cb = cb;
+    m_trace = TraceContext();
 
     if (getcontext(&m_ctx)) {
         SYLAR_ASSERT2(false, "getcontext");
@@ -12,6 +12,7 @@
 #include <memory>
 #include <functional>
 #include <ucontext.h>
+#include "trace.h"
 
 namespace sylar {
 
@@ -100,6 +101,11 @@ public:
      */
     uint64_t getId() const { return m_id;}
 
+    /**
+     * @brief 返回协程的追踪上下文，reset时清空
+     */
+    TraceContext& getTraceContext() { return m_trace;}
+
     /**
      * @brief 返回协程状态
      */
@@ -150,6 +156,11 @@ public:
      * @brief 获取当前协程的id
      */
     static uint64_t GetFiberId();
+
+    /**
+     * @brief 获取当前协程的追踪上下文，线程还没有协程时返回线程自己的
+     */
+    static TraceContext* GetTraceContext();
 private:
     /// 协程id
     uint64_t m_id = 0;
@@ -163,6 +174,8 @@ private:
     void* m_stack = nullptr;
     /// 协程运行函数
     std::function<void()> m_cb;
+    /// 追踪上下文
+    TraceContext m_trace;
 };
 
 }
@@ -2,6 +2,7 @@
 #include <dlfcn.h>
 #include <cstdarg>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 
 #include "config.h"
 #include "log.h"
@@ -9,6 +10,7 @@
 #include "iomanager.h"
 #include "fd_manager.h"
 #include "macro.h"
+#include "trace.h"
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 namespace sylar {
@@ -35,11 +37,14 @@ static thread_local bool t_hook_enable = false;
     XX(recv) \
     XX(recvfrom) \
     XX(recvmsg) \
+    XX(recvmmsg) \
     XX(write) \
     XX(writev) \
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendmmsg) \
+    XX(sendfile) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -199,7 +204,11 @@ retry:
             return -1;
         } else {
             //挂起当前协程，切换到其他任务;等待IO事件触发,当 I/O 事件发生后，协程会被重新唤醒
-            sylar::Fiber::YieldToHold();
+            {
+                //采样时记录等待fd的时间(包括唤醒后在调度队列里排队的时间)
+                sylar::TraceSpan span("io", hook_fun_name);
+                sylar::Fiber::YieldToHold();
+            }
             if (timer) {
                 timer->cancel();
             }
@@ -216,6 +225,7 @@ retry:
 extern "C" {
 
 #define XX(name) name##_fun name##_f = nullptr;
+    HOOK_FUN(XX);
 #undef XX
 
 //sleep hook版本
@@ -435,6 +445,12 @@ ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
     return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
 }
 
+//一次接收多个数据报，没有数据可读时挂起当前协程，有数据时尽量把msgvec填满
+//返回实际接收到的数据报个数，每个数据报的长度在msgvec[i].msg_len中
+int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags, struct timespec* timeout) {
+    return do_io(sockfd, recvmmsg_f, "recvmmsg", sylar::IOManager::READ, SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+}
+
 //将buf中的count字节数据写入fd
 ssize_t write(int fd, const void* buf, size_t count) {
     return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
@@ -479,6 +495,16 @@ ssize_t sendmsg(int fd, const struct msghdr *msg, int flags) {
     return do_io(fd, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+//一次发送多个数据报，发送缓冲区满时挂起当前协程，返回实际发送出去的数据报个数
+int sendmmsg(int fd, struct mmsghdr* msgvec, unsigned int vlen, int flags) {
+    return do_io(fd, sendmmsg_f, "sendmmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+//out_fd是socket时按写事件挂起，offset由内核更新
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+    return do_io(out_fd, sendfile_f, "sendfile", sylar::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
 
 int close(int fd) {
     if (!t_hook_enable) {
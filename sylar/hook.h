@@ -87,6 +87,10 @@ typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr *msg, int flags);
 extern recvmsg_fun recvmsg_f;  
 // 对应 recvmsg()，用于接收带有多个缓冲区和控制信息的消息（如带外数据）
 
+typedef int (*recvmmsg_fun)(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
+extern recvmmsg_fun recvmmsg_f;
+// 对应 recvmmsg()，一次系统调用接收多个数据报(UDP批量接收)
+
 // write 相关函数指针
 typedef ssize_t (*write_fun)(int fd, const void *buf, size_t count);
 extern write_fun write_f;  
@@ -108,6 +112,14 @@ typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;  
 // 对应 sendmsg()，用于发送带有多个缓冲区和控制信息的消息（如带外数据）
 
+typedef int (*sendmmsg_fun)(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+extern sendmmsg_fun sendmmsg_f;
+// 对应 sendmmsg()，一次系统调用发送多个数据报(UDP批量发送)
+
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_fun sendfile_f;
+// 对应 sendfile()，在内核里把文件内容直接发到socket，数据不经过用户态
+
 // 关闭文件描述符
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;  
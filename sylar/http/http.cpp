@@ -1,7 +1,15 @@
 #include "http.h"
+#include "http_body.h"
+#include "http_parser.h"
 #include "sylar/util.h"
 
 #include <string>
+#include <map>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
 
 namespace sylar {
 namespace http {
@@ -72,28 +80,219 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
       m_path("/"){
 }
 
+const std::string& HttpRequest::getBody() const {
+    if (m_bodyView) {
+        m_body.assign(m_bodyView, m_bodyViewLength);
+        m_bodyView = nullptr;
+        m_bodyViewLength = 0;
+    }
+    if (m_bodyReader && !m_bodyReader->isDone() && !m_bodyReader->isError()) {
+        if (m_bodyReader->readAll(m_body, HttpRequestParser::GetHttpRequestMaxBodySize()) < 0) {
+            m_body.clear();
+        }
+    }
+    return m_body;
+}
+
 std::shared_ptr<HttpResponse> HttpRequest::createResponse() {
     std::shared_ptr<HttpResponse> rsp(new HttpResponse(getVersion(), isClose()));
     return rsp;
 }
 
-std::string HttpRequest::getHeader(const std::string& key, const std::string& def = "") const {
-    auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+std::string HttpRequest::getHeader(const StringView& key, const std::string& def) const {
+    StringView v;
+    return m_headers.get(key, v) ? v.str() : def;
+}
+
+//去掉首尾的空格和制表符
+static StringView TrimView(const StringView& str) {
+    size_t begin = 0;
+    size_t end = str.size();
+    while (begin < end && (str[begin] == ' ' || str[begin] == '\t')) {
+        ++begin;
+    }
+    while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t')) {
+        --end;
+    }
+    return str.substr(begin, end - begin);
+}
+
+static bool NeedUrlDecode(const StringView& str) {
+    for (auto c : str) {
+        if (c == '%' || c == '+') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+//url解码到arena中，'+'解码为空格，不合法的%xx原样保留
+static StringView UrlDecodeTo(Arena& arena, const StringView& str) {
+    if (!NeedUrlDecode(str)) {
+        return arena.copy(str);
+    }
+    char* out = arena.allocateChars(str.size());
+    size_t n = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        char c = str[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && i + 2 < str.size()) {
+            int h = HexValue(str[i + 1]);
+            int l = HexValue(str[i + 2]);
+            if (h >= 0 && l >= 0) {
+                c = (char)((h << 4) | l);
+                i += 2;
+            }
+        }
+        out[n++] = c;
+    }
+    return StringView(out, n);
+}
+
+//遍历"k1=v1<sep>k2=v2"，cb(key, value)的key已经去掉首尾空白，key和value都还没有解码
+//cb返回false时停止遍历
+template<class F>
+static void ForEachParam(const StringView& str, char sep, F cb) {
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(sep, pos);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        StringView item = str.substr(pos, end - pos);
+        pos = end + 1;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        if (!cb(TrimView(item.substr(0, eq)), item.substr(eq + 1))) {
+            break;
+        }
+    }
+}
+
+//在str中找名字解码后等于key的第一个参数，值解码到arena
+static bool FindEncodedParam(Arena& arena, const StringView& str, char sep,
+                             const StringView& key, StringView& val) {
+    bool found = false;
+    ForEachParam(str, sep, [&](const StringView& k, const StringView& v) {
+        //名字一般不需要解码，先按长度过滤
+        if (NeedUrlDecode(k) ? UrlDecodeTo(arena, k) != key : k != key) {
+            return true;
+        }
+        val = UrlDecodeTo(arena, v);
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+bool HttpRequest::getFormBody(StringView& body) const {
+    StringView type = m_headers.get(HttpHeaders::CONTENT_TYPE);
+    if (type.size() < 33 || strncasecmp(type.data(), "application/x-www-form-urlencoded", 33)) {
+        return false;
+    }
+    //流式消息体先读进m_body
+    if (m_bodyReader) {
+        getBody();
+    }
+    body = StringView(getBodyData(), getBodyLength());
+    return true;
+}
+
+bool HttpRequest::findParam(const StringView& key, StringView& val) const {
+    for (ParamNode* n = m_paramCache; n; n = n->next) {
+        if (n->key == key) {
+            val = n->value;
+            return true;
+        }
+    }
+    StringView body;
+    if (!FindEncodedParam(m_arena, m_query, '&', key, val)
+            && !(getFormBody(body) && FindEncodedParam(m_arena, body, '&', key, val))) {
+        return false;
+    }
+    ParamNode* node = new (m_arena.allocate(sizeof(ParamNode))) ParamNode;
+    node->key = m_arena.copy(key);
+    node->value = val;
+    node->next = m_paramCache;
+    m_paramCache = node;
+    return true;
+}
+
+bool HttpRequest::findCookie(const StringView& key, StringView& val) const {
+    for (ParamNode* n = m_cookieCache; n; n = n->next) {
+        if (n->key == key) {
+            val = n->value;
+            return true;
+        }
+    }
+    StringView cookie = m_headers.get(HttpHeaders::COOKIE);
+    if (cookie.empty() || !FindEncodedParam(m_arena, cookie, ';', key, val)) {
+        return false;
+    }
+    ParamNode* node = new (m_arena.allocate(sizeof(ParamNode))) ParamNode;
+    node->key = m_arena.copy(key);
+    node->value = val;
+    node->next = m_cookieCache;
+    m_cookieCache = node;
+    return true;
+}
+
+bool HttpRequest::getParamView(const StringView& key, StringView& val) const {
+    //setParam设置的(路由参数等)优先
+    if (!m_params.empty()) {
+        auto it = m_params.find(key.str());
+        if (it != m_params.end()) {
+            val = it->second;
+            return true;
+        }
+    }
+    //initParam已经把query和消息体全部解析进m_params
+    if ((m_parserParamFlag & 0x3) == 0x3) {
+        return false;
+    }
+    return findParam(key, val);
 }
 
-std::string HttpRequest::getParam(const std::string& key, const std::string& def = "") const {
-    auto it = m_params.find(key);
-    return it == m_params.end() ? def : it->second;
+bool HttpRequest::getCookieView(const StringView& key, StringView& val) const {
+    if (!m_cookies.empty()) {
+        auto it = m_cookies.find(key.str());
+        if (it != m_cookies.end()) {
+            val = it->second;
+            return true;
+        }
+    }
+    if (m_parserParamFlag & 0x4) {
+        return false;
+    }
+    return findCookie(key, val);
 }
 
-std::string HttpRequest::getCookie(const std::string& key, const std::string& def = "") const {
-    auto it = m_cookies.find(key);
-    return it == m_cookies.end() ? def : it->second;
+std::string HttpRequest::getParam(const std::string& key, const std::string& def) const {
+    StringView v;
+    return getParamView(key, v) ? v.str() : def;
 }
 
-void HttpRequest::setHeader(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+std::string HttpRequest::getCookie(const std::string& key, const std::string& def) const {
+    StringView v;
+    return getCookieView(key, v) ? v.str() : def;
+}
+
+void HttpRequest::setHeader(const StringView& key, const StringView& val) {
+    m_headers.set(key, val);
 }
 
 void HttpRequest::setParam(const std::string& key, const std::string& val) {
@@ -104,7 +303,7 @@ void HttpRequest::setCookie(const std::string& key, const std::string& val) {
     m_cookies[key] = val;
 }
 
-void HttpRequest::delHeader(const std::string& key) {
+void HttpRequest::delHeader(const StringView& key) {
     m_headers.erase(key);
 }
 
@@ -117,38 +316,35 @@ void HttpRequest::delCookie(const std::string& key) {
 }
 
 
-bool HttpRequest::hasHeader(const std::string& key, std::string* val) {
-    auto it = m_headers.find(key);
-    if(it == m_headers.end()) {
+bool HttpRequest::hasHeader(const StringView& key, std::string* val) {
+    StringView v;
+    if(!m_headers.get(key, v)) {
         return false;
     }
     if(val) {
-        *val = it->second;
+        *val = v.str();
     }
     return true;
 }
 
-bool HttpRequest::hasParam(const std::string& key, std::string* val) {
-    initQueryParam();
-    initBodyParam();
-    auto it = m_params.find(key);
-    if(it == m_params.end()) {
+bool HttpRequest::hasParam(const std::string& key, std::string* val) const {
+    StringView v;
+    if(!getParamView(key, v)) {
         return false;
     }
     if(val) {
-        *val = it->second;
+        *val = v.str();
     }
     return true;
 }
 
-bool HttpRequest::hasCookie(const std::string& key, std::string* val) {
-    initCookies();
-    auto it = m_cookies.find(key);
-    if(it == m_cookies.end()) {
+bool HttpRequest::hasCookie(const std::string& key, std::string* val) const {
+    StringView v;
+    if(!getCookieView(key, v)) {
         return false;
     }
     if(val) {
-        *val = it->second;
+        *val = v.str();
     }
     return true;
 }
@@ -200,15 +396,16 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
         os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
     }
     for(auto& i : m_headers) {
-        if(!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
+        if(!m_websocket && i.first.iequals("connection", 10)) {
             continue;
         }
         os << i.first << ": " << i.second << "\r\n";
     }
 
-    if(!m_body.empty()) {
-        os << "content-length: " << m_body.size() << "\r\n\r\n"
-           << m_body;
+    size_t body_len = getBodyLength();
+    if(body_len) {
+        os << "content-length: " << body_len << "\r\n\r\n";
+        os.write(getBodyData(), body_len);
     } else {
         os << "\r\n";
     }
@@ -232,93 +429,53 @@ void HttpRequest::initParam() {
     initCookies();
 }
 
-//去掉字符串头部和尾部多余的空格
-std::string trim(const const std::string& str) {
-    size_t start = 0;
-    size_t end = str.size() - 1;
-    while (start <= end && (str[start] == ' ')) {
-        start++;
-    }
-    if (start == (end + 1)) {
-        return "";
-    }
-    while (end > start && (str[end] == ' ')) {
-        end--;
-    }
-    return str.substr(start, end - start + 1);
-}
-
 void HttpRequest::initQueryParam() {
     //每个位作为某个东西是否初始化的标志位，按位去判断的好处是节省了内存大小
     if (m_parserParamFlag & 0x01) {
         return;
     }
-//遍历字符串str(假设他是一个URL参数，例如a=1&b=2&c=3)，按照给定的flag(这里是&)分割键值对
-//每个键值对用=分割键和值，把解码后的结果放入m(map/unordered_map)中
-#define PARSE_PARAM(str, m, flag, trim)                                           \
-    /* 初始化位置索引为0，用于从头开始解析字符串 */                                   \
-    size_t pos = 0;                                                                \
-    do {                                                                           \
-        /* 记录当前字段的起始位置，用于后续截取 key */                                 \
-        size_t last = pos;                                                          \
-        /* 查找等号的位置，用于分隔 key 和 value */                                    \
-        pos = str.find('=', pos);                                                     \
-        /* 如果找不到等号，说明没有更多的参数对了，退出循环 */                              \
-        if (pos == std::string::npos) {                                                  \
-            break;                                                                        \
-        }                                                                           \
-        /* 保存等号位置，用于后续截取 key 和 value */                                   \
-        size_t key = pos;                                                             \
-        /* 查找参数之间的分隔符（如 &），用于确定 value 的结束位置 */                       \
-        pos = str.find(flag, pos);                                                      \
-        /* 向 map 插入解析出的 key-value 对，key 去除空白，value 做 URL 解码 */             \
-        m.insert(std::make_pair(                                                          \
-            trim(str.substr(last, key - last)),                                            \
-            sylar::StringUtil::UrlDecode(str.substr(key + 1, pos - key - 1))));             \
-        /* 如果找不到分隔符，说明这是最后一个参数，结束循环 */                                   \
-        if (pos == std::string::npos) {                                             \
-            break;                                                                   \
-        }                                                                             \
-        /* 跳过分隔符，准备解析下一个参数对 */                                            \
-        ++pos;                                                                          \
-    /* 循环解析直到所有 key-value 对都处理完 */                                            \
-    } while (true);                                                                      
-                                                             
-    PARSE_PARAM(m_query, m_params, '&', sylar::http::trim)  
-    m_parserParamFlag |= 0x01;                                            
+    //把a=1&b=2&c=3按&分割成键值对，解码后放入m_params，同名参数保留第一个
+    ForEachParam(m_query, '&', [this](const StringView& k, const StringView& v) {
+        m_params.insert(std::make_pair(UrlDecodeTo(m_arena, k).str(), UrlDecodeTo(m_arena, v).str()));
+        return true;
+    });
+    m_parserParamFlag |= 0x01;
 }
 
 void HttpRequest::initBodyParam() {
     if (m_parserParamFlag & 0x2) {
         return;
     }
-    std::string content_type = getHeader("content_type");
-    if (strcasestr(content_type.c_str(), "application/x-www-urlencoded") == nullptr) {
-        //strcasestr(a, b)的作用是在字符串a中看是否能找到子串b，如果能找到返回b在a中第一次出现的位置，找不到返回nullptr
-        //如果找不到的话，说明了请求体的格式不是a=1&b=2的格式，如果不是这种合适就没法解析
-        //content_type还可以是application/json表示请求体是json格式，不能用key-value解析
-        //content_type还可以是multipart/from-data表示文件上传，不能用key-value解析
-        m_parserParamFlag |= 0x2;
-        return;
+    //只有application/x-www-form-urlencoded的消息体是a=1&b=2的格式
+    //application/json、multipart/form-data等不能按key-value解析
+    StringView body;
+    if (getFormBody(body)) {
+        ForEachParam(body, '&', [this](const StringView& k, const StringView& v) {
+            m_params.insert(std::make_pair(UrlDecodeTo(m_arena, k).str(), UrlDecodeTo(m_arena, v).str()));
+            return true;
+        });
     }
-    PARSE_PARAM(m_body, m_params, '&', sylar::http::trim);
     m_parserParamFlag |= 0x2;
-
 }
 
 void HttpRequest::initCookies() {
     if (m_parserParamFlag & 0x4) return;
-    std::string cookie = getHeader("cookie");
-    if (cookie.empty()) {
-        m_parserParamFlag |= 0x4;
-        return;
-    }
-    PARSE_PARAM(cookie, m_cookies, ':', sylar::StringUtil::Trim);
+    //Cookie: a=1; b=2
+    ForEachParam(m_headers.get(HttpHeaders::COOKIE), ';', [this](const StringView& k, const StringView& v) {
+        m_cookies.insert(std::make_pair(UrlDecodeTo(m_arena, k).str(), UrlDecodeTo(m_arena, v).str()));
+        return true;
+    });
     m_parserParamFlag |= 0x4;
 }
 
 
 //HTTP Response
+HttpFileBody::~HttpFileBody() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
 HttpResponse::HttpResponse(uint8_t version, bool close) 
     : m_status(HttpStatus::OK),
       m_version(version),
@@ -327,16 +484,16 @@ HttpResponse::HttpResponse(uint8_t version, bool close)
 }
 
 
-std::string HttpResponse::getHeader(const std::string& key, const std::string& def = "") const {
-    auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+std::string HttpResponse::getHeader(const StringView& key, const std::string& def) const {
+    StringView v;
+    return m_headers.get(key, v) ? v.str() : def;
 }
 
-void HttpResponse::setHeader(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+void HttpResponse::setHeader(const StringView& key, const StringView& val) {
+    m_headers.set(key, val);
 }
 
-void HttpResponse::delHeader(const std::string& key) {
+void HttpResponse::delHeader(const StringView& key) {
     m_headers.erase(key);
 }
 
@@ -346,6 +503,73 @@ std::string HttpResponse::toString() const{
     return ss.str();
 }
 
+//常见状态的响应行"HTTP/1.x code reason\r\n"，启动时拼好，避免每个响应都格式化
+static const std::string* GetStatusLine(uint8_t version, HttpStatus status) {
+    static std::map<uint32_t, std::string> s_lines = []() {
+        std::map<uint32_t, std::string> lines;
+        const uint8_t versions[] = {0x10, 0x11};
+        for (auto v : versions) {
+#define XX(code, name, desc) \
+            lines[((uint32_t)v << 16) | code] = "HTTP/" + std::to_string(v >> 4) + "." \
+                + std::to_string(v & 0x0F) + " " #code " " #desc "\r\n";
+            HTTP_STATUS_MAP(XX);
+#undef XX
+        }
+        return lines;
+    }();
+    auto it = s_lines.find(((uint32_t)version << 16) | (uint32_t)status);
+    return it == s_lines.end() ? nullptr : &it->second;
+}
+
+void HttpResponse::serializeHeader(std::string& buf, const std::string& server_line) const {
+    const std::string* line = m_reason.empty() ? GetStatusLine(m_version, m_status) : nullptr;
+    if (line) {
+        buf.append(*line);
+    } else {
+        buf.append("HTTP/");
+        buf.append(std::to_string(m_version >> 4));
+        buf.push_back('.');
+        buf.append(std::to_string(m_version & 0x0F));
+        buf.push_back(' ');
+        buf.append(std::to_string((uint32_t)m_status));
+        buf.push_back(' ');
+        buf.append(m_reason.empty() ? HttpStatusToString(m_status) : m_reason.c_str());
+        buf.append("\r\n");
+    }
+    bool has_server = false;
+    for (auto& i : m_headers) {
+        if (!m_websocket && i.first.iequals("connection", 10)) {
+            continue;
+        }
+        if (!has_server && i.first.iequals("server", 6)) {
+            has_server = true;
+        }
+        buf += i.first;
+        buf.append(": ");
+        buf += i.second;
+        buf.append("\r\n");
+    }
+    if (!has_server) {
+        buf.append(server_line);
+    }
+    for (auto& i : m_cookies) {
+        buf.append("Set-Cookie: ");
+        buf.append(i);
+        buf.append("\r\n");
+    }
+    if (!m_websocket) {
+        buf.append(m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
+    }
+    size_t length = m_fileBody ? m_fileBody->getLength() : m_body.size();
+    if (length || m_fileBody) {
+        char tmp[32];
+        int n = snprintf(tmp, sizeof(tmp), "content-length: %zu\r\n\r\n", length);
+        buf.append(tmp, n);
+    } else {
+        buf.append("\r\n");
+    }
+}
+
 std::ostream& HttpResponse::dump(std::ostream& os) const {
     // 示例成员值：
     // m_version   = 0x11;                // 表示 HTTP/1.1（高4位主版本号，低4位次版本号）
@@ -380,7 +604,7 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
     // 输出所有 headers
     for(auto& i : m_headers) {
         // 若非 WebSocket 且是 "Connection" 头，由系统统一输出，跳过用户设置的
-        if(!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
+        if(!m_websocket && i.first.iequals("connection", 10)) {
             continue;
         }
         os << i.first << ": " << i.second << "\r\n";  // 输出头部，如：Server: sylar/1.0
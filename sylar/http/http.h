@@ -13,7 +13,10 @@
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <sys/types.h>
 #include <boost/lexical_cast.hpp>
+#include "http_headers.h"
+#include "sylar/util/arena.h"
 
 
 // HTTP（超文本传输协议）是一种客户端（比如浏览器、移动 App）和服务器之间通信的协议。
@@ -54,6 +57,7 @@
 
 
 namespace sylar {
+class Address;
 namespace http {
 
 /* Request Methods */
@@ -376,13 +380,44 @@ T getAs(const MapType& m, const std::string& key, const T& def = T()) {
     return def;
 }
 
+//HttpHeaders的版本，值是视图，直接从视图转换，不构造临时字符串
+template <class T>
+bool checkGetAs(const HttpHeaders& m, const std::string& key, T& val, const T& def = T()) {
+    StringView v;
+    if (!m.get(key, v)) {
+      val = def;
+      return false;
+    }
+    try {
+      val = boost::lexical_cast<T>(v.data(), v.size());
+      return true;
+    } catch(...) {
+      val = def;
+    }
+    return false;
+}
+
+template <class T>
+T getAs(const HttpHeaders& m, const std::string& key, const T& def = T()) {
+    StringView v;
+    if (!m.get(key, v)) {
+      return def;
+    }
+    try {
+      return boost::lexical_cast<T>(v.data(), v.size());
+    } catch(...){
+    }
+    return def;
+}
+
 
 class HttpResponse;
+class HttpBodyReader;
 //HTTP请求结构
 class HttpRequest {
 public:
   typedef std::shared_ptr<HttpRequest> ptr;
-  typedef std::map<std::string, std::string, CaseInsensitiveLess()> MapType;
+  typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
 
   //构造函数
   //close：是否在请求完毕后关闭TCP连接
@@ -417,13 +452,51 @@ public:
 
   /**
    * @brief 返回HTTP请求的消息体
+   * @details 如果消息体是读缓冲区上的视图(setBodyView)，第一次调用时会拷贝一份到m_body
+   *          如果消息体是流式的(getBodyReader)，第一次调用时把剩下没读的消息体全部读进m_body
+   */
+  const std::string& getBody() const;
+
+  /**
+   * @brief 返回流式消息体的读取器
+   * @details chunked或者较大的请求消息体不会提前读进内存，由servlet通过读取器增量读取，
+   *          此时getBodyData/getBodyLength为空；非流式消息体返回nullptr
+   */
+  std::shared_ptr<HttpBodyReader> getBodyReader() const { return m_bodyReader;}
+
+  /**
+   * @brief 设置流式消息体的读取器
+   */
+  void setBodyReader(std::shared_ptr<HttpBodyReader> v) { m_bodyReader = v;}
+
+  /**
+   * @brief 返回客户端(TCP连接对端)的地址
+   * @details 由HttpSession/Http2Session收到请求时设置，不依赖session，
+   *          http2和CacheServlet后台刷新等session为nullptr的场景也能取到；自己构造的请求为nullptr
    */
-  const std::string& getBody() const { return m_body;}
+  std::shared_ptr<Address> getRemoteAddress() const { return m_remoteAddress;}
+  void setRemoteAddress(std::shared_ptr<Address> v) { m_remoteAddress = v;}
 
   /**
-   * @brief 返回HTTP请求的消息头MAP
+   * @brief 返回消息体数据，不拷贝
+   * @details 消息体是读缓冲区上的视图时直接返回缓冲区地址，只在同一连接读取下一个请求之前有效
    */
-  const MapType& getHeaders() const { return m_headers;}
+  const char* getBodyData() const { return m_bodyView ? m_bodyView : m_body.data();}
+
+  /**
+   * @brief 返回消息体长度
+   */
+  size_t getBodyLength() const { return m_bodyView ? m_bodyViewLength : m_body.size();}
+
+  /**
+   * @brief 消息体是否是读缓冲区上的视图
+   */
+  bool isBodyView() const { return m_bodyView != nullptr;}
+
+  /**
+   * @brief 返回HTTP请求的消息头
+   */
+  const HttpHeaders& getHeaders() const { return m_headers;}
 
   /**
    * @brief 返回HTTP请求的参数MAP
@@ -469,7 +542,14 @@ public:
    * @brief 设置HTTP请求的消息体
    * @param[in] v 消息体
    */
-  void setBody(const std::string& v) { m_body = v;}
+  void setBody(const std::string& v) { m_body = v; m_bodyView = nullptr; m_bodyViewLength = 0;}
+
+  /**
+   * @brief 把消息体设置为外部缓冲区上的视图，不拷贝
+   * @param[in] data 消息体地址，调用方保证在请求使用期间有效
+   * @param[in] len 消息体长度
+   */
+  void setBodyView(const char* data, size_t len) { m_body.clear(); m_bodyView = data; m_bodyViewLength = len;}
 
   /**
    * @brief 是否自动关闭
@@ -492,10 +572,10 @@ public:
   void setWebsocket(bool v) { m_websocket = v;}
 
   /**
-   * @brief 设置HTTP请求的头部MAP
-   * @param[in] v map
+   * @brief 设置HTTP请求的头部
+   * @param[in] v 头部
    */
-  void setHeaders(const MapType& v) { m_headers = v;}
+  void setHeaders(const HttpHeaders& v) { m_headers = v;}
 
   /**
    * @brief 设置HTTP请求的参数MAP
@@ -510,29 +590,36 @@ public:
   void setCookies(const MapType& v) { m_cookies = v;}
 
   //获取HTTP请求的头部参数，如果存在则返回对应值，不存在则返回默认值
-  std::string getHeader(const std::string& key, const std::string& def = "") const;
+  std::string getHeader(const StringView& key, const std::string& def = "") const;
+  //获取常见头部的值，不拷贝，不存在时返回空视图，请求被修改前有效
+  StringView getHeaderView(HttpHeaders::Id id) const { return m_headers.get(id);}
   //获取HTTP请求的请求参数
+  //依次查找setParam设置的参数(包括路由参数)、query、application/x-www-form-urlencoded消息体
+  //只解码要找的那一个参数，找到的结果缓存在arena里
   std::string getParam(const std::string& key, const std::string& def = "") const;
-  //获取HTTP请求的cookie参数
+  //获取HTTP请求的cookie参数，同样按需解码
   std::string getCookie(const std::string& key, const std::string& def = "") const;
+  //不拷贝的版本，val指向arena(或者setParam设置的值)，在请求销毁前有效
+  bool getParamView(const StringView& key, StringView& val) const;
+  bool getCookieView(const StringView& key, StringView& val) const;
   //设置HTTP请求的头部参数
-  void setHeader(const std::string& key, const std::string& val);
+  void setHeader(const StringView& key, const StringView& val);
   //设置HTTP请求的请求参数
   void setParam(const std::string& key, const std::string& val);
   //设置HTTP请求的cookie参数
   void setCookie(const std::string& key, const std::string& val);
   //删除HTTP请求的头部参数
-  void delHeader(const std::string& key);
+  void delHeader(const StringView& key);
   //删除HTTP请求的请求参数
   void delParam(const std::string& key);
   //删除HTTP请求的Cookie参数
   void delCookie(const std::string& key);
   //判断HTTP请求的头部参数是否存在
-  bool hasHeader(const std::string& key, std::string* val = nullptr);
+  bool hasHeader(const StringView& key, std::string* val = nullptr);
   //判断HTTP请求的请求参数是否存在
-  bool hasParam(const std::string& key, std::string* val = nullptr);
+  bool hasParam(const std::string& key, std::string* val = nullptr) const;
   //判断HTTP请求的Cookie参数是否存在
-  bool hasCookie(const std::string& key, std::string* val = nullptr);
+  bool hasCookie(const std::string& key, std::string* val = nullptr) const;
 
   //检查并获取HTTP请求的头部参数
   template <class T>
@@ -547,40 +634,73 @@ public:
   //检查并获取HTTP请求的请求参数
   template <class T>
   bool checkGetParamAs(const std::string& key, T& val, const T& def = T()) {
-    initQueryParam();
-    initBodyParam();
-    return checkGetAs(m_params, key, val, def);
+    StringView v;
+    return checkViewAs(getParamView(key, v), v, val, def);
   }
   //获取HTTP请求的请求的请求参数
   template <class T>
   T getParamAs(const std::string& key, const T& def = T()) {
-    initQueryParam();
-    initBodyParam();
-    return getAs(m_params, key, def);
+    T val;
+    StringView v;
+    checkViewAs(getParamView(key, v), v, val, def);
+    return val;
   }
   //检查并获取HTTP请求的cookie参数
   template <class T>
   bool checkGetCookieAs(const std::string& key, T& val, const T& def = T()) {
-    initCookies();
-    return checkGetAs(m_cookies, key, val, def);
+    StringView v;
+    return checkViewAs(getCookieView(key, v), v, val, def);
   }
   //获取HTTP请求的请求的请求参数
   template <class T>
   T getCookieAs(const std::string& key, const T& def = T()) {
-    initCookies();
-    return getAs(m_cookies, key, def);
+    T val;
+    StringView v;
+    checkViewAs(getCookieView(key, v), v, val, def);
+    return val;
   }
 
+  //请求级别的内存池，请求销毁时一起释放
+  //解码出的参数、cookie从这里分配，servlet也可以用它存放只在本次请求中使用的字符串
+  Arena& getArena() const { return m_arena;}
+
   
   std::string toString() const;
   std::ostream& dump(std::ostream& os) const;
 
   void init();
+  //一次性解析全部参数和cookie到getParams/getCookies返回的map中
+  //只按key取值时不需要调用，getParam/getCookie会按需解码
   void initParam();
   void initQueryParam();
   void initBodyParam();
   void initCookies();
 
+private:
+  //按需解码的结果，节点从arena分配
+  struct ParamNode {
+    StringView key;
+    StringView value;
+    ParamNode* next;
+  };
+  bool findParam(const StringView& key, StringView& val) const;
+  bool findCookie(const StringView& key, StringView& val) const;
+  //application/x-www-form-urlencoded消息体，不是表单时返回false
+  bool getFormBody(StringView& body) const;
+
+  template <class T>
+  static bool checkViewAs(bool found, const StringView& v, T& val, const T& def) {
+    if (found) {
+      try {
+        val = boost::lexical_cast<T>(v.data(), v.size());
+        return true;
+      } catch(...) {
+      }
+    }
+    val = def;
+    return false;
+  }
+
 private:
   //HTTP方法
   HttpMethod m_method;
@@ -591,7 +711,7 @@ private:
   //是否为websocket，如果请求头包含Upgrade: websocket，说明这是一个websocket请求
   bool m_websocket;
   //解析参数时的标志位：控制是否已经解析了Query、Body、Cookie等参数，避免重复解析
-  bool m_parserParamFlag;
+  uint8_t m_parserParamFlag;
 
   // GET /search?q=c++&page=1 HTTP/1.1
   //请求的路径部分(不含参数)，来源于请求行的URL   示例中的/search
@@ -602,13 +722,21 @@ private:
   //url的锚点
   std::string m_fragment;
   //请求的消息体,通常出现现在POST PUT方法的HTTP请求中
-  std::string m_body;
-
-  //请求头部MAP,对应如下示例部分
+  //使用视图时m_body为空，getBody时才拷贝，所以声明为mutable
+  mutable std::string m_body;
+  //消息体视图，指向HttpSession的读缓冲区，为nullptr表示消息体在m_body中
+  mutable const char* m_bodyView = nullptr;
+  mutable size_t m_bodyViewLength = 0;
+  //流式消息体读取器，引用着HttpSession的连接
+  std::shared_ptr<HttpBodyReader> m_bodyReader;
+  //客户端地址
+  std::shared_ptr<Address> m_remoteAddress;
+
+  //请求头部,对应如下示例部分
   // Host: www.example.com
   // User-Agent: Mozilla/5.0    
   // Accept: text/html  
-  MapType m_headers;
+  HttpHeaders m_headers;
 
   //将query参数(以及body中的url编码参数)解析成键值对存储
   //来源是url中的查询参数(如GET /search?q=c%2B%2B&page=1&sort=desc HTTP/1.1中的q=c%2B%2B&page=1&sort=desc)
@@ -619,6 +747,11 @@ private:
   //Cookie: sessionid=abc123;
   MapType m_cookies;
 
+  //请求级别的内存池和按需解码的缓存
+  mutable Arena m_arena;
+  mutable ParamNode* m_paramCache = nullptr;
+  mutable ParamNode* m_cookieCache = nullptr;
+
 //各成员与实际请求的对应关系
 // +-----------------------------------------------------------+
 // |                      HTTP 请求行                           |
@@ -695,6 +828,25 @@ private:
 };
 
 
+//以文件内容作为响应消息体，发送时用sendfile直接从文件发到socket，析构时关闭文件
+class HttpFileBody {
+public:
+    typedef std::shared_ptr<HttpFileBody> ptr;
+    //fd：已打开的文件，所有权交给HttpFileBody
+    //offset/length：发送文件中[offset, offset + length)的部分
+    HttpFileBody(int fd, off_t offset, size_t length)
+        :m_fd(fd), m_offset(offset), m_length(length) {}
+    ~HttpFileBody();
+
+    int getFd() const { return m_fd;}
+    off_t getOffset() const { return m_offset;}
+    size_t getLength() const { return m_length;}
+private:
+    int m_fd;
+    off_t m_offset;
+    size_t m_length;
+};
+
 //HTTP响应结构
 class HttpResponse {
 public:
@@ -712,8 +864,8 @@ public:
     const std::string& getBody() const { return m_body;}
     //返回响应原因
     const std::string& getReason() const { return m_reason;}
-    //返回响应头部MAP
-    const MapType& getHeaders() const { return m_headers;}
+    //返回响应头部
+    const HttpHeaders& getHeaders() const { return m_headers;}
 
     //设置响应状态
     void setStatus(HttpStatus v) { m_status = v;}
@@ -723,8 +875,16 @@ public:
     void setBody(const std::string& v) { m_body = v;}
     //设置响应原因
     void setReason(const std::string& v) { m_reason = v;}
-    //设置响应头部MAP
-    void setHeaders(const MapType& v) { m_headers = v;}
+    //设置文件消息体，设置后m_body被忽略，由HttpSession用sendfile发送
+    void setFileBody(HttpFileBody::ptr v) { m_fileBody = v;}
+    //返回文件消息体，没有时为nullptr
+    HttpFileBody::ptr getFileBody() const { return m_fileBody;}
+    //流式消息体读取器，HttpConnection::recvResponseHeader返回的响应由调用方自己读取消息体
+    //读取器引用着HttpConnection，读完之前连接不能释放或复用
+    std::shared_ptr<HttpBodyReader> getBodyReader() const { return m_bodyReader;}
+    void setBodyReader(std::shared_ptr<HttpBodyReader> v) { m_bodyReader = v;}
+    //设置响应头部
+    void setHeaders(const HttpHeaders& v) { m_headers = v;}
 
     //是否自动关闭
     bool isClose() const { return m_close;}
@@ -736,11 +896,15 @@ public:
     void setWebsocket(bool v) { m_websocket = v;}
 
     //获取响应头部参数
-    std::string getHeader(const std::string& key, const std::string& def = "") const;
+    std::string getHeader(const StringView& key, const std::string& def = "") const;
+    //获取常见头部的值，不拷贝，不存在时返回空视图
+    StringView getHeaderView(HttpHeaders::Id id) const { return m_headers.get(id);}
+    //获取setCookie设置的Set-Cookie值
+    const std::vector<std::string>& getCookies() const { return m_cookies;}
     //设置响应头部参数
-    void setHeader(const std::string& key, const std::string& val);
+    void setHeader(const StringView& key, const StringView& val);
     //删除响应头部参数
-    void delHeader(const std::string& key);
+    void delHeader(const StringView& key);
 
     //检查并获取HTTP响应的头部参数
     template <class T>
@@ -756,6 +920,11 @@ public:
     std::string toString() const;
     std::ostream& dump(std::ostream& os) const;
 
+    //把响应行和头部(含结尾空行，不含消息体)追加到buf，不经过ostream
+    //buf可以在连接上复用，server_line为预先拼好的"Server: xxx\r\n"，响应中没有设置Server头时使用
+    //消息体用getBody单独发送，和头部一起writev，避免拷贝
+    void serializeHeader(std::string& buf, const std::string& server_line = "") const;
+
     // 它的作用是设置一个 HTTP 重定向响应，也就是告诉客户端：“你请求的资源已经移动到另一个地址了，请去那里访问。”
     void setRedirect(const std::string& url);
     //设置一个http响应的cookie
@@ -795,16 +964,20 @@ private:
     // 主要承载响应内容，如 HTML 页面、JSON 数据等
     // 对应响应中空行之后的主体部分
     std::string m_body;
+    // 文件消息体，不为空时代替m_body
+    HttpFileBody::ptr m_fileBody;
+    // 流式消息体读取器(客户端接收响应时使用)
+    std::shared_ptr<HttpBodyReader> m_bodyReader;
 
     // 响应原因短语
     // 通常与状态码一起出现，如 "OK", "Not Found"，用于人类阅读
     // 对应 HTTP 响应行中的原因短语部分，如 HTTP/1.1 404 Not Found 中的 Not Found
     std::string m_reason;
 
-    // 响应头部字段 Map
-    // 保存所有响应头，例如 Content-Type、Server、Set-Cookie 等
+    // 响应头部字段
+    // 保存所有响应头，例如 Content-Type、Server 等
     // 格式如：{ "Content-Type": "text/html", "Server": "MyServer/1.0" }
-    MapType m_headers;
+    HttpHeaders m_headers;
 
     // Set-Cookie 头中设置的 Cookie 字符串集合
     // 每个元素对应一个完整的 Set-Cookie 头字段内容，未解析成键值对
@@ -0,0 +1,335 @@
+#include "http_body.h"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "sylar/log.h"
+#include "http_compress.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+HttpReadBuffer::HttpReadBuffer(size_t capacity)
+    :m_data(new char[capacity])
+    ,m_capacity(capacity)
+    ,m_begin(0)
+    ,m_end(0) {
+}
+
+HttpReadBuffer::~HttpReadBuffer() {
+    delete[] m_data;
+}
+
+void HttpReadBuffer::consume(size_t n) {
+    m_begin += std::min(n, size());
+}
+
+void HttpReadBuffer::compact() {
+    if (m_begin == 0) {
+        return;
+    }
+    size_t n = size();
+    if (n) {
+        memmove(m_data, m_data + m_begin, n);
+    }
+    m_begin = 0;
+    m_end = n;
+}
+
+int HttpReadBuffer::fill(Stream* stream) {
+    if (m_end == m_capacity) {
+        if (m_begin == 0) {
+            return -1;
+        }
+        compact();
+    }
+    int rt = stream->read(m_data + m_end, m_capacity - m_end);
+    if (rt > 0) {
+        m_end += rt;
+    }
+    return rt;
+}
+
+size_t HttpReadBuffer::take(void* buf, size_t len) {
+    size_t n = std::min(len, size());
+    memcpy(buf, data(), n);
+    m_begin += n;
+    return n;
+}
+
+bool HttpReadBuffer::append(const char* data, size_t len) {
+    if (m_capacity - m_end < len) {
+        compact();
+        if (m_capacity - m_end < len) {
+            return false;
+        }
+    }
+    memcpy(m_data + m_end, data, len);
+    m_end += len;
+    return true;
+}
+
+HttpBodyReader::HttpBodyReader(Stream* stream, HttpReadBuffer::ptr buffer, Mode mode, uint64_t length)
+    :m_stream(stream)
+    ,m_buffer(buffer)
+    ,m_mode(mode)
+    ,m_left(mode == LENGTH ? length : 0)
+    ,m_readBytes(0)
+    ,m_chunkStarted(false)
+    ,m_done(mode == LENGTH && length == 0)
+    ,m_error(false) {
+}
+
+int HttpBodyReader::readRaw(void* buf, size_t len) {
+    if (m_buffer->size()) {
+        return m_buffer->take(buf, len);
+    }
+    //缓冲区已经空了，大块读取直接读到调用方的内存
+    if (len >= m_buffer->capacity() / 2) {
+        return m_stream->read(buf, len);
+    }
+    int rt = m_buffer->fill(m_stream);
+    if (rt <= 0) {
+        return rt;
+    }
+    return m_buffer->take(buf, len);
+}
+
+bool HttpBodyReader::readLine(std::string& line) {
+    do {
+        const char* data = m_buffer->data();
+        size_t size = m_buffer->size();
+        const char* pos = (const char*)memchr(data, '\n', size);
+        if (pos) {
+            size_t len = pos - data;
+            line.assign(data, (len && data[len - 1] == '\r') ? len - 1 : len);
+            m_buffer->consume(len + 1);
+            return true;
+        }
+        //行比缓冲区还长时fill返回-1
+        if (m_buffer->fill(m_stream) <= 0) {
+            return false;
+        }
+    } while (true);
+}
+
+int HttpBodyReader::nextChunk() {
+    std::string line;
+    //上一个chunk的数据后面跟着\r\n
+    if (m_chunkStarted && (!readLine(line) || !line.empty())) {
+        return -1;
+    }
+    m_chunkStarted = true;
+    if (!readLine(line)) {
+        return -1;
+    }
+    //chunk-size [; chunk-ext]
+    const char* str = line.c_str();
+    char* end = nullptr;
+    uint64_t size = strtoull(str, &end, 16);
+    if (end == str || end - str > 16
+            || (*end && *end != ';' && *end != ' ' && *end != '\t')) {
+        SYLAR_LOG_WARN(g_logger) << "invalid chunk size line: " << line;
+        return -1;
+    }
+    if (size == 0) {
+        //trailer到空行为止，内容忽略
+        do {
+            if (!readLine(line)) {
+                return -1;
+            }
+        } while (!line.empty());
+        m_done = true;
+        return 0;
+    }
+    m_left = size;
+    return 1;
+}
+
+int HttpBodyReader::read(void* buf, size_t len) {
+    if (m_error) {
+        return -1;
+    }
+    if (m_done || len == 0) {
+        return 0;
+    }
+    if (m_mode == CHUNKED && m_left == 0) {
+        int rt = nextChunk();
+        if (rt <= 0) {
+            m_error = (rt < 0);
+            return rt;
+        }
+    }
+    size_t n = len;
+    if (m_mode != UNTIL_CLOSE && n > m_left) {
+        n = m_left;
+    }
+    int rt = readRaw(buf, n);
+    if (rt <= 0) {
+        if (rt == 0 && m_mode == UNTIL_CLOSE) {
+            m_done = true;
+            return 0;
+        }
+        m_error = true;
+        return -1;
+    }
+    m_readBytes += rt;
+    if (m_mode != UNTIL_CLOSE) {
+        m_left -= rt;
+        if (m_mode == LENGTH && m_left == 0) {
+            m_done = true;
+        }
+    }
+    return rt;
+}
+
+int HttpBodyReader::readAll(std::string& body, uint64_t max_size) {
+    if (m_mode == LENGTH) {
+        if (body.size() + m_left > max_size) {
+            m_error = true;
+            return -1;
+        }
+        body.reserve(body.size() + m_left);
+    }
+    while (!m_done) {
+        size_t n = m_mode == LENGTH ? m_left : 16 * 1024;
+        size_t old = body.size();
+        body.resize(old + n);
+        int rt = read(&body[old], n);
+        body.resize(old + (rt > 0 ? rt : 0));
+        if (rt < 0) {
+            return -1;
+        }
+        if (body.size() > max_size) {
+            m_error = true;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int HttpBodyReader::discard() {
+    char buf[4096];
+    int rt = 0;
+    while ((rt = read(buf, sizeof(buf))) > 0);
+    return rt;
+}
+
+HttpBodyWriter::HttpBodyWriter(Socket::ptr sock, bool chunked)
+    :m_sock(sock)
+    ,m_chunked(chunked)
+    ,m_finished(false)
+    ,m_error(false)
+    ,m_writeBytes(0) {
+}
+
+int HttpBodyWriter::write(const void* data, size_t len) {
+    if (m_error || m_finished) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    int rt = 0;
+    if (m_encoder) {
+        m_encoded.clear();
+        if (!HttpCompress::Encode(m_encoder, data, len, m_encoded, false)) {
+            m_error = true;
+            return -1;
+        }
+        rt = writeRaw(m_encoded.data(), m_encoded.size());
+    } else {
+        rt = writeRaw(data, len);
+    }
+    if (rt <= 0) {
+        m_error = true;
+        return rt;
+    }
+    m_writeBytes += len;
+    return len;
+}
+
+int HttpBodyWriter::writeRaw(const void* data, size_t len) {
+    if (len == 0) {
+        return 1;
+    }
+    iovec iov[3];
+    int count = 0;
+    char head[24];
+    if (m_chunked) {
+        iov[count].iov_base = head;
+        iov[count++].iov_len = snprintf(head, sizeof(head), "%zx\r\n", len);
+    }
+    iov[count].iov_base = (void*)data;
+    iov[count++].iov_len = len;
+    if (m_chunked) {
+        iov[count].iov_base = (void*)"\r\n";
+        iov[count++].iov_len = 2;
+    }
+    return SendIov(m_sock, iov, count);
+}
+
+int HttpBodyWriter::finish() {
+    if (m_error) {
+        return -1;
+    }
+    if (m_finished) {
+        return 0;
+    }
+    m_finished = true;
+    if (m_encoder) {
+        m_encoded.clear();
+        if (!HttpCompress::Encode(m_encoder, nullptr, 0, m_encoded, true)
+                || writeRaw(m_encoded.data(), m_encoded.size()) <= 0) {
+            m_error = true;
+            return -1;
+        }
+        m_encoder = nullptr;
+    }
+    if (!m_chunked) {
+        return 0;
+    }
+    iovec iov;
+    iov.iov_base = (void*)"0\r\n\r\n";
+    iov.iov_len = 5;
+    if (SendIov(m_sock, &iov, 1) <= 0) {
+        m_error = true;
+        return -1;
+    }
+    return 0;
+}
+
+int HttpBodyWriter::SendIov(Socket::ptr sock, iovec* iov, int count) {
+    size_t left = 0;
+    for (int i = 0; i < count; ++i) {
+        left += iov[i].iov_len;
+    }
+    size_t total = left;
+    //一次writev没写完时跳过已经写出的部分继续写
+    while (left > 0) {
+        int len = sock->send(iov, count);
+        if (len <= 0) {
+            return len;
+        }
+        left -= len;
+        while (count > 0 && (size_t)len >= iov->iov_len) {
+            len -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + len;
+            iov->iov_len -= len;
+        }
+    }
+    return total;
+}
+
+bool IsChunked(const std::string& transfer_encoding) {
+    return !transfer_encoding.empty()
+        && strcasestr(transfer_encoding.c_str(), "chunked") != nullptr;
+}
+
+}
+}
@@ -0,0 +1,173 @@
+/**
+ * @file http_body.h
+ * @brief HTTP消息体的流式读写(Content-Length / chunked)
+ * @date 2025-07-15
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 原来HttpSession/HttpConnection都是把整个消息体读进一个std::string再交给业务，
+// 几百M的上传/下载会把内存撑爆，chunked的请求也不支持
+// 这里把消息体的读写拆出来：
+//   HttpReadBuffer  连接上复用的读缓冲区，头部解析剩下的数据留在里面，消息体从这里接着读，
+//                   读完后剩下的是下一个请求(pipelining)
+//   HttpBodyReader  按Content-Length / chunked / 读到连接关闭 三种方式增量读取消息体，
+//                   chunked在这里解码，调用方拿到的是解码后的数据
+//   HttpBodyWriter  响应头先发出去，之后按块写消息体，chunked时每次write编码成一个chunk直接发出
+
+#ifndef __SYLAR_HTTP_BODY_H__
+#define __SYLAR_HTTP_BODY_H__
+
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+#include "sylar/socket.h"
+#include "sylar/streams/socket_stream.h"
+#include "sylar/streams/zlib_stream.h"
+
+namespace sylar {
+namespace http {
+
+//连接上的读缓冲区，[m_begin, m_end)为已读取还没消费的数据
+class HttpReadBuffer {
+public:
+    typedef std::shared_ptr<HttpReadBuffer> ptr;
+
+    HttpReadBuffer(size_t capacity);
+    ~HttpReadBuffer();
+
+    //未消费数据的起始地址
+    char* data() const { return m_data + m_begin;}
+    //未消费的字节数
+    size_t size() const { return m_end - m_begin;}
+    size_t capacity() const { return m_capacity;}
+    //未消费的数据已经占满整个缓冲区
+    bool full() const { return m_begin == 0 && m_end == m_capacity;}
+
+    //消费头部n个字节，只移动位置，数据在下次fill前仍然有效(消息体视图依赖这一点)
+    void consume(size_t n);
+    //把未消费的数据截断为n个字节(parser的execute会把未解析的部分前移)
+    void resize(size_t n) { m_end = m_begin + n;}
+    //未消费的数据移到缓冲区头部
+    void compact();
+    //从stream读一次追加到末尾，尾部没有空间时先compact
+    //返回读到的字节数，<=0为连接关闭或出错，缓冲区已满返回-1
+    int fill(Stream* stream);
+    //最多取出len字节到buf，返回取出的字节数
+    size_t take(void* buf, size_t len);
+    //把data追加到末尾(连接切换协议时转移另一个缓冲区里剩下的数据)，放不下返回false
+    bool append(const char* data, size_t len);
+
+private:
+    char* m_data;
+    size_t m_capacity;
+    size_t m_begin;
+    size_t m_end;
+};
+
+//消息体读取器，先读缓冲区里剩下的，不够再读socket
+//只引用连接，不持有，连接关闭或复用给下一个请求后不能再使用
+class HttpBodyReader {
+public:
+    typedef std::shared_ptr<HttpBodyReader> ptr;
+
+    enum Mode {
+        //按Content-Length读
+        LENGTH,
+        //Transfer-Encoding: chunked
+        CHUNKED,
+        //没有长度，读到连接关闭为止(只出现在响应中)
+        UNTIL_CLOSE
+    };
+
+    //length：LENGTH模式下的消息体长度
+    HttpBodyReader(Stream* stream, HttpReadBuffer::ptr buffer, Mode mode, uint64_t length = 0);
+
+    //读取最多len字节解码后的消息体
+    //返回>0为读到的字节数，0为消息体已经读完，<0为出错(连接被关闭、chunk格式错误)
+    int read(void* buf, size_t len);
+    //把剩下的消息体全部读到body后面，超过max_size返回-1
+    int readAll(std::string& body, uint64_t max_size);
+    //读取并丢弃剩下的消息体，连接复用给下一个请求之前调用，成功返回0
+    int discard();
+
+    Mode getMode() const { return m_mode;}
+    //消息体是否已经读完
+    bool isDone() const { return m_done;}
+    //是否出过错，出错后连接不能再复用
+    bool isError() const { return m_error;}
+    //LENGTH模式下剩余的字节数，其他模式为0
+    uint64_t getLeft() const { return m_mode == LENGTH ? m_left : 0;}
+    //已经返回给调用方的字节数
+    uint64_t getReadBytes() const { return m_readBytes;}
+
+private:
+    //从缓冲区或socket读取原始数据，缓冲区为空且len较大时直接读到buf，少一次拷贝
+    int readRaw(void* buf, size_t len);
+    //读取一行(不含\r\n)，行长度不能超过缓冲区大小
+    bool readLine(std::string& line);
+    //读取下一个chunk的大小行，最后一个chunk时读完trailer
+    int nextChunk();
+
+private:
+    Stream* m_stream;
+    HttpReadBuffer::ptr m_buffer;
+    Mode m_mode;
+    //LENGTH：剩余字节数；CHUNKED：当前chunk剩余字节数
+    uint64_t m_left;
+    uint64_t m_readBytes;
+    //CHUNKED：是否已经读过第一个chunk(后续chunk前面有上一个chunk的\r\n)
+    bool m_chunkStarted;
+    bool m_done;
+    bool m_error;
+};
+
+//消息体写入器，由HttpSession::startResponse在响应头发出后创建
+//chunked时每次write编码成一个chunk，finish写出结束的0长度chunk
+//否则按原样写出，由调用方保证写入的总长度和Content-Length一致
+//设置了压缩上下文时，每次write先压缩(Z_SYNC_FLUSH)再写出，finish时写出压缩的结束标志
+class HttpBodyWriter {
+public:
+    typedef std::shared_ptr<HttpBodyWriter> ptr;
+
+    HttpBodyWriter(Socket::ptr sock, bool chunked);
+
+    //写出一块消息体，len为0时什么都不做，返回len，出错返回<=0
+    int write(const void* data, size_t len);
+    int write(const std::string& data) { return write(data.data(), data.size());}
+    //写出结束标志(chunked时为"0\r\n\r\n")，重复调用只生效一次，成功返回0
+    int finish();
+
+    //设置压缩上下文(HttpCompress::CreateEncoder)，需要在第一次write之前设置
+    void setEncoder(ZlibStream::ptr v) { m_encoder = v;}
+
+    bool isChunked() const { return m_chunked;}
+    bool isFinished() const { return m_finished;}
+    bool isError() const { return m_error;}
+    //已写出的消息体字节数(不含chunk编码)
+    uint64_t getWriteBytes() const { return m_writeBytes;}
+
+    //writev直到iov全部写出，会修改iov，返回写出的总字节数，出错返回<=0
+    static int SendIov(Socket::ptr sock, iovec* iov, int count);
+
+private:
+    //按chunked编码(或原样)写出已经压缩过的数据
+    int writeRaw(const void* data, size_t len);
+
+private:
+    Socket::ptr m_sock;
+    ZlibStream::ptr m_encoder;
+    //压缩输出的缓冲区，每次write复用
+    std::string m_encoded;
+    bool m_chunked;
+    bool m_finished;
+    bool m_error;
+    uint64_t m_writeBytes;
+};
+
+//请求/响应头中Transfer-Encoding是否包含chunked
+bool IsChunked(const std::string& transfer_encoding);
+
+}
+}
+
+#endif
@@ -0,0 +1,348 @@
+#include "http_compress.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+
+#include <set>
+#include <atomic>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <iomanip>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<bool>::ptr g_http_compress_enable =
+    sylar::Config::Lookup("http.compress.enable", true, "http response compress enable");
+static sylar::ConfigVar<uint64_t>::ptr g_http_compress_min_size =
+    sylar::Config::Lookup("http.compress.min_size", (uint64_t)1024,
+                          "http response min body size to compress");
+static sylar::ConfigVar<int32_t>::ptr g_http_compress_level =
+    sylar::Config::Lookup("http.compress.level", (int32_t)6,
+                          "http response compress level(1-9, -1 default)");
+static sylar::ConfigVar<uint64_t>::ptr g_http_compress_cache_size =
+    sylar::Config::Lookup("http.compress.cache_size", (uint64_t)(8 * 1024 * 1024),
+                          "http compressed response cache size");
+static sylar::ConfigVar<std::vector<std::string> >::ptr g_http_compress_mime_types =
+    sylar::Config::Lookup("http.compress.mime_types", std::vector<std::string>{
+                            "text/html", "text/plain", "text/css", "text/xml",
+                            "text/javascript", "application/javascript",
+                            "application/json", "application/xml"},
+                          "http response content types to compress, type/* matches subtypes");
+
+//mime_types每个响应都要查，转成set缓存起来，配置变化时整体替换
+typedef std::set<std::string> MimeSet;
+static std::shared_ptr<const MimeSet> s_mime_types;
+
+namespace {
+struct _MimeIniter {
+    static void Set(const std::vector<std::string>& v) {
+        std::shared_ptr<MimeSet> types = std::make_shared<MimeSet>();
+        for (auto& i : v) {
+            types->insert(sylar::ToLower(i));
+        }
+        std::atomic_store(&s_mime_types, std::shared_ptr<const MimeSet>(types));
+    }
+    _MimeIniter() {
+        Set(g_http_compress_mime_types->getValue());
+        g_http_compress_mime_types->addListener([](const std::vector<std::string>& old_value,
+                                                   const std::vector<std::string>& new_value){
+            Set(new_value);
+        });
+    }
+};
+static _MimeIniter s_mime_initer;
+}
+
+static std::atomic<uint64_t> s_count = {0};
+static std::atomic<uint64_t> s_in_bytes = {0};
+static std::atomic<uint64_t> s_out_bytes = {0};
+static std::atomic<uint64_t> s_cpu_us = {0};
+static std::atomic<uint64_t> s_cache_hits = {0};
+static std::atomic<uint64_t> s_cache_bytes = {0};
+
+static uint64_t GetThreadCpuUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+static std::string Trim(const std::string& str, size_t begin, size_t end) {
+    while (begin < end && (str[begin] == ' ' || str[begin] == '\t')) {
+        ++begin;
+    }
+    while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t')) {
+        --end;
+    }
+    return str.substr(begin, end - begin);
+}
+
+HttpCompress::Encoding HttpCompress::Negotiate(const std::string& accept_encoding) {
+    //-1表示没有出现
+    double q_gzip = -1;
+    double q_deflate = -1;
+    double q_any = -1;
+    size_t pos = 0;
+    while (pos < accept_encoding.size()) {
+        size_t end = accept_encoding.find(',', pos);
+        if (end == std::string::npos) {
+            end = accept_encoding.size();
+        }
+        //coding [; q=value]
+        size_t semi = accept_encoding.find(';', pos);
+        std::string name = sylar::ToLower(Trim(accept_encoding, pos
+                                    , semi < end ? semi : end));
+        double q = 1;
+        if (semi < end) {
+            std::string param = Trim(accept_encoding, semi + 1, end);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                q = atof(param.c_str() + 2);
+            }
+        }
+        if (name == "gzip" || name == "x-gzip") {
+            q_gzip = q;
+        } else if (name == "deflate") {
+            q_deflate = q;
+        } else if (name == "*") {
+            q_any = q;
+        }
+        pos = end + 1;
+    }
+    if (q_gzip < 0) {
+        q_gzip = q_any;
+    }
+    if (q_deflate < 0) {
+        q_deflate = q_any;
+    }
+    if (q_gzip <= 0 && q_deflate <= 0) {
+        return NONE;
+    }
+    return q_gzip >= q_deflate ? GZIP : DEFLATE;
+}
+
+const char* HttpCompress::EncodingToString(Encoding e) {
+    switch (e) {
+        case GZIP:
+            return "gzip";
+        case DEFLATE:
+            return "deflate";
+        default:
+            return "";
+    }
+}
+
+bool HttpCompress::IsCompressible(HttpResponse::ptr rsp, int64_t length) {
+    if (!g_http_compress_enable->getValue()) {
+        return false;
+    }
+    if (length >= 0 && (uint64_t)length < g_http_compress_min_size->getValue()) {
+        return false;
+    }
+    HttpStatus status = rsp->getStatus();
+    if ((int)status < 200 || status == HttpStatus::NO_CONTENT
+            || status == HttpStatus::PARTIAL_CONTENT
+            || status == HttpStatus::NOT_MODIFIED) {
+        return false;
+    }
+    if (rsp->getFileBody() || !rsp->getHeader("Content-Encoding").empty()) {
+        return false;
+    }
+    if (strcasestr(rsp->getHeader("Cache-Control").c_str(), "no-transform")) {
+        return false;
+    }
+    std::string type = rsp->getHeader("Content-Type");
+    type = sylar::ToLower(Trim(type, 0, std::min(type.find(';'), type.size())));
+    if (type.empty()) {
+        return false;
+    }
+    std::shared_ptr<const MimeSet> types = std::atomic_load(&s_mime_types);
+    if (types->count(type)) {
+        return true;
+    }
+    size_t slash = type.find('/');
+    return slash != std::string::npos && types->count(type.substr(0, slash) + "/*");
+}
+
+void HttpCompress::AddVary(HttpResponse::ptr rsp) {
+    std::string vary = rsp->getHeader("Vary");
+    if (vary.empty()) {
+        rsp->setHeader("Vary", "Accept-Encoding");
+    } else if (!strcasestr(vary.c_str(), "accept-encoding")) {
+        rsp->setHeader("Vary", vary + ", Accept-Encoding");
+    }
+}
+
+void HttpCompress::WeakenETag(HttpResponse::ptr rsp) {
+    std::string etag = rsp->getHeader("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        rsp->setHeader("ETag", "W/" + etag);
+    }
+}
+
+ZlibStream::ptr HttpCompress::GetEncoder(Encoding e) {
+    //HTTP中的deflate是带zlib头的格式(RFC 1950)
+    return ZlibStreamPool::Get(true, e == GZIP ? ZlibStream::GZIP : ZlibStream::ZLIB,
+                               g_http_compress_level->getValue(), 16 * 1024);
+}
+
+bool HttpCompress::Encode(ZlibStream::ptr encoder, const void* data, size_t len,
+                          std::string& out, bool finish) {
+    size_t old = out.size();
+    uint64_t begin = GetThreadCpuUs();
+    int rt = encoder->encodeTo(data, len, out, finish);
+    s_cpu_us += GetThreadCpuUs() - begin;
+    if (rt != Z_OK) {
+        SYLAR_LOG_ERROR(g_logger) << "HttpCompress encode error rt=" << rt;
+        return false;
+    }
+    ++s_count;
+    s_in_bytes += len;
+    s_out_bytes += out.size() - old;
+    return true;
+}
+
+bool HttpCompress::CompressResponse(HttpRequest::ptr req, HttpResponse::ptr rsp) {
+    const std::string& body = rsp->getBody();
+    if (!IsCompressible(rsp, body.size())) {
+        return false;
+    }
+    //结果和Accept-Encoding有关，不管这次是否压缩都要告诉中间缓存
+    AddVary(rsp);
+    Encoding e = Negotiate(req->getHeader("Accept-Encoding"));
+    if (e == NONE) {
+        return false;
+    }
+
+    //带ETag、没有禁止缓存的响应，同一个ETag的内容相同，压缩结果可以复用
+    std::string key;
+    std::string etag = rsp->getHeader("ETag");
+    if (!etag.empty() && rsp->getStatus() == HttpStatus::OK) {
+        std::string cc = rsp->getHeader("Cache-Control");
+        if (!strcasestr(cc.c_str(), "no-store") && !strcasestr(cc.c_str(), "private")) {
+            key = std::string(EncodingToString(e)) + " " + req->getPath() + " " + etag;
+        }
+    }
+    std::string out;
+    if (!key.empty() && HttpCompressCacheMgr::GetInstance()->get(key, out)) {
+        ++s_cache_hits;
+        s_cache_bytes += body.size();
+    } else {
+        ZlibStream::ptr encoder = GetEncoder(e);
+        if (!encoder) {
+            return false;
+        }
+        out.reserve(body.size() / 4 + 64);
+        if (!Encode(encoder, body.data(), body.size(), out, true)) {
+            return false;
+        }
+        if (!key.empty()) {
+            HttpCompressCacheMgr::GetInstance()->set(key, out);
+        }
+    }
+    //压缩后没有变小就发原文
+    if (out.size() >= body.size()) {
+        return false;
+    }
+    rsp->setBody(out);
+    rsp->setHeader("Content-Encoding", EncodingToString(e));
+    WeakenETag(rsp);
+    return true;
+}
+
+ZlibStream::ptr HttpCompress::CreateEncoder(HttpRequest::ptr req, HttpResponse::ptr rsp) {
+    if (!IsCompressible(rsp, -1)) {
+        return nullptr;
+    }
+    AddVary(rsp);
+    Encoding e = Negotiate(req->getHeader("Accept-Encoding"));
+    if (e == NONE) {
+        return nullptr;
+    }
+    ZlibStream::ptr encoder = GetEncoder(e);
+    if (encoder) {
+        rsp->setHeader("Content-Encoding", EncodingToString(e));
+        WeakenETag(rsp);
+    }
+    return encoder;
+}
+
+HttpCompress::Stats HttpCompress::GetStats() {
+    Stats s;
+    s.count = s_count;
+    s.inBytes = s_in_bytes;
+    s.outBytes = s_out_bytes;
+    s.cpuUs = s_cpu_us;
+    s.cacheHits = s_cache_hits;
+    s.cacheBytes = s_cache_bytes;
+    return s;
+}
+
+std::ostream& HttpCompress::DumpStats(std::ostream& os) {
+    Stats s = GetStats();
+    double in_mb = s.inBytes / 1024.0 / 1024.0;
+    os << "count=" << s.count
+       << " in_bytes=" << s.inBytes
+       << " out_bytes=" << s.outBytes
+       << " saved_bytes=" << (s.inBytes - s.outBytes)
+       << std::fixed << std::setprecision(2)
+       << " ratio=" << (s.inBytes ? s.outBytes * 100.0 / s.inBytes : 0) << "%"
+       << " cpu_ms_per_mb=" << (in_mb > 0 ? s.cpuUs / 1000.0 / in_mb : 0)
+       << " cache_hits=" << s.cacheHits
+       << " cache_saved_bytes=" << s.cacheBytes
+       << " cache_count=" << HttpCompressCacheMgr::GetInstance()->getCount();
+    return os;
+}
+
+HttpCompressCache::HttpCompressCache()
+    :m_bytes(0) {
+}
+
+bool HttpCompressCache::get(const std::string& key, std::string& data) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        return false;
+    }
+    m_list.splice(m_list.begin(), m_list, it->second);
+    data = it->second->second;
+    return true;
+}
+
+void HttpCompressCache::set(const std::string& key, const std::string& data) {
+    size_t max_bytes = g_http_compress_cache_size->getValue();
+    size_t bytes = key.size() + data.size();
+    if (bytes > max_bytes) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_bytes -= it->second->first.size() + it->second->second.size();
+        m_list.erase(it->second);
+        m_index.erase(it);
+    }
+    shrink(max_bytes - bytes);
+    m_list.push_front(std::make_pair(key, data));
+    m_index[key] = m_list.begin();
+    m_bytes += bytes;
+}
+
+size_t HttpCompressCache::getCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_list.size();
+}
+
+void HttpCompressCache::shrink(size_t max_bytes) {
+    while (m_bytes > max_bytes && !m_list.empty()) {
+        auto& item = m_list.back();
+        m_bytes -= item.first.size() + item.second.size();
+        m_index.erase(item.first);
+        m_list.pop_back();
+    }
+}
+
+}
+}
@@ -0,0 +1,127 @@
+/**
+ * @file http_compress.h
+ * @brief HTTP响应压缩(Accept-Encoding协商)
+ * @date 2025-07-16
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// HttpServer发送响应前根据请求的Accept-Encoding透明地压缩消息体：
+// 1.支持gzip和deflate，按q值协商，q相同时gzip优先，q=0表示不接受
+// 2.只压缩Content-Type在http.compress.mime_types中、长度不小于http.compress.min_size的响应，
+//   已经有Content-Encoding、文件消息体(sendfile)、206/204/304、Cache-Control: no-transform的不压缩
+// 3.压缩上下文从ZlibStreamPool取，用完归还，避免每个响应deflateInit2
+// 4.带ETag的可缓存响应，压缩结果按 编码 + path + ETag 放进LRU缓存，同一资源只压缩一次
+// 5.流式响应(HttpSession::startResponse)每次write用Z_SYNC_FLUSH压缩后立即发出
+//
+// 配置示例：
+//   http:
+//     compress:
+//       enable: true
+//       min_size: 1024
+//       level: 6
+//       cache_size: 8388608
+//       mime_types: [text/html, text/plain, application/json, text/*]
+
+#ifndef __SYLAR_HTTP_COMPRESS_H__
+#define __SYLAR_HTTP_COMPRESS_H__
+
+#include <list>
+#include <string>
+#include <ostream>
+#include <unordered_map>
+#include "http.h"
+#include "sylar/mutex.h"
+#include "sylar/singleton.h"
+#include "sylar/streams/zlib_stream.h"
+
+namespace sylar {
+namespace http {
+
+class HttpCompress {
+public:
+    enum Encoding {
+        NONE,
+        GZIP,
+        DEFLATE
+    };
+
+    //压缩统计
+    struct Stats {
+        //压缩的次数(流式响应每次write算一次)
+        uint64_t count;
+        //压缩前后的字节数
+        uint64_t inBytes;
+        uint64_t outBytes;
+        //压缩消耗的线程CPU时间
+        uint64_t cpuUs;
+        //命中缓存的次数和节省的压缩字节数
+        uint64_t cacheHits;
+        uint64_t cacheBytes;
+    };
+
+    //根据Accept-Encoding选择编码
+    static Encoding Negotiate(const std::string& accept_encoding);
+    //编码在Content-Encoding中的名字，NONE返回空串
+    static const char* EncodingToString(Encoding e);
+
+    //响应是否适合压缩，length<0时不检查最小长度(流式响应)
+    static bool IsCompressible(HttpResponse::ptr rsp, int64_t length);
+
+    //按请求的Accept-Encoding压缩响应的消息体，压缩后设置Content-Encoding和Vary，返回是否压缩
+    static bool CompressResponse(HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+    //流式响应：协商成功时设置响应头并返回压缩上下文，不压缩返回nullptr
+    static ZlibStream::ptr CreateEncoder(HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+    //用encoder压缩一段数据追加到out，并计入统计，finish为true时输出结束标志
+    static bool Encode(ZlibStream::ptr encoder, const void* data, size_t len,
+                       std::string& out, bool finish);
+
+    static Stats GetStats();
+    //输出统计：每MB输入消耗的CPU时间、节省的带宽
+    static std::ostream& DumpStats(std::ostream& os);
+
+private:
+    //从ZlibStreamPool取压缩上下文
+    static ZlibStream::ptr GetEncoder(Encoding e);
+    //设置Vary: Accept-Encoding，已有Vary时追加
+    static void AddVary(HttpResponse::ptr rsp);
+    //压缩后的内容和原文字节不同，强ETag改成弱ETag
+    static void WeakenETag(HttpResponse::ptr rsp);
+};
+
+//压缩结果缓存，按字节数限制大小的LRU
+class HttpCompressCache {
+public:
+    typedef Mutex MutexType;
+
+    HttpCompressCache();
+
+    //查找缓存，找到后移到链表头部
+    bool get(const std::string& key, std::string& data);
+    //放入缓存，超过http.compress.cache_size时从链表尾部淘汰
+    void set(const std::string& key, const std::string& data);
+
+    size_t getBytes() const { return m_bytes;}
+    size_t getCount();
+
+private:
+    typedef std::pair<std::string, std::string> Item;
+
+    //淘汰直到缓存大小不超过max_bytes，调用方需持有锁
+    void shrink(size_t max_bytes);
+
+private:
+    MutexType m_mutex;
+    //链表头部为最近使用的
+    std::list<Item> m_list;
+    std::unordered_map<std::string, std::list<Item>::iterator> m_index;
+    size_t m_bytes;
+};
+
+typedef sylar::Singleton<HttpCompressCache> HttpCompressCacheMgr;
+
+}
+}
+
+#endif
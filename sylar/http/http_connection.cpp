@@ -3,170 +3,136 @@
 #include "http_parser.h"
 #include "sylar/util.h"
 #include "sylar/log.h"
+#include "sylar/config.h"
+#include "sylar/iomanager.h"
+#include "sylar/dns.h"
+#include "sylar/trace.h"
 
 namespace sylar {
 namespace http {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static sylar::ConfigVar<uint64_t>::ptr g_http_pool_wait_timeout =
+    sylar::Config::Lookup("http.pool.wait_timeout", (uint64_t)(3 * 1000)
+                          , "http connection pool wait timeout ms");
+static sylar::ConfigVar<uint32_t>::ptr g_http_pool_max_connecting =
+    sylar::Config::Lookup("http.pool.max_connecting", (uint32_t)8
+                          , "http connection pool max concurrent connects per host");
+static sylar::ConfigVar<uint32_t>::ptr g_http_pool_outlier_failures =
+    sylar::Config::Lookup("http.pool.outlier.failures", (uint32_t)5
+                          , "consecutive failures before an address is ejected");
+static sylar::ConfigVar<uint64_t>::ptr g_http_pool_outlier_eject_ms =
+    sylar::Config::Lookup("http.pool.outlier.eject_ms", (uint64_t)(30 * 1000)
+                          , "base ejection time ms");
+static sylar::ConfigVar<uint64_t>::ptr g_http_pool_maintain_interval =
+    sylar::Config::Lookup("http.pool.maintain_interval", (uint64_t)1000
+                          , "http connection pool prewarm/reap interval ms");
+
 std::string HttpResult::toString() const {
     std::stringstream ss;
     ss << result << " " << error << " " << response << std::endl;
     return ss.str();
 }
 
-HttpConnection::HttpConnection(Socket::ptr sock, bool owner) : SocketStream(sock, owner) {}
+HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
+    : SocketStream(sock, owner)
+    , m_createTime(sylar::GetCurrentMS()) {
+}
 
 HttpConnection::~HttpConnection() {
     SYLAR_LOG_DEBUG(g_logger) << "HttpConnection::~HttpConnection";
 }
 
 /**
- * @brief 接收并解析HTTP响应
+ * @brief 接收并解析HTTP响应头
  * @return HttpResponse::ptr 解析成功的响应对象指针，失败返回nullptr
- * 
- * 完整处理流程：
- * 1. 初始化解析器和缓冲区
- * 2. 循环读取并解析响应头
- * 3. 处理分块传输或固定长度响应体
- * 4. 处理内容编码（如gzip压缩）
- * 5. 返回最终响应对象
+ *
+ * 处理流程：
+ * 1. 丢弃上一个响应没有读完的消息体
+ * 2. 循环读取并解析响应头，多读的数据留在连接的读缓冲区里
+ * 3. 根据chunked/Content-Length/Connection确定消息体的读取方式，创建HttpBodyReader
  */
-HttpResponse::ptr HttpConnection::recvResponse() {
-    // 1. 初始化HTTP响应解析器和数据缓冲区
-    HttpResponseParser::ptr parser(new HttpResponseParser);  // 创建响应解析器实例
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();  // 获取缓冲区大小配置值
-    
-    // 创建智能指针管理的缓冲区，带自定义删除器（自动释放内存）
-    std::shared_ptr<char> buffer(new char[buff_size + 1], [](char* ptr) { 
-        delete[] ptr; 
-    });
-    
-    // 获取裸指针用于直接操作缓冲区数据
-    char* data = buffer.get();
-    // 记录已读取但未解析的数据偏移量（用于处理不完整的报文）
-    int offset = 0;
+HttpResponse::ptr HttpConnection::recvResponseHeader() {
+    if (!m_buffer) {
+        m_buffer.reset(new HttpReadBuffer(HttpResponseParser::GetHttpRequestBufferSize()));
+    }
+    // 1. 上一个响应的消息体没有读完时先读完丢弃，否则读到的不是下一个响应
+    if (m_reader && !m_reader->isDone() && m_reader->discard() < 0) {
+        m_reader = nullptr;
+        close();
+        return nullptr;
+    }
+    m_reader = nullptr;
+    m_buffer->compact();
 
     // 2. 主解析循环 - 处理响应头
+    HttpResponseParser::ptr parser(new HttpResponseParser);
+    bool need_read = (m_buffer->size() == 0);
     do {
-        // 从socket读取数据到缓冲区（从offset位置开始写，避免覆盖未解析数据）
-        int len = read(data + offset, buff_size - offset);
-        if (len <= 0) {  // 读取失败或连接关闭
-            close();     // 关闭连接
-            return nullptr;
-        }
-        len += offset;   // 计算当前缓冲区有效数据总长度
-        
-        // 执行HTTP响应解析（false表示解析头部，不处理body）
-        size_t nparse = parser->execute(data, len, false);
-        if (parser->hasError()) {  // 解析错误处理
-            close();
-            return nullptr;
+        if (need_read) {
+            // 读取失败、连接关闭或响应头超过缓冲区大小
+            if (m_buffer->fill(this) <= 0) {
+                close();
+                return nullptr;
+            }
         }
-        
-        // 计算剩余未解析数据量（可能包含部分body数据）
-        offset = len - nparse;
-        if (offset == (int)buff_size) {  // 缓冲区溢出保护
+        need_read = true;
+        // 执行HTTP响应解析（false表示解析头部，不处理body），未解析的部分移到data()头部
+        size_t nparse = parser->execute(m_buffer->data(), m_buffer->size(), false);
+        if (parser->hasError()) {
             close();
             return nullptr;
         }
-        if (parser->isFinshed()) {  // 头部解析完成
+        m_buffer->resize(m_buffer->size() - nparse);
+        if (parser->isFinshed()) {
             break;
         }
     } while(true);
 
-    // 3. 获取解析器底层状态机引用（用于检查传输编码等）
+    // 3. 确定消息体的读取方式
+    HttpResponse::ptr rsp = parser->getData();
     auto& client_parser = parser->getParser();
-    std::string body;  // 准备存储响应体
-
-    // 4. 处理响应体（分块传输和固定长度两种方式）
-    if (client_parser.chunked) {  // 分块传输编码处理
-        int len = offset;  // 初始化未处理数据长度
-        do {
-            bool begin = true;  // 标记是否开始处理新分块
-            do {
-                // 需要读取更多数据的情况：不是第一个分块或缓冲区已空
-                if(!begin || len == 0) {
-                    int rt = read(data + len, buff_size - len);  // 读取数据
-                    if(rt <= 0) {  // 读取失败
-                        close();
-                        return nullptr;
-                    }
-                    len += rt;  // 更新缓冲区有效长度
-                }
-                data[len] = '\0';  // 确保字符串终止
-                
-                // 执行分块数据解析（true表示处理body）
-                size_t nparse = parser->execute(data, len, true);
-                if(parser->hasError()) {  // 解析错误
-                    close();
-                    return nullptr;
-                }
-                len -= nparse;  // 减去已解析的字节数
-                if(len == (int)buff_size) {  // 缓冲区溢出检查
-                    close();
-                    return nullptr;
-                }
-                begin = false;  // 标记已开始处理当前分块
-            } while(!parser->isFinshed());  // 循环直到当前分块解析完成
-            
-            // 调试日志：记录当前分块长度
-            SYLAR_LOG_DEBUG(g_logger) << "content_len=" << client_parser.content_len;
-            
-            // 处理分块数据（+2是为了跳过分块结束标记\r\n）
-            if(client_parser.content_len + 2 <= len) {  // 完整分块在缓冲区中
-                body.append(data, client_parser.content_len);  // 添加有效数据
-                // 移动剩余数据到缓冲区头部（内存重叠安全）
-                memmove(data, data + client_parser.content_len + 2, 
-                       len - client_parser.content_len - 2);
-                len -= client_parser.content_len + 2;  // 更新缓冲区长度
-            } else {  // 分块数据不完整
-                body.append(data, len);  // 先添加现有数据
-                int left = client_parser.content_len - len + 2;  // 计算剩余需要读取的字节
-                while(left > 0) {  // 循环读取剩余数据
-                    // 计算单次读取大小（不超过缓冲区大小）
-                    int rt = read(data, left > (int)buff_size ? (int)buff_size : left);
-                    if(rt <= 0) {  // 读取失败
-                        close();
-                        return nullptr;
-                    }
-                    body.append(data, rt);  // 追加数据
-                    left -= rt;  // 减少剩余字节数
-                }
-                body.resize(body.size() - 2);  // 移除分块结束标记
-                len = 0;  // 缓冲区已空
-            }
-        } while(!client_parser.chunks_done);  // 循环直到所有分块完成
-    } 
-    else {  // 固定长度响应体处理
-        // 获取Content-Length头指定的body长度
-        int64_t length = parser->getContentLength();
-        if (length > 0) {  // 存在响应体
-            body.resize(length);  // 预分配空间
-            
-            int len = 0;  // 已拷贝字节数
-            if (length >= offset) {  // 缓冲区中有部分body数据
-                memcpy(&body[0], data, offset);  // 拷贝缓冲区数据
-                len = offset;
-            } else {  // 缓冲区数据已超过body长度（异常情况）
-                memcpy(&body[0], data, length);
-                len = length;
-            }
-            
-            // 读取剩余body数据（如果有）
-            length -= offset;
-            if (length > 0) {
-                if (readFixSize(&body[len], length) <= 0) {  // 精确读取指定长度
-                    close();
-                    return nullptr;
-                }
-            }
-        }
+    HttpBodyReader::ptr reader;
+    if (client_parser.chunked) {
+        reader.reset(new HttpBodyReader(this, m_buffer, HttpBodyReader::CHUNKED));
+    } else if (!rsp->getHeader("content-length").empty()) {
+        reader.reset(new HttpBodyReader(this, m_buffer, HttpBodyReader::LENGTH
+                                        , parser->getContentLength()));
+    } else if (rsp->isClose()) {
+        // 没有长度又要关闭连接，消息体读到连接关闭为止
+        reader.reset(new HttpBodyReader(this, m_buffer, HttpBodyReader::UNTIL_CLOSE));
+    } else {
+        // 长连接上没有长度，按没有消息体处理(1xx/204/304等)
+        reader.reset(new HttpBodyReader(this, m_buffer, HttpBodyReader::LENGTH, 0));
     }
+    m_reader = reader;
+    rsp->setBodyReader(reader);
+    return rsp;
+}
 
-    // 5. 内容编码处理（如gzip解压）
+/**
+ * @brief 接收并解析HTTP响应
+ * @return HttpResponse::ptr 解析成功的响应对象指针，失败返回nullptr
+ *
+ * 在recvResponseHeader的基础上把消息体全部读完(chunked由HttpBodyReader解码)，
+ * 再按Content-Encoding解压
+ */
+HttpResponse::ptr HttpConnection::recvResponse() {
+    HttpResponse::ptr rsp = recvResponseHeader();
+    if (!rsp) {
+        return nullptr;
+    }
+    std::string body;
+    if (m_reader->readAll(body, HttpResponseParser::GetHttpRequestMaxBodySize()) < 0) {
+        close();
+        return nullptr;
+    }
+    rsp->setBodyReader(nullptr);
+
+    // 内容编码处理（如gzip解压）
     if (!body.empty()) {
-        auto content_encoding = parser->getData()->getHeader("content-encoding");
+        auto content_encoding = rsp->getHeader("content-encoding");
         // gzip解压处理
         if (strcasecmp(content_encoding.c_str(), "gzip") == 0) {
             auto zs = ZlibStream::CreateGzip(false);  // 创建解压流
@@ -182,14 +148,17 @@ HttpResponse::ptr HttpConnection::recvResponse() {
             zs->getResult().swap(body);
         }
         // 更新响应对象的body数据
-        parser->getData()->setBody(body);
+        rsp->setBody(body);
     }
-
-    // 6. 返回最终解析结果
-    return parser->getData();
+    return rsp;
 }
 
 int HttpConnection::sendRequest(HttpRequest::ptr req) {
+    //当前协程在追踪中时把上下文传给下游，调用方自己设置了traceparent时不覆盖
+    TraceContext* trace = Tracer::GetContext();
+    if (trace->valid() && !req->hasHeader("traceparent")) {
+        req->setHeader("traceparent", Tracer::FormatTraceParent(*trace));
+    }
     std::stringstream ss;
     ss << *req;
     std::string data = ss.str();
@@ -268,6 +237,8 @@ HttpResult::ptr HttpConnection::DoRequest(HttpMethod method, Uri::ptr uri, uint6
 }
 
 HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req, Uri::ptr uri, uint64_t timeout_ms) {
+    //采样时记录客户端请求(包括建立连接)的span，下游看到的父span是它
+    TraceSpan span("http", "client ", uri->getHost());
     bool is_ssl = uri->getScheme() == "https";
     Address::ptr addr = uri->createAddress();
     if (!addr) {
@@ -281,7 +252,7 @@ HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req, Uri::ptr uri, ui
                                             + " errstr= " + std::string(strerror(errno)));
     }
     //尝试连接
-    if (sock->connect(addr)) {
+    if (!sock->connect(addr)) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::CONNECT_FAIL, nullptr, "connect fail: " + addr->toString());
     }
     sock->setRecvTimeout(timeout_ms);
@@ -303,6 +274,40 @@ HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req, Uri::ptr uri, ui
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
 
+bool HttpSingleFlight::CanCoalesce(HttpRequest::ptr req) {
+    return req->getMethod() == HttpMethod::GET && req->getBodyLength() == 0
+                && !req->getBodyReader();
+}
+
+HttpResult::ptr HttpSingleFlight::run(const std::string& key, std::function<HttpResult::ptr()> fn) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    if (!scheduler) {
+        return fn();
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_calls.find(key);
+    if (it != m_calls.end()) {
+        Call::ptr call = it->second;
+        call->waiters.push_back(std::make_pair(scheduler, Fiber::GetThis()));
+        lock.unlock();
+        Fiber::YieldToHold();
+        return call->result;
+    }
+    Call::ptr call = std::make_shared<Call>();
+    m_calls[key] = call;
+    lock.unlock();
+
+    HttpResult::ptr result = fn();
+
+    lock.lock();
+    m_calls.erase(key);
+    call->result = result;
+    for (auto& i : call->waiters) {
+        i.first->schedule(i.second);
+    }
+    return result;
+}
+
 HttpConnectionPool::ptr HttpConnectionPool::Create(const std::string& uri, const std::string& vhost,
                         uint32_t max_size, uint32_t max_alive_time, uint32_t max_request) {
     Uri::ptr turi = Uri::Create(uri);
@@ -326,74 +331,379 @@ HttpConnectionPool::HttpConnectionPool(const std::string& host
         ,m_maxAliveTime(max_alive_time)
         ,m_maxRequest(max_request)
         ,m_isHttps(is_https) {
+    metrics::Labels labels = {{"pool", m_host + ":" + std::to_string(m_port)}};
+    m_connectLatency = metrics::MetricsMgr::GetInstance()->getHistogram(
+            "sylar_http_client_connect_duration_seconds", "http client pool connect latency"
+            , labels, 1e-6);
+    m_requestLatency = metrics::MetricsMgr::GetInstance()->getHistogram(
+            "sylar_http_client_request_duration_seconds", "http client pool request latency"
+            , labels, 1e-6);
 }
 
-HttpConnection::ptr HttpConnectionPool::getConnection() {
-    uint64_t now_ms = sylar::GetCurrentMS();
+HttpConnectionPool::~HttpConnectionPool() {
+    if (m_maintainTimer) {
+        m_maintainTimer->cancel();
+    }
+    for (auto& i : m_conns) {
+        delete i;
+    }
+}
+
+bool HttpConnectionPool::isReusable(HttpConnection* conn, uint64_t now_ms) const {
+    if (!conn->isConnected()) {
+        return false;
+    }
+    if (m_maxAliveTime && conn->m_createTime + m_maxAliveTime <= now_ms) {
+        return false;
+    }
+    if (m_maxRequest && conn->m_request >= m_maxRequest) {
+        return false;
+    }
+    return true;
+}
+
+HttpConnection::ptr HttpConnectionPool::wrap(HttpConnection* conn) {
+    return HttpConnection::ptr(conn, std::bind(&HttpConnectionPool::ReleasePtr, std::placeholders::_1, this));
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms) {
+    if (timeout_ms == (uint64_t)-1) {
+        timeout_ms = g_http_pool_wait_timeout->getValue();
+    }
+    uint64_t start_ms = sylar::GetCurrentMS();
     std::vector<HttpConnection*> invalid_conns;
     HttpConnection* ptr = nullptr;
+    bool create = false;
     MutexType::Lock lock(m_mutex);
-    while (!m_conns.empty()) {
-        auto conn = *m_conns.begin();
-        m_conns.pop_front();
-        if (!conn->isConnected()) {
+    while (true) {
+        uint64_t now_ms = sylar::GetCurrentMS();
+        //后进先出，最近归还的连接最可能还活着
+        while (!m_conns.empty()) {
+            HttpConnection* conn = m_conns.back();
+            m_conns.pop_back();
+            if (isReusable(conn, now_ms)) {
+                ptr = conn;
+                break;
+            }
             invalid_conns.push_back(conn);
-            continue;
+            --m_total;
         }
-        if (conn->m_createTime + m_maxAliveTime >= now_ms) {
-            invalid_conns.push_back(conn);
-            continue;
+        if (ptr) {
+            break;
+        }
+        if ((m_maxSize == 0 || m_total < m_maxSize)
+                && m_connecting < g_http_pool_max_connecting->getValue()) {
+            //先占住名额再解锁去连接
+            ++m_total;
+            ++m_connecting;
+            create = true;
+            break;
+        }
+
+        IOManager* iom = IOManager::GetThis();
+        uint64_t elapsed = now_ms - start_ms;
+        if (!iom || elapsed >= timeout_ms) {
+            break;
+        }
+        Waiter::ptr waiter = std::make_shared<Waiter>();
+        waiter->scheduler = Scheduler::GetThis();
+        waiter->fiber = Fiber::GetThis();
+        m_waiters.push_back(waiter);
+        //超时回调和归还都在锁内检查done，只有一方会唤醒
+        std::weak_ptr<Waiter> weak_waiter(waiter);
+        Timer::ptr timer = iom->addTimer(timeout_ms - elapsed, [this, weak_waiter](){
+            Waiter::ptr w = weak_waiter.lock();
+            if (!w) {
+                return;
+            }
+            MutexType::Lock lock(m_mutex);
+            if (w->done) {
+                return;
+            }
+            w->done = true;
+            m_waiters.remove(w);
+            w->scheduler->schedule(w->fiber);
+        });
+        lock.unlock();
+        Fiber::YieldToHold();
+        timer->cancel();
+        lock.lock();
+        if (waiter->conn) {
+            ptr = waiter->conn;
+            break;
         }
-        ptr = conn;
-        break;
     }
     lock.unlock();
-    m_total -= invalid_conns.size();
     for (auto& i : invalid_conns) {
         delete i;
     }
+
+    if (create) {
+        ptr = createConnection();
+        MutexType::Lock lock(m_mutex);
+        --m_connecting;
+        if (!ptr) {
+            --m_total;
+        }
+        //建立连接的名额空出来了，让一个等待的协程重新检查
+        if (m_maxSize == 0 || m_total < m_maxSize) {
+            wakeWaiter(nullptr);
+        }
+    }
     if (!ptr) {
-        IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
-        if (!addr) {
-            SYLAR_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
-            return nullptr;
+        return nullptr;
+    }
+    return wrap(ptr);
+}
+
+HttpConnection* HttpConnectionPool::createConnection() {
+    std::vector<IPAddress::ptr> addrs;
+    if (!DnsCacheMgr::GetInstance()->lookup(m_host, m_port, addrs)) {
+        SYLAR_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
+        return nullptr;
+    }
+    IPAddress::ptr addr;
+    std::shared_ptr<SSL_SESSION> session;
+    {
+        MutexType::Lock lock(m_mutex);
+        addr = addrs[pickEndpoint(addrs, sylar::GetCurrentMS())];
+        session = m_sslSession;
+    }
+    std::string endpoint = addr->toString();
+    Socket::ptr sock = m_isHttps ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+    if (!sock) {
+        SYLAR_LOG_ERROR(g_logger) << "create sock fail: " << endpoint;
+        return nullptr;
+    }
+    if (m_isHttps) {
+        std::static_pointer_cast<SSLSocket>(sock)->setSession(session);
+    }
+    uint64_t start_us = sylar::GetCurrentUS();
+    bool ok = sock->connect(addr);
+    m_connectLatency->observe(sylar::GetCurrentUS() - start_us);
+    reportResult(endpoint, ok);
+    if (!ok) {
+        SYLAR_LOG_ERROR(g_logger) << "sock connect fail: " << endpoint;
+        return nullptr;
+    }
+    HttpConnection* conn = new HttpConnection(sock);
+    conn->m_endpoint = endpoint;
+    return conn;
+}
+
+size_t HttpConnectionPool::pickEndpoint(const std::vector<IPAddress::ptr>& addrs, uint64_t now_ms) {
+    size_t start = m_nextEndpoint++ % addrs.size();
+    size_t best = start;
+    uint64_t best_until = (uint64_t)-1;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        size_t idx = (start + i) % addrs.size();
+        auto it = m_endpoints.find(addrs[idx]->toString());
+        if (it == m_endpoints.end() || it->second.ejectUntil <= now_ms) {
+            return idx;
         }
-        addr->setPort(m_port);
-        Socket::ptr sock = m_isHttps ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        if (!sock) {
-            SYLAR_LOG_ERROR(g_logger) << "create sock fail: " << *addr;
-            return nullptr;
+        if (it->second.ejectUntil < best_until) {
+            best_until = it->second.ejectUntil;
+            best = idx;
         }
-        if (!sock->connect(addr)) {
-            SYLAR_LOG_ERROR(g_logger) << "sock connect fail: " << *addr;
-            return nullptr;
+    }
+    //全部被摘除时选最早恢复的，总比直接失败好
+    return best;
+}
+
+void HttpConnectionPool::reportResult(const std::string& endpoint, bool ok) {
+    if (endpoint.empty()) {
+        return;
+    }
+    uint64_t now_ms = sylar::GetCurrentMS();
+    MutexType::Lock lock(m_mutex);
+    if (ok) {
+        auto it = m_endpoints.find(endpoint);
+        if (it != m_endpoints.end()) {
+            it->second.failures = 0;
+            if (it->second.ejectUntil <= now_ms) {
+                it->second.ejections = 0;
+            }
         }
-        ptr = new HttpConnection(sock);
-        ++m_total;
+        return;
+    }
+    Endpoint& ep = m_endpoints[endpoint];
+    if (++ep.failures < g_http_pool_outlier_failures->getValue()) {
+        return;
+    }
+    ep.failures = 0;
+    //每摘除一次时间翻倍，最多8倍
+    ep.ejections = std::min<uint32_t>(ep.ejections + 1, 4);
+    uint64_t eject_ms = g_http_pool_outlier_eject_ms->getValue() << (ep.ejections - 1);
+    ep.ejectUntil = now_ms + eject_ms;
+    SYLAR_LOG_WARN(g_logger) << "http pool " << m_host << ":" << m_port
+        << " eject " << endpoint << " for " << eject_ms << "ms";
+}
+
+bool HttpConnectionPool::wakeWaiter(HttpConnection* conn) {
+    if (m_waiters.empty()) {
+        return false;
+    }
+    Waiter::ptr w = m_waiters.front();
+    m_waiters.pop_front();
+    w->done = true;
+    w->conn = conn;
+    w->scheduler->schedule(w->fiber);
+    return true;
+}
+
+void HttpConnectionPool::setMinIdle(uint32_t min_idle) {
+    MutexType::Lock lock(m_mutex);
+    m_minIdle = min_idle;
+    if (min_idle == 0) {
+        if (m_maintainTimer) {
+            m_maintainTimer->cancel();
+            m_maintainTimer = nullptr;
+        }
+        return;
+    }
+    if (m_maintainTimer) {
+        return;
+    }
+    IOManager* iom = IOManager::GetThis();
+    if (!iom) {
+        SYLAR_LOG_ERROR(g_logger) << "HttpConnectionPool::setMinIdle not in IOManager, host=" << m_host;
+        return;
+    }
+    //定时器只持有weak_ptr，连接池析构后不再执行
+    std::weak_ptr<HttpConnectionPool> weak_self(shared_from_this());
+    m_maintainTimer = iom->addConditionTimer(g_http_pool_maintain_interval->getValue()
+                            , std::bind(&HttpConnectionPool::maintain, this), weak_self, true);
+    iom->schedule(std::bind(&HttpConnectionPool::maintain, shared_from_this()));
+}
+
+void HttpConnectionPool::maintain() {
+    uint64_t now_ms = sylar::GetCurrentMS();
+    std::vector<HttpConnection*> invalid_conns;
+    {
+        MutexType::Lock lock(m_mutex);
+        std::vector<HttpConnection*> conns;
+        conns.reserve(m_conns.size());
+        for (auto& i : m_conns) {
+            if (isReusable(i, now_ms)) {
+                conns.push_back(i);
+            } else {
+                invalid_conns.push_back(i);
+            }
+        }
+        m_conns.swap(conns);
+        m_total -= invalid_conns.size();
+    }
+    for (auto& i : invalid_conns) {
+        delete i;
+    }
+
+    //一次建一个，不长时间占着建立连接的名额
+    while (true) {
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_conns.size() + m_connecting >= m_minIdle
+                    || (m_maxSize && m_total >= m_maxSize)
+                    || m_connecting >= g_http_pool_max_connecting->getValue()) {
+                return;
+            }
+            ++m_total;
+            ++m_connecting;
+        }
+        HttpConnection* conn = createConnection();
+        MutexType::Lock lock(m_mutex);
+        --m_connecting;
+        if (!conn) {
+            --m_total;
+            return;
+        }
+        if (!wakeWaiter(conn)) {
+            m_conns.push_back(conn);
+        }
+    }
+}
+
+size_t HttpConnectionPool::getIdleCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_conns.size();
+}
+
+size_t HttpConnectionPool::getWaitingCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_waiters.size();
+}
+
+std::ostream& HttpConnectionPool::dump(std::ostream& os) {
+    uint64_t now_ms = sylar::GetCurrentMS();
+    MutexType::Lock lock(m_mutex);
+    os << "[HttpConnectionPool host=" << m_host << ":" << m_port
+       << " total=" << m_total
+       << " idle=" << m_conns.size()
+       << " connecting=" << m_connecting
+       << " waiting=" << m_waiters.size()
+       << " max_size=" << m_maxSize
+       << " min_idle=" << m_minIdle
+       << "]" << std::endl;
+    for (auto& i : m_endpoints) {
+        os << "    " << i.first
+           << " failures=" << i.second.failures
+           << " ejections=" << i.second.ejections;
+        if (i.second.ejectUntil > now_ms) {
+            os << " ejected_ms=" << (i.second.ejectUntil - now_ms);
+        }
+        os << std::endl;
+    }
+    lock.unlock();
+    os << "    connect_us: count=" << m_connectLatency->getCount()
+       << " p50=" << m_connectLatency->percentile(0.5)
+       << " p99=" << m_connectLatency->percentile(0.99) << std::endl;
+    os << "    request_us: count=" << m_requestLatency->getCount()
+       << " p50=" << m_requestLatency->percentile(0.5)
+       << " p99=" << m_requestLatency->percentile(0.99) << std::endl;
+    return os;
+}
+
+void HttpConnectionPool::saveSSLSession(HttpConnection* ptr) {
+    auto sock = std::dynamic_pointer_cast<SSLSocket>(ptr->getSocket());
+    if (!sock) {
+        return;
+    }
+    //已经收到过响应，TLS1.3的session ticket此时已经处理过了
+    auto session = sock->getSession();
+    if (session && SSL_SESSION_is_resumable(session.get())) {
+        MutexType::Lock lock(m_mutex);
+        m_sslSession = session;
     }
-    return HttpConnection::ptr(ptr, std::bind(&HttpConnectionPool::ReleasePtr, std::placeholders::_1, this));
 }
 
 void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool) {
     ++ptr->m_request;
-    if (!ptr->isConnected() || (ptr->m_createTime + pool->m_maxAliveTime >= sylar::GetCurrentMS()) || ptr->m_request >= pool->m_maxRequest) {
-        delete ptr;
+    if (pool->m_isHttps && ptr->isConnected()) {
+        pool->saveSSLSession(ptr);
+    }
+    MutexType::Lock lock(pool->m_mutex);
+    if (!pool->isReusable(ptr, sylar::GetCurrentMS())) {
         --pool->m_total;
+        //空出了一个名额，等待的协程可以去新建连接
+        pool->wakeWaiter(nullptr);
+        lock.unlock();
+        delete ptr;
         return;
     }
-    MutexType::Lock lock(pool->m_mutex);
-    pool->m_conns.push_back(ptr);
+    //有协程在等时直接交给它，不放回池子
+    if (!pool->wakeWaiter(ptr)) {
+        pool->m_conns.push_back(ptr);
+    }
 }
 
 HttpResult::ptr HttpConnectionPool::doGet(const std::string& url, uint64_t timeout_ms, 
-                                         const std::map<std::string, std::string>& headers = {},
-                                         const std::string& body = "") {
+                                         const std::map<std::string, std::string>& headers,
+                                         const std::string& body) {
     return doRequest(HttpMethod::GET, url, timeout_ms, headers, body);
 }
 
 HttpResult::ptr HttpConnectionPool::doGet(Uri::ptr uri, uint64_t timeout_ms, 
-                                          const std::map<std::string, std::string>& headers = {},
-                                          const std::string& body = "") {
+                                          const std::map<std::string, std::string>& headers,
+                                          const std::string& body) {
     std::stringstream ss;
     ss << uri->getPath()
        << (uri->getQuery().empty() ? "" : "?")
@@ -404,14 +714,14 @@ HttpResult::ptr HttpConnectionPool::doGet(Uri::ptr uri, uint64_t timeout_ms,
 }
 
 HttpResult::ptr HttpConnectionPool::doPost(const std::string& url, uint64_t timeout_ms, 
-                                          const std::map<std::string, std::string>& headers = {},
-                                          const std::string& body = "") {
+                                          const std::map<std::string, std::string>& headers,
+                                          const std::string& body) {
     return doRequest(HttpMethod::POST, url, timeout_ms, headers, body);                                        
 }
 
 HttpResult::ptr HttpConnectionPool::doPost(Uri::ptr uri, uint64_t timeout_ms, 
-                                          const std::map<std::string, std::string>& headers = {},
-                                          const std::string& body = "") {
+                                          const std::map<std::string, std::string>& headers,
+                                          const std::string& body) {
     std::stringstream ss;
     ss << uri->getPath()
        << (uri->getQuery().empty() ? "" : "?")
@@ -422,8 +732,8 @@ HttpResult::ptr HttpConnectionPool::doPost(Uri::ptr uri, uint64_t timeout_ms,
 }
 
 HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, Uri::ptr uri, uint64_t timeout_ms, 
-                                             const std::map<std::string, std::string>& headers = {},
-                                             const std::string& body = "") {
+                                             const std::map<std::string, std::string>& headers,
+                                             const std::string& body) {
     std::stringstream ss;
     ss << uri->getPath()
         << (uri->getQuery().empty() ? "" : "?")
@@ -434,8 +744,8 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, Uri::ptr uri, u
 }
 
 HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, const std::string& url, uint64_t timeout_ms, 
-                                             const std::map<std::string, std::string>& headers = {},
-                                             const std::string& body = "") {
+                                             const std::map<std::string, std::string>& headers,
+                                             const std::string& body) {
     HttpRequest::ptr req = std::make_shared<HttpRequest>();
     req->setPath(url);
     req->setMethod(method);
@@ -465,7 +775,18 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, const std::stri
 }
 
 HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t timeout_ms) {
-    auto conn = getConnection();
+    if (m_singleFlight && HttpSingleFlight::CanCoalesce(req)) {
+        //连接池只对应一个host，序列化后的请求(方法、路径、头部)就能区分不同的请求
+        std::stringstream ss;
+        ss << *req;
+        return m_flights.run(ss.str(), std::bind(&HttpConnectionPool::sendAndRecv, this, req, timeout_ms));
+    }
+    return sendAndRecv(req, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::sendAndRecv(HttpRequest::ptr req, uint64_t timeout_ms) {
+    uint64_t start_us = sylar::GetCurrentUS();
+    auto conn = getConnection(timeout_ms);
     if (!conn) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION,
                                             nullptr, "pool hast:" + m_host + " port:" + std::to_string(m_port));
@@ -476,7 +797,13 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t tim
                                              nullptr, "pool host:" + m_host + " port:" + std::to_string(m_port));
     }
     sock->setRecvTimeout(timeout_ms);
+    TraceSpan span("http", "client ", m_host);
     int rt = conn->sendRequest(req);
+    if (rt <= 0) {
+        //失败的连接不再放回池子
+        reportResult(conn->m_endpoint, false);
+        conn->close();
+    }
     if (rt == 0) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::SEND_CLOSE_BY_PEER, 
                                              nullptr, "send request closed by peer: " + sock->getRemoteAddress()->toString());
@@ -488,10 +815,14 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t tim
     }
     auto rsp = conn->recvResponse();
     if (!rsp) {
+        reportResult(conn->m_endpoint, false);
+        conn->close();
         return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
                                             , nullptr, "recv response timeout: " + sock->getRemoteAddress()->toString()
                                             + " timeout_ms:" + std::to_string(timeout_ms));   
     }
+    reportResult(conn->m_endpoint, true);
+    m_requestLatency->observe(sylar::GetCurrentUS() - start_us);
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
 
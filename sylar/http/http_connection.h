@@ -12,13 +12,20 @@
 #include "sylar/thread.h"
 #include "sylar/mutex.h"
 #include "sylar/uri.h"
+#include "sylar/timer.h"
+#include "sylar/fiber.h"
+#include "sylar/scheduler.h"
+#include "sylar/metrics.h"
 #include "http.h"
+#include "http_body.h"
 
 #include <map>
 #include <list>
+#include <vector>
 #include <string>
 #include <memory>
 #include <atomic>
+#include <functional>
 #include <stdint.h>
 
 namespace sylar {
@@ -55,7 +62,13 @@ struct HttpResult {
         //从连接池中连接失败
         POOL_GET_CONNECTION = 8,
         //无效的连接
-        POOL_INVALID_CONNECTION = 9
+        POOL_INVALID_CONNECTION = 9,
+        //WebSocket握手失败(不是101、Sec-WebSocket-Accept不对或者扩展不合法)
+        WS_HANDSHAKE_FAIL = 10,
+        //流水线连接已经关闭，请求没有收到响应
+        PIPELINE_CLOSED = 11,
+        //请求不能走流水线(HEAD的响应没有消息体，按响应头无法区分下一个响应)
+        NOT_PIPELINABLE = 12
     };
 
     HttpResult(int _result, HttpResponse::ptr _response, const std::string& _error) : 
@@ -116,19 +129,57 @@ public:
     HttpConnection(Socket::ptr sock, bool owner = true);
     ~HttpConnection();
 
-    //接收HTTP响应
+    //接收HTTP响应，消息体(包括chunked)全部读完并按Content-Encoding解压后返回
     HttpResponse::ptr recvResponse();
+    //只接收响应头，消息体通过HttpResponse::getBodyReader增量读取(chunked已解码，不做解压)
+    //读缓冲区在连接上复用，下一次接收响应前会丢弃上一个响应没有读完的消息体
+    HttpResponse::ptr recvResponseHeader();
     //发送HTTP请求
     int sendRequest(HttpRequest::ptr req);
+    //连接上的读缓冲区，升级到WebSocket后101响应之后多读的数据接着用
+    HttpReadBuffer::ptr getReadBuffer() const { return m_buffer;}
+
+private:
+    //读缓冲区，第一次接收响应时创建
+    HttpReadBuffer::ptr m_buffer;
+    //上一个响应的消息体读取器
+    HttpBodyReader::ptr m_reader;
 
 public:
     // 记录当前 HttpConnection 对象（即一个 HTTP 客户端连接）的创建时间点（通常是毫秒或微秒级时间戳）。
     uint64_t m_createTime = 0;
     // 统计当前连接已发送的HTTP请求数量（每次执行完DoRequest或sendRequest后计数+1）。
     uint64_t m_request = 0;
+    // 连接池创建的连接连的是哪个地址(ip:port)，请求失败时记到这个地址上
+    std::string m_endpoint;
 };
 
 
+//合并同时发出的相同请求：同一个key同时只执行一次，其他调用方的协程等待并共享结果
+//返回的HttpResult和HttpResponse是共享的，调用方不要修改
+//等待的调用方不受自己的超时时间限制，以执行的那个请求的结果为准
+class HttpSingleFlight {
+public:
+    typedef Mutex MutexType;
+
+    //没有消息体的GET才合并
+    static bool CanCoalesce(HttpRequest::ptr req);
+
+    //不在协程调度器中调用时不合并，直接执行fn
+    HttpResult::ptr run(const std::string& key, std::function<HttpResult::ptr()> fn);
+
+private:
+    struct Call {
+        typedef std::shared_ptr<Call> ptr;
+        HttpResult::ptr result;
+        std::vector<std::pair<Scheduler*, Fiber::ptr> > waiters;
+    };
+
+private:
+    MutexType m_mutex;
+    std::map<std::string, Call::ptr> m_calls;
+};
+
 //该类是Http连接池，用来统一管理、复用、维护一批HTTP链接，避免每次请求都新建连接，提高性能，节省资源
 //前提是HTTP请求服务器和客户端都支持连接复用机制(keep-aive机制)，那么
 // 第一次建立 TCP 连接之后（socket 建好了），
@@ -136,7 +187,15 @@ public:
 // 只要连接有效、没有关闭，就可以从连接池拿出用一次，然后放回池子继续用，
 // 这样就省掉了反复建连接的开销（TCP三次握手、SSL握手都很重）。
 // 这就是连接池存在的意义。
-class HttpConnectionPool {
+//
+// 连接池是一个host:port的连接，max_size限制总连接数(0为不限制)，包括正在使用的和正在建立的：
+//   空闲连接后进先出，刚归还的连接最先复用，多出来的连接留在底部等过期
+//   连接数到上限时getConnection在协程里等待，归还的连接直接交给等待的协程，超时返回nullptr
+//   同时建立的连接数由http.pool.max_connecting限制，避免冷启动时一起发起大量连接
+//   域名解析走DnsCache，有多个地址时轮流使用；一个地址连续失败http.pool.outlier.failures次后
+//   摘除一段时间(http.pool.outlier.eject_ms，每被摘除一次延长一倍，最多8倍)，所有地址都被摘除时仍然选最早恢复的
+//   setMinIdle后定时补足空闲连接，同时清理池底已经断开或过期的连接
+class HttpConnectionPool : public std::enable_shared_from_this<HttpConnectionPool> {
 public:
     typedef std::shared_ptr<HttpConnectionPool> ptr;
     typedef Mutex MutexType;
@@ -152,9 +211,26 @@ public:
                       ,uint32_t max_size
                       ,uint32_t max_alive_time
                       ,uint32_t max_request);
+    ~HttpConnectionPool();
     
     //从连接池中拿到一个可用的HttpConnection，如果没有可用的就创建新的连接
-    HttpConnection::ptr getConnection();
+    //连接数到上限时最多等待timeout_ms(-1为http.pool.wait_timeout)，不在IOManager里调用时不等待
+    HttpConnection::ptr getConnection(uint64_t timeout_ms = -1);
+
+    //保持至少min_idle个空闲连接，需要在IOManager里调用，0为关闭预热
+    void setMinIdle(uint32_t min_idle);
+    //是否合并同时发出的相同GET请求(见HttpSingleFlight)
+    void setSingleFlight(bool v) { m_singleFlight = v;}
+
+    uint32_t getTotal() const { return m_total;}
+    size_t getIdleCount();
+    size_t getWaitingCount();
+    //建立连接的耗时(us)，导出为sylar_http_client_connect_duration_seconds{pool="host:port"}
+    metrics::HdrHistogram::ptr getConnectLatency() const { return m_connectLatency;}
+    //doRequest从取连接到收到响应头的耗时(us)，导出为sylar_http_client_request_duration_seconds{pool="host:port"}
+    metrics::HdrHistogram::ptr getRequestLatency() const { return m_requestLatency;}
+    //输出连接数、各地址的状态和延迟分布
+    std::ostream& dump(std::ostream& os);
 
     HttpResult::ptr doGet(const std::string& url, uint64_t timeout_ms, 
                                  const std::map<std::string, std::string>& headers = {},
@@ -182,10 +258,47 @@ public:
 
 
 private:
+    //等待连接的协程
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        //归还时直接交过来的连接，为空表示有了新建连接的名额或者超时
+        HttpConnection* conn = nullptr;
+        bool done = false;
+    };
+
+    //一个地址的失败统计
+    struct Endpoint {
+        //连续失败次数，成功一次清零
+        uint32_t failures = 0;
+        //被摘除的次数，决定下次摘除多久
+        uint32_t ejections = 0;
+        //摘除到什么时候(ms)
+        uint64_t ejectUntil = 0;
+    };
+
     //当一个HttpConnection(HTTP连接)用完后，不是直接销毁，而是通过ReleasePtr把它归还到连接池中或者彻底销毁
     //ptr：是当前要归还的连接指针
     //pool：是该连接所属的连接池指针
     static void ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool); 
+    //https连接归还时保存它的TLS会话，下次新建连接时用来恢复会话，省掉完整的TLS握手
+    void saveSSLSession(HttpConnection* ptr);
+    //连接是否还能复用
+    bool isReusable(HttpConnection* conn, uint64_t now_ms) const;
+    //解析地址并建立新连接，调用方已经占了m_total和m_connecting的名额，不持有锁
+    HttpConnection* createConnection();
+    //从解析结果中选一个没有被摘除的地址，调用方持有锁
+    size_t pickEndpoint(const std::vector<IPAddress::ptr>& addrs, uint64_t now_ms);
+    //记录一次连接或请求的结果
+    void reportResult(const std::string& endpoint, bool ok);
+    //取连接、发送请求并接收响应
+    HttpResult::ptr sendAndRecv(HttpRequest::ptr req, uint64_t timeout_ms);
+    //唤醒一个等待的协程，把conn交给它，没有等待的协程返回false，调用方持有锁
+    bool wakeWaiter(HttpConnection* conn);
+    //定时任务：清理空闲连接并补足到m_minIdle
+    void maintain();
+    HttpConnection::ptr wrap(HttpConnection* conn);
 private:
     //保存远程服务器的的主机名或ip地址,比如请求 http://example.com/path，那么 m_host 就是 example.com。
     std::string m_host;
@@ -204,11 +317,28 @@ private:
     //标记是否是加密传输
     bool m_isHttps;
     MutexType m_mutex;
-    //存储可用的空闲连接列表
-    std::list<HttpConnection*> m_conns;
-    //统计当前连接池中总共存在的连接数
+    //存储可用的空闲连接列表，尾部是最近归还的
+    std::vector<HttpConnection*> m_conns;
+    //统计当前连接池中总共存在的连接数(包括正在建立的)
     //假设m_conns中有三个空闲的连接，还有两个正在使用的连接，那么m_total=5
-    std::atomic<int32_t> m_total = {0};
+    std::atomic<uint32_t> m_total = {0};
+    //正在建立的连接数
+    uint32_t m_connecting = 0;
+    //至少保持的空闲连接数
+    uint32_t m_minIdle = 0;
+    //下一次从哪个地址开始选
+    uint32_t m_nextEndpoint = 0;
+    std::list<Waiter::ptr> m_waiters;
+    //ip:port -> 失败统计
+    std::map<std::string, Endpoint> m_endpoints;
+    Timer::ptr m_maintainTimer;
+    //最近一次可复用的TLS会话(只有https有效)
+    std::shared_ptr<SSL_SESSION> m_sslSession;
+    //同一个host:port的连接池共用一组直方图
+    metrics::HdrHistogram::ptr m_connectLatency;
+    metrics::HdrHistogram::ptr m_requestLatency;
+    bool m_singleFlight = false;
+    HttpSingleFlight m_flights;
 };
 
 }
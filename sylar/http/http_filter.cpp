@@ -0,0 +1,384 @@
+#include "http_filter.h"
+#include "servlet.h"
+#include "sylar/log.h"
+#include "sylar/trace.h"
+#include "sylar/util.h"
+
+#include <arpa/inet.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <algorithm>
+#include <set>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<std::vector<RateLimitRule> >::ptr g_rate_limit_rules =
+    sylar::Config::Lookup("http.filter.rate_limit", std::vector<RateLimitRule>()
+            , "http rate limit rules, [{path, rate, burst, per_ip}]");
+
+static sylar::ConfigVar<uint32_t>::ptr g_rate_limit_max_clients =
+    sylar::Config::Lookup("http.filter.rate_limit_max_clients", (uint32_t)100000
+            , "max per ip buckets of one rate limit rule");
+
+static sylar::ConfigVar<ConcurrencyLimitConf>::ptr g_concurrency_limit =
+    sylar::Config::Lookup("http.filter.concurrency", ConcurrencyLimitConf()
+            , "http adaptive concurrency limit");
+
+static sylar::ConfigVar<std::vector<std::string> >::ptr g_trusted_proxies =
+    sylar::Config::Lookup("http.trusted_proxies", std::vector<std::string>()
+            , "peer ips allowed to set X-Real-IP, local means unix socket");
+
+//每个请求都要查，转成set缓存起来，配置变化时整体替换
+typedef std::set<std::string> ProxySet;
+static std::shared_ptr<const ProxySet> s_trusted_proxies;
+
+namespace {
+struct _ProxyIniter {
+    static void Set(const std::vector<std::string>& v) {
+        std::shared_ptr<ProxySet> proxies = std::make_shared<ProxySet>(v.begin(), v.end());
+        std::atomic_store(&s_trusted_proxies, std::shared_ptr<const ProxySet>(proxies));
+    }
+    _ProxyIniter() {
+        Set(g_trusted_proxies->getValue());
+        g_trusted_proxies->addListener([](const std::vector<std::string>& old_value,
+                                          const std::vector<std::string>& new_value){
+            Set(new_value);
+        });
+    }
+};
+static _ProxyIniter s_proxy_initer;
+}
+
+HttpFilterChain::HttpFilterChain(ServletDispatch* dispatch, const std::vector<HttpFilter::ptr>& filters
+                                 ,HttpRequest::ptr request, HttpResponse::ptr response
+                                 ,HttpSession::ptr session)
+    :m_dispatch(dispatch)
+    ,m_filters(filters)
+    ,m_request(request)
+    ,m_response(response)
+    ,m_session(session) {
+}
+
+int32_t HttpFilterChain::next() {
+    if (m_index < m_filters.size()) {
+        return m_filters[m_index++]->filter(m_request, m_response, m_session, *this);
+    }
+    return m_dispatch->dispatch(m_request, m_response, m_session);
+}
+
+MetricsFilter::MetricsFilter(const std::string& server)
+    :HttpFilter("MetricsFilter") {
+    setServer(server);
+}
+
+void MetricsFilter::setServer(const std::string& server) {
+    static const char* s_codes[] = {"1xx", "2xx", "3xx", "4xx", "5xx", "other"};
+    auto mgr = metrics::MetricsMgr::GetInstance();
+    std::shared_ptr<Metrics> m = std::make_shared<Metrics>();
+    for (size_t i = 0; i < 6; ++i) {
+        m->requests[i] = mgr->getCounter("sylar_http_requests_total", "http requests handled"
+                                        , {{"server", server}, {"code", s_codes[i]}});
+    }
+    m->latency = mgr->getHistogram("sylar_http_request_duration_seconds"
+                                   , "time spent in filters and servlet", {{"server", server}}, 1e-6);
+    m->inflight = mgr->getGauge("sylar_http_requests_inflight", "http requests being handled"
+                                , {{"server", server}});
+    std::atomic_store(&m_metrics, MetricsPtr(m));
+}
+
+int32_t MetricsFilter::filter(HttpRequest::ptr request, HttpResponse::ptr response
+                              ,HttpSession::ptr session, HttpFilterChain& chain) {
+    MetricsPtr m = std::atomic_load(&m_metrics);
+    m->inflight->inc();
+    uint64_t start = sylar::GetCurrentUS();
+    int32_t rt = chain.next();
+    m->latency->observe(sylar::GetCurrentUS() - start);
+    int cls = (int)response->getStatus() / 100;
+    m->requests[(cls >= 1 && cls <= 5) ? cls - 1 : 5]->inc();
+    m->inflight->dec();
+    return rt;
+}
+
+TraceFilter::TraceFilter()
+    :HttpFilter("TraceFilter") {
+}
+
+int32_t TraceFilter::filter(HttpRequest::ptr request, HttpResponse::ptr response
+                            ,HttpSession::ptr session, HttpFilterChain& chain) {
+    TraceContext ctx;
+    std::string parent = request->getHeader("traceparent");
+    if (parent.empty() || !Tracer::ParseTraceParent(parent, ctx)) {
+        if (!Tracer::NewTrace(ctx)) {
+            return chain.next();
+        }
+    }
+    //没有采样的上游trace也要继续往下游传
+    TraceScope scope(ctx);
+    if (!ctx.sampled) {
+        return chain.next();
+    }
+    TraceSpan span("http", std::string(HttpMethodToString(request->getMethod()))
+                            + " " + request->getPath());
+    ctx.span_id = span.getSpanId();
+    response->setHeader("traceresponse", Tracer::FormatTraceParent(ctx));
+    return chain.next();
+}
+
+std::string GetClientIp(HttpRequest::ptr request, HttpSession::ptr session) {
+    Address::ptr addr = request->getRemoteAddress();
+    if (!addr) {
+        Socket::ptr sock = session ? session->getSocket() : nullptr;
+        addr = sock ? sock->getRemoteAddress() : nullptr;
+    }
+    if (!addr) {
+        return "";
+    }
+    std::string ip;
+    char buf[INET6_ADDRSTRLEN] = {0};
+    const sockaddr* sa = addr->getAddr();
+    if (sa->sa_family == AF_INET) {
+        inet_ntop(AF_INET, &((const sockaddr_in*)sa)->sin_addr, buf, sizeof(buf));
+        ip = buf;
+    } else if (sa->sa_family == AF_INET6) {
+        inet_ntop(AF_INET6, &((const sockaddr_in6*)sa)->sin6_addr, buf, sizeof(buf));
+        ip = buf;
+    } else {
+        //unix socket等，所有客户端算同一个
+        ip = "local";
+    }
+    //X-Real-IP谁都能伪造，只有对端是配置的反向代理时才用
+    std::shared_ptr<const ProxySet> proxies = std::atomic_load(&s_trusted_proxies);
+    if (!proxies->empty() && proxies->count(ip)) {
+        std::string real = request->getHeader("X-Real-IP");
+        if (!real.empty()) {
+            return real;
+        }
+    }
+    return ip;
+}
+
+RateLimitFilter::RateLimitFilter()
+    :HttpFilter("RateLimitFilter") {
+    setRules(g_rate_limit_rules->getValue());
+    m_listenerId = g_rate_limit_rules->addListener([this](const std::vector<RateLimitRule>& old_value
+                                                          ,const std::vector<RateLimitRule>& new_value){
+        setRules(new_value);
+    });
+}
+
+RateLimitFilter::~RateLimitFilter() {
+    g_rate_limit_rules->delListener(m_listenerId);
+}
+
+void RateLimitFilter::setRules(const std::vector<RateLimitRule>& rules) {
+    std::shared_ptr<std::vector<Limiter::ptr> > limiters = std::make_shared<std::vector<Limiter::ptr> >();
+    for (auto& i : rules) {
+        if (i.path.empty() || i.rate <= 0) {
+            SYLAR_LOG_ERROR(g_logger) << "invalid rate limit rule path=" << i.path
+                << " rate=" << i.rate;
+            continue;
+        }
+        Limiter::ptr limiter = std::make_shared<Limiter>();
+        limiter->rule = i;
+        limiters->push_back(limiter);
+    }
+    std::atomic_store(&m_limiters, LimitersPtr(limiters));
+}
+
+bool RateLimitFilter::Take(Bucket& bucket, const RateLimitRule& rule, uint64_t now_us, uint64_t& retry_ms) {
+    double burst = rule.burst > 0 ? rule.burst : rule.rate;
+    if (bucket.last == 0) {
+        bucket.tokens = burst;
+    } else if (now_us > bucket.last) {
+        bucket.tokens = std::min(burst, bucket.tokens + (now_us - bucket.last) * rule.rate / 1000000.0);
+    }
+    bucket.last = now_us;
+    if (bucket.tokens >= 1) {
+        bucket.tokens -= 1;
+        return true;
+    }
+    retry_ms = (uint64_t)ceil((1 - bucket.tokens) * 1000 / rule.rate);
+    return false;
+}
+
+void RateLimitFilter::Sweep(Limiter& limiter, uint64_t now_us) {
+    //每秒最多清理一次，大量不同ip的请求时不会每个请求都遍历一遍
+    if (now_us < limiter.lastSweep + 1000000) {
+        return;
+    }
+    limiter.lastSweep = now_us;
+    const RateLimitRule& rule = limiter.rule;
+    double burst = rule.burst > 0 ? rule.burst : rule.rate;
+    for (auto it = limiter.clients.begin(); it != limiter.clients.end();) {
+        //已经补满的桶和新建的一样，可以删掉
+        if (it->second.tokens + (now_us - it->second.last) * rule.rate / 1000000.0 >= burst) {
+            it = limiter.clients.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (limiter.clients.size() > g_rate_limit_max_clients->getValue()) {
+        SYLAR_LOG_WARN(g_logger) << "rate limit rule " << rule.path << " too many clients "
+            << limiter.clients.size() << ", reset all";
+        limiter.clients.clear();
+    }
+}
+
+int32_t RateLimitFilter::filter(HttpRequest::ptr request, HttpResponse::ptr response
+                                ,HttpSession::ptr session, HttpFilterChain& chain) {
+    LimitersPtr limiters = std::atomic_load(&m_limiters);
+    Limiter::ptr limiter;
+    for (auto& i : *limiters) {
+        if (!fnmatch(i->rule.path.c_str(), request->getPath().c_str(), 0)) {
+            limiter = i;
+            break;
+        }
+    }
+    if (!limiter) {
+        return chain.next();
+    }
+
+    uint64_t now = sylar::GetCurrentUS();
+    uint64_t retry_ms = 0;
+    bool ok = false;
+    if (limiter->rule.per_ip) {
+        std::string ip = GetClientIp(request, session);
+        MutexType::Lock lock(limiter->mutex);
+        if (limiter->clients.size() > g_rate_limit_max_clients->getValue()) {
+            Sweep(*limiter, now);
+        }
+        ok = Take(limiter->clients[ip], limiter->rule, now, retry_ms);
+    } else {
+        MutexType::Lock lock(limiter->mutex);
+        ok = Take(limiter->global, limiter->rule, now, retry_ms);
+    }
+    if (ok) {
+        ++limiter->passed;
+        return chain.next();
+    }
+
+    ++limiter->rejected;
+    response->setStatus(HttpStatus::TOO_MANY_REQUESTS);
+    response->setHeader("Retry-After", std::to_string((retry_ms + 999) / 1000));
+    response->setHeader("Content-Type", "text/plain");
+    response->setBody("429 Too Many Requests");
+    return 0;
+}
+
+std::ostream& RateLimitFilter::dump(std::ostream& os) {
+    LimitersPtr limiters = std::atomic_load(&m_limiters);
+    for (auto& i : *limiters) {
+        size_t clients = 0;
+        {
+            MutexType::Lock lock(i->mutex);
+            clients = i->clients.size();
+        }
+        os << "    " << i->rule.path
+           << " rate=" << i->rule.rate
+           << " burst=" << (i->rule.burst > 0 ? i->rule.burst : i->rule.rate)
+           << " per_ip=" << i->rule.per_ip
+           << " clients=" << clients
+           << " passed=" << i->passed
+           << " rejected=" << i->rejected << std::endl;
+    }
+    return os;
+}
+
+ConcurrencyLimitFilter::ConcurrencyLimitFilter()
+    :HttpFilter("ConcurrencyLimitFilter") {
+    setConf(g_concurrency_limit->getValue());
+    m_listenerId = g_concurrency_limit->addListener([this](const ConcurrencyLimitConf& old_value
+                                                           ,const ConcurrencyLimitConf& new_value){
+        setConf(new_value);
+    });
+}
+
+ConcurrencyLimitFilter::~ConcurrencyLimitFilter() {
+    g_concurrency_limit->delListener(m_listenerId);
+}
+
+void ConcurrencyLimitFilter::setConf(const ConcurrencyLimitConf& conf) {
+    MutexType::Lock lock(m_mutex);
+    m_conf = conf;
+    if (m_conf.min_limit < 1) {
+        m_conf.min_limit = 1;
+    }
+    if (m_conf.max_limit < m_conf.min_limit) {
+        m_conf.max_limit = m_conf.min_limit;
+    }
+    if (m_conf.long_window < 1) {
+        m_conf.long_window = 1;
+    }
+    m_estimate = std::max(m_conf.min_limit, std::min(m_conf.max_limit, m_conf.initial_limit));
+    m_longRtt = 0;
+    m_limit = (uint32_t)m_estimate;
+    m_enable = m_conf.enable;
+}
+
+int32_t ConcurrencyLimitFilter::filter(HttpRequest::ptr request, HttpResponse::ptr response
+                                       ,HttpSession::ptr session, HttpFilterChain& chain) {
+    if (!m_enable) {
+        return chain.next();
+    }
+    uint32_t inflight = ++m_inflight;
+    if (inflight > m_limit) {
+        --m_inflight;
+        ++m_rejected;
+        //快速失败，客户端可以马上重试别的实例
+        response->setStatus(HttpStatus::SERVICE_UNAVAILABLE);
+        response->setHeader("Retry-After", "1");
+        response->setHeader("Content-Type", "text/plain");
+        response->setBody("503 Service Unavailable");
+        return 0;
+    }
+    uint64_t start = sylar::GetCurrentUS();
+    int32_t rt = chain.next();
+    onSample(sylar::GetCurrentUS() - start, inflight);
+    --m_inflight;
+    return rt;
+}
+
+void ConcurrencyLimitFilter::onSample(uint64_t rtt_us, uint32_t inflight) {
+    double rtt = std::max<uint64_t>(rtt_us, 1);
+    MutexType::Lock lock(m_mutex);
+    if (m_longRtt == 0) {
+        m_longRtt = rtt;
+    } else {
+        m_longRtt += (rtt - m_longRtt) / m_conf.long_window;
+    }
+    //负载下降后当前延迟远低于长期平均，加快长期平均回落，否则上限很久才能恢复
+    if (m_longRtt / rtt > 2) {
+        m_longRtt *= 0.95;
+    }
+    //正在处理的请求远少于上限时，延迟说明不了上限是否合适
+    if (inflight < m_estimate / 2) {
+        return;
+    }
+    //当前延迟比长期平均高时梯度小于1，上限按比例降低，最多降一半
+    double gradient = std::max(0.5, std::min(1.0, m_conf.tolerance * m_longRtt / rtt));
+    //允许sqrt(limit)个请求排队，延迟正常时上限以此缓慢增长
+    double new_limit = m_estimate * gradient + sqrt(m_estimate);
+    new_limit = m_estimate * (1 - m_conf.smoothing) + new_limit * m_conf.smoothing;
+    m_estimate = std::max<double>(m_conf.min_limit, std::min<double>(m_conf.max_limit, new_limit));
+    m_limit = (uint32_t)m_estimate;
+}
+
+std::ostream& ConcurrencyLimitFilter::dump(std::ostream& os) {
+    double long_rtt = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        long_rtt = m_longRtt;
+    }
+    os << "    enable=" << m_enable
+       << " limit=" << m_limit
+       << " inflight=" << m_inflight
+       << " long_rtt_us=" << (uint64_t)long_rtt
+       << " rejected=" << m_rejected << std::endl;
+    return os;
+}
+
+}
+}
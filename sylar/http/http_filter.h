@@ -0,0 +1,333 @@
+/**
+ * @file http_filter.h
+ * @brief Servlet前的过滤器链，内置限流和自适应并发限制
+ * @date 2025-07-22
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// ServletDispatch在匹配Servlet之前按添加顺序执行HttpFilter：
+//   filter里调用chain.next()继续执行后面的filter，最后一个filter之后才是路由和Servlet
+//   不调用next()时请求到此结束，filter自己填好response(如429、503)
+//   next()返回后可以看到Servlet生成的response，可以统计耗时或修改响应
+// HttpServer默认在最前面装了TraceFilter(请求追踪，见sylar/trace.h)和MetricsFilter(统计请求数和耗时)，
+// 之后是两个由配置控制的filter，没有配置时直接放行：
+// 1.RateLimitFilter: 令牌桶限流，http.filter.rate_limit是规则列表
+//     - path: /api/*     # fnmatch模式，一个请求只用第一条匹配的规则
+//       rate: 100        # 每秒产生的令牌数
+//       burst: 200       # 桶容量，允许的突发请求数，0时等于rate
+//       per_ip: true     # 每个客户端ip一个桶，否则所有客户端共用一个桶
+//   令牌不够时返回429和Retry-After
+// 2.ConcurrencyLimitFilter: 自适应并发限制(参考Netflix concurrency-limits的Gradient2)，
+//   用长期平均延迟和当前延迟的比值调整允许同时处理的请求数，
+//   下游变慢、请求开始排队时上限跟着降低，超过上限的请求立即返回503，不再排队等到超时
+
+#ifndef __SYLAR_HTTP_FILTER_H__
+#define __SYLAR_HTTP_FILTER_H__
+
+#include <atomic>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "http.h"
+#include "http_session.h"
+#include "sylar/config.h"
+#include "sylar/metrics.h"
+#include "sylar/mutex.h"
+
+namespace sylar {
+namespace http {
+
+class ServletDispatch;
+class HttpFilterChain;
+
+class HttpFilter {
+public:
+    typedef std::shared_ptr<HttpFilter> ptr;
+
+    HttpFilter(const std::string& name) : m_name(name) {}
+    virtual ~HttpFilter() {}
+
+    //处理请求，调用chain.next()交给后面的filter和Servlet；session可能为nullptr(HTTP/2)
+    virtual int32_t filter(HttpRequest::ptr request, HttpResponse::ptr response
+                           ,HttpSession::ptr session, HttpFilterChain& chain) = 0;
+
+    //输出状态，/_/status中显示
+    virtual std::ostream& dump(std::ostream& os) { return os;}
+
+    const std::string& getName() const { return m_name;}
+protected:
+    std::string m_name;
+};
+
+//一次请求的filter执行位置，在栈上创建，不分配内存
+class HttpFilterChain {
+public:
+    HttpFilterChain(ServletDispatch* dispatch, const std::vector<HttpFilter::ptr>& filters
+                    ,HttpRequest::ptr request, HttpResponse::ptr response
+                    ,HttpSession::ptr session);
+
+    //执行下一个filter，filter都执行过后执行路由和Servlet
+    int32_t next();
+private:
+    ServletDispatch* m_dispatch;
+    const std::vector<HttpFilter::ptr>& m_filters;
+    HttpRequest::ptr m_request;
+    HttpResponse::ptr m_response;
+    HttpSession::ptr m_session;
+    size_t m_index = 0;
+};
+
+//按状态码分类统计请求数，统计处理耗时(不含发送响应)和正在处理的请求数
+//放在第一个，被限流拒绝的请求也会统计到
+class MetricsFilter : public HttpFilter {
+public:
+    typedef std::shared_ptr<MetricsFilter> ptr;
+
+    MetricsFilter(const std::string& server);
+
+    virtual int32_t filter(HttpRequest::ptr request, HttpResponse::ptr response
+                           ,HttpSession::ptr session, HttpFilterChain& chain) override;
+
+    //服务器改名后重新取对应标签的指标
+    void setServer(const std::string& server);
+
+private:
+    struct Metrics {
+        //1xx~5xx，其他
+        metrics::Counter::ptr requests[6];
+        metrics::HdrHistogram::ptr latency;
+        metrics::Gauge::ptr inflight;
+    };
+    typedef std::shared_ptr<const Metrics> MetricsPtr;
+
+    //用std::atomic_load/atomic_store读写
+    MetricsPtr m_metrics;
+};
+
+//从traceparent头继续上游的追踪，没有时按trace.sample_rate新建，处理请求期间作为当前协程的追踪上下文
+//采样时整个处理过程记录为一个span，响应带上traceresponse头，用里面的trace id到/_/trace查找
+class TraceFilter : public HttpFilter {
+public:
+    typedef std::shared_ptr<TraceFilter> ptr;
+
+    TraceFilter();
+
+    virtual int32_t filter(HttpRequest::ptr request, HttpResponse::ptr response
+                           ,HttpSession::ptr session, HttpFilterChain& chain) override;
+};
+
+//客户端ip(不带端口)，优先取请求上记录的对端地址(http2时session为nullptr)，unix socket返回local，取不到时返回空
+//对端在http.trusted_proxies里时改用X-Real-IP
+std::string GetClientIp(HttpRequest::ptr request, HttpSession::ptr session);
+
+//令牌桶限流规则
+struct RateLimitRule {
+    //匹配请求路径的fnmatch模式
+    std::string path;
+    //每秒产生的令牌数
+    double rate = 0;
+    //桶容量，0时等于rate
+    double burst = 0;
+    //是否按客户端ip分别限流
+    bool per_ip = false;
+
+    bool operator==(const RateLimitRule& oth) const {
+        return path == oth.path
+            && rate == oth.rate
+            && burst == oth.burst
+            && per_ip == oth.per_ip;
+    }
+};
+
+}
+
+template<>
+class LexicalCast<std::string, http::RateLimitRule> {
+public:
+    http::RateLimitRule operator()(const std::string& v) {
+        YAML::Node node = YAML::Load(v);
+        http::RateLimitRule rule;
+        rule.path = node["path"].as<std::string>(rule.path);
+        rule.rate = node["rate"].as<double>(rule.rate);
+        rule.burst = node["burst"].as<double>(rule.burst);
+        rule.per_ip = node["per_ip"].as<bool>(rule.per_ip);
+        return rule;
+    }
+};
+
+template<>
+class LexicalCast<http::RateLimitRule, std::string> {
+public:
+    std::string operator()(const http::RateLimitRule& rule) {
+        YAML::Node node;
+        node["path"] = rule.path;
+        node["rate"] = rule.rate;
+        node["burst"] = rule.burst;
+        node["per_ip"] = rule.per_ip;
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+};
+
+namespace http {
+
+class RateLimitFilter : public HttpFilter {
+public:
+    typedef std::shared_ptr<RateLimitFilter> ptr;
+    typedef Mutex MutexType;
+
+    //规则来自http.filter.rate_limit，配置修改后立即生效(已有的桶重新开始计数)
+    RateLimitFilter();
+    ~RateLimitFilter();
+
+    virtual int32_t filter(HttpRequest::ptr request, HttpResponse::ptr response
+                           ,HttpSession::ptr session, HttpFilterChain& chain) override;
+    virtual std::ostream& dump(std::ostream& os) override;
+
+    //替换规则
+    void setRules(const std::vector<RateLimitRule>& rules);
+
+private:
+    struct Bucket {
+        double tokens = 0;
+        //上次补充令牌的时间(us)
+        uint64_t last = 0;
+    };
+
+    //一条规则的桶
+    struct Limiter {
+        typedef std::shared_ptr<Limiter> ptr;
+        RateLimitRule rule;
+        MutexType mutex;
+        //per_ip为false时使用
+        Bucket global;
+        //per_ip为true时每个ip一个桶
+        std::unordered_map<std::string, Bucket> clients;
+        //上次清理clients的时间(us)
+        uint64_t lastSweep = 0;
+        std::atomic<uint64_t> passed = {0};
+        std::atomic<uint64_t> rejected = {0};
+    };
+    typedef std::shared_ptr<const std::vector<Limiter::ptr> > LimitersPtr;
+
+    //补充令牌后取一个，取不到时retry_ms返回等到有令牌的时间
+    static bool Take(Bucket& bucket, const RateLimitRule& rule, uint64_t now_us, uint64_t& retry_ms);
+    //删除已经补满的ip桶，调用方持有limiter的锁
+    static void Sweep(Limiter& limiter, uint64_t now_us);
+
+private:
+    //当前规则，用std::atomic_load/atomic_store读写
+    LimitersPtr m_limiters;
+    uint64_t m_listenerId = 0;
+};
+
+//自适应并发限制的配置
+struct ConcurrencyLimitConf {
+    bool enable = false;
+    //初始的并发上限
+    uint32_t initial_limit = 50;
+    uint32_t min_limit = 8;
+    uint32_t max_limit = 1000;
+    //当前延迟不超过长期延迟的tolerance倍时不降低上限
+    double tolerance = 1.5;
+    //新上限的平滑系数，越小变化越慢
+    double smoothing = 0.2;
+    //长期延迟指数平均的窗口(请求数)
+    uint32_t long_window = 600;
+
+    bool operator==(const ConcurrencyLimitConf& oth) const {
+        return enable == oth.enable
+            && initial_limit == oth.initial_limit
+            && min_limit == oth.min_limit
+            && max_limit == oth.max_limit
+            && tolerance == oth.tolerance
+            && smoothing == oth.smoothing
+            && long_window == oth.long_window;
+    }
+};
+
+}
+
+template<>
+class LexicalCast<std::string, http::ConcurrencyLimitConf> {
+public:
+    http::ConcurrencyLimitConf operator()(const std::string& v) {
+        YAML::Node node = YAML::Load(v);
+        http::ConcurrencyLimitConf conf;
+        conf.enable = node["enable"].as<bool>(conf.enable);
+        conf.initial_limit = node["initial_limit"].as<uint32_t>(conf.initial_limit);
+        conf.min_limit = node["min_limit"].as<uint32_t>(conf.min_limit);
+        conf.max_limit = node["max_limit"].as<uint32_t>(conf.max_limit);
+        conf.tolerance = node["tolerance"].as<double>(conf.tolerance);
+        conf.smoothing = node["smoothing"].as<double>(conf.smoothing);
+        conf.long_window = node["long_window"].as<uint32_t>(conf.long_window);
+        return conf;
+    }
+};
+
+template<>
+class LexicalCast<http::ConcurrencyLimitConf, std::string> {
+public:
+    std::string operator()(const http::ConcurrencyLimitConf& conf) {
+        YAML::Node node;
+        node["enable"] = conf.enable;
+        node["initial_limit"] = conf.initial_limit;
+        node["min_limit"] = conf.min_limit;
+        node["max_limit"] = conf.max_limit;
+        node["tolerance"] = conf.tolerance;
+        node["smoothing"] = conf.smoothing;
+        node["long_window"] = conf.long_window;
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+};
+
+namespace http {
+
+class ConcurrencyLimitFilter : public HttpFilter {
+public:
+    typedef std::shared_ptr<ConcurrencyLimitFilter> ptr;
+    typedef Spinlock MutexType;
+
+    //配置来自http.filter.concurrency，修改后上限从initial_limit重新开始
+    ConcurrencyLimitFilter();
+    ~ConcurrencyLimitFilter();
+
+    virtual int32_t filter(HttpRequest::ptr request, HttpResponse::ptr response
+                           ,HttpSession::ptr session, HttpFilterChain& chain) override;
+    virtual std::ostream& dump(std::ostream& os) override;
+
+    void setConf(const ConcurrencyLimitConf& conf);
+    uint32_t getLimit() const { return m_limit;}
+    uint32_t getInflight() const { return m_inflight;}
+
+private:
+    //一个请求完成，rtt_us为耗时，inflight为它开始时正在处理的请求数
+    void onSample(uint64_t rtt_us, uint32_t inflight);
+
+private:
+    MutexType m_mutex;
+    //以下由m_mutex保护
+    ConcurrencyLimitConf m_conf;
+    //精确的上限
+    double m_estimate = 0;
+    //长期平均延迟(us)
+    double m_longRtt = 0;
+
+    std::atomic<bool> m_enable = {false};
+    //m_estimate取整，请求入口只读这个
+    std::atomic<uint32_t> m_limit = {0};
+    std::atomic<uint32_t> m_inflight = {0};
+    std::atomic<uint64_t> m_rejected = {0};
+    uint64_t m_listenerId = 0;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "http_headers.h"
+#include <string.h>
+#include <strings.h>
+
+namespace sylar {
+namespace http {
+
+static const char* s_header_string[] = {
+    "",
+#define XX(id, name) #name,
+    HTTP_HEADER_MAP(XX)
+#undef XX
+};
+
+//常见头部名中最长的长度
+static const size_t s_max_known_length = 32;
+
+HttpHeaders::Id HttpHeaders::GetId(const char* name, size_t len) {
+    //按长度分桶，同一长度的常见头部只有几个，再用首字母过滤
+    static std::vector<Id>* s_buckets = []() {
+        std::vector<Id>* buckets = new std::vector<Id>[s_max_known_length + 1];
+        for (int i = UNKNOWN + 1; i < ID_COUNT; ++i) {
+            size_t l = strlen(s_header_string[i]);
+            if (l <= s_max_known_length) {
+                buckets[l].push_back((Id)i);
+            }
+        }
+        return buckets;
+    }();
+    if (len == 0 || len > s_max_known_length) {
+        return UNKNOWN;
+    }
+    char c = name[0] | 0x20;
+    for (auto id : s_buckets[len]) {
+        const char* s = s_header_string[id];
+        if ((s[0] | 0x20) == c && strncasecmp(s, name, len) == 0) {
+            return id;
+        }
+    }
+    return UNKNOWN;
+}
+
+const char* HttpHeaders::IdToString(Id id) {
+    if (id <= UNKNOWN || id >= ID_COUNT) {
+        return "";
+    }
+    return s_header_string[id];
+}
+
+void HttpHeaders::const_iterator::load() {
+    if (m_idx < m_headers->m_entries.size()) {
+        const Entry& e = m_headers->m_entries[m_idx];
+        m_field.first = m_headers->nameOf(e);
+        m_field.second = m_headers->valueOf(e);
+    }
+}
+
+HttpHeaders::HttpHeaders()
+    :m_dead(0) {
+    memset(m_index, 0, sizeof(m_index));
+}
+
+size_t HttpHeaders::indexOf(const StringView& name) const {
+    Id id = GetId(name);
+    if (id != UNKNOWN) {
+        return indexOf(id);
+    }
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const Entry& e = m_entries[i];
+        if (e.id == UNKNOWN && e.nameLen == name.size()
+                && strncasecmp(m_pool.data() + e.name, name.data(), name.size()) == 0) {
+            return i;
+        }
+    }
+    return m_entries.size();
+}
+
+size_t HttpHeaders::indexOf(Id id) const {
+    if (id <= UNKNOWN || id >= ID_COUNT || m_index[id] == 0) {
+        return m_entries.size();
+    }
+    return m_index[id] - 1;
+}
+
+bool HttpHeaders::get(const StringView& name, StringView& value) const {
+    size_t idx = indexOf(name);
+    if (idx == m_entries.size()) {
+        return false;
+    }
+    value = valueOf(m_entries[idx]);
+    return true;
+}
+
+StringView HttpHeaders::get(Id id) const {
+    size_t idx = indexOf(id);
+    return idx == m_entries.size() ? StringView() : valueOf(m_entries[idx]);
+}
+
+void HttpHeaders::set(const StringView& name, const StringView& value) {
+    if (name.empty()) {
+        return;
+    }
+    Id id = GetId(name);
+    size_t idx = id != UNKNOWN ? indexOf(id) : indexOf(name);
+    if (idx != m_entries.size()) {
+        Entry& e = m_entries[idx];
+        if (value.size() <= e.valueLen) {
+            //新值放得下时原地覆盖
+            memmove(&m_pool[e.value], value.data(), value.size());
+            m_dead += e.valueLen - value.size();
+        } else {
+            m_dead += e.valueLen;
+            e.value = m_pool.size();
+            m_pool.append(value.data(), value.size());
+        }
+        e.valueLen = value.size();
+        compact();
+        return;
+    }
+    //下标用uint16_t保存，一个消息不会有这么多头部
+    if (m_entries.size() >= 0xffff) {
+        return;
+    }
+    if (m_entries.empty()) {
+        m_entries.reserve(16);
+        m_pool.reserve(512);
+    }
+    Entry e;
+    e.name = m_pool.size();
+    e.nameLen = name.size();
+    m_pool.append(name.data(), name.size());
+    e.value = m_pool.size();
+    e.valueLen = value.size();
+    m_pool.append(value.data(), value.size());
+    e.id = id;
+    m_entries.push_back(e);
+    if (id != UNKNOWN) {
+        m_index[id] = m_entries.size();
+    }
+}
+
+bool HttpHeaders::erase(const StringView& name) {
+    size_t idx = indexOf(name);
+    if (idx == m_entries.size()) {
+        return false;
+    }
+    m_dead += m_entries[idx].nameLen + m_entries[idx].valueLen;
+    m_entries.erase(m_entries.begin() + idx);
+    rebuildIndex();
+    compact();
+    return true;
+}
+
+void HttpHeaders::clear() {
+    m_pool.clear();
+    m_entries.clear();
+    memset(m_index, 0, sizeof(m_index));
+    m_dead = 0;
+}
+
+void HttpHeaders::rebuildIndex() {
+    memset(m_index, 0, sizeof(m_index));
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].id != UNKNOWN) {
+            m_index[m_entries[i].id] = i + 1;
+        }
+    }
+}
+
+void HttpHeaders::compact() {
+    if (m_dead < 1024 || m_dead * 2 < m_pool.size()) {
+        return;
+    }
+    std::string pool;
+    pool.reserve(m_pool.size() - m_dead);
+    for (auto& e : m_entries) {
+        uint32_t name = pool.size();
+        pool.append(m_pool, e.name, e.nameLen);
+        uint32_t value = pool.size();
+        pool.append(m_pool, e.value, e.valueLen);
+        e.name = name;
+        e.value = value;
+    }
+    m_pool.swap(pool);
+    m_dead = 0;
+}
+
+}
+}
@@ -0,0 +1,167 @@
+/**
+ * @file http_headers.h
+ * @brief HTTP头部的紧凑存储
+ * @date 2025-07-19
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 原来的头部是std::map<std::string, std::string, CaseInsensitiveLess>，
+// 每个头部两次字符串分配加一个树节点，每次查找是O(log n)次strcasecmp
+// HttpHeaders把一个消息的所有头部名和值连续放在一块内存(m_pool)里，
+// 另外用一个扁平数组记录每个头部在m_pool中的偏移和长度，一个请求的头部通常只需要两次分配
+// 常见头部在解析时识别成固定的Id，按Id查找是O(1)；其他头部顺序比较，先比长度再忽略大小写比较
+// 同名头部后设置的覆盖前面的(和原来map的语义一样)，遍历顺序为第一次设置的顺序
+//
+// 头部数据是拷贝进m_pool的，不直接引用连接的读缓冲区：
+// 解析器会把未解析的数据前移，缓冲区也会被同一连接上的下一个请求覆盖，而请求对象可能被servlet继续持有
+
+#ifndef __SYLAR_HTTP_HEADERS_H__
+#define __SYLAR_HTTP_HEADERS_H__
+
+#include <stdint.h>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "sylar/util/string_view.h"
+
+namespace sylar {
+namespace http {
+
+/* Well-known headers */
+#define HTTP_HEADER_MAP(XX)                                   \
+    XX(HOST,                     Host)                        \
+    XX(CONNECTION,               Connection)                  \
+    XX(CONTENT_LENGTH,           Content-Length)              \
+    XX(CONTENT_TYPE,             Content-Type)                \
+    XX(CONTENT_ENCODING,         Content-Encoding)            \
+    XX(TRANSFER_ENCODING,        Transfer-Encoding)           \
+    XX(ACCEPT,                   Accept)                      \
+    XX(ACCEPT_ENCODING,          Accept-Encoding)             \
+    XX(ACCEPT_LANGUAGE,          Accept-Language)             \
+    XX(USER_AGENT,               User-Agent)                  \
+    XX(COOKIE,                   Cookie)                      \
+    XX(AUTHORIZATION,            Authorization)               \
+    XX(REFERER,                  Referer)                     \
+    XX(ORIGIN,                   Origin)                      \
+    XX(KEEP_ALIVE,               Keep-Alive)                  \
+    XX(UPGRADE,                  Upgrade)                     \
+    XX(EXPECT,                   Expect)                      \
+    XX(TE,                       TE)                          \
+    XX(CACHE_CONTROL,            Cache-Control)               \
+    XX(PRAGMA,                   Pragma)                      \
+    XX(IF_NONE_MATCH,            If-None-Match)               \
+    XX(IF_MODIFIED_SINCE,        If-Modified-Since)           \
+    XX(IF_RANGE,                 If-Range)                    \
+    XX(RANGE,                    Range)                       \
+    XX(ETAG,                     ETag)                        \
+    XX(LAST_MODIFIED,            Last-Modified)               \
+    XX(DATE,                     Date)                        \
+    XX(SERVER,                   Server)                      \
+    XX(LOCATION,                 Location)                    \
+    XX(VARY,                     Vary)                        \
+    XX(X_FORWARDED_FOR,          X-Forwarded-For)             \
+    XX(X_REAL_IP,                X-Real-IP)                   \
+    XX(HTTP2_SETTINGS,           HTTP2-Settings)              \
+    XX(SEC_WEBSOCKET_KEY,        Sec-WebSocket-Key)           \
+    XX(SEC_WEBSOCKET_VERSION,    Sec-WebSocket-Version)       \
+    XX(SEC_WEBSOCKET_ACCEPT,     Sec-WebSocket-Accept)        \
+    XX(SEC_WEBSOCKET_EXTENSIONS, Sec-WebSocket-Extensions)    \
+
+class HttpHeaders {
+public:
+    enum Id {
+        UNKNOWN = 0,
+#define XX(id, name) id,
+        HTTP_HEADER_MAP(XX)
+#undef XX
+        ID_COUNT
+    };
+
+    //遍历时的一个头部，视图指向m_pool，头部被修改后失效
+    struct Field {
+        StringView first;
+        StringView second;
+    };
+
+    class const_iterator : public std::iterator<std::forward_iterator_tag, Field> {
+    public:
+        const_iterator(const HttpHeaders* headers, size_t idx)
+            :m_headers(headers), m_idx(idx) {
+            load();
+        }
+        const Field& operator*() const { return m_field;}
+        const Field* operator->() const { return &m_field;}
+        const_iterator& operator++() { ++m_idx; load(); return *this;}
+        const_iterator operator++(int) { const_iterator tmp = *this; ++*this; return tmp;}
+        bool operator==(const const_iterator& o) const { return m_idx == o.m_idx;}
+        bool operator!=(const const_iterator& o) const { return m_idx != o.m_idx;}
+    private:
+        void load();
+    private:
+        const HttpHeaders* m_headers;
+        size_t m_idx;
+        Field m_field;
+    };
+
+    //识别常见头部名(忽略大小写)，不是常见头部返回UNKNOWN
+    static Id GetId(const char* name, size_t len);
+    static Id GetId(const StringView& name) { return GetId(name.data(), name.size());}
+    //常见头部的标准写法，如Content-Length
+    static const char* IdToString(Id id);
+
+    HttpHeaders();
+
+    size_t size() const { return m_entries.size();}
+    bool empty() const { return m_entries.empty();}
+    const_iterator begin() const { return const_iterator(this, 0);}
+    const_iterator end() const { return const_iterator(this, m_entries.size());}
+
+    const_iterator find(const StringView& name) const { return const_iterator(this, indexOf(name));}
+    const_iterator find(Id id) const { return const_iterator(this, indexOf(id));}
+    bool has(const StringView& name) const { return indexOf(name) != m_entries.size();}
+    bool has(Id id) const { return indexOf(id) != m_entries.size();}
+
+    //头部存在时返回true，value指向m_pool，在下一次修改前有效
+    bool get(const StringView& name, StringView& value) const;
+    //不存在时返回空视图
+    StringView get(Id id) const;
+
+    //设置头部，已经存在时覆盖原来的值(名字的大小写保持第一次设置时的写法)
+    void set(const StringView& name, const StringView& value);
+    //删除头部，不存在返回false
+    bool erase(const StringView& name);
+    void clear();
+
+private:
+    struct Entry {
+        uint32_t name;
+        uint32_t value;
+        uint32_t valueLen;
+        uint16_t nameLen;
+        uint8_t id;
+    };
+
+    //返回下标，不存在返回size()
+    size_t indexOf(const StringView& name) const;
+    size_t indexOf(Id id) const;
+    void rebuildIndex();
+    //被覆盖和删除的数据超过一半时整理m_pool
+    void compact();
+
+    StringView nameOf(const Entry& e) const { return StringView(m_pool.data() + e.name, e.nameLen);}
+    StringView valueOf(const Entry& e) const { return StringView(m_pool.data() + e.value, e.valueLen);}
+
+private:
+    //所有头部名和值
+    std::string m_pool;
+    std::vector<Entry> m_entries;
+    //Id -> 下标 + 1，0表示不存在
+    uint16_t m_index[ID_COUNT];
+    //m_pool中已经没有被引用的字节数
+    size_t m_dead;
+};
+
+}
+}
+
+#endif
@@ -25,10 +25,18 @@ static sylar::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
                                                 (uint64_t)(64 * 1024  * 1024), 
                                                 "http response max body size");
 
+static sylar::ConfigVar<std::string>::ptr g_http_request_parser =
+                            sylar::Config::Lookup("http.request.parser",
+                                                std::string("ragel"),
+                                                "http request parser: ragel or simd, simd falls back to ragel for heads larger than http.request.buffer_size");
+
 static uint64_t s_http_request_buffer_size = 0;
 static uint64_t s_http_request_max_body_size = 0;
 static uint64_t s_http_response_buffer_size = 0;
 static uint64_t s_http_response_max_body_size = 0;
+static bool s_http_request_parser_simd = false;
+//simd解析一个请求最多的头部个数，超过按格式错误处理
+static const size_t s_simd_max_headers = 128;
 
 uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
     return s_http_request_buffer_size;
@@ -66,9 +74,21 @@ struct _SizeIniter {
         g_http_response_max_body_size->addListener([](const uint64_t& old_value, const uint64_t& new_value){
             s_http_response_max_body_size = new_value;
         });
+    }
+};
+//必须有实例才会执行构造函数，否则s_http_xx一直是0(缓冲区大小为0，所有请求都会失败)
+static _SizeIniter _init;
 
+//http.request.parser只在HttpRequestParser构造和reset时读取，缓存成bool
+struct _ParserIniter {
+    _ParserIniter() {
+        s_http_request_parser_simd = g_http_request_parser->getValue() == "simd";
+        g_http_request_parser->addListener([](const std::string& old_value, const std::string& new_value){
+            s_http_request_parser_simd = new_value == "simd";
+        });
     }
 };
+static _ParserIniter _parser_init;
 }
 
 
@@ -125,14 +145,17 @@ void on_request_version(void* data, const char* at, size_t length) {
 void on_request_http_field(void* data, const char* field, size_t flen, const char* value, size_t vlen) {
     HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
     if (flen == 0) return;
-    parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    parser->getData()->setHeader(StringView(field, flen), StringView(value, vlen));
 }
 //该回调函数的作用是，当所有的请求头header都解析完了后，会执行这个回调函数
 void on_request_header_done(void* data, const char* at, size_t length) {
 }
 
 HttpRequestParser::HttpRequestParser()
-    : m_error(0) {
+    : m_simd(s_http_request_parser_simd)
+    , m_finished(false)
+    , m_lastLen(0)
+    , m_error(0) {
     m_data.reset(new sylar::http::HttpRequest);
     http_parser_init(&m_parser);
     m_parser.request_method = on_request_method;
@@ -146,6 +169,16 @@ HttpRequestParser::HttpRequestParser()
     m_parser.data = this;
 }
 
+void HttpRequestParser::reset() {
+    //http_parser_init只重置状态，不会清掉回调和data
+    http_parser_init(&m_parser);
+    m_data.reset(new sylar::http::HttpRequest);
+    m_error = 0;
+    m_simd = s_http_request_parser_simd;
+    m_finished = false;
+    m_lastLen = 0;
+}
+
 uint64_t HttpRequestParser::getContentLength() {
     return m_data->getHeaderAs<uint64_t>("content-length", 0);
 }
@@ -154,6 +187,9 @@ uint64_t HttpRequestParser::getContentLength() {
 //返回-1表示错误
 //返回>0表示成功处理的字节数
 size_t HttpRequestParser::execute(char* data, size_t len) {
+    if (m_simd) {
+        return executeSimd(data, len);
+    }
     size_t offset = http_parser_execute(&m_parser, data, len, 0);
     //memmove和mepcpy都是用来复制内存的函数，把一块内存的数据拷贝到另一块内存区域
     //区别在于memmove内层做了判断，如果拷贝到内存有重叠，会从后往前复制，避免数据被覆盖
@@ -162,11 +198,98 @@ size_t HttpRequestParser::execute(char* data, size_t len) {
     return offset;
 }
 
+//方法名精确比较，CharsToHttpMethod按前缀比较，需要'\0'结尾
+static HttpMethod SpanToHttpMethod(const StringView& m) {
+#define XX(num, name, string) \
+    if (m.equals(#string, sizeof(#string) - 1)) { \
+        return HttpMethod::name; \
+    }
+    HTTP_METHOD_MAP(XX);
+#undef XX
+    return HttpMethod::INVALID_METHOD;
+}
+
+size_t HttpRequestParser::executeSimd(char* data, size_t len) {
+    if (m_finished || m_error) {
+        return 0;
+    }
+    if (m_simdHeaders.empty()) {
+        m_simdHeaders.resize(s_simd_max_headers);
+    }
+    HttpSimdRequest req;
+    req.headers = &m_simdHeaders[0];
+    req.numHeaders = m_simdHeaders.size();
+    int rt = ParseHttpRequestHead(data, len, req, m_lastLen);
+    if (rt == -2 && len < s_http_request_buffer_size) {
+        //请求头还不完整，数据留在原处，读到更多数据后重新解析
+        m_lastLen = len;
+        return 0;
+    }
+    if (rt < 0) {
+        //simd要求整个请求头都在缓冲区里，头部个数也有上限；ragel边读边解析，
+        //请求头占满缓冲区或者格式不对时交给ragel从头解析，两种解析器接受的请求保持一致
+        //到这里还没有修改m_data，ragel的状态也是初始状态
+        m_simd = false;
+        m_lastLen = 0;
+        return execute(data, len);
+    }
+
+    HttpMethod m = SpanToHttpMethod(req.method);
+    if (m == HttpMethod::INVALID_METHOD) {
+        m_error = 1000;
+        return 0;
+    }
+    if (req.minorVersion > 1) {
+        SYLAR_LOG_WARN(g_logger) << "invalid http request version HTTP/1." << req.minorVersion;
+        m_error = 1001;
+        return 0;
+    }
+    m_data->setMethod(m);
+    m_data->setVersion(req.minorVersion ? 0x11 : 0x10);
+
+    //目标拆成path?query#fragment，绝对形式(http://host/path)只取路径部分
+    StringView target = req.target;
+    if (target[0] != '/' && target[0] != '*') {
+        size_t scheme = target.find(':');
+        size_t slash = scheme == std::string::npos ? std::string::npos : target.find('/', scheme + 3);
+        if (scheme == std::string::npos || scheme + 3 > target.size()
+                || target[scheme + 1] != '/' || target[scheme + 2] != '/') {
+            m_error = 1002;
+            return 0;
+        }
+        target = slash == std::string::npos ? StringView("/") : target.substr(slash);
+    }
+    size_t pos = target.find('#');
+    if (pos != std::string::npos) {
+        m_data->setFragment(target.substr(pos + 1));
+        target = target.substr(0, pos);
+    }
+    pos = target.find('?');
+    if (pos != std::string::npos) {
+        m_data->setQuery(target.substr(pos + 1));
+        target = target.substr(0, pos);
+    }
+    m_data->setPath(target);
+
+    for (size_t i = 0; i < req.numHeaders; ++i) {
+        m_data->setHeader(req.headers[i].name, req.headers[i].value);
+    }
+    m_finished = true;
+    memmove(data, data + rt, len - rt);
+    return rt;
+}
+
 int HttpRequestParser::isFinshed() {
+    if (m_simd) {
+        return m_finished;
+    }
     return http_parser_finish(&m_parser);
 }
 
 int HttpRequestParser::hasError() {
+    if (m_simd) {
+        return m_error;
+    }
     return m_error || http_parser_has_error(&m_parser);
 }
 
@@ -205,7 +328,7 @@ void on_response_header_done(void* data, const char* at, size_t length){
 void on_response_http_field(void* data, const char* field, size_t flen, const char* value, size_t vlen) {
     HttpResponseParser* parser = static_cast<HttpResponseParser*>(data);
     if (flen == 0) return;
-    parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    parser->getData()->setHeader(StringView(field, flen), StringView(value, vlen));
 }
 
 HttpResponseParser::HttpResponseParser()
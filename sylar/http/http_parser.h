@@ -11,13 +11,19 @@
  #include "http.h"
  #include "http11_parser.h"
  #include "httpclient_parser.h"
+ #include "http_simd_parser.h"
 
  #include <memory>
+ #include <vector>
 
 namespace sylar {
 namespace http {
 
 //Http请求解析类，将请求解析成HttpRequest
+//有两种实现，由配置http.request.parser选择，reset时生效：
+//  ragel：http11_parser状态机，增量解析
+//  simd：ParseHttpRequestHead，请求头不完整时返回0，数据读全后一次解析完(见http_simd_parser.h)
+//        请求头占满http.request.buffer_size还不完整或者解析失败时，这个请求改用ragel从头解析，两者接受的请求一致
 class HttpRequestParser {
 public:
     typedef std::shared_ptr<HttpRequestParser> ptr;
@@ -38,8 +44,12 @@ public:
     void setError(int v) {m_error = v;}
     //获取消息体长度，对应HTTP中的Content-length字段，常用于确定是否读完整个body
     uint64_t getContentLength();
-    //获取http_parser结构体
+    //获取http_parser结构体(simd解析时没有意义)
     const http_parser& getParser() const {return m_parser;}
+    //重置解析状态并创建新的HttpRequest，同一个连接上解析下一个请求时复用parser
+    void reset();
+    //是否使用simd解析
+    bool isSimd() const { return m_simd;}
 
 public:
     //返回用于存放HTTP请求内容的的缓冲区的大小
@@ -47,9 +57,18 @@ public:
     //返回最大可接受的请求体长度(如64M)，用于防止大流量攻击
     static uint64_t GetHttpRequestMaxBodySize();
 
+private:
+    size_t executeSimd(char* data, size_t len);
+
 private:
     //http_parser,负责实际解析
     http_parser m_parser;
+    //以下为simd解析使用
+    bool m_simd;
+    bool m_finished;
+    //上一次execute时的数据长度，请求头不完整时下次从这里往后找空行
+    size_t m_lastLen;
+    std::vector<HttpSimdHeader> m_simdHeaders;
     //HttpRequest结构，解析出来的最终结果
     HttpRequest::ptr m_data;
     //错误码
@@ -102,8 +121,8 @@ public:
     void setError(int v) {m_error = v;}
     //获取消息体长度，对应HTTP中的Content-length字段，常用于确定是否读完整个body
     uint64_t getContentLength();
-    //获取http_parser结构体
-    const http_parser& getParser() const {return m_parser;}
+    //获取httpclient_parser结构体
+    const httpclient_parser& getParser() const {return m_parser;}
 
 public:
     //返回用于存放HTTP响应内容的的缓冲区的大小
@@ -0,0 +1,263 @@
+#include "http_pipeline.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/trace.h"
+#include "sylar/util.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http_pipeline_max_depth =
+    sylar::Config::Lookup("http.client.pipeline.max_depth", (uint32_t)32
+                          , "max in-flight requests on a pipelined http connection");
+
+HttpPipelineConnection::ptr HttpPipelineConnection::Create(const std::string& url, uint64_t timeout_ms) {
+    Uri::ptr uri = Uri::Create(url);
+    if (!uri) {
+        SYLAR_LOG_ERROR(g_logger) << "invalid url: " << url;
+        return nullptr;
+    }
+    Address::ptr addr = uri->createAddress();
+    if (!addr) {
+        SYLAR_LOG_ERROR(g_logger) << "invalid host: " << uri->getHost();
+        return nullptr;
+    }
+    Socket::ptr sock = uri->getScheme() == "https" ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+    if (!sock) {
+        SYLAR_LOG_ERROR(g_logger) << "create sock fail: " << addr->toString();
+        return nullptr;
+    }
+    if (!sock->connect(addr, timeout_ms)) {
+        SYLAR_LOG_ERROR(g_logger) << "sock connect fail: " << addr->toString();
+        return nullptr;
+    }
+    sock->setRecvTimeout(timeout_ms);
+    return std::make_shared<HttpPipelineConnection>(std::make_shared<HttpConnection>(sock), uri->getHost());
+}
+
+HttpPipelineConnection::HttpPipelineConnection(HttpConnection::ptr conn, const std::string& host
+                                               ,IOManager* iom)
+    :m_conn(conn)
+    ,m_host(host)
+    ,m_iom(iom) {
+}
+
+HttpResult::ptr HttpPipelineConnection::doGet(const std::string& path, uint64_t timeout_ms
+                                              ,const std::map<std::string, std::string>& headers) {
+    HttpRequest::ptr req = std::make_shared<HttpRequest>();
+    size_t pos = path.find('?');
+    req->setPath(path.substr(0, pos));
+    if (pos != std::string::npos) {
+        req->setQuery(path.substr(pos + 1));
+    }
+    req->setMethod(HttpMethod::GET);
+    req->setClose(false);
+    for (auto& i : headers) {
+        req->setHeader(i.first, i.second);
+    }
+    if (!req->hasHeader("Host") && !m_host.empty()) {
+        req->setHeader("Host", m_host);
+    }
+    return request(req, timeout_ms);
+}
+
+HttpResult::ptr HttpPipelineConnection::request(HttpRequest::ptr req, uint64_t timeout_ms) {
+    if (req->getMethod() == HttpMethod::HEAD) {
+        return std::make_shared<HttpResult>((int)HttpResult::Error::NOT_PIPELINABLE
+                                            , nullptr, "HEAD request can not be pipelined");
+    }
+    if (!m_iom || !Scheduler::GetThis()) {
+        return std::make_shared<HttpResult>((int)HttpResult::Error::NOT_PIPELINABLE
+                                            , nullptr, "pipelined request must run in a fiber");
+    }
+    //流水线上的请求都不能要求关闭连接，否则后面的请求都会失败
+    req->setClose(false);
+    TraceSpan span("http", "pipeline ", m_host);
+    TraceContext* trace = Tracer::GetContext();
+    if (trace->valid() && !req->hasHeader("traceparent")) {
+        req->setHeader("traceparent", Tracer::FormatTraceParent(*trace));
+    }
+    std::stringstream ss;
+    ss << *req;
+
+    Ctx::ptr ctx = std::make_shared<Ctx>();
+    ctx->scheduler = Scheduler::GetThis();
+    ctx->fiber = Fiber::GetThis();
+
+    std::weak_ptr<HttpPipelineConnection> weak_self(shared_from_this());
+    std::weak_ptr<Ctx> weak_ctx(ctx);
+    uint64_t start_ms = sylar::GetCurrentMS();
+    uint64_t elapsed = 0;
+    MutexType::Lock lock(m_mutex);
+    while (!m_closed && m_pending.size() >= g_http_pipeline_max_depth->getValue()) {
+        elapsed = sylar::GetCurrentMS() - start_ms;
+        if (elapsed >= timeout_ms) {
+            return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                        , nullptr, "wait pipeline slot timeout, timeout_ms:" + std::to_string(timeout_ms));
+        }
+        m_senders.push_back(ctx);
+        //超时回调和wakeSender都在锁内从m_senders里摘掉ctx，只有一方会唤醒
+        Timer::ptr timer = m_iom->addTimer(timeout_ms - elapsed, [weak_self, weak_ctx](){
+            auto self = weak_self.lock();
+            auto c = weak_ctx.lock();
+            if (!self || !c) {
+                return;
+            }
+            MutexType::Lock lock(self->m_mutex);
+            auto it = std::find(self->m_senders.begin(), self->m_senders.end(), c);
+            if (it == self->m_senders.end()) {
+                return;
+            }
+            self->m_senders.erase(it);
+            c->scheduler->schedule(c->fiber);
+        });
+        lock.unlock();
+        Fiber::YieldToHold();
+        timer->cancel();
+        lock.lock();
+    }
+    if (m_closed) {
+        return std::make_shared<HttpResult>((int)HttpResult::Error::PIPELINE_CLOSED
+                                            , nullptr, "pipeline connection closed");
+    }
+    elapsed = sylar::GetCurrentMS() - start_ms;
+    //写入发送缓冲区和加入等待队列在同一个锁内，保证响应顺序和请求顺序一致
+    m_out.append(ss.str());
+    m_pending.push_back(ctx);
+    //发送和接收都放到单独的协程里，请求协程只在等待响应时让出一次
+    if (!m_writing) {
+        m_writing = true;
+        m_iom->schedule(std::bind(&HttpPipelineConnection::flush, shared_from_this()));
+    }
+    if (!m_reading) {
+        m_reading = true;
+        m_iom->schedule(std::bind(&HttpPipelineConnection::readLoop, shared_from_this()));
+    }
+    //等待发送名额的时间也算在timeout_ms里
+    uint64_t left_ms = elapsed < timeout_ms ? timeout_ms - elapsed : 0;
+    Timer::ptr timer = m_iom->addTimer(left_ms, [weak_self, weak_ctx, timeout_ms](){
+        auto self = weak_self.lock();
+        auto c = weak_ctx.lock();
+        if (!self || !c) {
+            return;
+        }
+        MutexType::Lock lock(self->m_mutex);
+        //超时的请求留在队列里，响应到达后丢弃
+        self->finish(c, std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                            , nullptr, "recv response timeout, timeout_ms:" + std::to_string(timeout_ms)));
+    });
+    lock.unlock();
+
+    Fiber::YieldToHold();
+    timer->cancel();
+    return ctx->result;
+}
+
+void HttpPipelineConnection::flush() {
+    MutexType::Lock lock(m_mutex);
+    while (!m_out.empty() && !m_closed) {
+        std::string out;
+        out.swap(m_out);
+        lock.unlock();
+        bool ok = m_conn->writeFixSize(out.data(), out.size()) > 0;
+        lock.lock();
+        if (!ok) {
+            closeLocked((int)HttpResult::Error::SEND_SOCKET_ERROR, "send request fail");
+            break;
+        }
+    }
+    m_writing = false;
+}
+
+void HttpPipelineConnection::readLoop() {
+    while (true) {
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_pending.empty() || m_closed) {
+                m_reading = false;
+                return;
+            }
+        }
+        //只有这个协程读连接
+        HttpResponse::ptr rsp = m_conn->recvResponse();
+        MutexType::Lock lock(m_mutex);
+        if (!rsp) {
+            closeLocked((int)HttpResult::Error::PIPELINE_CLOSED, "recv response fail");
+            m_reading = false;
+            return;
+        }
+        if (m_pending.empty()) {
+            //close()之后才收到的响应
+            m_reading = false;
+            return;
+        }
+        Ctx::ptr ctx = m_pending.front();
+        m_pending.pop_front();
+        finish(ctx, std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok"));
+        wakeSender();
+        if (rsp->isClose()) {
+            closeLocked((int)HttpResult::Error::PIPELINE_CLOSED, "connection closed by peer");
+            m_reading = false;
+            return;
+        }
+    }
+}
+
+void HttpPipelineConnection::finish(Ctx::ptr ctx, HttpResult::ptr result) {
+    if (ctx->done) {
+        return;
+    }
+    ctx->done = true;
+    ctx->result = result;
+    ctx->scheduler->schedule(ctx->fiber);
+}
+
+void HttpPipelineConnection::wakeSender() {
+    if (m_senders.empty()) {
+        return;
+    }
+    Ctx::ptr sender = m_senders.front();
+    m_senders.pop_front();
+    sender->scheduler->schedule(sender->fiber);
+}
+
+void HttpPipelineConnection::closeLocked(int result, const std::string& error) {
+    if (!m_closed) {
+        m_closed = true;
+        SYLAR_LOG_DEBUG(g_logger) << "pipeline connection closed: " << error
+            << " pending=" << m_pending.size();
+        m_conn->close();
+    }
+    for (auto& i : m_pending) {
+        finish(i, std::make_shared<HttpResult>(result, nullptr, error));
+    }
+    m_pending.clear();
+    m_out.clear();
+    for (auto& i : m_senders) {
+        i->scheduler->schedule(i->fiber);
+    }
+    m_senders.clear();
+}
+
+void HttpPipelineConnection::close() {
+    MutexType::Lock lock(m_mutex);
+    closeLocked((int)HttpResult::Error::PIPELINE_CLOSED, "pipeline connection closed");
+}
+
+bool HttpPipelineConnection::isAlive() {
+    MutexType::Lock lock(m_mutex);
+    return !m_closed && m_conn->isConnected();
+}
+
+size_t HttpPipelineConnection::getPending() {
+    MutexType::Lock lock(m_mutex);
+    return m_pending.size();
+}
+
+}
+}
@@ -0,0 +1,105 @@
+/**
+ * @file http_pipeline.h
+ * @brief HTTP/1.1客户端流水线连接
+ * @date 2025-07-20
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// HttpConnection一次只能有一个请求在路上，扇出调用时一个并发请求就要占一个连接
+// HttpPipelineConnection让多个协程在同一个连接上连续发送请求，不等前一个响应回来：
+//   请求按调用顺序写进发送缓冲区，由一个写协程合并发送
+//   服务端按请求顺序返回响应，读协程按先进先出把响应交给对应的请求
+//   某个请求超时只唤醒它自己，它的响应到达后丢弃，不影响后面的请求
+//   读写出错或者对端要求关闭连接时，所有还没收到响应的请求都返回PIPELINE_CLOSED，连接不再可用
+// 前面的慢响应会阻塞后面的响应(队头阻塞)，只适合幂等、响应快的内部调用；非幂等请求失败后无法判断服务端是否执行过
+
+#ifndef __SYLAR_HTTP_PIPELINE_H__
+#define __SYLAR_HTTP_PIPELINE_H__
+
+#include "http_connection.h"
+#include "sylar/iomanager.h"
+
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+
+namespace sylar {
+namespace http {
+
+class HttpPipelineConnection : public std::enable_shared_from_this<HttpPipelineConnection> {
+public:
+    typedef std::shared_ptr<HttpPipelineConnection> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 连接到url的host，需要在IOManager中调用
+     * @param[in] url 如http://127.0.0.1:8080，只用到scheme、host和port
+     * @param[in] timeout_ms 连接超时，同时作为读取响应的超时
+     * @return 连接失败返回nullptr
+     */
+    static ptr Create(const std::string& url, uint64_t timeout_ms);
+
+    //conn为已经连接好的连接，之后不能再直接用它收发；读写协程在iom上运行
+    HttpPipelineConnection(HttpConnection::ptr conn, const std::string& host = ""
+                           ,IOManager* iom = IOManager::GetThis());
+
+    /**
+     * @brief 发送请求并等待对应的响应，多个协程可以同时调用
+     * @details 已经发出还没收到响应的请求数达到http.client.pipeline.max_depth时先等待，
+     *          等待名额和等待响应共用timeout_ms，超时返回TIMEOUT
+     */
+    HttpResult::ptr request(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    //path可以带query，没有Host头时用Create时的host
+    HttpResult::ptr doGet(const std::string& path, uint64_t timeout_ms
+                          ,const std::map<std::string, std::string>& headers = {});
+
+    //关闭连接，还没收到响应的请求返回PIPELINE_CLOSED
+    void close();
+    bool isAlive();
+    //已经发送还没收到响应的请求数
+    size_t getPending();
+
+private:
+    //一个等待响应的请求
+    struct Ctx {
+        typedef std::shared_ptr<Ctx> ptr;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        HttpResult::ptr result;
+        //已经有结果(收到响应、超时或者连接关闭)，只唤醒一次
+        bool done = false;
+    };
+
+    //写协程：发送m_out直到为空
+    void flush();
+    //读协程：按顺序接收响应直到没有等待的请求
+    void readLoop();
+    //设置结果并唤醒请求的协程，调用方持有锁
+    void finish(Ctx::ptr ctx, HttpResult::ptr result);
+    //关闭连接并让所有等待的请求失败，调用方持有锁
+    void closeLocked(int result, const std::string& error);
+    //唤醒一个等待发送的协程，调用方持有锁
+    void wakeSender();
+
+private:
+    HttpConnection::ptr m_conn;
+    std::string m_host;
+    IOManager* m_iom;
+    MutexType m_mutex;
+    //待发送的数据
+    std::string m_out;
+    //已经发送(或在m_out中)等待响应的请求，顺序和发送顺序一致
+    std::deque<Ctx::ptr> m_pending;
+    //流水线满了等待发送的请求
+    std::list<Ctx::ptr> m_senders;
+    bool m_writing = false;
+    bool m_reading = false;
+    bool m_closed = false;
+};
+
+}
+}
+
+#endif
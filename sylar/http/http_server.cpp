@@ -1,13 +1,64 @@
 #include <memory>
+#include <string.h>
+#include <algorithm>
 
 #include "http_server.h"
+#include "http_compress.h"
 #include "sylar/log.h"
-#include "sylar/http/servlets/config_servlet.h"
-#include "sylar/http/servlets/status_servlet.h"
+#include "sylar/config.h"
+#include "sylar/http2/http2_session.h"
+#include "sylar/http/servlet/config_servlet.h"
+#include "sylar/http/servlet/metrics_servlet.h"
+#include "sylar/http/servlet/pprof_servlet.h"
+#include "sylar/http/servlet/trace_servlet.h"
+#include "sylar/http/servlet/status_servlet.h"
 
 namespace sylar {
 namespace http {
 
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<bool>::ptr g_http2_enable =
+    sylar::Config::Lookup("http2.enable", true
+            , "enable http2 (tls alpn h2, plaintext prior knowledge and upgrade h2c)");
+
+//CPU采样会占用整个进程的SIGPROF，堆采样会暴露调用栈和符号，trace会暴露请求路径和耗时，
+//默认不注册，只在内网调试时打开
+static sylar::ConfigVar<bool>::ptr g_http_pprof_enable =
+    sylar::Config::Lookup("http.pprof.enable", false
+            , "register /_/trace, /_/pprof/profile and /_/pprof/heap on every HttpServer");
+
+//明文连接开头是否是HTTP/2的连接前言，前言的前缀一直匹配时继续读
+//返回1是，0不是(读到的数据留在缓冲区给HTTP/1.1解析)，-1连接关闭
+static int CheckHttp2Preface(HttpSession::ptr session) {
+    HttpReadBuffer::ptr buffer = session->getReadBuffer();
+    do {
+        size_t n = std::min(buffer->size(), sylar::http2::CONNECTION_PREFACE_LEN);
+        if (memcmp(buffer->data(), sylar::http2::CONNECTION_PREFACE, n) != 0) {
+            return 0;
+        }
+        if (n == sylar::http2::CONNECTION_PREFACE_LEN) {
+            return 1;
+        }
+        if (buffer->fill(session.get()) <= 0) {
+            return -1;
+        }
+    } while (true);
+}
+
+//Upgrade: h2c，并且带了HTTP2-Settings(RFC 7540 3.2)
+static bool IsH2cUpgrade(HttpRequest::ptr req) {
+    if (req->getVersion() != 0x11 || req->getBodyReader()) {
+        return false;
+    }
+    std::string upgrade = req->getHeader("upgrade");
+    if (upgrade.empty() || strcasestr(upgrade.c_str(), "h2c") == nullptr) {
+        return false;
+    }
+    std::string settings;
+    return req->checkGetHeaderAs("http2-settings", settings);
+}
+
 HttpServer::HttpServer(bool keepalive
                         ,sylar::IOManager* worker
                         ,sylar::IOManager* io_worker
@@ -19,10 +70,27 @@ HttpServer::HttpServer(bool keepalive
     //将/_/status路径映射到一个StatusServlet实例，当用户访问/_/status时，就会调用StatusServlet::handle()
     m_dispatch->addServlet("/_/status", Servlet::ptr(new StatusServlet));
     m_dispatch->addServlet("/_/config", Servlet::ptr(new ConfigServlet));
+    m_dispatch->addServlet("/_/metrics", Servlet::ptr(new MetricsServlet));
+    if (g_http_pprof_enable->getValue()) {
+        m_dispatch->addServlet("/_/trace", Servlet::ptr(new TraceServlet));
+        m_dispatch->addServlet("/_/pprof/profile", Servlet::ptr(new CpuProfileServlet));
+        m_dispatch->addServlet("/_/pprof/heap", Servlet::ptr(new HeapProfileServlet));
+    }
+    m_dispatch->addFilter(std::make_shared<TraceFilter>());
+    m_metricsFilter = std::make_shared<MetricsFilter>(getName());
+    m_dispatch->addFilter(m_metricsFilter);
+    //先按规则限流，通过的请求再受并发上限约束，没有配置时都直接放行
+    m_dispatch->addFilter(std::make_shared<RateLimitFilter>());
+    m_dispatch->addFilter(std::make_shared<ConcurrencyLimitFilter>());
+    if (g_http2_enable->getValue()) {
+        //TLS握手时优先选择h2，客户端不支持时回落到http/1.1
+        setAlpnProtocols({"h2", "http/1.1"});
+    }
 }
 
 void HttpServer::setName(const std::string& v) {
     TcpServer::setName(v);
+    m_metricsFilter->setServer(v);
     //设置默认的Servlet，如果用户访问的URL没有任何匹配的Servlet路径，就会调用这个默认处理器来响应
     //这里创建的是一个404处理器
     m_dispatch->setDefault(std::make_shared<NotFoundServlet>(v));
@@ -31,28 +99,102 @@ void HttpServer::setName(const std::string& v) {
 //接收请求->分发处理->发送响应
 //这里传入的socket是服务端接受客户端连接后返回的套接字，即accept返回的
 void HttpServer::handleClient(Socket::ptr client) {
-    SYLAR_LOG_DEBUG(g_logger) << "handleClient" << *Client;
-    HttpSession session(new HttpSession(client));
+    SYLAR_LOG_DEBUG(g_logger) << "handleClient" << *client;
+    bool http2 = g_http2_enable->getValue();
+    SSLSocket::ptr ssl_sock = std::dynamic_pointer_cast<SSLSocket>(client);
+    if (http2 && ssl_sock && ssl_sock->getAlpnProtocol() == "h2") {
+        handleHttp2(client, nullptr, nullptr);
+        return;
+    }
+    //明文连接在第一个请求之前检查h2c prior knowledge
+    bool check_preface = http2 && !ssl_sock;
+    HttpSession::ptr session(new HttpSession(client));
+    session->setServerName(getName());
     do {
+        //等待下一个请求期间连接是空闲的，drain时可以直接关闭
+        if (!setClientIdle(client, true)) {
+            break;
+        }
+        if (check_preface) {
+            check_preface = false;
+            int rt = CheckHttp2Preface(session);
+            if (rt != 0) {
+                setClientIdle(client, false);
+                if (rt > 0) {
+                    handleHttp2(client, session, nullptr);
+                    return;
+                }
+                break;
+            }
+        }
         auto req = session->recvRequest();
+        setClientIdle(client, false);
         if (!req) {
             break;
         }
+        if (http2 && !ssl_sock && IsH2cUpgrade(req)) {
+            handleHttp2(client, session, req);
+            return;
+        }
+        //drain时处理完当前请求就关闭连接，响应里带上Connection: close通知客户端
+        bool close = req->isClose() || !m_isKeepalive || isDraining();
         //req->isClose()用于判断客户端在一次请求中有没有说：处理完我就关闭连接吧
         //背后是HTTP协议中的Connect字段
         //Connect：close表明客户端请求服务器在响应后关闭连接
         //Connect：keep-alive客户端希望和服务器保持长连接
-        HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), req->isClose() || !m_isKeepalive));
-        rsp->setHeader("Server", getName());
+        HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), close));
         m_dispatch->handle(req, rsp, session);
-        session->sendResponse(rsp);
-        if (!m_isKeepalive || req->isClose()) {
+        //servlet调用了startResponse时响应头已经发出，这里只需要结束消息体
+        HttpBodyWriter::ptr writer = session->getBodyWriter();
+        if (writer) {
+            if (writer->finish() < 0) {
+                break;
+            }
+        } else {
+            //按Accept-Encoding压缩消息体
+            HttpCompress::CompressResponse(req, rsp);
+            session->sendResponse(rsp);
+        }
+        if (close || rsp->isClose()) {
             break;
         }
     } while (true);
     session->close();
 }
 
+void HttpServer::handleHttp2(Socket::ptr client, HttpSession::ptr session, HttpRequest::ptr upgrade_req) {
+    sylar::http2::Http2Session::ptr h2(new sylar::http2::Http2Session(client, m_dispatch));
+    h2->setServerName(getName());
+    h2->setIdleCallback([this, client](bool idle) {
+        return setClientIdle(client, idle);
+    });
+    if (upgrade_req) {
+        //消息体可能是HttpSession读缓冲区上的视图，流1在其他协程处理，先拷贝出来
+        upgrade_req->getBody();
+        if (!h2->upgrade(upgrade_req->getHeader("http2-settings"), upgrade_req)) {
+            session->close();
+            return;
+        }
+        static const char s_switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                                          "Connection: Upgrade\r\n"
+                                          "Upgrade: h2c\r\n\r\n";
+        if (session->writeFixSize(s_switching, sizeof(s_switching) - 1) <= 0) {
+            session->close();
+            return;
+        }
+    }
+    if (session) {
+        HttpReadBuffer::ptr buffer = session->getReadBuffer();
+        if (!h2->appendInput(buffer->data(), buffer->size())) {
+            SYLAR_LOG_WARN(g_logger) << "too many pending bytes to switch to http2 " << *client;
+            session->close();
+            return;
+        }
+        buffer->consume(buffer->size());
+    }
+    h2->start();
+}
+
 
 }
 }
@@ -37,13 +37,20 @@ public:
     //客户端处理函数，当有客户端连接时，这个方法会被调用
     virtual void handleClient(Socket::ptr client) override;
 
+private:
+    //切换到HTTP/2处理这个连接，直到连接关闭
+    //session不为空时，把它的读缓冲区里剩下的数据转给HTTP/2
+    //upgrade_req不为空时为h2c升级，已经回复了101，请求作为流1处理
+    void handleHttp2(Socket::ptr client, HttpSession::ptr session, HttpRequest::ptr upgrade_req);
+
 private:
     //标识HTTP是否启用长连接
     bool m_isKeepalive;
     //是一个Servlet管理器(调度器)，负责URL到处理器的映射
     //这里的映射指的是根据HTTP请求路径URL选择并调用对应的Servlet(请求处理器)来处理请求
     ServletDispatch::ptr m_dispatch;
-
+    //请求数和耗时统计，改名时更新标签
+    MetricsFilter::ptr m_metricsFilter;
 };
 
 
@@ -1,87 +1,178 @@
 #include <string>
+#include <string.h>
 #include "http_session.h"
 #include "http_parser.h"
+#include "http_compress.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
 
 namespace sylar {
 namespace http {
 
-HttpSession::HttpSession(Socket::ptr sock, bool owner = true) :SocketStream(sock, owner) {
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_request_stream_body_size =
+                            sylar::Config::Lookup("http.request.stream_body_size",
+                                                (uint64_t)(1024 * 1024),
+                                                "http request body larger than this is streamed to servlet");
+
+HttpSession::HttpSession(Socket::ptr sock, bool owner)
+    :SocketStream(sock, owner) {
     m_socket = sock;
     m_owner = owner;
+    m_parser.reset(new HttpRequestParser);
+    m_buffer.reset(new HttpReadBuffer(HttpRequestParser::GetHttpRequestBufferSize()));
 }
 
 HttpRequest::ptr HttpSession::recvRequest() {
-    //该函数的整体流程就是先在socket缓冲区读取完整的HTTP请求数据(包括请求头和请求体)
-    //然后将其解析为一个结构化的HttpRequest对象返回。
+    //该函数的整体流程就是先在socket缓冲区读取完整的HTTP请求头，解析为一个结构化的HttpRequest对象返回
+    //小的消息体一起读进来，大的消息体和chunked消息体交给HttpBodyReader由servlet自己读
+    //parser和缓冲区在连接上复用，上一次多读的数据(pipelining的下一个请求)保留在缓冲区里
 
-    HttpRequestParser::ptr parser(new HttpRequestParser);
-    //获取初始读取缓冲区大小
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    std::shared_ptr<char> buffer(new char[buff_size], [](char* ptr){
-                                    delete[] ptr;
-                                });
-    //获取裸指针用于操作数据
-    char* data = buffer.get();
-    //记录已经读入，但未解析的缓冲区位置
-    int offset = 0;
-    do {
-        int len = read(data + offset, buff_size - offset);
-        if (len <= 0) {
+    m_writer = nullptr;
+    if (m_lastRequest) {
+        //上一个请求的消息体servlet没有读完，丢弃剩下的部分才能读到下一个请求
+        HttpBodyReader::ptr reader = m_lastRequest->getBodyReader();
+        if (reader && !reader->isDone() && reader->discard() < 0) {
+            m_lastRequest = nullptr;
             close();
             return nullptr;
         }
-        len += offset;
-        //nparse是解析了多少字节
-        size_t nparse = parser->execute(data, len);
-        if (parser->hasError()) {
-            close();
-            return nullptr;
+        //上一个请求的消息体视图还指向缓冲区，如果请求还被别人持有，先拷贝出来再覆盖缓冲区
+        if (m_lastRequest.use_count() > 1 && m_lastRequest->isBodyView()) {
+            m_lastRequest->getBody();
         }
-        //将offset设置为未解析部分的字节数
-        offset = len - nparse;
-        if (offset == (int)buff_size) {
+        m_lastRequest = nullptr;
+    }
+    m_buffer->compact();
+
+    m_parser->reset();
+    //缓冲区里有剩余数据时先解析剩余的，不够再读
+    bool need_read = (m_buffer->size() == 0);
+    do {
+        if (need_read) {
+            //请求头把缓冲区占满了还没解析完时fill返回-1
+            if (m_buffer->fill(this) <= 0) {
+                close();
+                return nullptr;
+            }
+        }
+        need_read = true;
+        //nparse是解析了多少字节，execute会把未解析的部分移到data()头部
+        size_t nparse = m_parser->execute(m_buffer->data(), m_buffer->size());
+        if (m_parser->hasError()) {
             close();
             return nullptr;
         }
-        if (parser->isFinshed()) {
+        m_buffer->resize(m_buffer->size() - nparse);
+        if (m_parser->isFinshed()) {
             break;
         }
     } while(true);
 
-
-    
-    //获取请求体长度
-    int64_t length = parser->getContentLength();
-    if (length > 0) {
-        std::string body;
-        body.resize(length);
-        int len = 0;
-        if (length >= offset) { //否则只拷贝offset，剩下的后面再读
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else { //如果offset已经覆盖了body的长度，就拷贝body
-            memcpy(&body[0], data, length);
-            len = length;
+    HttpRequest::ptr req = m_parser->getData();
+    req->setRemoteAddress(m_socket->getRemoteAddress());
+    //大部分请求没有Transfer-Encoding，按Id查找不构造字符串
+    StringView te = req->getHeaderView(HttpHeaders::TRANSFER_ENCODING);
+    if (!te.empty() && IsChunked(te.str())) {
+        //chunked不知道总长度，总是流式读取
+        req->setBodyReader(std::make_shared<HttpBodyReader>(this, m_buffer, HttpBodyReader::CHUNKED));
+    } else {
+        //获取请求体长度
+        uint64_t length = m_parser->getContentLength();
+        if (length > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+            close();
+            return nullptr;
         }
-        length -= offset;
-        if (length > 0) {
-            if (readFixSize(&body[len], length) <= 0) {
-                close();
-                return nullptr;
+        if (length > 0 && length <= m_buffer->size()) {
+            //消息体已经完整在缓冲区里，不拷贝，直接引用
+            req->setBodyView(m_buffer->data(), length);
+            m_buffer->consume(length);
+        } else if (length > 0) {
+            HttpBodyReader::ptr reader = std::make_shared<HttpBodyReader>(this, m_buffer
+                                                    , HttpBodyReader::LENGTH, length);
+            if (length > g_http_request_stream_body_size->getValue()) {
+                req->setBodyReader(reader);
+            } else {
+                //不大的消息体直接读完，读缓冲区里的部分拷贝，剩下的直接读进body
+                std::string body;
+                if (reader->readAll(body, length) < 0) {
+                    close();
+                    return nullptr;
+                }
+                req->setBody(body);
             }
         }
-        parser->getData()->setBody(body);
     }
-    parser->getData()->init();
-    return parser->getData();
+    req->init();
+    m_lastRequest = req;
+    return req;
 }
 
-int HttpSession::sendResponse(HttpResponse::ptr rsp) {
-    std::stringstream ss;
-    ss << *rsp;
-    std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+HttpBodyWriter::ptr HttpSession::startResponse(HttpResponse::ptr rsp) {
+    if (m_writer) {
+        SYLAR_LOG_ERROR(g_logger) << "HttpSession::startResponse response already started";
+        return nullptr;
+    }
+    bool chunked = false;
+    if (rsp->getHeaderView(HttpHeaders::CONTENT_LENGTH).empty()) {
+        if (rsp->getVersion() >= 0x11) {
+            rsp->setHeader("Transfer-Encoding", "chunked");
+            chunked = true;
+        } else {
+            //HTTP/1.0没有chunked，只能用关闭连接表示消息体结束
+            rsp->setClose(true);
+        }
+    }
+    rsp->setBody("");
+    rsp->setFileBody(nullptr);
+    //不知道总长度时才能压缩，Content-Length已经确定的按原样发送
+    ZlibStream::ptr encoder;
+    if (m_lastRequest && rsp->getHeaderView(HttpHeaders::CONTENT_LENGTH).empty()) {
+        encoder = HttpCompress::CreateEncoder(m_lastRequest, rsp);
+    }
+    m_writeBuffer.clear();
+    rsp->serializeHeader(m_writeBuffer, m_serverLine);
+    iovec iov;
+    iov.iov_base = (void*)m_writeBuffer.data();
+    iov.iov_len = m_writeBuffer.size();
+    if (HttpBodyWriter::SendIov(m_socket, &iov, 1) <= 0) {
+        return nullptr;
+    }
+    m_writer = std::make_shared<HttpBodyWriter>(m_socket, chunked);
+    m_writer->setEncoder(encoder);
+    return m_writer;
 }
 
+void HttpSession::setServerName(const std::string& v) {
+    m_serverLine = v.empty() ? "" : "Server: " + v + "\r\n";
+}
+
+int64_t HttpSession::sendResponse(HttpResponse::ptr rsp) {
+    m_writeBuffer.clear();
+    rsp->serializeHeader(m_writeBuffer, m_serverLine);
+    const std::string& body = rsp->getBody();
+    iovec iovs[2];
+    iovs[0].iov_base = (void*)m_writeBuffer.data();
+    iovs[0].iov_len = m_writeBuffer.size();
+    iovs[1].iov_base = (void*)body.data();
+    iovs[1].iov_len = body.size();
+    //文件消息体在头部发完之后用sendfile单独发送
+    HttpFileBody::ptr file = rsp->getFileBody();
+    int count = (body.empty() || file) ? 1 : 2;
+    int64_t total = HttpBodyWriter::SendIov(m_socket, iovs, count);
+    if (total <= 0) {
+        return total;
+    }
+    if (file && file->getLength()) {
+        int64_t rt = m_socket->sendFile(file->getFd(), file->getOffset(), file->getLength());
+        if (rt != (int64_t)file->getLength()) {
+            return rt < 0 ? rt : -1;
+        }
+        total += rt;
+    }
+    return total;
+}
+
+}
 }
-}
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include "sylar/streams/socket_stream.h"
 #include "socket.h"
 #include "http.h"
+#include "http_parser.h"
+#include "http_body.h"
 
 namespace sylar {
 namespace http {
@@ -25,12 +27,49 @@ public:
     HttpSession(Socket::ptr sock, bool owner = true);
 
     //接收Http请求，并从接收的TCP流中解析成HttpRequest
+    //parser和读缓冲区在整个连接上复用，读多了的数据留给下一个请求，支持HTTP/1.1 pipelining
+    //消息体完整落在读缓冲区内时，请求的消息体是缓冲区上的视图(HttpRequest::isBodyView)，
+    //只在下一次recvRequest之前有效；如果上一个请求还被其他地方持有，会先把它的消息体拷贝出来
+    //chunked或者Content-Length超过http.request.stream_body_size的请求不读消息体，
+    //由servlet通过HttpRequest::getBodyReader增量读取；servlet没有读完的部分在下一次recvRequest时丢弃
     HttpRequest::ptr recvRequest();
     //将HttpResponse序列化，并通过socket发送出去
-    int sendResponse(HttpResponse::ptr rsp);
+    //头部写入连接上复用的缓冲区，和消息体一起用一次writev发出，消息体不拷贝
+    //返回发送的总字节数(文件消息体可能超过2GB)，<=0表示失败
+    int64_t sendResponse(HttpResponse::ptr rsp);
+
+    //流式响应：立即发出响应头，返回消息体写入器，之后由servlet边生成边写
+    //响应中没有设置Content-Length时，HTTP/1.1使用chunked编码，HTTP/1.0写完后关闭连接，
+    //并且按请求的Accept-Encoding边写边压缩(HttpCompress)
+    //调用后HttpServer不再sendResponse，只负责调用writer的finish，失败返回nullptr
+    HttpBodyWriter::ptr startResponse(HttpResponse::ptr rsp);
+    //当前请求的流式响应写入器，没有调用startResponse时为nullptr
+    HttpBodyWriter::ptr getBodyWriter() const { return m_writer;}
+
+    //设置响应默认的Server头，连接建立时设置一次，响应中自己设置了Server头时不使用
+    void setServerName(const std::string& v);
+
+    //读缓冲区中已经收到、还没有解析的字节数(后续pipelining的请求)
+    size_t getPendingSize() const { return m_buffer->size();}
+    //连接上的读缓冲区，切换到HTTP/2时把里面剩下的数据交给Http2Session
+    HttpReadBuffer::ptr getReadBuffer() const { return m_buffer;}
+
+private:
+    //请求解析器，每个请求前reset
+    HttpRequestParser::ptr m_parser;
+    //读缓冲区，大小为http.request.buffer_size，流式读取消息体的HttpBodyReader共用
+    HttpReadBuffer::ptr m_buffer;
+    //上一个请求，消息体可能引用着读缓冲区，或者还没有读完
+    HttpRequest::ptr m_lastRequest;
+    //响应头部的写缓冲区，连接上复用
+    std::string m_writeBuffer;
+    //拼好的"Server: xxx\r\n"
+    std::string m_serverLine;
+    //当前请求的流式响应
+    HttpBodyWriter::ptr m_writer;
 };
 
 }
 }
 
-#endif __SYLAR_HTTP_SESSION_H__
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "http_simd_parser.h"
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define SYLAR_HTTP_SIMD_X86 1
+#endif
+
+namespace sylar {
+namespace http {
+
+namespace {
+
+//查表用的字符分类
+struct CharTables {
+    //方法和头部名允许的字符(RFC 7230 tchar)
+    bool token[256];
+    //请求目标中遇到就停止的字符：空白和控制字符
+    bool targetStop[256];
+    //头部值中遇到就停止的字符：除\t以外的控制字符
+    bool valueStop[256];
+
+    CharTables() {
+        for (int c = 0; c < 256; ++c) {
+            token[c] = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+                       || (c >= 'A' && c <= 'Z') || (c && strchr("!#$%&'*+-.^_`|~", c));
+            targetStop[c] = c <= 0x20 || c == 0x7f;
+            valueStop[c] = (c < 0x20 && c != '\t') || c == 0x7f;
+        }
+    }
+};
+
+static const CharTables s_tables;
+
+//pcmpestri的范围表，每两个字节是一个闭区间，要能读16个字节
+alignas(16) static const char s_target_ranges[16] = "\x00\x20\x7f\x7f";
+alignas(16) static const char s_value_ranges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+
+#ifdef SYLAR_HTTP_SIMD_X86
+static const bool s_sse42 = []() {
+    //静态初始化阶段调用需要先初始化CPU信息
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") != 0;
+}();
+
+//每次检查16个字节，返回第一个落在ranges里的字符，剩下不足16字节时返回剩余部分的开头
+__attribute__((target("sse4.2")))
+static const char* FindRangesSSE42(const char* p, const char* end, const char* ranges, int ranges_len) {
+    __m128i r = _mm_load_si128((const __m128i*)ranges);
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(r, ranges_len, b, 16,
+                               _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+        if (idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return p;
+}
+#else
+static const bool s_sse42 = false;
+#endif
+
+static inline const char* FindStop(const char* p, const char* end, const char* ranges,
+                                   int ranges_len, const bool* stop) {
+#ifdef SYLAR_HTTP_SIMD_X86
+    if (s_sse42) {
+        p = FindRangesSSE42(p, end, ranges, ranges_len);
+    }
+#endif
+    while (p < end && !stop[(uint8_t)*p]) {
+        ++p;
+    }
+    return p;
+}
+
+static inline const char* SkipToken(const char* p, const char* end) {
+    while (p < end && s_tables.token[(uint8_t)*p]) {
+        ++p;
+    }
+    return p;
+}
+
+//请求头是否已经完整(出现了空行)，从上次检查过的位置往后找
+static bool HasHeadEnd(const char* buf, size_t len, size_t last_len) {
+    size_t pos = last_len >= 3 ? last_len - 3 : 0;
+    while (pos < len) {
+        const char* nl = (const char*)memchr(buf + pos, '\n', len - pos);
+        if (!nl) {
+            return false;
+        }
+        size_t i = nl - buf;
+        if (i + 1 < len && buf[i + 1] == '\n') {
+            return true;
+        }
+        if (i + 2 < len && buf[i + 1] == '\r' && buf[i + 2] == '\n') {
+            return true;
+        }
+        pos = i + 1;
+    }
+    return false;
+}
+
+//行尾可以是\r\n或者\n，返回0成功
+static inline int ParseEol(const char*& p, const char* end) {
+    if (p == end) {
+        return -2;
+    }
+    if (*p == '\r') {
+        if (end - p < 2) {
+            return -2;
+        }
+        if (p[1] != '\n') {
+            return -1;
+        }
+        p += 2;
+        return 0;
+    }
+    if (*p == '\n') {
+        ++p;
+        return 0;
+    }
+    return -1;
+}
+
+}
+
+bool HttpSimdParserAccelerated() {
+    return s_sse42;
+}
+
+int ParseHttpRequestHead(const char* buf, size_t len, HttpSimdRequest& req, size_t last_len) {
+    size_t max_headers = req.numHeaders;
+    req.numHeaders = 0;
+    if (!HasHeadEnd(buf, len, last_len)) {
+        return -2;
+    }
+    const char* p = buf;
+    const char* end = buf + len;
+    //请求行之前的空行忽略(RFC 7230 3.5)
+    while (p < end && (*p == '\r' || *p == '\n')) {
+        ++p;
+    }
+
+    //请求行：method SP target SP HTTP/1.x CRLF
+    const char* start = p;
+    p = SkipToken(p, end);
+    if (p == end) {
+        return -2;
+    }
+    if (p == start || *p != ' ') {
+        return -1;
+    }
+    req.method = StringView(start, p - start);
+    start = ++p;
+    p = FindStop(p, end, s_target_ranges, 4, s_tables.targetStop);
+    if (p == end) {
+        return -2;
+    }
+    if (p == start || *p != ' ') {
+        return -1;
+    }
+    req.target = StringView(start, p - start);
+    ++p;
+    if (end - p < 8) {
+        return -2;
+    }
+    if (memcmp(p, "HTTP/1.", 7) != 0 || p[7] < '0' || p[7] > '9') {
+        return -1;
+    }
+    req.minorVersion = p[7] - '0';
+    p += 8;
+    int rt = ParseEol(p, end);
+    if (rt) {
+        return rt;
+    }
+
+    //请求头：name ":" OWS value OWS CRLF，空行结束
+    while (true) {
+        if (p == end) {
+            return -2;
+        }
+        if (*p == '\r' || *p == '\n') {
+            rt = ParseEol(p, end);
+            if (rt) {
+                return rt;
+            }
+            break;
+        }
+        if (req.numHeaders == max_headers) {
+            return -1;
+        }
+        //头部名后不能有空白，行首是空白的折行(obs-fold)也不接受
+        start = p;
+        p = SkipToken(p, end);
+        if (p == end) {
+            return -2;
+        }
+        if (p == start || *p != ':') {
+            return -1;
+        }
+        StringView name(start, p - start);
+        ++p;
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        start = p;
+        p = FindStop(p, end, s_value_ranges, 6, s_tables.valueStop);
+        const char* value_end = p;
+        rt = ParseEol(p, end);
+        if (rt) {
+            return rt;
+        }
+        while (value_end > start && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            --value_end;
+        }
+        HttpSimdHeader& h = req.headers[req.numHeaders++];
+        h.name = name;
+        h.value = StringView(start, value_end - start);
+    }
+    return p - buf;
+}
+
+}
+}
@@ -0,0 +1,58 @@
+/**
+ * @file http_simd_parser.h
+ * @brief 用SSE4.2查找分隔符的HTTP/1.x请求头解析
+ * @date 2025-07-19
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// Ragel生成的http11_parser逐字节走状态机，回调时把每个字段拷贝成std::string
+// 这里是另一种实现(思路和picohttpparser相同)：
+//   不保存中间状态，每次收到数据都从请求行开始解析，请求头不完整时返回-2，由调用方读到更多数据后重新解析；
+//   为了避免对不完整的请求头反复做完整解析，先从上次检查到的位置往后找空行，找到了才解析
+//   请求目标和头部值用SSE4.2的pcmpestri一次检查16个字节，找出第一个不允许出现的字符
+//   (运行时检测CPU，不支持时退回查表)，方法和头部名较短，直接查表
+//   解析结果是指向输入缓冲区的视图，不拷贝
+// 由HttpRequestParser在配置http.request.parser为simd时使用
+
+#ifndef __SYLAR_HTTP_SIMD_PARSER_H__
+#define __SYLAR_HTTP_SIMD_PARSER_H__
+
+#include <stddef.h>
+#include "sylar/util/string_view.h"
+
+namespace sylar {
+namespace http {
+
+struct HttpSimdHeader {
+    StringView name;
+    StringView value;
+};
+
+struct HttpSimdRequest {
+    StringView method;
+    //请求行中的目标，如/search?q=1#top
+    StringView target;
+    //HTTP/1.x中的x
+    int minorVersion = -1;
+    //headers由调用方提供，numHeaders为数组大小，解析后为头部个数
+    HttpSimdHeader* headers = nullptr;
+    size_t numHeaders = 0;
+};
+
+/**
+ * @brief 解析请求行和请求头
+ * @param[in] buf 数据
+ * @param[in] len 数据长度
+ * @param[in,out] req 解析结果，视图指向buf
+ * @param[in] last_len 上一次调用时的len(这次是在同一块数据后面追加了数据)，第一次为0
+ * @return >0 请求头(包括结尾空行)的长度，-1 格式错误或者头部个数超过req.numHeaders，-2 请求头不完整
+ */
+int ParseHttpRequestHead(const char* buf, size_t len, HttpSimdRequest& req, size_t last_len = 0);
+
+//当前CPU是否支持SSE4.2(不支持时ParseHttpRequestHead逐字节查表)
+bool HttpSimdParserAccelerated();
+
+}
+}
+
+#endif
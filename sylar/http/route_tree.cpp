@@ -0,0 +1,209 @@
+#include "route_tree.h"
+
+namespace sylar {
+namespace http {
+
+//基数树节点
+//label：从父节点到本节点的静态前缀；参数节点和根节点的label为空
+//children：静态子节点，每个子节点label的首字符互不相同
+struct RouteTree::Node {
+    typedef std::map<int, CreatorPtr> Handlers;
+
+    std::string label;
+    std::vector<NodePtr> children;
+    //":name"子节点及参数名
+    NodePtr param;
+    std::string paramName;
+    //"*name"通配及参数名
+    Handlers wildcard;
+    std::string wildcardName;
+    //路由在本节点结束时的servlet，key为方法
+    Handlers handlers;
+
+    static CreatorPtr Find(const Handlers& h, int method) {
+        auto it = h.find(method);
+        if (it != h.end()) {
+            return it->second;
+        }
+        it = h.find(ANY_METHOD);
+        return it == h.end() ? nullptr : it->second;
+    }
+};
+
+RouteTree::RouteTree()
+    :m_root(std::make_shared<Node>())
+    ,m_size(0) {
+}
+
+RouteTree::RouteTree(NodePtr root, size_t size)
+    :m_root(root)
+    ,m_size(size) {
+}
+
+RouteTree::ptr RouteTree::insert(int method, const std::string& pattern,
+                                 CreatorPtr creator, std::string* err) const {
+    std::string error;
+    bool added = false;
+    NodePtr root;
+    if (pattern.empty() || pattern[0] != '/') {
+        error = "pattern must start with '/'";
+    } else {
+        root = Insert(m_root, pattern, 0, method, creator, added, error);
+    }
+    if (!root) {
+        if (err) {
+            *err = error;
+        }
+        return nullptr;
+    }
+    return RouteTree::ptr(new RouteTree(root, m_size + (added ? 1 : 0)));
+}
+
+//node的label已经匹配到path[pos]之前，把path[pos:]插入到node下面
+//返回node的拷贝(node为nullptr时新建)，没有修改的子树和原来的树共享
+RouteTree::NodePtr RouteTree::Insert(const NodePtr& node, const std::string& path, size_t pos,
+                                     int method, CreatorPtr creator, bool& added, std::string& err) {
+    std::shared_ptr<Node> n = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+    if (pos == path.size()) {
+        added = n->handlers.find(method) == n->handlers.end();
+        n->handlers[method] = creator;
+        return n;
+    }
+    char c = path[pos];
+    if (c == ':') {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        std::string name = path.substr(pos + 1, end - pos - 1);
+        if (name.empty()) {
+            err = "empty param name in " + path;
+            return nullptr;
+        }
+        if (n->param && n->paramName != name) {
+            err = "param :" + name + " conflicts with :" + n->paramName + " in " + path;
+            return nullptr;
+        }
+        NodePtr child = Insert(n->param, path, end, method, creator, added, err);
+        if (!child) {
+            return nullptr;
+        }
+        n->param = child;
+        n->paramName = name;
+        return n;
+    }
+    if (c == '*') {
+        std::string name = path.substr(pos + 1);
+        if (name.find('/') != std::string::npos) {
+            err = "wildcard must be the last segment in " + path;
+            return nullptr;
+        }
+        if (!n->wildcard.empty() && n->wildcardName != name) {
+            err = "wildcard *" + name + " conflicts with *" + n->wildcardName + " in " + path;
+            return nullptr;
+        }
+        added = n->wildcard.find(method) == n->wildcard.end();
+        n->wildcard[method] = creator;
+        n->wildcardName = name;
+        return n;
+    }
+
+    //静态部分到下一个':'或'*'为止
+    size_t end = path.find_first_of(":*", pos);
+    if (end == std::string::npos) {
+        end = path.size();
+    }
+    for (auto& child : n->children) {
+        if (child->label[0] != c) {
+            continue;
+        }
+        //和已有子节点的公共前缀
+        const std::string& label = child->label;
+        size_t k = 0;
+        while (k < label.size() && pos + k < end && label[k] == path[pos + k]) {
+            ++k;
+        }
+        NodePtr base = child;
+        if (k < label.size()) {
+            //只匹配了一部分，把子节点拆成 label[0, k) -> label[k, )
+            std::shared_ptr<Node> mid = std::make_shared<Node>();
+            mid->label = label.substr(0, k);
+            std::shared_ptr<Node> tail = std::make_shared<Node>(*child);
+            tail->label = label.substr(k);
+            mid->children.push_back(tail);
+            base = mid;
+        }
+        NodePtr nc = Insert(base, path, pos + k, method, creator, added, err);
+        if (!nc) {
+            return nullptr;
+        }
+        child = nc;
+        return n;
+    }
+    std::shared_ptr<Node> leaf = std::make_shared<Node>();
+    leaf->label = path.substr(pos, end - pos);
+    NodePtr nc = Insert(leaf, path, end, method, creator, added, err);
+    if (!nc) {
+        return nullptr;
+    }
+    n->children.push_back(nc);
+    return n;
+}
+
+RouteTree::CreatorPtr RouteTree::match(int method, const std::string& path, Params& params) const {
+    CreatorPtr result;
+    size_t n = params.size();
+    if (!Match(m_root.get(), method, path, 0, params, result)) {
+        params.resize(n);
+        return nullptr;
+    }
+    return result;
+}
+
+bool RouteTree::Match(const Node* node, int method, const std::string& path,
+                      size_t pos, Params& params, CreatorPtr& result) {
+    if (pos == path.size()) {
+        result = Node::Find(node->handlers, method);
+        if (result) {
+            return true;
+        }
+    } else {
+        //静态子节点，首字符唯一，最多只有一个候选
+        char c = path[pos];
+        for (auto& child : node->children) {
+            if (child->label[0] != c) {
+                continue;
+            }
+            if (path.compare(pos, child->label.size(), child->label) == 0
+                    && Match(child.get(), method, path, pos + child->label.size(), params, result)) {
+                return true;
+            }
+            break;
+        }
+        //参数，匹配到下一个'/'
+        if (node->param) {
+            size_t end = path.find('/', pos);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            if (end > pos) {
+                params.push_back(std::make_pair(node->paramName, path.substr(pos, end - pos)));
+                if (Match(node->param.get(), method, path, end, params, result)) {
+                    return true;
+                }
+                params.pop_back();
+            }
+        }
+    }
+    if (!node->wildcard.empty()) {
+        result = Node::Find(node->wildcard, method);
+        if (result) {
+            params.push_back(std::make_pair(node->wildcardName, path.substr(pos)));
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+}
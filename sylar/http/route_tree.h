@@ -0,0 +1,77 @@
+/**
+ * @file route_tree.h
+ * @brief 基于基数树(radix tree)的路由表
+ * @date 2025-07-14
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// ServletDispatch 原来用 unordered_map 做精确匹配 + vector 线性扫描模糊匹配，每次请求都要加锁
+// RouteTree 把所有路由放进一棵基数树：
+//   静态部分按公共前缀压缩成一条边，查找时逐段比较前缀，和路由数量基本无关
+//   :name      匹配一个路径段(不含'/')，匹配到的值写入请求参数 name
+//   *name      只能出现在最后，匹配剩余的全部路径(可以为空)，写入请求参数 name
+// 同一位置的优先级：静态 > :param > *wildcard，静态匹配失败时会回溯尝试参数和通配
+// 每个节点可以按HTTP方法挂不同的servlet，ANY_METHOD表示不区分方法
+//
+// 树是不可变的：插入时只拷贝从根到插入点路径上的节点，其余子树和旧树共享(copy-on-write)，
+// 修改完成后由ServletDispatch原子地替换根节点，查找时不需要加锁
+
+#ifndef __SYLAR_HTTP_ROUTE_TREE_H__
+#define __SYLAR_HTTP_ROUTE_TREE_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+namespace sylar {
+namespace http {
+
+class IServletCreator;
+
+class RouteTree {
+public:
+    typedef std::shared_ptr<const RouteTree> ptr;
+    typedef std::shared_ptr<IServletCreator> CreatorPtr;
+    //路由匹配出的参数 name -> value
+    typedef std::vector<std::pair<std::string, std::string> > Params;
+
+    //不区分方法
+    static const int ANY_METHOD = -1;
+
+    //空树
+    RouteTree();
+
+    //返回插入路由后的新树，当前树不变
+    //pattern不合法或和已有路由的参数名冲突时返回nullptr，err中为原因
+    RouteTree::ptr insert(int method, const std::string& pattern,
+                          CreatorPtr creator, std::string* err = nullptr) const;
+
+    //查找path对应的servlet，先找method对应的，再找ANY_METHOD的
+    //params中追加匹配出来的参数，找不到返回nullptr
+    CreatorPtr match(int method, const std::string& path, Params& params) const;
+
+    //路由数量
+    size_t size() const { return m_size;}
+
+private:
+    struct Node;
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    RouteTree(NodePtr root, size_t size);
+
+    static NodePtr Insert(const NodePtr& node, const std::string& path, size_t pos,
+                          int method, CreatorPtr creator, bool& added, std::string& err);
+    static bool Match(const Node* node, int method, const std::string& path,
+                      size_t pos, Params& params, CreatorPtr& result);
+
+private:
+    NodePtr m_root;
+    size_t m_size;
+};
+
+}
+}
+
+#endif
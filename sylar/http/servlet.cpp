@@ -1,4 +1,5 @@
 #include "servlet.h"
+#include "sylar/log.h"
 #include <fnmatch.h>
 
 namespace sylar {
@@ -17,30 +18,110 @@ int32_t FunctionServlet::handle(sylar::http::HttpRequest::ptr request,
 
 ServletDispatch::ServletDispatch() : Servlet("ServletDispatch") {
     m_default.reset(new NotFoundServlet("sylar/1.0"));
+    std::shared_ptr<RouteTable> table = std::make_shared<RouteTable>();
+    table->tree.reset(new RouteTree);
+    m_table = table;
+    m_filters = std::make_shared<std::vector<HttpFilter::ptr> >();
 }
 
 int32_t ServletDispatch::handle(sylar::http::HttpRequest::ptr request,
                                 sylar::http::HttpResponse::ptr response,
                                 sylar::http::HttpSession::ptr session) {
-    auto servlet = getMatchedServlet(request->getPath());
+    FiltersPtr filters = std::atomic_load(&m_filters);
+    if (filters->empty()) {
+        return dispatch(request, response, session);
+    }
+    HttpFilterChain chain(this, *filters, request, response, session);
+    return chain.next();
+}
+
+int32_t ServletDispatch::dispatch(HttpRequest::ptr request, HttpResponse::ptr response
+                                  ,HttpSession::ptr session) {
+    RouteTree::Params params;
+    auto servlet = getMatchedServlet(request->getMethod(), request->getPath(), params);
+    for (auto& i : params) {
+        //前缀通配(/prefix/*)没有参数名
+        if (!i.first.empty()) {
+            request->setParam(i.first, i.second);
+        }
+    }
     if (servlet) {
       servlet->handle(request, response, session);
     }
     return 0;
 }
 
-void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri] = std::make_shared<HoldServletCreator>(slt);
+//形如"/prefix/*"：只有结尾一个'*'，没有其他fnmatch特殊字符和':'，可以直接放进路由树
+static bool IsPrefixGlob(const std::string& uri) {
+    return !uri.empty() && uri[0] == '/' && uri.back() == '*'
+        && uri.find_first_of("*?[:") == uri.size() - 1;
+}
+
+bool ServletDispatch::addRouteCreator(int method, const std::string& uri, IServletCreator::ptr creator) {
+    RouteTable::ptr old = getTable();
+    std::string err;
+    RouteTree::ptr tree = old->tree->insert(method, uri, creator, &err);
+    if (!tree) {
+        SYLAR_LOG_ERROR(SYLAR_LOG_NAME("system")) << "ServletDispatch add route fail uri="
+            << uri << " err=" << err;
+        return false;
+    }
+    std::shared_ptr<RouteTable> table = std::make_shared<RouteTable>(*old);
+    table->tree = tree;
+    std::atomic_store(&m_table, RouteTable::ptr(table));
+    return true;
 }
 
-void ServletDispatch::addServletCreator(const std::string& uri, IServletCreator::ptr creator) {
+void ServletDispatch::rebuild() {
+    std::shared_ptr<RouteTable> table = std::make_shared<RouteTable>();
+    table->tree.reset(new RouteTree);
+    std::string err;
+    auto insert = [&](int method, const std::string& uri, IServletCreator::ptr creator) {
+        RouteTree::ptr tree = table->tree->insert(method, uri, creator, &err);
+        if (tree) {
+            table->tree = tree;
+        }
+    };
+    for (auto& i : m_datas) {
+        insert(RouteTree::ANY_METHOD, i.first, i.second);
+    }
+    for (auto& i : m_routes) {
+        insert(i.first.first, i.first.second, i.second);
+    }
+    for (auto& i : m_globs) {
+        if (IsPrefixGlob(i.first)) {
+            insert(RouteTree::ANY_METHOD, i.first, i.second);
+        } else {
+            table->globs.push_back(i);
+        }
+    }
+    std::atomic_store(&m_table, RouteTable::ptr(table));
+}
+
+bool ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
+    return addServletCreator(uri, std::make_shared<HoldServletCreator>(slt));
+}
+
+bool ServletDispatch::addServletCreator(const std::string& uri, IServletCreator::ptr creator) {
+    //精确路由不走参数解析，带':'或'*'的按原样也匹配不到，直接拒绝
+    if (uri.find_first_of(":*") != std::string::npos) {
+        SYLAR_LOG_ERROR(SYLAR_LOG_NAME("system")) << "ServletDispatch exact uri can not contain ':' or '*' uri="
+            << uri << ", use addRoute or addGlobServlet";
+        return false;
+    }
     RWMutexType::WriteLock lock(m_mutex);
+    if (!addRouteCreator(RouteTree::ANY_METHOD, uri, creator)) {
+        return false;
+    }
     m_datas[uri] = creator;
+    return true;
 }
 
-void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) {
+bool ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) {
     RWMutexType::WriteLock lock(m_mutex);
+    if (IsPrefixGlob(uri) && !addRouteCreator(RouteTree::ANY_METHOD, uri, creator)) {
+        return false;
+    }
     for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
         if (it->first == uri) {
             m_globs.erase(it);
@@ -48,30 +129,42 @@ void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCrea
         }
     }
     m_globs.push_back(std::make_pair(uri, creator));
+    if (!IsPrefixGlob(uri)) {
+        rebuild();
+    }
+    return true;
 }
 
-void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callback cb) {
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri] = std::make_shared<HoldServletCreator>(std::make_shared<FunctionServlet>(cb));
+bool ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callback cb) {
+    return addServlet(uri, std::make_shared<FunctionServlet>(cb));
 }
-    
-void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
+
+bool ServletDispatch::addRoute(HttpMethod method, const std::string& uri, Servlet::ptr slt) {
+    IServletCreator::ptr creator = std::make_shared<HoldServletCreator>(slt);
     RWMutexType::WriteLock lock(m_mutex);
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-        if (it->first == uri) {
-            m_globs.erase(it);
-            break;
-        }
+    if (!addRouteCreator((int)method, uri, creator)) {
+        return false;
     }
-    m_globs.push_back(std::make_pair(uri, std::make_shared<HoldServletCreator>(slt)));
+    m_routes[std::make_pair((int)method, uri)] = creator;
+    return true;
+}
+
+bool ServletDispatch::addRoute(HttpMethod method, const std::string& uri, FunctionServlet::callback cb) {
+    return addRoute(method, uri, std::make_shared<FunctionServlet>(cb));
+}
+    
+bool ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
+    return addGlobServletCreator(uri, std::make_shared<HoldServletCreator>(slt));
 }
 
-void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::callback cb) {
+bool ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::callback cb) {
     return addGlobServlet(uri, std::make_shared<FunctionServlet>(cb));
 }
 
 void ServletDispatch::delServlet(const std::string& uri) {
+    RWMutexType::WriteLock lock(m_mutex);
     m_datas.erase(uri);
+    rebuild();
 }
 
 void ServletDispatch::delGlobServlet(const std::string& uri) {
@@ -82,16 +175,17 @@ void ServletDispatch::delGlobServlet(const std::string& uri) {
           break;
       }
     }
+    rebuild();
 }
 
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
+    RWMutexType::ReadLock lock(m_mutex);
     auto it = m_datas.find(uri);
     return it == m_datas.end() ? nullptr : it->second->get();
 }
 
 Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
+    RWMutexType::ReadLock lock(m_mutex);
     for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
       if (it->first == uri) {
           return it->second->get();
@@ -101,33 +195,64 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
 }
 
 Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri) {
-    RWMutexType::WriteLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    if (it != m_datas.end()) {
-        return it->second->get();
+    RouteTree::Params params;
+    return getMatchedServlet(HttpMethod::INVALID_METHOD, uri, params);
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(HttpMethod method, const std::string& uri,
+                                                RouteTree::Params& params) {
+    RouteTable::ptr table = getTable();
+    IServletCreator::ptr creator = table->tree->match((int)method, uri, params);
+    if (creator) {
+        return creator->get();
     }
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-      if (it->first == uri) {
-          return it->second->get();
-      }
+    for (auto& i : table->globs) {
+        if (!fnmatch(i.first.c_str(), uri.c_str(), 0)) {
+            return i.second->get();
+        }
     }
     return m_default;
 }
     
 void ServletDispatch::listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos) {
-    RWMutexType::WriteLock lock(m_mutex);
+    RWMutexType::ReadLock lock(m_mutex);
     for (auto& i : m_datas) {
         infos[i.first] = i.second;
     }
 }
 
 void ServletDispatch::listAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos) {
-    RWMutexType::WriteLock lock(m_mutex);
+    RWMutexType::ReadLock lock(m_mutex);
     for (auto& i : m_globs) {
         infos[i.first] = i.second;
     }
 }
 
+void ServletDispatch::addFilter(HttpFilter::ptr filter) {
+    RWMutexType::WriteLock lock(m_mutex);
+    std::shared_ptr<std::vector<HttpFilter::ptr> > filters
+        = std::make_shared<std::vector<HttpFilter::ptr> >(*m_filters);
+    filters->push_back(filter);
+    std::atomic_store(&m_filters, FiltersPtr(filters));
+}
+
+void ServletDispatch::delFilter(const std::string& name) {
+    RWMutexType::WriteLock lock(m_mutex);
+    std::shared_ptr<std::vector<HttpFilter::ptr> > filters
+        = std::make_shared<std::vector<HttpFilter::ptr> >();
+    for (auto& i : *m_filters) {
+        if (i->getName() != name) {
+            filters->push_back(i);
+        }
+    }
+    std::atomic_store(&m_filters, FiltersPtr(filters));
+}
+
+void ServletDispatch::listAllFilter(std::vector<HttpFilter::ptr>& filters) {
+    FiltersPtr cur = std::atomic_load(&m_filters);
+    filters.insert(filters.end(), cur->begin(), cur->end());
+}
+
 
 NotFoundServlet::NotFoundServlet(const std::string& name) : Servlet("NotFoundServlet"), m_name(name) {
     m_content = "<html><head><title>404 Not Found"
@@ -142,6 +267,7 @@ int32_t NotFoundServlet::handle(sylar::http::HttpRequest::ptr request,
     response->setHeader("Server", "sylar/1.0.0");
     response->setHeader("Content-Type", "text/html");
     response->setBody(m_content);
+    return 0;
 }
 
 } 
@@ -25,6 +25,8 @@
 #include "http_session.h"
 #include "sylar/thread.h"
 #include "sylar/util.h"
+#include "route_tree.h"
+#include "http_filter.h"
 
 namespace sylar {
 namespace http {
@@ -52,7 +54,7 @@ protected:
 //m_dispatch->addServlet("/hello", FunctionServlet::ptr(new FunctionServlt([](){})));
 class FunctionServlet : public Servlet {
 public:
-    std::shared_ptr<FunctionServlet> ptr;
+    typedef std::shared_ptr<FunctionServlet> ptr;
     typedef std::function<int32_t(sylar::http::HttpRequest::ptr request, 
                                   sylar::http::HttpResponse::ptr response,
                                   sylar::http::HttpSession::ptr session)> callback;
@@ -116,6 +118,9 @@ public:
 
 
 //servlet分发器
+//路由存放在RouteTree(基数树)中，支持 /user/:id 这样的参数段和 /static/*path 这样的通配段，
+//匹配出的参数通过HttpRequest::setParam写入请求
+//路由表不可变，增删路由时在写锁下生成新表再原子替换，处理请求时查找路由不加锁
 class ServletDispatch : public Servlet {
 public:
     typedef std::shared_ptr<ServletDispatch> ptr;
@@ -126,26 +131,32 @@ public:
                            sylar::http::HttpResponse::ptr response,
                            sylar::http::HttpSession::ptr session) override;
 
-    //添加servlet 精确
-    void addServlet(const std::string& uri, Servlet::ptr slt);
-    void addServlet(const std::string& uri, FunctionServlet::callback cb);
+    //添加路由失败(uri不合法、和已有路由的参数名冲突)时记录错误日志并返回false，已注册的路由不变
+
+    //添加servlet 精确，uri不能包含':'和'*'(参数和通配用addRoute/addGlobServlet)
+    bool addServlet(const std::string& uri, Servlet::ptr slt);
+    bool addServlet(const std::string& uri, FunctionServlet::callback cb);
+    //添加只匹配某个HTTP方法的路由，uri可以包含:param和*wildcard
+    bool addRoute(HttpMethod method, const std::string& uri, Servlet::ptr slt);
+    bool addRoute(HttpMethod method, const std::string& uri, FunctionServlet::callback cb);
     //添加servlet 模糊
-    void addGlobServlet(const std::string& uri, Servlet::ptr slt);
-    void addGlobServlet(const std::string& uri, FunctionServlet::callback cb);
+    //形如/prefix/*的前缀通配放进路由树，其他fnmatch模式按添加顺序逐个匹配
+    bool addGlobServlet(const std::string& uri, Servlet::ptr slt);
+    bool addGlobServlet(const std::string& uri, FunctionServlet::callback cb);
 
     //添加servlet servlet由传入的ServletCreator创建
-    void addServletCreator(const std::string& uri, IServletCreator::ptr creator);
-    void addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator);
+    bool addServletCreator(const std::string& uri, IServletCreator::ptr creator);
+    bool addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator);
 
     //使用  servlet_dispatch->addServletCreator<MyServlet>("/usr/login")
     //他等价于 servlet_dispatch->addServletCreator("/usr/login", std::make_shared<MySrvlet>())
     template<class T>
-    void addServletCreator(const std::string& uri) {
-        addServletCreator(uri, std::make_shared<ServletCreator<T>>());
+    bool addServletCreator(const std::string& uri) {
+        return addServletCreator(uri, std::make_shared<ServletCreator<T>>());
     }
     template<class T>
-    void addGlobServletCreator(const std::string& uri) {
-        addGlobServletCreator(uri, std::make_shared<ServletCreator<T>>())
+    bool addGlobServletCreator(const std::string& uri) {
+        return addGlobServletCreator(uri, std::make_shared<ServletCreator<T>>());
     }
 
     void delServlet(const std::string& uri);
@@ -160,15 +171,50 @@ public:
     Servlet::ptr getGlobServlet(const std::string& uri);
     //通过uri获得servlet，优先精确匹配，其次模糊匹配，最后返回默认
     Servlet::ptr getMatchedServlet(const std::string& uri);
+    //按方法和路径匹配，params中返回匹配出的路由参数
+    Servlet::ptr getMatchedServlet(HttpMethod method, const std::string& uri,
+                                   RouteTree::Params& params);
 
     //将已经注册的servlet全部拷贝出来，放到一个外部传入的map中
     void listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
     void listAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
 
+    //在路由之前执行的filter，按添加顺序执行
+    void addFilter(HttpFilter::ptr filter);
+    void delFilter(const std::string& name);
+    void listAllFilter(std::vector<HttpFilter::ptr>& filters);
+
 
+private:
+    friend class HttpFilterChain;
+    typedef std::shared_ptr<const std::vector<HttpFilter::ptr> > FiltersPtr;
+
+    //filter都执行过后：匹配路由并执行Servlet
+    int32_t dispatch(HttpRequest::ptr request, HttpResponse::ptr response, HttpSession::ptr session);
+
+    //不可变的路由表
+    struct RouteTable {
+        typedef std::shared_ptr<const RouteTable> ptr;
+        RouteTree::ptr tree;
+        //不能放进路由树的fnmatch模式
+        std::vector<std::pair<std::string, IServletCreator::ptr>> globs;
+    };
+
+    //在写锁下把路由插入当前路由表，生成新表并发布，插入失败时返回false，路由表不变
+    bool addRouteCreator(int method, const std::string& uri, IServletCreator::ptr creator);
+    //在写锁下用所有已注册路由重新生成路由表(删除路由时)
+    void rebuild();
+    RouteTable::ptr getTable() const { return std::atomic_load(&m_table);}
 
 private:
+    //只保护下面的注册信息和路由表的替换，查找路由不需要加锁
     RWMutexType m_mutex;
+    //当前的路由表，用std::atomic_load/atomic_store读写
+    RouteTable::ptr m_table;
+    //当前的filter列表，和路由表一样整体替换
+    FiltersPtr m_filters;
+    //按方法注册的路由 (method, uri) -> creator
+    std::map<std::pair<int, std::string>, IServletCreator::ptr> m_routes;
     //一个精准的URI匹配器，将具体的UTI映射到对应的servlet对象
     //uri-servlet映射器
     std::unordered_map<std::string, IServletCreator::ptr> m_datas;
@@ -0,0 +1,405 @@
+#include "cache_servlet.h"
+#include "sylar/config.h"
+#include "sylar/iomanager.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <functional>
+#include <iomanip>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_cache_max_bytes =
+    sylar::Config::Lookup("http.cache.max_bytes", (uint64_t)(64 * 1024 * 1024),
+                          "http response cache memory size");
+static sylar::ConfigVar<uint32_t>::ptr g_http_cache_shards =
+    sylar::Config::Lookup("http.cache.shards", (uint32_t)16,
+                          "http response cache shard count, takes effect at startup");
+static sylar::ConfigVar<uint64_t>::ptr g_http_cache_ttl =
+    sylar::Config::Lookup("http.cache.ttl", (uint64_t)1000,
+                          "http response cache default ttl ms");
+static sylar::ConfigVar<uint64_t>::ptr g_http_cache_stale =
+    sylar::Config::Lookup("http.cache.stale", (uint64_t)5000,
+                          "http response cache default stale-while-revalidate ms");
+
+//Cache-Control中需要的指令
+struct CacheControl {
+    bool noStore = false;
+    bool noCache = false;
+    bool isPrivate = false;
+    //秒，-1表示没有
+    int64_t maxAge = -1;
+    int64_t sMaxAge = -1;
+    int64_t staleWhileRevalidate = -1;
+};
+
+static bool DirectiveIs(const StringView& d, const char* name) {
+    return d.iequals(name, strlen(name));
+}
+
+static int64_t DirectiveSeconds(const StringView& v) {
+    std::string s = v.str();
+    if (s.size() >= 2 && s[0] == '"') {
+        s = s.substr(1, s.size() - 2);
+    }
+    return s.empty() ? -1 : strtoll(s.c_str(), nullptr, 10);
+}
+
+static CacheControl ParseCacheControl(const std::string& value) {
+    CacheControl cc;
+    StringView v(value);
+    size_t pos = 0;
+    while (pos < v.size()) {
+        size_t end = v.find(',', pos);
+        if (end == std::string::npos) {
+            end = v.size();
+        }
+        StringView item = v.substr(pos, end - pos);
+        pos = end + 1;
+        while (!item.empty() && (item[0] == ' ' || item[0] == '\t')) {
+            item = item.substr(1);
+        }
+        while (!item.empty() && (item[item.size() - 1] == ' ' || item[item.size() - 1] == '\t')) {
+            item = item.substr(0, item.size() - 1);
+        }
+        size_t eq = item.find('=');
+        StringView name = item.substr(0, eq);
+        StringView arg = eq == std::string::npos ? StringView() : item.substr(eq + 1);
+        if (DirectiveIs(name, "no-store")) {
+            cc.noStore = true;
+        } else if (DirectiveIs(name, "no-cache")) {
+            cc.noCache = true;
+        } else if (DirectiveIs(name, "private")) {
+            cc.isPrivate = true;
+        } else if (DirectiveIs(name, "max-age")) {
+            cc.maxAge = DirectiveSeconds(arg);
+        } else if (DirectiveIs(name, "s-maxage")) {
+            cc.sMaxAge = DirectiveSeconds(arg);
+        } else if (DirectiveIs(name, "stale-while-revalidate")) {
+            cc.staleWhileRevalidate = DirectiveSeconds(arg);
+        }
+    }
+    return cc;
+}
+
+HttpResponseCache::HttpResponseCache() {
+    uint32_t n = std::max<uint32_t>(g_http_cache_shards->getValue(), 1);
+    for (uint32_t i = 0; i < n; ++i) {
+        m_shards.emplace_back(new Shard);
+    }
+}
+
+HttpResponseCache::Shard& HttpResponseCache::getShard(const std::string& key) {
+    return *m_shards[std::hash<std::string>()(key) % m_shards.size()];
+}
+
+void HttpResponseCache::erase(Shard& shard, ListType::iterator it) {
+    shard.bytes -= it->second->bytes;
+    shard.index.erase(it->first);
+    shard.list.erase(it);
+}
+
+HttpCacheEntry::ptr HttpResponseCache::get(const std::string& key, uint64_t now_ms
+                                           ,State& state, bool& refresh) {
+    refresh = false;
+    state = MISS;
+    Shard& shard = getShard(key);
+    MutexType::Lock lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++m_miss;
+        return nullptr;
+    }
+    HttpCacheEntry::ptr entry = it->second->second;
+    if (entry->staleTime <= now_ms) {
+        erase(shard, it->second);
+        ++m_miss;
+        return nullptr;
+    }
+    shard.list.splice(shard.list.begin(), shard.list, it->second);
+    if (entry->expireTime > now_ms) {
+        state = HIT;
+        ++m_hit;
+    } else {
+        state = STALE;
+        ++m_stale;
+        if (!entry->refreshing) {
+            entry->refreshing = true;
+            refresh = true;
+        }
+    }
+    return entry;
+}
+
+void HttpResponseCache::set(const std::string& key, HttpCacheEntry::ptr entry) {
+    entry->bytes = sizeof(HttpCacheEntry) + key.size() * 2 + entry->body.size() + entry->reason.size();
+    for (auto& i : entry->headers) {
+        entry->bytes += i.first.size() + i.second.size();
+    }
+    size_t budget = g_http_cache_max_bytes->getValue() / m_shards.size();
+    Shard& shard = getShard(key);
+    MutexType::Lock lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        erase(shard, it->second);
+    }
+    //比整个分片还大的响应不缓存
+    if (entry->bytes > budget) {
+        return;
+    }
+    shard.list.push_front(std::make_pair(key, entry));
+    shard.index[key] = shard.list.begin();
+    shard.bytes += entry->bytes;
+    while (shard.bytes > budget && !shard.list.empty()) {
+        erase(shard, --shard.list.end());
+        ++m_evict;
+    }
+}
+
+void HttpResponseCache::abortRefresh(const std::string& key) {
+    Shard& shard = getShard(key);
+    MutexType::Lock lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        it->second->second->refreshing = false;
+    }
+}
+
+void HttpResponseCache::del(const std::string& key) {
+    Shard& shard = getShard(key);
+    MutexType::Lock lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        erase(shard, it->second);
+    }
+}
+
+void HttpResponseCache::clear() {
+    for (auto& i : m_shards) {
+        MutexType::Lock lock(i->mutex);
+        i->list.clear();
+        i->index.clear();
+        i->bytes = 0;
+    }
+}
+
+size_t HttpResponseCache::getBytes() {
+    size_t bytes = 0;
+    for (auto& i : m_shards) {
+        MutexType::Lock lock(i->mutex);
+        bytes += i->bytes;
+    }
+    return bytes;
+}
+
+size_t HttpResponseCache::getCount() {
+    size_t count = 0;
+    for (auto& i : m_shards) {
+        MutexType::Lock lock(i->mutex);
+        count += i->list.size();
+    }
+    return count;
+}
+
+std::ostream& HttpResponseCache::dump(std::ostream& os) {
+    uint64_t hit = m_hit;
+    uint64_t stale = m_stale;
+    uint64_t miss = m_miss;
+    uint64_t total = hit + stale + miss;
+    os << std::setw(30) << std::right << "cache_hit: " << hit << std::endl;
+    os << std::setw(30) << std::right << "cache_stale_hit: " << stale << std::endl;
+    os << std::setw(30) << std::right << "cache_miss: " << miss << std::endl;
+    os << std::setw(30) << std::right << "cache_bypass: " << m_bypass << std::endl;
+    os << std::setw(30) << std::right << "cache_hit_ratio: "
+       << (total ? (hit + stale) * 100.0 / total : 0.0) << "%" << std::endl;
+    os << std::setw(30) << std::right << "cache_entries: " << getCount() << std::endl;
+    os << std::setw(30) << std::right << "cache_bytes: " << getBytes()
+       << "/" << g_http_cache_max_bytes->getValue() << std::endl;
+    os << std::setw(30) << std::right << "cache_evict: " << m_evict;
+    return os;
+}
+
+static std::atomic<uint32_t> s_cache_servlet_id = {0};
+
+CacheServlet::CacheServlet(Servlet::ptr servlet, int64_t ttl_ms, int64_t stale_ms
+                           ,const std::vector<std::string>& vary_headers)
+    :Servlet("CacheServlet(" + servlet->getName() + ")")
+    ,m_servlet(servlet)
+    ,m_ttl(ttl_ms)
+    ,m_stale(stale_ms)
+    ,m_varyHeaders(vary_headers)
+    ,m_id(++s_cache_servlet_id) {
+}
+
+std::string CacheServlet::makeKey(HttpRequest::ptr req) const {
+    std::string key;
+    key.reserve(64);
+    key.append(std::to_string(m_id));
+    key.append(" ");
+    key.append(HttpMethodToString(req->getMethod()));
+    key.append(" ");
+    key.append(req->getPath());
+    if (!req->getQuery().empty()) {
+        key.append("?");
+        key.append(req->getQuery());
+    }
+    for (auto& i : m_varyHeaders) {
+        StringView v;
+        key.append("\n");
+        key.append(i);
+        key.append(":");
+        if (req->getHeaders().get(i, v)) {
+            key += v;
+        }
+    }
+    return key;
+}
+
+bool CacheServlet::Store(const std::string& key, HttpResponse::ptr rsp, HttpSession::ptr session
+                         ,uint64_t ttl_ms, uint64_t stale_ms) {
+    //已经直接写给客户端的流式响应、文件响应不缓存
+    if ((session && session->getBodyWriter()) || rsp->getFileBody() || rsp->getBodyReader()) {
+        return false;
+    }
+    switch (rsp->getStatus()) {
+        case HttpStatus::OK:
+        case HttpStatus::NON_AUTHORITATIVE_INFORMATION:
+        case HttpStatus::NO_CONTENT:
+        case HttpStatus::MOVED_PERMANENTLY:
+        case HttpStatus::NOT_FOUND:
+        case HttpStatus::GONE:
+            break;
+        default:
+            return false;
+    }
+    if (!rsp->getCookies().empty() || rsp->getHeaders().has("Set-Cookie")) {
+        return false;
+    }
+    StringView v = rsp->getHeaderView(HttpHeaders::CACHE_CONTROL);
+    if (!v.empty()) {
+        CacheControl cc = ParseCacheControl(v.str());
+        if (cc.noStore || cc.noCache || cc.isPrivate) {
+            return false;
+        }
+        if (cc.sMaxAge >= 0) {
+            ttl_ms = cc.sMaxAge * 1000;
+        } else if (cc.maxAge >= 0) {
+            ttl_ms = cc.maxAge * 1000;
+        }
+        if (cc.staleWhileRevalidate >= 0) {
+            stale_ms = cc.staleWhileRevalidate * 1000;
+        }
+    }
+    if (ttl_ms == 0) {
+        return false;
+    }
+    HttpCacheEntry::ptr entry = std::make_shared<HttpCacheEntry>();
+    entry->status = rsp->getStatus();
+    entry->reason = rsp->getReason();
+    entry->headers = rsp->getHeaders();
+    entry->headers.erase("Connection");
+    entry->body = rsp->getBody();
+    entry->createTime = sylar::GetCurrentMS();
+    entry->expireTime = entry->createTime + ttl_ms;
+    entry->staleTime = entry->expireTime + stale_ms;
+    HttpResponseCacheMgr::GetInstance()->set(key, entry);
+    return true;
+}
+
+void CacheServlet::revalidate(const std::string& key, HttpRequest::ptr req
+                              ,uint64_t ttl_ms, uint64_t stale_ms) {
+    IOManager* iom = IOManager::GetThis();
+    if (!iom) {
+        HttpResponseCacheMgr::GetInstance()->abortRefresh(key);
+        return;
+    }
+    //前台还在用req(参数缓存、arena都不是线程安全的)，后台只拿一份拷贝
+    HttpRequest::ptr copy(new HttpRequest(req->getVersion(), req->isClose()));
+    copy->setMethod(req->getMethod());
+    copy->setPath(req->getPath());
+    copy->setQuery(req->getQuery());
+    copy->setHeaders(req->getHeaders());
+    copy->setRemoteAddress(req->getRemoteAddress());
+    Servlet::ptr servlet = m_servlet;
+    iom->schedule([key, copy, servlet, ttl_ms, stale_ms](){
+        HttpResponse::ptr rsp(new HttpResponse(copy->getVersion(), false));
+        int32_t rt = servlet->handle(copy, rsp, nullptr);
+        if (rt != 0 || !Store(key, rsp, nullptr, ttl_ms, stale_ms)) {
+            SYLAR_LOG_DEBUG(g_logger) << "http cache revalidate not stored, key=" << key
+                << " rt=" << rt << " status=" << (int)rsp->getStatus();
+            HttpResponseCacheMgr::GetInstance()->abortRefresh(key);
+        }
+    });
+}
+
+int32_t CacheServlet::handle(sylar::http::HttpRequest::ptr request
+                            , sylar::http::HttpResponse::ptr response
+                            , sylar::http::HttpSession::ptr session) {
+    HttpResponseCache* cache = HttpResponseCacheMgr::GetInstance();
+    bool lookup = true;
+    if (request->getMethod() != HttpMethod::GET) {
+        cache->addBypass();
+        return m_servlet->handle(request, response, session);
+    }
+    StringView v = request->getHeaderView(HttpHeaders::CACHE_CONTROL);
+    if (!v.empty()) {
+        CacheControl cc = ParseCacheControl(v.str());
+        if (cc.noStore) {
+            cache->addBypass();
+            return m_servlet->handle(request, response, session);
+        }
+        lookup = !cc.noCache;
+    }
+    if (request->getHeaders().has(HttpHeaders::AUTHORIZATION)) {
+        bool vary = false;
+        for (auto& i : m_varyHeaders) {
+            if (strcasecmp(i.c_str(), "Authorization") == 0) {
+                vary = true;
+                break;
+            }
+        }
+        if (!vary) {
+            cache->addBypass();
+            return m_servlet->handle(request, response, session);
+        }
+    }
+
+    std::string key = makeKey(request);
+    uint64_t ttl_ms = m_ttl >= 0 ? (uint64_t)m_ttl : g_http_cache_ttl->getValue();
+    uint64_t stale_ms = m_stale >= 0 ? (uint64_t)m_stale : g_http_cache_stale->getValue();
+    if (lookup) {
+        uint64_t now_ms = sylar::GetCurrentMS();
+        HttpResponseCache::State state;
+        bool refresh = false;
+        HttpCacheEntry::ptr entry = cache->get(key, now_ms, state, refresh);
+        if (entry) {
+            response->setStatus(entry->status);
+            response->setReason(entry->reason);
+            response->setHeaders(entry->headers);
+            response->setBody(entry->body);
+            response->setHeader("Age", std::to_string((now_ms - entry->createTime) / 1000));
+            response->setHeader("X-Cache", state == HttpResponseCache::HIT ? "HIT" : "STALE");
+            if (refresh) {
+                revalidate(key, request, ttl_ms, stale_ms);
+            }
+            return 0;
+        }
+    } else {
+        cache->addBypass();
+    }
+
+    int32_t rt = m_servlet->handle(request, response, session);
+    if (rt == 0 && Store(key, response, session, ttl_ms, stale_ms)) {
+        response->setHeader("X-Cache", "MISS");
+    }
+    return rt;
+}
+
+}
+}
@@ -0,0 +1,157 @@
+/**
+ * @file cache_servlet.h
+ * @brief 响应缓存Servlet
+ * @date 2025-07-20
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// CacheServlet 包装任意一个Servlet，把它的GET响应缓存一段时间，期间相同的请求直接返回缓存，不再执行业务代码
+// 1.缓存key：方法、路径、query，加上构造时指定的请求头(如Accept-Language)
+//   压缩在Servlet之后按每个请求的Accept-Encoding做，缓存的是压缩前的内容，不需要把Accept-Encoding放进key
+// 2.有效期：响应的Cache-Control: s-maxage/max-age优先，其次构造参数，最后http.cache.ttl
+//   响应带no-store/no-cache/private、Set-Cookie，或者是流式/文件消息体的不缓存
+//   请求带no-store时不走缓存，带no-cache时不读缓存但会用新的响应更新缓存，带Authorization(没有放进key)时不走缓存
+// 3.过期后的stale窗口内(stale-while-revalidate)，先返回旧的内容，同时在后台协程里重新执行Servlet刷新缓存，
+//   同一个key同时只有一个刷新；后台执行时session为nullptr(原连接可能已经关闭或者在处理下一个请求)，
+//   被包装的Servlet必须能处理session为nullptr的情况，需要客户端地址等信息时从request里取
+// 4.所有CacheServlet共用一个HttpResponseCache：分成多个分片，每个分片一个锁和一个LRU，按字节数淘汰
+//
+// 使用：dispatch->addServlet("/api/list", std::make_shared<CacheServlet>(servlet, 2000));
+
+#ifndef __SYLAR_HTTP_SERVLETS_CACHE_SERVLET_H__
+#define __SYLAR_HTTP_SERVLETS_CACHE_SERVLET_H__
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sylar/http/servlet.h"
+#include "sylar/mutex.h"
+#include "sylar/singleton.h"
+
+namespace sylar {
+namespace http {
+
+//缓存的响应，放进缓存后除refreshing外不再修改
+struct HttpCacheEntry {
+    typedef std::shared_ptr<HttpCacheEntry> ptr;
+    HttpStatus status = HttpStatus::OK;
+    std::string reason;
+    HttpHeaders headers;
+    std::string body;
+    //生成时间，用于Age头
+    uint64_t createTime = 0;
+    //在这之前是新鲜的
+    uint64_t expireTime = 0;
+    //在这之前可以先返回旧内容再刷新，之后删除
+    uint64_t staleTime = 0;
+    //已经有协程在刷新，由分片的锁保护
+    bool refreshing = false;
+    //占用的字节数(估算)
+    size_t bytes = 0;
+};
+
+class HttpResponseCache {
+public:
+    typedef Mutex MutexType;
+
+    enum State {
+        MISS = 0,
+        HIT = 1,
+        STALE = 2
+    };
+
+    HttpResponseCache();
+
+    /**
+     * @brief 查找缓存
+     * @param[out] state 命中状态
+     * @param[out] refresh STALE且还没有人刷新时为true，调用方负责刷新，结束后调用set或者abortRefresh
+     */
+    HttpCacheEntry::ptr get(const std::string& key, uint64_t now_ms, State& state, bool& refresh);
+    //放入缓存，超过分片的字节预算时从LRU尾部淘汰
+    void set(const std::string& key, HttpCacheEntry::ptr entry);
+    //刷新失败，保留旧内容，允许下一个请求再次刷新
+    void abortRefresh(const std::string& key);
+    void del(const std::string& key);
+    void clear();
+
+    //没有走缓存的请求
+    void addBypass() { ++m_bypass;}
+
+    size_t getBytes();
+    size_t getCount();
+    //输出命中率和内存占用
+    std::ostream& dump(std::ostream& os);
+
+private:
+    typedef std::list<std::pair<std::string, HttpCacheEntry::ptr> > ListType;
+
+    struct Shard {
+        MutexType mutex;
+        //链表头部为最近使用的
+        ListType list;
+        std::unordered_map<std::string, ListType::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard& getShard(const std::string& key);
+    //删除一项，调用方持有分片的锁
+    void erase(Shard& shard, ListType::iterator it);
+
+private:
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    std::atomic<uint64_t> m_hit = {0};
+    std::atomic<uint64_t> m_stale = {0};
+    std::atomic<uint64_t> m_miss = {0};
+    std::atomic<uint64_t> m_bypass = {0};
+    std::atomic<uint64_t> m_evict = {0};
+};
+
+typedef sylar::Singleton<HttpResponseCache> HttpResponseCacheMgr;
+
+class CacheServlet : public Servlet {
+public:
+    typedef std::shared_ptr<CacheServlet> ptr;
+
+    /**
+     * @param[in] servlet 被缓存的Servlet，后台刷新时以session为nullptr调用
+     * @param[in] ttl_ms 新鲜时间，<0时用http.cache.ttl
+     * @param[in] stale_ms 过期后还可以先返回旧内容的时间，<0时用http.cache.stale，0表示关闭stale-while-revalidate
+     * @param[in] vary_headers 参与缓存key的请求头
+     */
+    CacheServlet(Servlet::ptr servlet, int64_t ttl_ms = -1, int64_t stale_ms = -1
+                 ,const std::vector<std::string>& vary_headers = {});
+
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request
+                        , sylar::http::HttpResponse::ptr response
+                        , sylar::http::HttpSession::ptr session) override;
+
+    Servlet::ptr getServlet() const { return m_servlet;}
+
+private:
+    std::string makeKey(HttpRequest::ptr req) const;
+    //后台重新执行Servlet刷新缓存，ttl_ms/stale_ms是handle里已经按配置解析好的值(m_ttl/m_stale<0时是默认值)
+    //req还在被前台使用，这里拷贝一份给后台协程
+    void revalidate(const std::string& key, HttpRequest::ptr req
+                    ,uint64_t ttl_ms, uint64_t stale_ms);
+    //响应可以缓存时放进缓存
+    static bool Store(const std::string& key, HttpResponse::ptr rsp, HttpSession::ptr session
+                      ,uint64_t ttl_ms, uint64_t stale_ms);
+
+private:
+    Servlet::ptr m_servlet;
+    //<0表示用配置的默认值
+    int64_t m_ttl;
+    int64_t m_stale;
+    std::vector<std::string> m_varyHeaders;
+    //区分不同CacheServlet的key
+    uint32_t m_id;
+};
+
+}
+}
+
+#endif
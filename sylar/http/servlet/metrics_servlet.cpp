@@ -0,0 +1,19 @@
+#include "metrics_servlet.h"
+#include "sylar/metrics.h"
+
+namespace sylar {
+namespace http {
+
+MetricsServlet::MetricsServlet() : Servlet("MetricsServlet") {
+}
+
+int32_t MetricsServlet::handle(sylar::http::HttpRequest::ptr request,
+                               sylar::http::HttpResponse::ptr response,
+                               sylar::http::HttpSession::ptr session) {
+    response->setHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    response->setBody(sylar::metrics::MetricsMgr::GetInstance()->toString());
+    return 0;
+}
+
+}
+}
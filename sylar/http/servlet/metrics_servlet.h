@@ -0,0 +1,22 @@
+#ifndef __SYLAR_HTTP_SERVLETS_METRICS_SERVLET_H__
+#define __SYLAR_HTTP_SERVLETS_METRICS_SERVLET_H__
+
+#include "sylar/http/servlet.h"
+
+//GET /_/metrics 按Prometheus文本格式(0.0.4)返回MetricsMgr中的全部指标，供Prometheus抓取
+
+namespace sylar {
+namespace http {
+
+class MetricsServlet : public Servlet {
+public:
+    MetricsServlet();
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request,
+                           sylar::http::HttpResponse::ptr response,
+                           sylar::http::HttpSession::ptr session) override;
+};
+
+}
+}
+
+#endif
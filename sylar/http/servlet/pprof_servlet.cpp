@@ -0,0 +1,50 @@
+#include "pprof_servlet.h"
+#include "sylar/profiler.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace sylar {
+namespace http {
+
+CpuProfileServlet::CpuProfileServlet() : Servlet("CpuProfileServlet") {
+}
+
+int32_t CpuProfileServlet::handle(sylar::http::HttpRequest::ptr request,
+                                  sylar::http::HttpResponse::ptr response,
+                                  sylar::http::HttpSession::ptr session) {
+    uint32_t seconds = std::min(request->getParamAs<uint32_t>("seconds", 30), (uint32_t)600);
+    uint32_t hz = request->getParamAs<uint32_t>("hz", 99);
+    Profiler::GroupBy group = Profiler::ParseGroupBy(request->getParam("group", "thread"));
+    response->setHeader("Content-Type", "text/plain; charset=utf-8");
+    std::stringstream ss;
+    if (!Profiler::ProfileCpu(seconds, hz, group, ss)) {
+        response->setStatus(HttpStatus::SERVICE_UNAVAILABLE);
+        response->setBody(Profiler::IsCpuProfiling() ? "cpu profile is already running\n"
+                                                     : "start cpu profile fail\n");
+        return 0;
+    }
+    response->setBody(ss.str());
+    return 0;
+}
+
+HeapProfileServlet::HeapProfileServlet() : Servlet("HeapProfileServlet") {
+}
+
+int32_t HeapProfileServlet::handle(sylar::http::HttpRequest::ptr request,
+                                   sylar::http::HttpResponse::ptr response,
+                                   sylar::http::HttpSession::ptr session) {
+    response->setHeader("Content-Type", "text/plain; charset=utf-8");
+    if (!Profiler::IsHeapEnabled()) {
+        response->setStatus(HttpStatus::SERVICE_UNAVAILABLE);
+        response->setBody("heap profile is disabled, set pprof.heap_sample_bytes\n");
+        return 0;
+    }
+    std::stringstream ss;
+    Profiler::WriteHeap(Profiler::ParseGroupBy(request->getParam("group", "thread")), ss);
+    response->setBody(ss.str());
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,37 @@
+#ifndef __SYLAR_HTTP_SERVLETS_PPROF_SERVLET_H__
+#define __SYLAR_HTTP_SERVLETS_PPROF_SERVLET_H__
+
+#include "sylar/http/servlet.h"
+
+//GET /_/pprof/profile 采样CPU，返回flamegraph用的collapsed格式(见sylar/profiler.h)
+//  seconds=30  采样时长，最长600秒
+//  hz=99       每秒CPU时间的采样次数，最多1000
+//  group=thread  调用栈前面加的标签: none/thread(线程名)/fiber(线程名和协程id)
+//  已经有采样在进行时返回503
+//GET /_/pprof/heap 被采样的仍在使用的内存，值为估算的字节数，需要先配置pprof.heap_sample_bytes
+//  group=thread  同上
+//HttpServer只在http.pprof.enable为true(默认false)时注册(和/_/trace共用这个开关)，也可以由应用自己挂到有访问控制的路径上
+
+namespace sylar {
+namespace http {
+
+class CpuProfileServlet : public Servlet {
+public:
+    CpuProfileServlet();
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request,
+                           sylar::http::HttpResponse::ptr response,
+                           sylar::http::HttpSession::ptr session) override;
+};
+
+class HeapProfileServlet : public Servlet {
+public:
+    HeapProfileServlet();
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request,
+                           sylar::http::HttpResponse::ptr response,
+                           sylar::http::HttpSession::ptr session) override;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,448 @@
+#include "static_file_servlet.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/streams/zlib_stream.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<std::map<std::string, std::string> >::ptr g_static_roots =
+    sylar::Config::Lookup("http.static.roots", std::map<std::string, std::string>(),
+                          "http static file roots, uri prefix -> local dir");
+static sylar::ConfigVar<uint64_t>::ptr g_static_cache_file_size =
+    sylar::Config::Lookup("http.static.cache_file_size", (uint64_t)(64 * 1024),
+                          "http static file max size to be cached in memory, larger use sendfile");
+static sylar::ConfigVar<uint64_t>::ptr g_static_cache_size =
+    sylar::Config::Lookup("http.static.cache_size", (uint64_t)(64 * 1024 * 1024),
+                          "http static file memory cache size");
+static sylar::ConfigVar<uint64_t>::ptr g_static_gzip_min_size =
+    sylar::Config::Lookup("http.static.gzip_min_size", (uint64_t)1024,
+                          "http static file min size to precompute gzip");
+static sylar::ConfigVar<uint32_t>::ptr g_static_max_age =
+    sylar::Config::Lookup("http.static.max_age", (uint32_t)3600,
+                          "http static file Cache-Control max-age(seconds)");
+
+StaticFileCache::StaticFileCache()
+    :m_bytes(0) {
+}
+
+StaticFileEntry::ptr StaticFileCache::get(const std::string& path) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(path);
+    if (it == m_index.end()) {
+        return nullptr;
+    }
+    m_list.splice(m_list.begin(), m_list, it->second);
+    return *it->second;
+}
+
+void StaticFileCache::set(StaticFileEntry::ptr entry) {
+    size_t max_bytes = g_static_cache_size->getValue();
+    size_t bytes = entry->data.size() + entry->gzip.size();
+    if (bytes > max_bytes) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(entry->path);
+    if (it != m_index.end()) {
+        m_bytes -= (*it->second)->data.size() + (*it->second)->gzip.size();
+        m_list.erase(it->second);
+        m_index.erase(it);
+    }
+    shrink(max_bytes - bytes);
+    m_list.push_front(entry);
+    m_index[entry->path] = m_list.begin();
+    m_bytes += bytes;
+}
+
+void StaticFileCache::del(const std::string& path) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(path);
+    if (it == m_index.end()) {
+        return;
+    }
+    m_bytes -= (*it->second)->data.size() + (*it->second)->gzip.size();
+    m_list.erase(it->second);
+    m_index.erase(it);
+}
+
+size_t StaticFileCache::getCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_list.size();
+}
+
+void StaticFileCache::shrink(size_t max_bytes) {
+    while (m_bytes > max_bytes && !m_list.empty()) {
+        auto& entry = m_list.back();
+        m_bytes -= entry->data.size() + entry->gzip.size();
+        m_index.erase(entry->path);
+        m_list.pop_back();
+    }
+}
+
+StaticFileServlet::StaticFileServlet(const std::string& prefix, const std::string& root)
+    :Servlet("StaticFileServlet")
+    ,m_prefix(prefix)
+    ,m_root(root) {
+    while (m_root.size() > 1 && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+    char* real = ::realpath(m_root.c_str(), nullptr);
+    if (real) {
+        m_realRoot = real;
+        free(real);
+    } else {
+        SYLAR_LOG_ERROR(g_logger) << "static root realpath fail root=" << m_root
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        m_realRoot = m_root;
+    }
+}
+
+void StaticFileServlet::RegisterRoots(ServletDispatch::ptr dispatch) {
+    for (auto& i : g_static_roots->getValue()) {
+        std::string prefix = i.first;
+        if (prefix.empty() || prefix.back() != '/') {
+            prefix.push_back('/');
+        }
+        dispatch->addGlobServlet(prefix + "*", std::make_shared<StaticFileServlet>(prefix, i.second));
+        SYLAR_LOG_INFO(g_logger) << "static file root " << prefix << " -> " << i.second;
+    }
+}
+
+std::string StaticFileServlet::GetContentType(const std::string& path) {
+    static const std::unordered_map<std::string, std::string> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"json", "application/json; charset=utf-8"},
+        {"xml", "application/xml; charset=utf-8"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"svg", "image/svg+xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"webp", "image/webp"},
+        {"ico", "image/x-icon"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"},
+        {"mp4", "video/mp4"},
+        {"zip", "application/zip"},
+        {"gz", "application/gzip"}
+    };
+    size_t pos = path.rfind('.');
+    if (pos != std::string::npos && path.find('/', pos) == std::string::npos) {
+        auto it = s_types.find(sylar::ToLower(path.substr(pos + 1)));
+        if (it != s_types.end()) {
+            return it->second;
+        }
+    }
+    return "application/octet-stream";
+}
+
+//文本类的内容才值得压缩，图片/视频/压缩包本身已经压缩过
+static bool IsCompressible(const std::string& content_type) {
+    return content_type.compare(0, 5, "text/") == 0
+        || content_type.find("javascript") != std::string::npos
+        || content_type.find("json") != std::string::npos
+        || content_type.find("xml") != std::string::npos
+        || content_type.find("wasm") != std::string::npos;
+}
+
+static std::string MakeETag(const struct stat& st) {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "\"%lx-%lx\"", (unsigned long)st.st_mtime, (unsigned long)st.st_size);
+    return std::string(buf, n);
+}
+
+//If-None-Match可能是 "*" 或逗号分隔的多个ETag，弱比较(忽略W/前缀)
+static bool MatchETag(const std::string& header, const std::string& etag) {
+    if (header.empty()) {
+        return false;
+    }
+    if (header == "*") {
+        return true;
+    }
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        std::string tag = sylar::StringUtil::Trim(header.substr(pos, end - pos));
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag = tag.substr(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+//解析单段Range：bytes=a-b、bytes=a-、bytes=-n
+//返回0表示成功，[begin, end]为闭区间；-1表示范围不可满足(416)；1表示格式不支持，按整个文件返回
+static int ParseRange(const std::string& range, off_t size, off_t& begin, off_t& end) {
+    if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos) {
+        return 1;
+    }
+    std::string spec = range.substr(6);
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return 1;
+    }
+    std::string first = sylar::StringUtil::Trim(spec.substr(0, dash));
+    std::string last = sylar::StringUtil::Trim(spec.substr(dash + 1));
+    char* p = nullptr;
+    if (first.empty()) {
+        //后缀范围：最后n个字节
+        if (last.empty()) {
+            return 1;
+        }
+        long long n = strtoll(last.c_str(), &p, 10);
+        if (*p || n <= 0) {
+            return n == 0 && !*p ? -1 : 1;
+        }
+        begin = n >= size ? 0 : size - n;
+        end = size - 1;
+    } else {
+        long long b = strtoll(first.c_str(), &p, 10);
+        if (*p || b < 0) {
+            return 1;
+        }
+        long long e = size - 1;
+        if (!last.empty()) {
+            e = strtoll(last.c_str(), &p, 10);
+            if (*p || e < b) {
+                return 1;
+            }
+            if (e >= size) {
+                e = size - 1;
+            }
+        }
+        begin = b;
+        end = e;
+    }
+    if (size == 0 || begin >= size) {
+        return -1;
+    }
+    return 0;
+}
+
+bool StaticFileServlet::toLocalPath(const std::string& uri, std::string& path) const {
+    if (uri.compare(0, m_prefix.size(), m_prefix) != 0) {
+        return false;
+    }
+    std::string rel = sylar::StringUtil::UrlDecode(uri.substr(m_prefix.size()), false);
+    //按段检查，拒绝".."以及解码出来的'\0'，防止访问root之外的文件
+    if (rel.find('\0') != std::string::npos) {
+        return false;
+    }
+    size_t pos = 0;
+    while (pos <= rel.size()) {
+        size_t end = rel.find('/', pos);
+        if (end == std::string::npos) {
+            end = rel.size();
+        }
+        if (rel.compare(pos, end - pos, "..") == 0 && end - pos == 2) {
+            return false;
+        }
+        pos = end + 1;
+    }
+    path = m_root + "/" + rel;
+    return true;
+}
+
+bool StaticFileServlet::toRealPath(const std::string& path, std::string& real) const {
+    char* p = ::realpath(path.c_str(), nullptr);
+    if (!p) {
+        return false;
+    }
+    real = p;
+    free(p);
+    //root里的符号链接可能指向root之外
+    if (real.compare(0, m_realRoot.size(), m_realRoot) != 0) {
+        return false;
+    }
+    return real.size() == m_realRoot.size() || m_realRoot.back() == '/'
+        || real[m_realRoot.size()] == '/';
+}
+
+StaticFileEntry::ptr StaticFileServlet::load(const std::string& path, const struct stat& st) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    StaticFileEntry::ptr entry(new StaticFileEntry);
+    entry->data.resize(st.st_size);
+    size_t offset = 0;
+    while (offset < (size_t)st.st_size) {
+        ssize_t n = ::read(fd, &entry->data[offset], st.st_size - offset);
+        if (n <= 0) {
+            break;
+        }
+        offset += n;
+    }
+    ::close(fd);
+    if (offset != (size_t)st.st_size) {
+        return nullptr;
+    }
+    entry->path = path;
+    entry->mtime = st.st_mtime;
+    entry->size = st.st_size;
+    entry->etag = MakeETag(st);
+    entry->contentType = GetContentType(path);
+    if (entry->data.size() >= g_static_gzip_min_size->getValue()
+            && IsCompressible(entry->contentType)) {
+        auto zs = ZlibStreamPool::GetGzip(true);
+        if (zs && zs->write(entry->data.c_str(), entry->data.size()) == Z_OK
+                && zs->flush() == Z_OK) {
+            std::string gz = zs->getResult();
+            if (gz.size() < entry->data.size()) {
+                entry->gzip.swap(gz);
+            }
+        }
+    }
+    return entry;
+}
+
+int32_t StaticFileServlet::handle(sylar::http::HttpRequest::ptr request
+                                  , sylar::http::HttpResponse::ptr response
+                                  , sylar::http::HttpSession::ptr session) {
+    if (request->getMethod() != HttpMethod::GET && request->getMethod() != HttpMethod::HEAD) {
+        response->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+    std::string path;
+    if (!toLocalPath(request->getPath(), path)) {
+        response->setStatus(HttpStatus::FORBIDDEN);
+        return 0;
+    }
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        if (path.back() != '/') {
+            path.push_back('/');
+        }
+        path.append("index.html");
+    }
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        response->setStatus(HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    std::string real;
+    if (!toRealPath(path, real)) {
+        response->setStatus(HttpStatus::FORBIDDEN);
+        return 0;
+    }
+    path.swap(real);
+
+    std::string content_type = GetContentType(path);
+    //可压缩的类型按Accept-Encoding返回不同的内容(预先压缩的gzip或者HttpCompress压缩)
+    bool compressible = IsCompressible(content_type);
+    std::string etag = MakeETag(st);
+    response->setHeader("ETag", etag);
+    response->setHeader("Accept-Ranges", "bytes");
+    response->setHeader("Cache-Control", "max-age=" + std::to_string(g_static_max_age->getValue()));
+    if (compressible) {
+        response->setHeader("Vary", "Accept-Encoding");
+    }
+    if (MatchETag(request->getHeader("If-None-Match"), etag)) {
+        response->setStatus(HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    off_t begin = 0;
+    off_t end = st.st_size - 1;
+    bool partial = false;
+    std::string range = request->getHeader("Range");
+    if (!range.empty()) {
+        int rt = ParseRange(range, st.st_size, begin, end);
+        if (rt < 0) {
+            response->setStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->setHeader("Content-Range", "bytes */" + std::to_string(st.st_size));
+            return 0;
+        }
+        if (rt == 0) {
+            partial = true;
+            response->setStatus(HttpStatus::PARTIAL_CONTENT);
+            response->setHeader("Content-Range", "bytes " + std::to_string(begin) + "-"
+                    + std::to_string(end) + "/" + std::to_string(st.st_size));
+        } else {
+            begin = 0;
+        }
+    }
+    response->setHeader("Content-Type", content_type);
+    bool head = request->getMethod() == HttpMethod::HEAD;
+    //HEAD没有消息体，Content-Length要和GET时一致
+    //空文件的消息体也是空的，序列化时不会带Content-Length，和HEAD一样显式写上
+    off_t length = end - begin + 1;
+
+    //小文件走内存缓存
+    if ((uint64_t)st.st_size <= g_static_cache_file_size->getValue()) {
+        auto cache = StaticFileCacheMgr::GetInstance();
+        StaticFileEntry::ptr entry = cache->get(path);
+        if (entry && (entry->mtime != st.st_mtime || entry->size != st.st_size)) {
+            cache->del(path);
+            entry = nullptr;
+        }
+        if (!entry) {
+            entry = load(path, st);
+            if (!entry) {
+                response->setStatus(HttpStatus::INTERNAL_SERVER_ERROR);
+                return 0;
+            }
+            cache->set(entry);
+        }
+        bool gzip = !partial && !entry->gzip.empty()
+            && strcasestr(request->getHeader("Accept-Encoding").c_str(), "gzip");
+        if (gzip) {
+            //压缩后的内容和原文字节不同，强ETag不能共用，改成弱ETag
+            response->setHeader("ETag", "W/" + etag);
+            response->setHeader("Content-Encoding", "gzip");
+            length = entry->gzip.size();
+        }
+        if (head || length == 0) {
+            response->setHeader("Content-Length", std::to_string(length));
+            return 0;
+        }
+        if (partial) {
+            response->setBody(entry->data.substr(begin, length));
+        } else if (gzip) {
+            response->setBody(entry->gzip);
+        } else {
+            response->setBody(entry->data);
+        }
+        return 0;
+    }
+
+    if (head || length == 0) {
+        response->setHeader("Content-Length", std::to_string(length));
+        return 0;
+    }
+    //大文件用sendfile发送
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        SYLAR_LOG_ERROR(g_logger) << "open static file fail path=" << path
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        response->setStatus(HttpStatus::INTERNAL_SERVER_ERROR);
+        return 0;
+    }
+    response->setFileBody(std::make_shared<HttpFileBody>(fd, begin, length));
+    return 0;
+}
+
+}
+}
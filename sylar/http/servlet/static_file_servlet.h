@@ -0,0 +1,124 @@
+/**
+ * @file static_file_servlet.h
+ * @brief 静态文件Servlet
+ * @date 2025-07-13
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// StaticFileServlet 把一个uri前缀映射到本地目录，直接由框架发送静态文件，不再经过业务代码读文件再setBody
+// 1.小文件(<= http.static.cache_file_size)读进内存，放进按字节数限制的LRU缓存，
+//   可压缩的类型预先算好gzip版本，客户端支持gzip时直接发送压缩后的内容
+// 2.大文件不进缓存，用sendfile从文件直接发到socket，数据不经过用户态
+// 3.用 "mtime-size" 生成ETag，If-None-Match命中时返回304；发送gzip内容时用弱ETag，可压缩的类型带Vary: Accept-Encoding
+// 4.支持单段Range请求(bytes=a-b / bytes=a- / bytes=-n)，返回206
+//
+// 通过配置 http.static.roots 注册：
+//   http:
+//     static:
+//       roots:
+//         /static/: /data/www/static
+//         /download/: /data/download
+// 然后 StaticFileServlet::RegisterRoots(dispatch) 把每个前缀注册成模糊匹配的Servlet
+
+#ifndef __SYLAR_HTTP_SERVLETS_STATIC_FILE_SERVLET_H__
+#define __SYLAR_HTTP_SERVLETS_STATIC_FILE_SERVLET_H__
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "sylar/http/servlet.h"
+#include "sylar/mutex.h"
+#include "sylar/singleton.h"
+
+namespace sylar {
+namespace http {
+
+//缓存的小文件
+struct StaticFileEntry {
+    typedef std::shared_ptr<StaticFileEntry> ptr;
+    //文件的绝对路径
+    std::string path;
+    //文件内容
+    std::string data;
+    //gzip压缩后的内容，不可压缩或压缩后没有变小时为空
+    std::string gzip;
+    std::string etag;
+    std::string contentType;
+    time_t mtime = 0;
+    off_t size = 0;
+};
+
+//按字节数限制大小的LRU缓存，多个StaticFileServlet共用
+class StaticFileCache {
+public:
+    typedef std::shared_ptr<StaticFileCache> ptr;
+    typedef Mutex MutexType;
+
+    StaticFileCache();
+
+    //查找缓存，找到后移到链表头部
+    StaticFileEntry::ptr get(const std::string& path);
+    //放入缓存，超过http.static.cache_size时从链表尾部淘汰
+    void set(StaticFileEntry::ptr entry);
+    //删除缓存(文件已修改)
+    void del(const std::string& path);
+
+    size_t getBytes() const { return m_bytes;}
+    size_t getCount();
+
+private:
+    //淘汰直到缓存大小不超过max_bytes，调用方需持有锁
+    void shrink(size_t max_bytes);
+
+private:
+    MutexType m_mutex;
+    //链表头部为最近使用的
+    std::list<StaticFileEntry::ptr> m_list;
+    std::unordered_map<std::string, std::list<StaticFileEntry::ptr>::iterator> m_index;
+    //缓存的总字节数(原文 + gzip)
+    size_t m_bytes;
+};
+
+typedef sylar::Singleton<StaticFileCache> StaticFileCacheMgr;
+
+class StaticFileServlet : public Servlet {
+public:
+    typedef std::shared_ptr<StaticFileServlet> ptr;
+
+    //prefix：uri前缀，如/static/
+    //root：对应的本地目录
+    StaticFileServlet(const std::string& prefix, const std::string& root);
+
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request
+                        , sylar::http::HttpResponse::ptr response
+                        , sylar::http::HttpSession::ptr session) override;
+
+    const std::string& getPrefix() const { return m_prefix;}
+    const std::string& getRoot() const { return m_root;}
+
+    //把配置http.static.roots中的每一项注册到dispatch上(prefix + "*")
+    static void RegisterRoots(ServletDispatch::ptr dispatch);
+    //根据文件扩展名返回Content-Type
+    static std::string GetContentType(const std::string& path);
+
+private:
+    //把uri映射到本地文件路径，包含".."等越界路径时返回false
+    bool toLocalPath(const std::string& uri, std::string& path) const;
+    //解析符号链接得到真实路径，不在root下(符号链接指向root之外)时返回false
+    bool toRealPath(const std::string& path, std::string& real) const;
+    //读取小文件并生成缓存项
+    StaticFileEntry::ptr load(const std::string& path, const struct stat& st);
+
+private:
+    std::string m_prefix;
+    std::string m_root;
+    //realpath之后的root
+    std::string m_realRoot;
+};
+
+}
+}
+
+#endif
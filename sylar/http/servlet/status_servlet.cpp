@@ -1,5 +1,7 @@
 #include "status_servlet.h"
 #include "sylar/sylar.h"
+#include "sylar/http/http_compress.h"
+#include "cache_servlet.h"
 
 namespace sylar {
 namespace http {
@@ -69,6 +71,12 @@ int32_t StatusServlet::handle(sylar::http::HttpRequest::ptr request
     ss << "===================================================" << std::endl;
     XX("fibers") << sylar::Fiber::TotalFibers() << std::endl;
     ss << "===================================================" << std::endl;
+    ss << "<Compress>" << std::endl;
+    HttpCompress::DumpStats(ss) << std::endl;
+    ss << "===================================================" << std::endl;
+    ss << "<ResponseCache>" << std::endl;
+    HttpResponseCacheMgr::GetInstance()->dump(ss) << std::endl;
+    ss << "===================================================" << std::endl;
     ss << "<Logger>" << std::endl;
     ss << sylar::LoggerMgr::GetInstance()->toYamlString() << std::endl;
     ss << "===================================================" << std::endl;
@@ -117,6 +125,15 @@ int32_t StatusServlet::handle(sylar::http::HttpRequest::ptr request
                     }
                     infos.clear();
                 }
+                std::vector<HttpFilter::ptr> filters;
+                sd->listAllFilter(filters);
+                if(!filters.empty()) {
+                    ss << "[Filters]" << std::endl;
+                    for(auto& i : filters) {
+                        ss << "  " << i->getName() << std::endl;
+                        i->dump(ss);
+                    }
+                }
             }
         }
     }
@@ -0,0 +1,33 @@
+#include "trace_servlet.h"
+#include "sylar/trace.h"
+
+#include <sstream>
+
+namespace sylar {
+namespace http {
+
+TraceServlet::TraceServlet() : Servlet("TraceServlet") {
+}
+
+int32_t TraceServlet::handle(sylar::http::HttpRequest::ptr request,
+                             sylar::http::HttpResponse::ptr response,
+                             sylar::http::HttpSession::ptr session) {
+    if (request->getMethod() == HttpMethod::POST) {
+        sylar::Tracer::Clear();
+        response->setBody("ok");
+        return 0;
+    }
+    if (request->getMethod() != HttpMethod::GET) {
+        response->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, POST");
+        return 0;
+    }
+    std::stringstream ss;
+    sylar::Tracer::WriteJson(ss, request->getParam("trace_id"));
+    response->setHeader("Content-Type", "application/json; charset=utf-8");
+    response->setBody(ss.str());
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,25 @@
+#ifndef __SYLAR_HTTP_SERVLETS_TRACE_SERVLET_H__
+#define __SYLAR_HTTP_SERVLETS_TRACE_SERVLET_H__
+
+#include "sylar/http/servlet.h"
+
+//GET /_/trace 按Chrome trace event格式返回各线程缓冲区里的span，用chrome://tracing或Perfetto打开
+//  trace_id=<32位hex>  只返回这个trace的span
+//POST /_/trace 丢弃已经记录的span
+//HttpServer只在http.pprof.enable为true(默认false)时注册
+
+namespace sylar {
+namespace http {
+
+class TraceServlet : public Servlet {
+public:
+    TraceServlet();
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request,
+                           sylar::http::HttpResponse::ptr response,
+                           sylar::http::HttpSession::ptr session) override;
+};
+
+}
+}
+
+#endif
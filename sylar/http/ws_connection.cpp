@@ -0,0 +1,146 @@
+#include "ws_connection.h"
+#include <string.h>
+#include <strings.h>
+#include <random>
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/util/hash_util.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+WSConnection::WSConnection(Socket::ptr sock, bool owner)
+    :HttpConnection(sock, owner) {
+}
+
+std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(const std::string& url
+                                    , uint64_t timeout_ms
+                                    , const std::map<std::string, std::string>& headers) {
+    Uri::ptr uri = Uri::Create(url);
+    if (!uri) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_URI,
+                                nullptr, "invalid url:" + url), nullptr);
+    }
+    return Create(uri, timeout_ms, headers);
+}
+
+std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(Uri::ptr uri
+                                    , uint64_t timeout_ms
+                                    , const std::map<std::string, std::string>& headers) {
+    Address::ptr addr = uri->createAddress();
+    if (!addr) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_HOST,
+                                nullptr, "invalid host: " + uri->getHost()), nullptr);
+    }
+    bool is_ssl = uri->getScheme() == "wss" || uri->getScheme() == "https";
+    Socket::ptr sock = is_ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+    if (!sock) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::CREATE_SOCKET_ERROR,
+                                nullptr, "create socket fail: " + addr->toString()
+                                + " errno=" + std::to_string(errno)
+                                + " errstr=" + std::string(strerror(errno))), nullptr);
+    }
+    if (!sock->connect(addr, timeout_ms)) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::CONNECT_FAIL,
+                                nullptr, "connect fail: " + addr->toString()), nullptr);
+    }
+    sock->setRecvTimeout(timeout_ms);
+    WSConnection::ptr conn = std::make_shared<WSConnection>(sock);
+
+    //Sec-WebSocket-Key：16字节随机数的base64
+    std::random_device rd;
+    std::string nonce(16, '\0');
+    for (size_t i = 0; i < nonce.size(); i += 4) {
+        uint32_t r = rd();
+        memcpy(&nonce[i], &r, 4);
+    }
+    std::string key = sylar::base64encode(nonce);
+
+    HttpRequest::ptr req = std::make_shared<HttpRequest>(0x11, false);
+    req->setPath(uri->getPath());
+    req->setQuery(uri->getQuery());
+    req->setMethod(HttpMethod::GET);
+    req->setWebsocket(true);
+    bool has_host = false;
+    for (auto& i : headers) {
+        if (!has_host && strcasecmp(i.first.c_str(), "host") == 0) {
+            has_host = !i.second.empty();
+        }
+        req->setHeader(i.first, i.second);
+    }
+    if (!has_host) {
+        req->setHeader("Host", uri->getHost());
+    }
+    req->setHeader("Upgrade", "websocket");
+    req->setHeader("Connection", "Upgrade");
+    req->setHeader("Sec-WebSocket-Version", "13");
+    req->setHeader("Sec-WebSocket-Key", key);
+    static sylar::ConfigVar<bool>::ptr s_deflate_enable =
+        sylar::Config::Lookup<bool>("websocket.deflate.enable");
+    if (s_deflate_enable && s_deflate_enable->getValue()) {
+        req->setHeader("Sec-WebSocket-Extensions", "permessage-deflate; client_max_window_bits");
+    }
+
+    int rt = conn->sendRequest(req);
+    if (rt == 0) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::SEND_CLOSE_BY_PEER,
+                                nullptr, "send request closed by peer: " + addr->toString()), nullptr);
+    }
+    if (rt < 0) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::SEND_SOCKET_ERROR,
+                                nullptr, "send request socket error errno=" + std::to_string(errno)
+                                + " errstr=" + std::string(strerror(errno))), nullptr);
+    }
+    //101没有消息体，响应头之后多读的数据留在读缓冲区里给WSChannel
+    auto rsp = conn->recvResponseHeader();
+    if (!rsp) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT,
+                                nullptr, "recv response timeout: " + addr->toString()
+                                + " timeout_ms:" + std::to_string(timeout_ms)), nullptr);
+    }
+    if (rsp->getStatus() != HttpStatus::SWITCHING_PROTOCOLS
+            || rsp->getHeader("Sec-WebSocket-Accept") != WSAcceptKey(key)) {
+        SYLAR_LOG_DEBUG(g_logger) << "websocket handshake fail status=" << (int)rsp->getStatus();
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::WS_HANDSHAKE_FAIL, rsp, "not websocket server "
+                                + addr->toString()), nullptr);
+    }
+
+    conn->m_channel = std::make_shared<WSChannel>(conn.get(), conn->getReadBuffer(), sock, true);
+    std::string ext = rsp->getHeader("Sec-WebSocket-Extensions");
+    if (!ext.empty()) {
+        WSDeflateParams params;
+        if (!WSParseDeflate(ext, params) || params.clientMaxWindowBits < 9) {
+            //服务端回复了没有请求过的扩展
+            conn->close();
+            return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::WS_HANDSHAKE_FAIL, rsp, "invalid websocket extensions: "
+                                    + ext), nullptr);
+        }
+        conn->m_channel->enableDeflate(params.clientNoContextTakeover, params.clientMaxWindowBits);
+    }
+    return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok"), conn);
+}
+
+WSFrameMessage::ptr WSConnection::recvMessage() {
+    return m_channel ? m_channel->recvMessage() : nullptr;
+}
+
+int32_t WSConnection::sendMessage(WSFrameMessage::ptr msg, bool fin) {
+    return m_channel ? m_channel->sendMessage(msg, fin) : -1;
+}
+
+int32_t WSConnection::sendMessage(const std::string& msg, int32_t opcode, bool fin) {
+    return m_channel ? m_channel->sendMessage(msg, opcode, fin) : -1;
+}
+
+int32_t WSConnection::ping() {
+    return m_channel ? m_channel->ping() : -1;
+}
+
+int32_t WSConnection::pong() {
+    return m_channel ? m_channel->pong() : -1;
+}
+
+}
+}
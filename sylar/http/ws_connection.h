@@ -0,0 +1,51 @@
+/**
+ * @file ws_connection.h
+ * @brief WebSocket客户端
+ * @date 2025-07-18
+ * @copyright Copyright (c) All rights reserved
+ */
+
+#ifndef __SYLAR_HTTP_WS_CONNECTION_H__
+#define __SYLAR_HTTP_WS_CONNECTION_H__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include "http_connection.h"
+#include "ws_session.h"
+
+namespace sylar {
+namespace http {
+
+class WSConnection : public HttpConnection {
+public:
+    typedef std::shared_ptr<WSConnection> ptr;
+    WSConnection(Socket::ptr sock, bool owner = true);
+
+    //连接url(ws://或者wss://)并完成握手，失败时WSConnection为nullptr，HttpResult中是失败原因
+    //默认请求permessage-deflate，配置websocket.deflate.enable为false时不请求
+    static std::pair<HttpResult::ptr, WSConnection::ptr> Create(const std::string& url
+                                    , uint64_t timeout_ms
+                                    , const std::map<std::string, std::string>& headers = {});
+    static std::pair<HttpResult::ptr, WSConnection::ptr> Create(Uri::ptr uri
+                                    , uint64_t timeout_ms
+                                    , const std::map<std::string, std::string>& headers = {});
+
+    WSFrameMessage::ptr recvMessage();
+    int32_t sendMessage(WSFrameMessage::ptr msg, bool fin = true);
+    int32_t sendMessage(const std::string& msg, int32_t opcode = WSFrameHead::TEXT_FRAME, bool fin = true);
+    int32_t ping();
+    int32_t pong();
+
+    //握手完成后有效
+    WSChannel::ptr getChannel() const { return m_channel;}
+
+private:
+    WSChannel::ptr m_channel;
+};
+
+}
+}
+
+#endif
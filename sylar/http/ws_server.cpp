@@ -0,0 +1,57 @@
+#include "ws_server.h"
+#include "sylar/log.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+WSServer::WSServer(sylar::IOManager* worker
+                   , sylar::IOManager* io_worker
+                   , sylar::IOManager* accept_worker)
+    :TcpServer(worker, io_worker, accept_worker) {
+    m_dispatch.reset(new WSServletDispatch);
+    m_type = "websocket_server";
+}
+
+void WSServer::handleClient(Socket::ptr client) {
+    SYLAR_LOG_DEBUG(g_logger) << "handleClient " << *client;
+    WSSession::ptr session(new WSSession(client));
+    do {
+        HttpRequest::ptr header = session->handleShake();
+        if (!header) {
+            SYLAR_LOG_DEBUG(g_logger) << "handleShake error";
+            break;
+        }
+        WSServlet::ptr servlet = m_dispatch->getWSServlet(header);
+        if (!servlet) {
+            SYLAR_LOG_DEBUG(g_logger) << "no match WSServlet path=" << header->getPath();
+            session->getChannel()->sendClose(1008, "no handler");
+            break;
+        }
+        int rt = servlet->onConnect(header, session);
+        if (rt) {
+            SYLAR_LOG_DEBUG(g_logger) << "onConnect return " << rt;
+            break;
+        }
+        //保活定时器挂在处理连接的IOManager上，连接对象析构时自动取消
+        session->getChannel()->startKeepalive(sylar::IOManager::GetThis());
+        while (true) {
+            auto msg = session->recvMessage();
+            if (!msg) {
+                break;
+            }
+            rt = servlet->handle(header, msg, session);
+            if (rt) {
+                SYLAR_LOG_DEBUG(g_logger) << "handle return " << rt;
+                break;
+            }
+        }
+        session->getChannel()->stopKeepalive();
+        servlet->onClose(header, session);
+    } while (false);
+    session->close();
+}
+
+}
+}
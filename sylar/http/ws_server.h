@@ -0,0 +1,43 @@
+/**
+ * @file ws_server.h
+ * @brief WebSocket服务器封装
+ * @date 2025-07-18
+ * @copyright Copyright (c) All rights reserved
+ */
+
+//每条连接在handleClient的协程中完成握手，按握手请求的路径找到WSServlet，
+//之后循环接收消息交给WSServlet处理，直到对端关闭、出错或者保活超时
+
+#ifndef __SYLAR_HTTP_WS_SERVER_H__
+#define __SYLAR_HTTP_WS_SERVER_H__
+
+#include <memory>
+#include "sylar/tcp_server.h"
+#include "ws_session.h"
+#include "ws_servlet.h"
+
+namespace sylar {
+namespace http {
+
+class WSServer : public TcpServer {
+public:
+    typedef std::shared_ptr<WSServer> ptr;
+
+    WSServer(sylar::IOManager* worker = sylar::IOManager::GetThis()
+             , sylar::IOManager* io_worker = sylar::IOManager::GetThis()
+             , sylar::IOManager* accept_worker = sylar::IOManager::GetThis());
+
+    WSServletDispatch::ptr getWSServletDispatch() const { return m_dispatch;}
+    void setWSServletDispatch(WSServletDispatch::ptr v) { m_dispatch = v;}
+
+protected:
+    virtual void handleClient(Socket::ptr client) override;
+
+protected:
+    WSServletDispatch::ptr m_dispatch;
+};
+
+}
+}
+
+#endif
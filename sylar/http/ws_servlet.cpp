@@ -0,0 +1,73 @@
+#include "ws_servlet.h"
+
+namespace sylar {
+namespace http {
+
+FunctionWSServlet::FunctionWSServlet(callback cb
+                                     , on_connect_cb connect_cb
+                                     , on_close_cb close_cb)
+    :WSServlet("FunctionWSServlet")
+    ,m_callback(cb)
+    ,m_onConnect(connect_cb)
+    ,m_onClose(close_cb) {
+}
+
+int32_t FunctionWSServlet::onConnect(sylar::http::HttpRequest::ptr header
+                                     , sylar::http::WSSession::ptr session) {
+    if (m_onConnect) {
+        return m_onConnect(header, session);
+    }
+    return 0;
+}
+
+int32_t FunctionWSServlet::onClose(sylar::http::HttpRequest::ptr header
+                                   , sylar::http::WSSession::ptr session) {
+    if (m_onClose) {
+        return m_onClose(header, session);
+    }
+    return 0;
+}
+
+int32_t FunctionWSServlet::handle(sylar::http::HttpRequest::ptr header
+                                  , sylar::http::WSFrameMessage::ptr msg
+                                  , sylar::http::WSSession::ptr session) {
+    if (m_callback) {
+        return m_callback(header, msg, session);
+    }
+    return 0;
+}
+
+WSServletDispatch::WSServletDispatch() {
+    m_name = "WSServletDispatch";
+}
+
+void WSServletDispatch::addWSServlet(const std::string& uri
+                                     , FunctionWSServlet::callback cb
+                                     , FunctionWSServlet::on_connect_cb connect_cb
+                                     , FunctionWSServlet::on_close_cb close_cb) {
+    //握手请求都是GET
+    addRoute(HttpMethod::GET, uri, std::make_shared<FunctionWSServlet>(cb, connect_cb, close_cb));
+}
+
+void WSServletDispatch::addGlobWSServlet(const std::string& uri
+                                         , FunctionWSServlet::callback cb
+                                         , FunctionWSServlet::on_connect_cb connect_cb
+                                         , FunctionWSServlet::on_close_cb close_cb) {
+    addGlobServlet(uri, std::make_shared<FunctionWSServlet>(cb, connect_cb, close_cb));
+}
+
+WSServlet::ptr WSServletDispatch::getWSServlet(HttpRequest::ptr req) {
+    RouteTree::Params params;
+    //默认的NotFoundServlet转换失败，返回nullptr
+    auto slt = std::dynamic_pointer_cast<WSServlet>(
+                    getMatchedServlet(req->getMethod(), req->getPath(), params));
+    if (slt) {
+        for (auto& i : params) {
+            req->setParam(i.first, i.second);
+        }
+    }
+    return slt;
+}
+
+}
+}
@@ -0,0 +1,101 @@
+/**
+ * @file ws_servlet.h
+ * @brief WebSocket Servlet封装
+ * @date 2025-07-18
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// WSServlet处理一条WebSocket连接的整个生命周期：
+//   握手成功后调用onConnect，之后每收到一条完整的消息调用一次handle，连接断开时调用onClose
+// WSServletDispatch复用ServletDispatch的路由表，握手请求的路径按GET路由匹配，
+// 匹配出的路由参数写入握手请求，后续的handle都能拿到
+
+#ifndef __SYLAR_HTTP_WS_SERVLET_H__
+#define __SYLAR_HTTP_WS_SERVLET_H__
+
+#include <functional>
+#include <memory>
+#include <string>
+#include "ws_session.h"
+#include "servlet.h"
+
+namespace sylar {
+namespace http {
+
+class WSServlet : public Servlet {
+public:
+    typedef std::shared_ptr<WSServlet> ptr;
+    WSServlet(const std::string& name)
+        :Servlet(name) {
+    }
+    virtual ~WSServlet() {}
+
+    //WebSocket连接不走HTTP的请求-响应处理
+    virtual int32_t handle(sylar::http::HttpRequest::ptr request
+                   , sylar::http::HttpResponse::ptr response
+                   , sylar::http::HttpSession::ptr session) override {
+        return 0;
+    }
+
+    //握手完成，返回非0时关闭连接
+    virtual int32_t onConnect(sylar::http::HttpRequest::ptr header
+                              , sylar::http::WSSession::ptr session) = 0;
+    virtual int32_t onClose(sylar::http::HttpRequest::ptr header
+                             , sylar::http::WSSession::ptr session) = 0;
+    //收到一条消息，返回非0时关闭连接
+    virtual int32_t handle(sylar::http::HttpRequest::ptr header
+                           , sylar::http::WSFrameMessage::ptr msg
+                           , sylar::http::WSSession::ptr session) = 0;
+};
+
+class FunctionWSServlet : public WSServlet {
+public:
+    typedef std::shared_ptr<FunctionWSServlet> ptr;
+    typedef std::function<int32_t (sylar::http::HttpRequest::ptr header
+                                   , sylar::http::WSSession::ptr session)> on_connect_cb;
+    typedef std::function<int32_t (sylar::http::HttpRequest::ptr header
+                                   , sylar::http::WSSession::ptr session)> on_close_cb;
+    typedef std::function<int32_t (sylar::http::HttpRequest::ptr header
+                                   , sylar::http::WSFrameMessage::ptr msg
+                                   , sylar::http::WSSession::ptr session)> callback;
+
+    FunctionWSServlet(callback cb
+                      , on_connect_cb connect_cb = nullptr
+                      , on_close_cb close_cb = nullptr);
+
+    using WSServlet::handle;
+    virtual int32_t onConnect(sylar::http::HttpRequest::ptr header
+                              , sylar::http::WSSession::ptr session) override;
+    virtual int32_t onClose(sylar::http::HttpRequest::ptr header
+                             , sylar::http::WSSession::ptr session) override;
+    virtual int32_t handle(sylar::http::HttpRequest::ptr header
+                           , sylar::http::WSFrameMessage::ptr msg
+                           , sylar::http::WSSession::ptr session) override;
+protected:
+    callback m_callback;
+    on_connect_cb m_onConnect;
+    on_close_cb m_onClose;
+};
+
+class WSServletDispatch : public ServletDispatch {
+public:
+    typedef std::shared_ptr<WSServletDispatch> ptr;
+
+    WSServletDispatch();
+    //uri可以包含:param和*wildcard
+    void addWSServlet(const std::string& uri
+                      , FunctionWSServlet::callback cb
+                      , FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                      , FunctionWSServlet::on_close_cb close_cb = nullptr);
+    void addGlobWSServlet(const std::string& uri
+                          , FunctionWSServlet::callback cb
+                          , FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                          , FunctionWSServlet::on_close_cb close_cb = nullptr);
+    //按握手请求匹配WSServlet，匹配出的路由参数写入req，没有匹配的返回nullptr
+    WSServlet::ptr getWSServlet(HttpRequest::ptr req);
+};
+
+}
+}
+
+#endif
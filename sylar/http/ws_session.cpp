@@ -0,0 +1,568 @@
+#include "ws_session.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/util.h"
+#include "sylar/util/hash_util.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_websocket_message_max_size =
+    sylar::Config::Lookup("websocket.message.max_size", (uint32_t)(1024 * 1024 * 32)
+            , "websocket message max size");
+
+static sylar::ConfigVar<bool>::ptr g_websocket_deflate_enable =
+    sylar::Config::Lookup("websocket.deflate.enable", true
+            , "websocket permessage-deflate enable");
+
+static sylar::ConfigVar<uint32_t>::ptr g_websocket_deflate_min_size =
+    sylar::Config::Lookup("websocket.deflate.min_size", (uint32_t)128
+            , "websocket messages smaller than this are sent uncompressed");
+
+static sylar::ConfigVar<uint64_t>::ptr g_websocket_keepalive_interval =
+    sylar::Config::Lookup("websocket.keepalive_interval", (uint64_t)(30 * 1000)
+            , "websocket ping interval in ms, 0 disables keepalive");
+
+WSFrameMessage::WSFrameMessage(int opcode, const std::string& data)
+    :m_opcode(opcode)
+    ,m_data(data) {
+}
+
+void WSMask(const char* src, char* dst, size_t len, const uint8_t key[4]) {
+    uint32_t k32;
+    memcpy(&k32, key, 4);
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i k128 = _mm_set1_epi32((int)k32);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(v, k128));
+    }
+#endif
+    //每个分组的长度都是4的倍数，key的相位不变
+    uint64_t k64 = ((uint64_t)k32 << 32) | k32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        v ^= k64;
+        memcpy(dst + i, &v, 8);
+    }
+    for (; i < len; ++i) {
+        dst[i] = src[i] ^ key[i & 3];
+    }
+}
+
+std::string WSAcceptKey(const std::string& key) {
+    return sylar::base64encode(sylar::sha1sum(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+static std::string Trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\"");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\"");
+    return str.substr(begin, end - begin + 1);
+}
+
+//解析一个permessage-deflate的参数，不认识的参数或者取值不合法返回false
+static bool ParseDeflateOffer(const std::string& offer, WSDeflateParams& params) {
+    size_t pos = offer.find(';');
+    if (Trim(offer.substr(0, pos)) != "permessage-deflate") {
+        return false;
+    }
+    while (pos != std::string::npos) {
+        size_t next = offer.find(';', pos + 1);
+        std::string param = offer.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+        pos = next;
+        size_t eq = param.find('=');
+        std::string name = Trim(param.substr(0, eq));
+        std::string value = eq == std::string::npos ? "" : Trim(param.substr(eq + 1));
+        if (name == "server_no_context_takeover") {
+            params.serverNoContextTakeover = true;
+        } else if (name == "client_no_context_takeover") {
+            params.clientNoContextTakeover = true;
+        } else if (name == "server_max_window_bits" || name == "client_max_window_bits") {
+            int bits = 15;
+            if (!value.empty()) {
+                bits = atoi(value.c_str());
+                if (bits < 8 || bits > 15) {
+                    return false;
+                }
+            } else if (name == "server_max_window_bits") {
+                return false;
+            }
+            (name[0] == 's' ? params.serverMaxWindowBits : params.clientMaxWindowBits) = bits;
+        } else if (!name.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WSParseDeflate(const std::string& extensions, WSDeflateParams& params) {
+    //多个扩展(或者同一个扩展的多个备选参数)用','分隔，按顺序取第一个能接受的
+    size_t begin = 0;
+    while (begin < extensions.size()) {
+        size_t end = extensions.find(',', begin);
+        if (end == std::string::npos) {
+            end = extensions.size();
+        }
+        WSDeflateParams tmp;
+        if (ParseDeflateOffer(extensions.substr(begin, end - begin), tmp)) {
+            params = tmp;
+            return true;
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+WSChannel::WSChannel(Stream* stream, HttpReadBuffer::ptr buffer, Socket::ptr sock, bool client)
+    :m_stream(stream)
+    ,m_buffer(buffer)
+    ,m_sock(sock)
+    ,m_client(client)
+    ,m_deflate(false)
+    ,m_noContextTakeover(false)
+    ,m_windowBits(15)
+    ,m_sendFragmenting(false)
+    ,m_closeCode(0)
+    ,m_lastRecvTime(sylar::GetCurrentMS())
+    ,m_writing(false)
+    ,m_error(false)
+    ,m_closeSent(false) {
+}
+
+WSChannel::~WSChannel() {
+    stopKeepalive();
+}
+
+void WSChannel::enableDeflate(bool no_context_takeover, int window_bits) {
+    m_deflate = true;
+    m_noContextTakeover = no_context_takeover;
+    //zlib的raw deflate不支持8，协商时已经拒绝了8
+    m_windowBits = std::max(window_bits, 9);
+}
+
+bool WSChannel::readFrameHead(uint8_t& flags, uint8_t& opcode, uint64_t& length, bool& mask, uint8_t key[4]) {
+    size_t need = 2;
+    while (m_buffer->size() < need) {
+        if (m_buffer->fill(m_stream) <= 0) {
+            return false;
+        }
+    }
+    const uint8_t* p = (const uint8_t*)m_buffer->data();
+    flags = p[0] & 0xf0;
+    opcode = p[0] & 0x0f;
+    mask = p[1] & 0x80;
+    length = p[1] & 0x7f;
+    need += (length == 126 ? 2 : (length == 127 ? 8 : 0)) + (mask ? 4 : 0);
+    while (m_buffer->size() < need) {
+        if (m_buffer->fill(m_stream) <= 0) {
+            return false;
+        }
+    }
+    //fill可能compact过，重新取地址
+    p = (const uint8_t*)m_buffer->data();
+    size_t pos = 2;
+    if (length == 126) {
+        length = ((uint64_t)p[2] << 8) | p[3];
+        pos = 4;
+    } else if (length == 127) {
+        length = 0;
+        for (int i = 0; i < 8; ++i) {
+            length = (length << 8) | p[2 + i];
+        }
+        pos = 10;
+        //最高位必须为0
+        if (length >> 63) {
+            return false;
+        }
+    }
+    if (mask) {
+        memcpy(key, p + pos, 4);
+        pos += 4;
+    }
+    m_buffer->consume(pos);
+    return true;
+}
+
+bool WSChannel::readPayload(std::string& out, uint64_t length) {
+    size_t old = out.size();
+    out.resize(old + length);
+    char* dst = &out[old];
+    size_t n = m_buffer->take(dst, length);
+    while (n < length) {
+        //剩下的比较多时直接读到目标内存，少的话先读进缓冲区，顺便把后面的帧一起读进来
+        if (length - n >= m_buffer->capacity() / 2) {
+            if (m_stream->readFixSize(dst + n, length - n) <= 0) {
+                return false;
+            }
+            break;
+        }
+        if (m_buffer->fill(m_stream) <= 0) {
+            return false;
+        }
+        n += m_buffer->take(dst + n, length - n);
+    }
+    return true;
+}
+
+WSFrameMessage::ptr WSChannel::recvMessage() {
+    WSFrameMessage::ptr msg(new WSFrameMessage);
+    std::string& data = msg->getData();
+    bool started = false;
+    bool compressed = false;
+    uint16_t error_code = 1002;
+    uint64_t max_size = g_websocket_message_max_size->getValue();
+    do {
+        uint8_t flags = 0;
+        uint8_t opcode = 0;
+        uint64_t length = 0;
+        bool mask = false;
+        uint8_t key[4] = {0};
+        if (!readFrameHead(flags, opcode, length, mask, key)) {
+            return nullptr;
+        }
+        m_lastRecvTime = sylar::GetCurrentMS();
+        bool fin = flags & 0x80;
+        bool rsv1 = flags & 0x40;
+        //客户端发的帧必须有掩码，服务端发的不能有；RSV2/RSV3没有协商任何扩展
+        if ((flags & 0x30) || mask == m_client) {
+            SYLAR_LOG_DEBUG(g_logger) << "invalid websocket frame flags=" << (int)flags
+                << " mask=" << mask;
+            break;
+        }
+        if (opcode & 0x08) {
+            //控制帧
+            if (!fin || rsv1 || length > 125) {
+                break;
+            }
+            std::string payload;
+            if (!readPayload(payload, length)) {
+                return nullptr;
+            }
+            if (mask) {
+                WSMask(&payload[0], &payload[0], length, key);
+            }
+            if (opcode == WSFrameHead::PING) {
+                pong(payload);
+                continue;
+            } else if (opcode == WSFrameHead::PONG) {
+                continue;
+            } else if (opcode == WSFrameHead::CLOSE) {
+                m_closeCode = payload.size() >= 2
+                    ? (((uint16_t)(uint8_t)payload[0] << 8) | (uint8_t)payload[1]) : 1005;
+                //回复CLOSE完成关闭握手
+                sendClose(payload.size() >= 2 ? m_closeCode : 1000);
+                return nullptr;
+            }
+            break;
+        }
+        if (opcode == WSFrameHead::CONTINUE) {
+            if (!started || rsv1) {
+                break;
+            }
+        } else if (opcode == WSFrameHead::TEXT_FRAME || opcode == WSFrameHead::BIN_FRAME) {
+            if (started || (rsv1 && !m_deflate)) {
+                break;
+            }
+            started = true;
+            compressed = rsv1;
+            msg->setOpcode(opcode);
+        } else {
+            break;
+        }
+        if (data.size() + length > max_size) {
+            SYLAR_LOG_WARN(g_logger) << "websocket message too large size="
+                << data.size() + length << " max_size=" << max_size;
+            error_code = 1009;
+            break;
+        }
+        size_t old = data.size();
+        if (!readPayload(data, length)) {
+            return nullptr;
+        }
+        if (mask) {
+            WSMask(&data[old], &data[old], length, key);
+        }
+        if (!fin) {
+            continue;
+        }
+        if (compressed) {
+            //补回发送方去掉的Z_SYNC_FLUSH结尾
+            data.append("\x00\x00\xff\xff", 4);
+            if (!m_decoder) {
+                m_decoder = ZlibStream::Create(false, 16 * 1024, ZlibStream::DEFLATE);
+            }
+            std::string out;
+            int rt = m_decoder ? m_decoder->decodeTo(data.data(), data.size(), out, max_size) : -1;
+            if (rt != Z_OK) {
+                SYLAR_LOG_WARN(g_logger) << "websocket inflate fail rt=" << rt;
+                error_code = rt == Z_BUF_ERROR ? 1009 : 1007;
+                break;
+            }
+            data.swap(out);
+        }
+        return msg;
+    } while (true);
+    sendClose(error_code);
+    return nullptr;
+}
+
+int32_t WSChannel::sendMessage(WSFrameMessage::ptr msg, bool fin) {
+    return sendMessage(msg->getData(), msg->getOpcode(), fin);
+}
+
+int32_t WSChannel::sendMessage(const std::string& msg, int32_t opcode, bool fin) {
+    uint8_t op = m_sendFragmenting ? (uint8_t)WSFrameHead::CONTINUE : (uint8_t)opcode;
+    //只压缩不分片的消息，RSV1必须在消息的第一个帧上决定
+    bool compress = !m_sendFragmenting && fin && m_deflate
+                    && msg.size() >= g_websocket_deflate_min_size->getValue();
+    m_sendFragmenting = !fin;
+    return sendFrame(op, fin, compress, msg.data(), msg.size());
+}
+
+int32_t WSChannel::ping(const std::string& data) {
+    return sendFrame(WSFrameHead::PING, true, false, data.data(), data.size());
+}
+
+int32_t WSChannel::pong(const std::string& data) {
+    return sendFrame(WSFrameHead::PONG, true, false, data.data(), data.size());
+}
+
+int32_t WSChannel::sendClose(uint16_t code, const std::string& reason) {
+    std::string payload;
+    payload.push_back((char)(code >> 8));
+    payload.push_back((char)code);
+    payload.append(reason.substr(0, 123));
+    return sendFrame(WSFrameHead::CLOSE, true, false, payload.data(), payload.size());
+}
+
+int32_t WSChannel::sendFrame(uint8_t opcode, bool fin, bool compress, const char* data, size_t len) {
+    static thread_local std::mt19937 s_rng(std::random_device{}());
+    MutexType::Lock lock(m_mutex);
+    if (m_error || m_closeSent) {
+        return -1;
+    }
+    std::string encoded;
+    if (compress) {
+        //压缩和追加在同一把锁下，保证对端按压缩的顺序解压
+        if (!m_encoder) {
+            m_encoder = ZlibStream::Create(true, 16 * 1024, ZlibStream::DEFLATE
+                                           , ZlibStream::DEFAULT_COMPRESSION, m_windowBits);
+        }
+        if (m_encoder && m_encoder->encodeTo(data, len, encoded, false) == Z_OK
+                && encoded.size() >= 4) {
+            encoded.resize(encoded.size() - 4);
+            if (m_noContextTakeover) {
+                m_encoder->reset();
+            }
+            data = encoded.data();
+            len = encoded.size();
+        } else {
+            SYLAR_LOG_WARN(g_logger) << "websocket deflate fail, send uncompressed";
+            compress = false;
+        }
+    }
+
+    char head[14];
+    size_t hl = 2;
+    head[0] = (fin ? 0x80 : 0) | (compress ? 0x40 : 0) | opcode;
+    uint8_t mask_bit = m_client ? 0x80 : 0;
+    if (len < 126) {
+        head[1] = mask_bit | len;
+    } else if (len <= 0xffff) {
+        head[1] = mask_bit | 126;
+        head[2] = (char)(len >> 8);
+        head[3] = (char)len;
+        hl = 4;
+    } else {
+        head[1] = mask_bit | 127;
+        for (int i = 0; i < 8; ++i) {
+            head[2 + i] = (char)((uint64_t)len >> (56 - 8 * i));
+        }
+        hl = 10;
+    }
+    uint8_t key[4];
+    if (m_client) {
+        uint32_t r = s_rng();
+        memcpy(key, &r, 4);
+        memcpy(head + hl, key, 4);
+        hl += 4;
+    }
+    m_out.append(head, hl);
+    size_t old = m_out.size();
+    m_out.resize(old + len);
+    if (m_client) {
+        WSMask(data, &m_out[old], len, key);
+    } else if (len) {
+        memcpy(&m_out[old], data, len);
+    }
+    if (opcode == WSFrameHead::CLOSE) {
+        m_closeSent = true;
+    }
+    lock.unlock();
+    flush();
+    return hl + len;
+}
+
+void WSChannel::flush() {
+    std::string out;
+    MutexType::Lock lock(m_mutex);
+    //已经有协程在发送，追加的帧由它发出
+    if (m_writing) {
+        return;
+    }
+    m_writing = true;
+    while (!m_out.empty() && !m_error) {
+        out.clear();
+        out.swap(m_out);
+        lock.unlock();
+        iovec iov;
+        iov.iov_base = &out[0];
+        iov.iov_len = out.size();
+        int rt = HttpBodyWriter::SendIov(m_sock, &iov, 1);
+        lock.lock();
+        if (rt <= 0) {
+            m_error = true;
+        }
+    }
+    m_writing = false;
+}
+
+void WSChannel::startKeepalive(TimerManager* timers, uint64_t interval_ms) {
+    if (interval_ms == 0) {
+        interval_ms = g_websocket_keepalive_interval->getValue();
+    }
+    if (!timers || interval_ms == 0) {
+        return;
+    }
+    stopKeepalive();
+    m_timer = timers->addConditionTimer(interval_ms, std::bind(&WSChannel::keepalive, this, interval_ms)
+                                        , shared_from_this(), true);
+}
+
+void WSChannel::stopKeepalive() {
+    Timer::ptr timer;
+    timer.swap(m_timer);
+    if (timer) {
+        timer->cancel();
+    }
+}
+
+void WSChannel::keepalive(uint64_t interval_ms) {
+    if (sylar::GetCurrentMS() - m_lastRecvTime > interval_ms * 2) {
+        SYLAR_LOG_INFO(g_logger) << "websocket keepalive timeout " << *m_sock;
+        stopKeepalive();
+        m_sock->close();
+        return;
+    }
+    ping();
+}
+
+WSSession::WSSession(Socket::ptr sock, bool owner)
+    :HttpSession(sock, owner) {
+}
+
+HttpRequest::ptr WSSession::handleShake() {
+    HttpRequest::ptr req = recvRequest();
+    if (!req) {
+        SYLAR_LOG_INFO(g_logger) << "invalid http request";
+        return nullptr;
+    }
+    do {
+        if (strcasecmp(req->getHeader("Upgrade").c_str(), "websocket")) {
+            SYLAR_LOG_INFO(g_logger) << "http header Upgrade != websocket";
+            break;
+        }
+        if (strcasestr(req->getHeader("Connection").c_str(), "upgrade") == nullptr) {
+            SYLAR_LOG_INFO(g_logger) << "http header Connection has no Upgrade";
+            break;
+        }
+        if (req->getHeaderAs<int>("Sec-WebSocket-Version") != 13) {
+            SYLAR_LOG_INFO(g_logger) << "http header Sec-WebSocket-Version != 13";
+            break;
+        }
+        std::string key = req->getHeader("Sec-WebSocket-Key");
+        if (key.empty()) {
+            SYLAR_LOG_INFO(g_logger) << "http header Sec-WebSocket-Key = null";
+            break;
+        }
+
+        HttpResponse::ptr rsp(new HttpResponse(0x11, false));
+        rsp->setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+        rsp->setWebsocket(true);
+        rsp->setReason("Web Socket Protocol Handshake");
+        rsp->setHeader("Upgrade", "websocket");
+        rsp->setHeader("Connection", "Upgrade");
+        rsp->setHeader("Sec-WebSocket-Accept", WSAcceptKey(key));
+
+        WSDeflateParams params;
+        bool deflate = g_websocket_deflate_enable->getValue()
+                       && WSParseDeflate(req->getHeader("Sec-WebSocket-Extensions"), params)
+                       && params.serverMaxWindowBits >= 9;
+        if (deflate) {
+            std::string ext = "permessage-deflate";
+            if (params.serverNoContextTakeover) {
+                ext += "; server_no_context_takeover";
+            }
+            if (params.clientNoContextTakeover) {
+                ext += "; client_no_context_takeover";
+            }
+            if (params.serverMaxWindowBits < 15) {
+                ext += "; server_max_window_bits=" + std::to_string(params.serverMaxWindowBits);
+            }
+            rsp->setHeader("Sec-WebSocket-Extensions", ext);
+        }
+        req->setWebsocket(true);
+        if (sendResponse(rsp) <= 0) {
+            return nullptr;
+        }
+        //握手请求之后多读的数据是客户端的第一批帧，留在读缓冲区里接着用
+        m_channel = std::make_shared<WSChannel>(this, getReadBuffer(), m_socket, false);
+        if (deflate) {
+            m_channel->enableDeflate(params.serverNoContextTakeover, params.serverMaxWindowBits);
+        }
+        return req;
+    } while (false);
+
+    HttpResponse::ptr rsp(new HttpResponse(0x11, true));
+    rsp->setStatus(HttpStatus::BAD_REQUEST);
+    sendResponse(rsp);
+    return nullptr;
+}
+
+WSFrameMessage::ptr WSSession::recvMessage() {
+    return m_channel ? m_channel->recvMessage() : nullptr;
+}
+
+int32_t WSSession::sendMessage(WSFrameMessage::ptr msg, bool fin) {
+    return m_channel ? m_channel->sendMessage(msg, fin) : -1;
+}
+
+int32_t WSSession::sendMessage(const std::string& msg, int32_t opcode, bool fin) {
+    return m_channel ? m_channel->sendMessage(msg, opcode, fin) : -1;
+}
+
+int32_t WSSession::ping() {
+    return m_channel ? m_channel->ping() : -1;
+}
+
+int32_t WSSession::pong() {
+    return m_channel ? m_channel->pong() : -1;
+}
+
+}
+}
@@ -0,0 +1,193 @@
+/**
+ * @file ws_session.h
+ * @brief WebSocket帧收发(RFC 6455)和服务端会话
+ * @date 2025-07-18
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 帧格式：
+//  0                   1                   2                   3
+//  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+// +-+-+-+-+-------+-+-------------+-------------------------------+
+// |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+// |I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
+// |N|V|V|V|       |S|             |   (if payload len==126/127)   |
+// | |1|2|3|       |K|             |                               |
+// +-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
+// |                Masking-key, if MASK set to 1 (32)             |
+// +---------------------------------------------------------------+
+// |                          Payload Data                     ... |
+// +---------------------------------------------------------------+
+// 客户端发出的帧必须带掩码，服务端发出的帧不能带掩码
+// 一条消息可以拆成多个帧：第一个帧带opcode，后续帧opcode为CONTINUE，最后一个帧FIN=1
+// 控制帧(CLOSE/PING/PONG)不能分片，可以夹在一条消息的分片之间
+// permessage-deflate(RFC 7692)：消息的第一个帧RSV1=1表示整条消息是压缩过的，
+// 压缩数据去掉了Z_SYNC_FLUSH结尾的00 00 ff ff
+
+#ifndef __SYLAR_HTTP_WS_SESSION_H__
+#define __SYLAR_HTTP_WS_SESSION_H__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "http_session.h"
+#include "sylar/mutex.h"
+#include "sylar/timer.h"
+#include "sylar/streams/zlib_stream.h"
+
+namespace sylar {
+namespace http {
+
+struct WSFrameHead {
+    enum OPCODE {
+        //数据分片帧
+        CONTINUE = 0,
+        //文本帧
+        TEXT_FRAME = 1,
+        //二进制帧
+        BIN_FRAME = 2,
+        //断开连接
+        CLOSE = 8,
+        //PING
+        PING = 0x9,
+        //PONG
+        PONG = 0xA
+    };
+};
+
+//一条完整的WebSocket消息(分片已经拼好，压缩已经解开)
+class WSFrameMessage {
+public:
+    typedef std::shared_ptr<WSFrameMessage> ptr;
+    WSFrameMessage(int opcode = 0, const std::string& data = "");
+
+    int getOpcode() const { return m_opcode;}
+    void setOpcode(int v) { m_opcode = v;}
+
+    const std::string& getData() const { return m_data;}
+    std::string& getData() { return m_data;}
+    void setData(const std::string& v) { m_data = v;}
+private:
+    int m_opcode;
+    std::string m_data;
+};
+
+//src与key异或后写到dst(可以是同一块内存)，key从payload的第0个字节开始对齐
+//按16字节(SSE2)/8字节一次处理，剩下的逐字节
+void WSMask(const char* src, char* dst, size_t len, const uint8_t key[4]);
+
+//一条WebSocket连接上的帧收发，WSSession和WSConnection共用
+//读：从连接的读缓冲区解析帧(握手时多读的数据接着用)，PING自动回复PONG
+//写：帧在m_mutex下追加到m_out，没有协程在发送时由当前协程发出，
+//    多个协程(包括保活定时器)可以同时发送，帧不会交错；分片发送只能在一个协程里进行
+class WSChannel : public std::enable_shared_from_this<WSChannel> {
+public:
+    typedef std::shared_ptr<WSChannel> ptr;
+    typedef sylar::Mutex MutexType;
+
+    //stream：读帧用，buffer：连接上的读缓冲区，client：是否客户端(发送的帧加掩码)
+    WSChannel(Stream* stream, HttpReadBuffer::ptr buffer, Socket::ptr sock, bool client);
+    ~WSChannel();
+
+    //握手协商出permessage-deflate后调用
+    //no_context_takeover：本端每条消息压缩完后重置上下文；window_bits：本端压缩使用的窗口
+    void enableDeflate(bool no_context_takeover, int window_bits);
+    bool isDeflate() const { return m_deflate;}
+
+    //接收一条完整的消息，对端关闭、出错或者超时返回nullptr
+    WSFrameMessage::ptr recvMessage();
+    //发送消息，fin为false时为分片发送，后续的分片opcode自动改为CONTINUE
+    //返回追加的字节数，连接已经出错返回-1
+    int32_t sendMessage(WSFrameMessage::ptr msg, bool fin = true);
+    int32_t sendMessage(const std::string& msg, int32_t opcode = WSFrameHead::TEXT_FRAME, bool fin = true);
+    int32_t ping(const std::string& data = "");
+    int32_t pong(const std::string& data = "");
+    //发送CLOSE帧，之后不能再发送数据帧
+    int32_t sendClose(uint16_t code = 1000, const std::string& reason = "");
+
+    //保活：每interval_ms发送一次PING，超过2 * interval_ms没有收到任何帧时关闭连接
+    //interval_ms为0时使用配置websocket.keepalive_interval
+    void startKeepalive(TimerManager* timers, uint64_t interval_ms = 0);
+    void stopKeepalive();
+
+    //对端CLOSE帧中的关闭码，没有收到时为0
+    uint16_t getCloseCode() const { return m_closeCode;}
+    uint64_t getLastRecvTime() const { return m_lastRecvTime;}
+
+private:
+    //读一个帧头，返回false表示连接出错或者帧不合法
+    bool readFrameHead(uint8_t& flags, uint8_t& opcode, uint64_t& length, bool& mask, uint8_t key[4]);
+    //读length字节追加到out
+    bool readPayload(std::string& out, uint64_t length);
+    //把一个帧追加到m_out并发送
+    int32_t sendFrame(uint8_t opcode, bool fin, bool rsv1, const char* data, size_t len);
+    void flush();
+    void keepalive(uint64_t interval_ms);
+
+private:
+    Stream* m_stream;
+    HttpReadBuffer::ptr m_buffer;
+    Socket::ptr m_sock;
+    bool m_client;
+
+    bool m_deflate;
+    bool m_noContextTakeover;
+    int m_windowBits;
+    ZlibStream::ptr m_encoder;
+    ZlibStream::ptr m_decoder;
+
+    //正在分片发送的消息，后续分片使用CONTINUE
+    bool m_sendFragmenting;
+    uint16_t m_closeCode;
+    std::atomic<uint64_t> m_lastRecvTime;
+    Timer::ptr m_timer;
+
+    MutexType m_mutex;
+    std::string m_out;
+    bool m_writing;
+    bool m_error;
+    //已经发出CLOSE帧
+    bool m_closeSent;
+};
+
+//服务端WebSocket会话
+class WSSession : public HttpSession {
+public:
+    typedef std::shared_ptr<WSSession> ptr;
+    WSSession(Socket::ptr sock, bool owner = true);
+
+    //接收握手请求并回复101，请求不是合法的WebSocket升级时回复400并返回nullptr
+    //客户端提供permessage-deflate且配置websocket.deflate.enable打开时启用压缩
+    HttpRequest::ptr handleShake();
+
+    WSFrameMessage::ptr recvMessage();
+    int32_t sendMessage(WSFrameMessage::ptr msg, bool fin = true);
+    int32_t sendMessage(const std::string& msg, int32_t opcode = WSFrameHead::TEXT_FRAME, bool fin = true);
+    int32_t ping();
+    int32_t pong();
+
+    //握手完成后有效
+    WSChannel::ptr getChannel() const { return m_channel;}
+
+private:
+    WSChannel::ptr m_channel;
+};
+
+//Sec-WebSocket-Key对应的Sec-WebSocket-Accept
+std::string WSAcceptKey(const std::string& key);
+
+//permessage-deflate协商参数
+struct WSDeflateParams {
+    bool serverNoContextTakeover = false;
+    bool clientNoContextTakeover = false;
+    int serverMaxWindowBits = 15;
+    int clientMaxWindowBits = 15;
+};
+
+//从Sec-WebSocket-Extensions中找permessage-deflate，找到返回true
+bool WSParseDeflate(const std::string& extensions, WSDeflateParams& params);
+
+}
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include "frame.h"
+#include <sstream>
+
+namespace sylar {
+namespace http2 {
+
+const char* CONNECTION_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+const char* FrameTypeToString(FrameType type) {
+    switch (type) {
+#define XX(name) \
+        case FrameType::name: \
+            return #name;
+        XX(DATA);
+        XX(HEADERS);
+        XX(PRIORITY);
+        XX(RST_STREAM);
+        XX(SETTINGS);
+        XX(PUSH_PROMISE);
+        XX(PING);
+        XX(GOAWAY);
+        XX(WINDOW_UPDATE);
+        XX(CONTINUATION);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+const char* Http2ErrorToString(Http2Error error) {
+    switch (error) {
+#define XX(name) \
+        case Http2Error::name: \
+            return #name;
+        XX(NO_ERROR);
+        XX(PROTOCOL_ERROR);
+        XX(INTERNAL_ERROR);
+        XX(FLOW_CONTROL_ERROR);
+        XX(SETTINGS_TIMEOUT);
+        XX(STREAM_CLOSED);
+        XX(FRAME_SIZE_ERROR);
+        XX(REFUSED_STREAM);
+        XX(CANCEL);
+        XX(COMPRESSION_ERROR);
+        XX(CONNECT_ERROR);
+        XX(ENHANCE_YOUR_CALM);
+        XX(INADEQUATE_SECURITY);
+        XX(HTTP_1_1_REQUIRED);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+void FrameHeader::parse(const char* data) {
+    const uint8_t* u = (const uint8_t*)data;
+    length = ((uint32_t)u[0] << 16) | ((uint32_t)u[1] << 8) | u[2];
+    type = (FrameType)u[3];
+    flags = u[4];
+    //最高位保留，忽略
+    streamId = ReadUint32(data + 5) & 0x7fffffff;
+}
+
+void FrameHeader::serialize(std::string& buf) const {
+    AppendFrameHeader(buf, type, flags, streamId, length);
+}
+
+std::string FrameHeader::toString() const {
+    std::stringstream ss;
+    ss << "[FrameHeader type=" << FrameTypeToString(type)
+       << " length=" << length
+       << " flags=0x" << std::hex << (uint32_t)flags << std::dec
+       << " stream_id=" << streamId << "]";
+    return ss.str();
+}
+
+void AppendFrameHeader(std::string& buf, FrameType type, uint8_t flags,
+                       uint32_t stream_id, uint32_t length) {
+    char tmp[FRAME_HEADER_SIZE] = {
+        (char)(length >> 16), (char)(length >> 8), (char)length,
+        (char)type, (char)flags,
+        (char)((stream_id >> 24) & 0x7f), (char)(stream_id >> 16),
+        (char)(stream_id >> 8), (char)stream_id
+    };
+    buf.append(tmp, FRAME_HEADER_SIZE);
+}
+
+void AppendSettings(std::string& buf, const Settings& settings, bool ack) {
+    AppendFrameHeader(buf, FrameType::SETTINGS, ack ? FLAG_ACK : 0, 0,
+                      ack ? 0 : settings.size() * 6);
+    if (ack) {
+        return;
+    }
+    for (auto& i : settings) {
+        buf.push_back((char)(i.first >> 8));
+        buf.push_back((char)i.first);
+        AppendUint32(buf, i.second);
+    }
+}
+
+void AppendWindowUpdate(std::string& buf, uint32_t stream_id, uint32_t increment) {
+    AppendFrameHeader(buf, FrameType::WINDOW_UPDATE, 0, stream_id, 4);
+    AppendUint32(buf, increment & 0x7fffffff);
+}
+
+void AppendRstStream(std::string& buf, uint32_t stream_id, Http2Error error) {
+    AppendFrameHeader(buf, FrameType::RST_STREAM, 0, stream_id, 4);
+    AppendUint32(buf, (uint32_t)error);
+}
+
+void AppendPing(std::string& buf, const char* opaque, bool ack) {
+    AppendFrameHeader(buf, FrameType::PING, ack ? FLAG_ACK : 0, 0, 8);
+    buf.append(opaque, 8);
+}
+
+void AppendGoAway(std::string& buf, uint32_t last_stream_id, Http2Error error,
+                  const std::string& debug) {
+    AppendFrameHeader(buf, FrameType::GOAWAY, 0, 0, 8 + debug.size());
+    AppendUint32(buf, last_stream_id & 0x7fffffff);
+    AppendUint32(buf, (uint32_t)error);
+    buf.append(debug);
+}
+
+bool ParseSettings(const char* data, size_t len, Settings& settings) {
+    if (len % 6) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i += 6) {
+        uint16_t id = ((uint16_t)(uint8_t)data[i] << 8) | (uint8_t)data[i + 1];
+        settings.push_back(std::make_pair(id, ReadUint32(data + i + 2)));
+    }
+    return true;
+}
+
+bool StripPadding(const FrameHeader& header, const char*& data, size_t& len) {
+    size_t pad = 0;
+    if (header.hasFlag(FLAG_PADDED)) {
+        if (len < 1) {
+            return false;
+        }
+        pad = (uint8_t)data[0];
+        ++data;
+        --len;
+    }
+    if (header.type == FrameType::HEADERS && header.hasFlag(FLAG_PRIORITY)) {
+        //依赖的流(4) + 权重(1)，不支持优先级，直接跳过
+        if (len < 5) {
+            return false;
+        }
+        data += 5;
+        len -= 5;
+    }
+    if (pad > len) {
+        return false;
+    }
+    len -= pad;
+    return true;
+}
+
+}
+}
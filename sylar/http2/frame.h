@@ -0,0 +1,140 @@
+/**
+ * @file frame.h
+ * @brief HTTP/2帧(RFC 7540 第4、6节)
+ * @date 2025-07-17
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 所有帧都是9字节的帧头 + 负载：
+// +-----------------------------------------------+
+// |                 Length (24)                   |
+// +---------------+---------------+---------------+
+// |   Type (8)    |   Flags (8)   |
+// +-+-------------+---------------+-------------------------------+
+// |R|                 Stream Identifier (31)                      |
+// +=+=============================================================+
+// |                   Frame Payload (0...)                      ...
+// +---------------------------------------------------------------+
+// 这里只做帧头的编解码和几种控制帧负载的构造，帧的语义在Http2Session中处理
+
+#ifndef __SYLAR_HTTP2_FRAME_H__
+#define __SYLAR_HTTP2_FRAME_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace sylar {
+namespace http2 {
+
+//连接开始时客户端发送的24字节前言
+extern const char* CONNECTION_PREFACE;
+static const size_t CONNECTION_PREFACE_LEN = 24;
+//帧头长度
+static const size_t FRAME_HEADER_SIZE = 9;
+//SETTINGS_MAX_FRAME_SIZE的默认值和上限
+static const uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+static const uint32_t MAX_MAX_FRAME_SIZE = 16777215;
+//流量控制窗口的默认值和上限
+static const int64_t DEFAULT_WINDOW_SIZE = 65535;
+static const int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+
+enum class FrameType {
+    DATA            = 0x0,
+    HEADERS         = 0x1,
+    PRIORITY        = 0x2,
+    RST_STREAM      = 0x3,
+    SETTINGS        = 0x4,
+    PUSH_PROMISE    = 0x5,
+    PING            = 0x6,
+    GOAWAY          = 0x7,
+    WINDOW_UPDATE   = 0x8,
+    CONTINUATION    = 0x9,
+};
+
+enum FrameFlag {
+    FLAG_END_STREAM     = 0x1,
+    FLAG_ACK            = 0x1,
+    FLAG_END_HEADERS    = 0x4,
+    FLAG_PADDED         = 0x8,
+    FLAG_PRIORITY       = 0x20,
+};
+
+enum class Http2Error {
+    NO_ERROR            = 0x0,
+    PROTOCOL_ERROR      = 0x1,
+    INTERNAL_ERROR      = 0x2,
+    FLOW_CONTROL_ERROR  = 0x3,
+    SETTINGS_TIMEOUT    = 0x4,
+    STREAM_CLOSED       = 0x5,
+    FRAME_SIZE_ERROR    = 0x6,
+    REFUSED_STREAM      = 0x7,
+    CANCEL              = 0x8,
+    COMPRESSION_ERROR   = 0x9,
+    CONNECT_ERROR       = 0xa,
+    ENHANCE_YOUR_CALM   = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED   = 0xd,
+};
+
+enum class SettingsId {
+    HEADER_TABLE_SIZE       = 0x1,
+    ENABLE_PUSH             = 0x2,
+    MAX_CONCURRENT_STREAMS  = 0x3,
+    INITIAL_WINDOW_SIZE     = 0x4,
+    MAX_FRAME_SIZE          = 0x5,
+    MAX_HEADER_LIST_SIZE    = 0x6,
+};
+
+const char* FrameTypeToString(FrameType type);
+const char* Http2ErrorToString(Http2Error error);
+
+struct FrameHeader {
+    uint32_t length = 0;
+    FrameType type = FrameType::DATA;
+    uint8_t flags = 0;
+    uint32_t streamId = 0;
+
+    bool hasFlag(uint8_t flag) const { return flags & flag;}
+
+    //从9字节的data解析帧头
+    void parse(const char* data);
+    //把帧头追加到buf
+    void serialize(std::string& buf) const;
+    std::string toString() const;
+};
+
+typedef std::vector<std::pair<uint16_t, uint32_t> > Settings;
+
+//以下函数把一个完整的帧(帧头+负载)追加到buf
+void AppendFrameHeader(std::string& buf, FrameType type, uint8_t flags,
+                       uint32_t stream_id, uint32_t length);
+void AppendSettings(std::string& buf, const Settings& settings, bool ack = false);
+void AppendWindowUpdate(std::string& buf, uint32_t stream_id, uint32_t increment);
+void AppendRstStream(std::string& buf, uint32_t stream_id, Http2Error error);
+void AppendPing(std::string& buf, const char* opaque, bool ack);
+void AppendGoAway(std::string& buf, uint32_t last_stream_id, Http2Error error,
+                  const std::string& debug = "");
+
+//解析SETTINGS负载，长度不是6的倍数返回false
+bool ParseSettings(const char* data, size_t len, Settings& settings);
+
+//去掉DATA/HEADERS帧的填充(PADDED)，HEADERS的优先级字段(PRIORITY)也一起跳过
+//成功时data/len指向真正的负载，填充长度不合法返回false
+bool StripPadding(const FrameHeader& header, const char*& data, size_t& len);
+
+//大端读写
+inline uint32_t ReadUint32(const char* p) {
+    const uint8_t* u = (const uint8_t*)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+inline void AppendUint32(std::string& buf, uint32_t v) {
+    char tmp[4] = {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+    buf.append(tmp, 4);
+}
+
+}
+}
+
+#endif
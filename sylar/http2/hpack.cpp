@@ -0,0 +1,498 @@
+#include "hpack.h"
+#include <string.h>
+#include <unordered_map>
+
+namespace sylar {
+namespace http2 {
+
+//RFC 7541 附录A
+static const HeaderField s_static_table[HeaderTable::STATIC_TABLE_SIZE] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+//RFC 7541 附录B，下标为符号，256为EOS
+static const uint32_t s_huffman_codes[257] = {
+    0x00001ff8, 0x007fffd8, 0x0fffffe2, 0x0fffffe3, 0x0fffffe4, 0x0fffffe5, 0x0fffffe6, 0x0fffffe7,
+    0x0fffffe8, 0x00ffffea, 0x3ffffffc, 0x0fffffe9, 0x0fffffea, 0x3ffffffd, 0x0fffffeb, 0x0fffffec,
+    0x0fffffed, 0x0fffffee, 0x0fffffef, 0x0ffffff0, 0x0ffffff1, 0x0ffffff2, 0x3ffffffe, 0x0ffffff3,
+    0x0ffffff4, 0x0ffffff5, 0x0ffffff6, 0x0ffffff7, 0x0ffffff8, 0x0ffffff9, 0x0ffffffa, 0x0ffffffb,
+    0x00000014, 0x000003f8, 0x000003f9, 0x00000ffa, 0x00001ff9, 0x00000015, 0x000000f8, 0x000007fa,
+    0x000003fa, 0x000003fb, 0x000000f9, 0x000007fb, 0x000000fa, 0x00000016, 0x00000017, 0x00000018,
+    0x00000000, 0x00000001, 0x00000002, 0x00000019, 0x0000001a, 0x0000001b, 0x0000001c, 0x0000001d,
+    0x0000001e, 0x0000001f, 0x0000005c, 0x000000fb, 0x00007ffc, 0x00000020, 0x00000ffb, 0x000003fc,
+    0x00001ffa, 0x00000021, 0x0000005d, 0x0000005e, 0x0000005f, 0x00000060, 0x00000061, 0x00000062,
+    0x00000063, 0x00000064, 0x00000065, 0x00000066, 0x00000067, 0x00000068, 0x00000069, 0x0000006a,
+    0x0000006b, 0x0000006c, 0x0000006d, 0x0000006e, 0x0000006f, 0x00000070, 0x00000071, 0x00000072,
+    0x000000fc, 0x00000073, 0x000000fd, 0x00001ffb, 0x0007fff0, 0x00001ffc, 0x00003ffc, 0x00000022,
+    0x00007ffd, 0x00000003, 0x00000023, 0x00000004, 0x00000024, 0x00000005, 0x00000025, 0x00000026,
+    0x00000027, 0x00000006, 0x00000074, 0x00000075, 0x00000028, 0x00000029, 0x0000002a, 0x00000007,
+    0x0000002b, 0x00000076, 0x0000002c, 0x00000008, 0x00000009, 0x0000002d, 0x00000077, 0x00000078,
+    0x00000079, 0x0000007a, 0x0000007b, 0x00007ffe, 0x000007fc, 0x00003ffd, 0x00001ffd, 0x0ffffffc,
+    0x000fffe6, 0x003fffd2, 0x000fffe7, 0x000fffe8, 0x003fffd3, 0x003fffd4, 0x003fffd5, 0x007fffd9,
+    0x003fffd6, 0x007fffda, 0x007fffdb, 0x007fffdc, 0x007fffdd, 0x007fffde, 0x00ffffeb, 0x007fffdf,
+    0x00ffffec, 0x00ffffed, 0x003fffd7, 0x007fffe0, 0x00ffffee, 0x007fffe1, 0x007fffe2, 0x007fffe3,
+    0x007fffe4, 0x001fffdc, 0x003fffd8, 0x007fffe5, 0x003fffd9, 0x007fffe6, 0x007fffe7, 0x00ffffef,
+    0x003fffda, 0x001fffdd, 0x000fffe9, 0x003fffdb, 0x003fffdc, 0x007fffe8, 0x007fffe9, 0x001fffde,
+    0x007fffea, 0x003fffdd, 0x003fffde, 0x00fffff0, 0x001fffdf, 0x003fffdf, 0x007fffeb, 0x007fffec,
+    0x001fffe0, 0x001fffe1, 0x003fffe0, 0x001fffe2, 0x007fffed, 0x003fffe1, 0x007fffee, 0x007fffef,
+    0x000fffea, 0x003fffe2, 0x003fffe3, 0x003fffe4, 0x007ffff0, 0x003fffe5, 0x003fffe6, 0x007ffff1,
+    0x03ffffe0, 0x03ffffe1, 0x000fffeb, 0x0007fff1, 0x003fffe7, 0x007ffff2, 0x003fffe8, 0x01ffffec,
+    0x03ffffe2, 0x03ffffe3, 0x03ffffe4, 0x07ffffde, 0x07ffffdf, 0x03ffffe5, 0x00fffff1, 0x01ffffed,
+    0x0007fff2, 0x001fffe3, 0x03ffffe6, 0x07ffffe0, 0x07ffffe1, 0x03ffffe7, 0x07ffffe2, 0x00fffff2,
+    0x001fffe4, 0x001fffe5, 0x03ffffe8, 0x03ffffe9, 0x0ffffffd, 0x07ffffe3, 0x07ffffe4, 0x07ffffe5,
+    0x000fffec, 0x00fffff3, 0x000fffed, 0x001fffe6, 0x003fffe9, 0x001fffe7, 0x001fffe8, 0x007ffff3,
+    0x003fffea, 0x003fffeb, 0x01ffffee, 0x01ffffef, 0x00fffff4, 0x00fffff5, 0x03ffffea, 0x007ffff4,
+    0x03ffffeb, 0x07ffffe6, 0x03ffffec, 0x03ffffed, 0x07ffffe7, 0x07ffffe8, 0x07ffffe9, 0x07ffffea,
+    0x07ffffeb, 0x0ffffffe, 0x07ffffec, 0x07ffffed, 0x07ffffee, 0x07ffffef, 0x07fffff0, 0x03ffffee,
+    0x3fffffff
+};
+static const uint8_t s_huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+namespace {
+
+//静态表的查找索引
+struct StaticIndex {
+    std::unordered_map<std::string, size_t> names;
+    std::unordered_map<std::string, size_t> fields;
+
+    StaticIndex() {
+        for (size_t i = HeaderTable::STATIC_TABLE_SIZE; i > 0; --i) {
+            const HeaderField& f = s_static_table[i - 1];
+            //同名的取最小的索引
+            names[f.first] = i;
+            fields[f.first + '\0' + f.second] = i;
+        }
+    }
+};
+
+//Huffman解码树，叶子节点的symbol为符号，内部节点为-1
+struct HuffmanTree {
+    struct Node {
+        int16_t children[2];
+        int16_t symbol;
+    };
+    std::vector<Node> nodes;
+
+    HuffmanTree() {
+        nodes.push_back(Node{{-1, -1}, -1});
+        for (int sym = 0; sym < 257; ++sym) {
+            uint32_t code = s_huffman_codes[sym];
+            int len = s_huffman_lengths[sym];
+            size_t cur = 0;
+            for (int i = len - 1; i >= 0; --i) {
+                int bit = (code >> i) & 1;
+                if (nodes[cur].children[bit] < 0) {
+                    nodes[cur].children[bit] = nodes.size();
+                    nodes.push_back(Node{{-1, -1}, -1});
+                }
+                cur = nodes[cur].children[bit];
+            }
+            nodes[cur].symbol = sym;
+        }
+    }
+};
+
+static const StaticIndex s_static_index;
+static const HuffmanTree s_huffman_tree;
+
+}
+
+bool Huffman::Decode(const char* data, size_t len, std::string& out) {
+    const std::vector<HuffmanTree::Node>& nodes = s_huffman_tree.nodes;
+    size_t cur = 0;
+    //当前还没有构成符号的位数，以及这些位是否全为1(合法的填充)
+    int pending = 0;
+    bool all_ones = true;
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t b = data[i];
+        for (int j = 7; j >= 0; --j) {
+            int bit = (b >> j) & 1;
+            int next = nodes[cur].children[bit];
+            if (next < 0) {
+                return false;
+            }
+            ++pending;
+            all_ones = all_ones && bit;
+            cur = next;
+            int sym = nodes[cur].symbol;
+            if (sym >= 0) {
+                //EOS不能出现在数据中
+                if (sym == 256) {
+                    return false;
+                }
+                out.push_back((char)sym);
+                cur = 0;
+                pending = 0;
+                all_ones = true;
+            }
+        }
+    }
+    //结尾的填充必须是EOS的前缀(全1)，且不超过7位
+    return pending <= 7 && all_ones;
+}
+
+size_t Huffman::EncodedLength(const char* data, size_t len) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < len; ++i) {
+        bits += s_huffman_lengths[(uint8_t)data[i]];
+    }
+    return (bits + 7) / 8;
+}
+
+void Huffman::Encode(const char* data, size_t len, std::string& out) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t c = data[i];
+        acc = (acc << s_huffman_lengths[c]) | s_huffman_codes[c];
+        bits += s_huffman_lengths[c];
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    if (bits > 0) {
+        //用EOS的高位(全1)填充
+        acc = (acc << (8 - bits)) | (0xff >> bits);
+        out.push_back((char)acc);
+    }
+}
+
+void EncodeInteger(uint64_t value, int prefix, uint8_t first, std::string& out) {
+    uint64_t mask = (1u << prefix) - 1;
+    if (value < mask) {
+        out.push_back((char)(first | value));
+        return;
+    }
+    out.push_back((char)(first | mask));
+    value -= mask;
+    while (value >= 128) {
+        out.push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool DecodeInteger(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value) {
+    if (p >= end) {
+        return false;
+    }
+    uint64_t mask = (1u << prefix) - 1;
+    value = *p++ & mask;
+    if (value < mask) {
+        return true;
+    }
+    int shift = 0;
+    while (p < end) {
+        uint8_t b = *p++;
+        value += (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+        shift += 7;
+        //头部中的整数不会超过32位，防止恶意的超长编码
+        if (shift > 28) {
+            return false;
+        }
+    }
+    return false;
+}
+
+HeaderTable::HeaderTable(uint32_t max_size)
+    :m_size(0)
+    ,m_maxSize(max_size) {
+}
+
+const HeaderField* HeaderTable::get(size_t index) const {
+    if (index == 0) {
+        return nullptr;
+    }
+    if (index <= STATIC_TABLE_SIZE) {
+        return &s_static_table[index - 1];
+    }
+    index -= STATIC_TABLE_SIZE + 1;
+    return index < m_entries.size() ? &m_entries[index] : nullptr;
+}
+
+size_t HeaderTable::find(const std::string& name, const std::string& value, size_t& name_index) const {
+    name_index = 0;
+    auto it = s_static_index.fields.find(name + '\0' + value);
+    if (it != s_static_index.fields.end()) {
+        return it->second;
+    }
+    auto nit = s_static_index.names.find(name);
+    if (nit != s_static_index.names.end()) {
+        name_index = nit->second;
+    }
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const HeaderField& f = m_entries[i];
+        if (f.first != name) {
+            continue;
+        }
+        if (f.second == value) {
+            return STATIC_TABLE_SIZE + 1 + i;
+        }
+        if (!name_index) {
+            name_index = STATIC_TABLE_SIZE + 1 + i;
+        }
+    }
+    return 0;
+}
+
+void HeaderTable::add(const std::string& name, const std::string& value) {
+    uint32_t size = EntrySize(name, value);
+    if (size > m_maxSize) {
+        evict(0);
+        return;
+    }
+    evict(m_maxSize - size);
+    m_entries.push_front(std::make_pair(name, value));
+    m_size += size;
+}
+
+void HeaderTable::setMaxSize(uint32_t v) {
+    m_maxSize = v;
+    evict(v);
+}
+
+void HeaderTable::evict(uint32_t max_size) {
+    while (m_size > max_size && !m_entries.empty()) {
+        m_size -= EntrySize(m_entries.back().first, m_entries.back().second);
+        m_entries.pop_back();
+    }
+}
+
+HPackDecoder::HPackDecoder(uint32_t max_size)
+    :m_table(max_size)
+    ,m_maxSize(max_size) {
+}
+
+bool HPackDecoder::readString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if (p >= end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t len = 0;
+    if (!DecodeInteger(p, end, 7, len) || len > (uint64_t)(end - p)) {
+        return false;
+    }
+    out.clear();
+    if (huffman) {
+        if (!Huffman::Decode((const char*)p, len, out)) {
+            return false;
+        }
+    } else {
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+bool HPackDecoder::decode(const char* data, size_t len, HeaderList& headers, size_t max_list_size) {
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + len;
+    size_t list_size = 0;
+    bool field_seen = false;
+    while (p < end) {
+        uint8_t b = *p;
+        uint64_t index = 0;
+        if (b & 0x80) {
+            //索引头部字段
+            if (!DecodeInteger(p, end, 7, index)) {
+                return false;
+            }
+            const HeaderField* f = m_table.get(index);
+            if (!f) {
+                return false;
+            }
+            headers.push_back(*f);
+        } else if ((b & 0xe0) == 0x20) {
+            //动态表大小更新，只能出现在头部块开头
+            if (field_seen || !DecodeInteger(p, end, 5, index) || index > m_maxSize) {
+                return false;
+            }
+            m_table.setMaxSize(index);
+            continue;
+        } else {
+            //字面值：01 增量索引(6位前缀)，0000 不索引 / 0001 永不索引(4位前缀)
+            bool indexing = (b & 0xc0) == 0x40;
+            if (!DecodeInteger(p, end, indexing ? 6 : 4, index)) {
+                return false;
+            }
+            HeaderField f;
+            if (index) {
+                const HeaderField* nf = m_table.get(index);
+                if (!nf) {
+                    return false;
+                }
+                f.first = nf->first;
+            } else if (!readString(p, end, f.first)) {
+                return false;
+            }
+            if (!readString(p, end, f.second)) {
+                return false;
+            }
+            if (indexing) {
+                m_table.add(f.first, f.second);
+            }
+            headers.push_back(std::move(f));
+        }
+        field_seen = true;
+        list_size += HeaderTable::EntrySize(headers.back().first, headers.back().second);
+        if (max_list_size && list_size > max_list_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HPackEncoder::HPackEncoder(uint32_t max_size)
+    :m_table(max_size)
+    ,m_pendingSize(-1) {
+}
+
+void HPackEncoder::setMaxSize(uint32_t v) {
+    //编码器的表不超过默认的4096，对端允许更大时也不用
+    if (v > 4096) {
+        v = 4096;
+    }
+    if (v != m_table.getMaxSize()) {
+        m_table.setMaxSize(v);
+        m_pendingSize = v;
+    }
+}
+
+void HPackEncoder::encodeString(const std::string& str, std::string& out) {
+    size_t hlen = Huffman::EncodedLength(str.data(), str.size());
+    if (hlen < str.size()) {
+        EncodeInteger(hlen, 7, 0x80, out);
+        Huffman::Encode(str.data(), str.size(), out);
+    } else {
+        EncodeInteger(str.size(), 7, 0, out);
+        out.append(str);
+    }
+}
+
+//每个响应都不同的值，加入动态表只会把有用的条目挤出去
+static bool IsNoIndexName(const std::string& name) {
+    return name == "content-length" || name == "date" || name == "etag"
+        || name == "last-modified" || name == ":path" || name == "content-range"
+        || name == "expires" || name == "age";
+}
+
+//敏感头部，使用永不索引的表示
+static bool IsSensitiveName(const std::string& name) {
+    return name == "authorization" || name == "proxy-authorization"
+        || name == "set-cookie" || name == "cookie";
+}
+
+void HPackEncoder::encode(const HeaderList& headers, std::string& out) {
+    if (m_pendingSize >= 0) {
+        EncodeInteger(m_pendingSize, 5, 0x20, out);
+        m_pendingSize = -1;
+    }
+    for (auto& h : headers) {
+        size_t name_index = 0;
+        size_t index = m_table.find(h.first, h.second, name_index);
+        if (index) {
+            EncodeInteger(index, 7, 0x80, out);
+            continue;
+        }
+        bool sensitive = IsSensitiveName(h.first);
+        bool indexing = !sensitive && !IsNoIndexName(h.first)
+            && HeaderTable::EntrySize(h.first, h.second) <= m_table.getMaxSize() / 2;
+        if (indexing) {
+            EncodeInteger(name_index, 6, 0x40, out);
+        } else {
+            EncodeInteger(name_index, 4, sensitive ? 0x10 : 0, out);
+        }
+        if (!name_index) {
+            encodeString(h.first, out);
+        }
+        encodeString(h.second, out);
+        if (indexing) {
+            m_table.add(h.first, h.second);
+        }
+    }
+}
+
+}
+}
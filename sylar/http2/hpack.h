@@ -0,0 +1,130 @@
+/**
+ * @file hpack.h
+ * @brief HTTP/2头部压缩HPACK(RFC 7541)
+ * @date 2025-07-17
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 头部块由若干条表示组成：
+//   1xxxxxxx  索引头部字段，整个name: value在表里
+//   01xxxxxx  带增量索引的字面值，解码后加入动态表
+//   0000xxxx  不加索引的字面值
+//   0001xxxx  永不索引的字面值(敏感头部，中间代理也不能加索引)
+//   001xxxxx  动态表大小更新
+// 索引空间：1~61为静态表，62开始为动态表(最新加入的在前)
+// 字符串可以是原文或Huffman编码(附录B的固定码表)
+// 编码器和解码器各自维护一张动态表，一条连接上两个方向的表互相独立，
+// 所以头部块必须按照在连接上发送/接收的顺序编码/解码
+
+#ifndef __SYLAR_HTTP2_HPACK_H__
+#define __SYLAR_HTTP2_HPACK_H__
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace sylar {
+namespace http2 {
+
+typedef std::pair<std::string, std::string> HeaderField;
+typedef std::vector<HeaderField> HeaderList;
+
+//Huffman编解码
+class Huffman {
+public:
+    //解码，遇到EOS或者填充不合法返回false
+    static bool Decode(const char* data, size_t len, std::string& out);
+    //编码追加到out
+    static void Encode(const char* data, size_t len, std::string& out);
+    //编码后的长度
+    static size_t EncodedLength(const char* data, size_t len);
+};
+
+//静态表 + 动态表
+class HeaderTable {
+public:
+    //静态表的条目数
+    static const size_t STATIC_TABLE_SIZE = 61;
+
+    HeaderTable(uint32_t max_size = 4096);
+
+    //按索引取字段，索引从1开始，超出范围返回nullptr
+    const HeaderField* get(size_t index) const;
+    //查找name和value都相同的索引，没有返回0；name_index返回只有name相同的索引(没有为0)
+    size_t find(const std::string& name, const std::string& value, size_t& name_index) const;
+    //加入动态表头部，超过容量时从尾部淘汰，单条比容量还大时清空动态表
+    void add(const std::string& name, const std::string& value);
+    //修改动态表容量，淘汰超出的条目
+    void setMaxSize(uint32_t v);
+
+    uint32_t getMaxSize() const { return m_maxSize;}
+    uint32_t getSize() const { return m_size;}
+    size_t getDynamicCount() const { return m_entries.size();}
+
+    //RFC 7541 4.1：每条的大小为name + value + 32
+    static uint32_t EntrySize(const std::string& name, const std::string& value) {
+        return name.size() + value.size() + 32;
+    }
+
+private:
+    void evict(uint32_t max_size);
+
+private:
+    std::deque<HeaderField> m_entries;
+    uint32_t m_size;
+    uint32_t m_maxSize;
+};
+
+//头部块解码器
+class HPackDecoder {
+public:
+    //max_size：本端SETTINGS_HEADER_TABLE_SIZE，对端的动态表大小更新不能超过它
+    HPackDecoder(uint32_t max_size = 4096);
+
+    //解码一个完整的头部块(HEADERS + CONTINUATION拼接后)，结果追加到headers
+    //max_list_size：解码后的头部总大小上限(name + value + 32)，0不限制
+    //出错返回false，此时连接必须以COMPRESSION_ERROR关闭
+    bool decode(const char* data, size_t len, HeaderList& headers, size_t max_list_size = 0);
+
+    const HeaderTable& getTable() const { return m_table;}
+
+private:
+    bool readString(const uint8_t*& p, const uint8_t* end, std::string& out);
+
+private:
+    HeaderTable m_table;
+    uint32_t m_maxSize;
+};
+
+//头部块编码器
+class HPackEncoder {
+public:
+    HPackEncoder(uint32_t max_size = 4096);
+
+    //把headers编码成一个头部块追加到out，name必须已经是小写
+    void encode(const HeaderList& headers, std::string& out);
+    //对端SETTINGS_HEADER_TABLE_SIZE变化，下一个头部块开头带上动态表大小更新
+    void setMaxSize(uint32_t v);
+
+    const HeaderTable& getTable() const { return m_table;}
+
+private:
+    void encodeString(const std::string& str, std::string& out);
+
+private:
+    HeaderTable m_table;
+    //需要在下一个头部块开头通知对端的动态表大小，-1表示没有
+    int64_t m_pendingSize;
+};
+
+//整数编解码(5.1)，prefix为前缀的位数，first为第一个字节中前缀以外的高位
+void EncodeInteger(uint64_t value, int prefix, uint8_t first, std::string& out);
+//解析失败(数据不够或溢出)返回false
+bool DecodeInteger(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value);
+
+}
+}
+
+#endif
@@ -0,0 +1,780 @@
+#include "http2_session.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/http/http_parser.h"
+#include "sylar/http/http_compress.h"
+
+namespace sylar {
+namespace http2 {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams =
+    sylar::Config::Lookup("http2.max_concurrent_streams", (uint32_t)128
+            , "http2 max concurrent streams per connection");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http2_initial_window_size =
+    sylar::Config::Lookup("http2.initial_window_size", (uint32_t)(1024 * 1024)
+            , "http2 stream receive window");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http2_connection_window_size =
+    sylar::Config::Lookup("http2.connection_window_size", (uint32_t)(16 * 1024 * 1024)
+            , "http2 connection receive window");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http2_max_header_list_size =
+    sylar::Config::Lookup("http2.max_header_list_size", (uint32_t)(64 * 1024)
+            , "http2 max decoded header list size");
+
+//m_out积压超过这个大小时，发送DATA的协程等待当前的发送完成
+static const size_t MAX_PENDING_OUTPUT = 256 * 1024;
+
+Http2Session::Http2Session(Socket::ptr sock, http::ServletDispatch::ptr dispatch)
+    :SocketStream(sock, true)
+    ,m_buffer(new http::HttpReadBuffer(FRAME_HEADER_SIZE + DEFAULT_MAX_FRAME_SIZE))
+    ,m_dispatch(dispatch)
+    ,m_worker(nullptr)
+    ,m_decoder(4096)
+    ,m_lastStreamId(0)
+    ,m_continuationId(0)
+    ,m_headerStreamId(0)
+    ,m_headerEndStream(false)
+    ,m_recvWindow(DEFAULT_WINDOW_SIZE)
+    ,m_localInitialWindow(std::min<int64_t>(g_http2_initial_window_size->getValue(), MAX_WINDOW_SIZE))
+    ,m_localConnWindow(std::min<int64_t>(g_http2_connection_window_size->getValue(), MAX_WINDOW_SIZE))
+    ,m_maxConcurrentStreams(g_http2_max_concurrent_streams->getValue())
+    ,m_maxHeaderListSize(g_http2_max_header_list_size->getValue())
+    ,m_encoder(4096)
+    ,m_sendWindow(DEFAULT_WINDOW_SIZE)
+    ,m_peerInitialWindow(DEFAULT_WINDOW_SIZE)
+    ,m_peerMaxFrameSize(DEFAULT_MAX_FRAME_SIZE)
+    ,m_writing(false)
+    ,m_goingAway(false)
+    ,m_closed(false) {
+}
+
+bool Http2Session::appendInput(const char* data, size_t len) {
+    return m_buffer->append(data, len);
+}
+
+bool Http2Session::DecodeSettingsHeader(const std::string& value, std::string& payload) {
+    //base64url，可以没有结尾的'='
+    uint32_t bits = 0;
+    int count = 0;
+    for (auto c : value) {
+        int v = 0;
+        if (c >= 'A' && c <= 'Z') {
+            v = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            v = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            v = c - '0' + 52;
+        } else if (c == '-' || c == '+') {
+            v = 62;
+        } else if (c == '_' || c == '/') {
+            v = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        bits = (bits << 6) | v;
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            payload.push_back((char)(bits >> count));
+        }
+    }
+    return true;
+}
+
+bool Http2Session::upgrade(const std::string& settings, http::HttpRequest::ptr req) {
+    std::string payload;
+    Settings values;
+    if (!DecodeSettingsHeader(settings, payload)
+            || !ParseSettings(payload.data(), payload.size(), values)) {
+        SYLAR_LOG_DEBUG(g_logger) << "invalid HTTP2-Settings: " << settings;
+        return false;
+    }
+    //HTTP2-Settings等同于客户端的第一个SETTINGS帧，不需要ACK
+    if (applySettings(values) != Http2Error::NO_ERROR) {
+        return false;
+    }
+    m_upgradeRequest = req;
+    return true;
+}
+
+size_t Http2Session::getStreamCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_streams.size();
+}
+
+void Http2Session::start() {
+    m_worker = sylar::IOManager::GetThis();
+    {
+        Settings settings;
+        settings.push_back(std::make_pair((uint16_t)SettingsId::MAX_CONCURRENT_STREAMS, m_maxConcurrentStreams));
+        settings.push_back(std::make_pair((uint16_t)SettingsId::INITIAL_WINDOW_SIZE, (uint32_t)m_localInitialWindow));
+        settings.push_back(std::make_pair((uint16_t)SettingsId::MAX_HEADER_LIST_SIZE, m_maxHeaderListSize));
+        MutexType::Lock lock(m_mutex);
+        AppendSettings(m_out, settings);
+        //连接窗口不能通过SETTINGS修改，只能用WINDOW_UPDATE扩大
+        if (m_localConnWindow > DEFAULT_WINDOW_SIZE) {
+            AppendWindowUpdate(m_out, 0, m_localConnWindow - DEFAULT_WINDOW_SIZE);
+        }
+    }
+    m_recvWindow = m_localConnWindow;
+    flush();
+
+    if (m_upgradeRequest) {
+        //升级的请求已经完整读完，流1直接是half closed(remote)
+        m_lastStreamId = 1;
+        Http2Stream::ptr stream(new Http2Stream(1, m_peerInitialWindow, m_localInitialWindow));
+        stream->setState(Http2Stream::HALF_CLOSED_REMOTE);
+        {
+            MutexType::Lock lock(m_mutex);
+            m_streams[1] = stream;
+        }
+        Http2Session::ptr self = shared_from_this();
+        http::HttpRequest::ptr req = m_upgradeRequest;
+        m_upgradeRequest = nullptr;
+        m_worker->schedule([self, stream, req]() {
+            self->handleStream(stream, req);
+        });
+    }
+
+    if (!readPreface()) {
+        close();
+        return;
+    }
+
+    while (true) {
+        bool idle = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            idle = m_streams.empty();
+            if (idle && m_goingAway) {
+                break;
+            }
+        }
+        //drain时空闲的连接发送GOAWAY后关闭
+        if (idle && m_idleCb && !m_idleCb(true)) {
+            goAway(Http2Error::NO_ERROR);
+            break;
+        }
+        //缓冲区里没有完整的帧，马上要阻塞在读上，先把积攒的控制帧发出去
+        bool has_frame = false;
+        if (m_buffer->size() >= FRAME_HEADER_SIZE) {
+            FrameHeader next;
+            next.parse(m_buffer->data());
+            has_frame = m_buffer->size() >= FRAME_HEADER_SIZE + next.length;
+        }
+        if (!has_frame) {
+            flush();
+        }
+        FrameHeader header;
+        int rt = readFrame(header);
+        if (idle && m_idleCb && !m_idleCb(false)) {
+            //drain：不再接受新的流，已经在处理的流完成后关闭
+            MutexType::Lock lock(m_mutex);
+            bool going_away = m_goingAway;
+            lock.unlock();
+            if (!going_away) {
+                goAway(Http2Error::NO_ERROR);
+            }
+        }
+        if (rt == -2) {
+            goAway(Http2Error::FRAME_SIZE_ERROR);
+            break;
+        }
+        if (rt <= 0) {
+            break;
+        }
+        Http2Error error = handleFrame(header, m_buffer->data());
+        m_buffer->consume(header.length);
+        if (error != Http2Error::NO_ERROR) {
+            SYLAR_LOG_DEBUG(g_logger) << "http2 connection error " << Http2ErrorToString(error)
+                << " " << header.toString();
+            goAway(error);
+            break;
+        }
+    }
+    flush();
+    close();
+}
+
+void Http2Session::close() {
+    {
+        MutexType::Lock lock(m_mutex);
+        m_closed = true;
+        wakeWaiters();
+    }
+    SocketStream::close();
+}
+
+bool Http2Session::readPreface() {
+    while (m_buffer->size() < CONNECTION_PREFACE_LEN) {
+        if (m_buffer->fill(this) <= 0) {
+            return false;
+        }
+    }
+    if (memcmp(m_buffer->data(), CONNECTION_PREFACE, CONNECTION_PREFACE_LEN) != 0) {
+        SYLAR_LOG_DEBUG(g_logger) << "invalid http2 connection preface";
+        return false;
+    }
+    m_buffer->consume(CONNECTION_PREFACE_LEN);
+    return true;
+}
+
+int Http2Session::readFrame(FrameHeader& header) {
+    while (m_buffer->size() < FRAME_HEADER_SIZE) {
+        int rt = m_buffer->fill(this);
+        if (rt <= 0) {
+            return rt < 0 ? -1 : 0;
+        }
+    }
+    header.parse(m_buffer->data());
+    //本端没有修改SETTINGS_MAX_FRAME_SIZE
+    if (header.length > DEFAULT_MAX_FRAME_SIZE) {
+        return -2;
+    }
+    m_buffer->consume(FRAME_HEADER_SIZE);
+    while (m_buffer->size() < header.length) {
+        int rt = m_buffer->fill(this);
+        if (rt <= 0) {
+            return rt < 0 ? -1 : 0;
+        }
+    }
+    return 1;
+}
+
+Http2Error Http2Session::handleFrame(const FrameHeader& header, const char* data) {
+    //头部块的HEADERS和CONTINUATION之间不能插入其他帧
+    if (m_continuationId && (header.type != FrameType::CONTINUATION
+                || header.streamId != m_continuationId)) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    switch (header.type) {
+        case FrameType::DATA:
+            return onData(header, data);
+        case FrameType::HEADERS:
+            return onHeaders(header, data);
+        case FrameType::CONTINUATION:
+            return onContinuation(header, data);
+        case FrameType::SETTINGS:
+            return onSettings(header, data);
+        case FrameType::WINDOW_UPDATE:
+            return onWindowUpdate(header, data);
+        case FrameType::RST_STREAM:
+            return onRstStream(header, data);
+        case FrameType::PING:
+            return onPing(header, data);
+        case FrameType::GOAWAY:
+            return onGoAway(header, data);
+        case FrameType::PRIORITY:
+            //不支持优先级，只检查格式
+            if (header.streamId == 0) {
+                return Http2Error::PROTOCOL_ERROR;
+            }
+            if (header.length != 5) {
+                resetStream(header.streamId, Http2Error::FRAME_SIZE_ERROR);
+            }
+            return Http2Error::NO_ERROR;
+        case FrameType::PUSH_PROMISE:
+            //客户端不能推送
+            return Http2Error::PROTOCOL_ERROR;
+        default:
+            //未知类型的帧必须忽略
+            return Http2Error::NO_ERROR;
+    }
+}
+
+Http2Error Http2Session::onHeaders(const FrameHeader& header, const char* data) {
+    if (header.streamId == 0) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    size_t len = header.length;
+    if (!StripPadding(header, data, len)) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    //头部块即使不处理也必须解码，否则两端的动态表不一致，所以超限只能断开连接
+    if (len > m_maxHeaderListSize) {
+        return Http2Error::ENHANCE_YOUR_CALM;
+    }
+    m_headerBlock.assign(data, len);
+    m_headerStreamId = header.streamId;
+    m_headerEndStream = header.hasFlag(FLAG_END_STREAM);
+    if (!header.hasFlag(FLAG_END_HEADERS)) {
+        m_continuationId = header.streamId;
+        return Http2Error::NO_ERROR;
+    }
+    return onHeaderBlock();
+}
+
+Http2Error Http2Session::onContinuation(const FrameHeader& header, const char* data) {
+    if (m_continuationId == 0) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    if (m_headerBlock.size() + header.length > m_maxHeaderListSize) {
+        return Http2Error::ENHANCE_YOUR_CALM;
+    }
+    m_headerBlock.append(data, header.length);
+    if (!header.hasFlag(FLAG_END_HEADERS)) {
+        return Http2Error::NO_ERROR;
+    }
+    m_continuationId = 0;
+    return onHeaderBlock();
+}
+
+Http2Error Http2Session::onHeaderBlock() {
+    HeaderList headers;
+    bool ok = m_decoder.decode(m_headerBlock.data(), m_headerBlock.size(), headers, m_maxHeaderListSize);
+    m_headerBlock.clear();
+    if (!ok) {
+        return Http2Error::COMPRESSION_ERROR;
+    }
+
+    uint32_t id = m_headerStreamId;
+    Http2Stream::ptr stream = getStream(id);
+    if (stream) {
+        if (stream->getState() != Http2Stream::OPEN) {
+            resetStream(id, Http2Error::STREAM_CLOSED);
+            return Http2Error::NO_ERROR;
+        }
+        //消息体后面的trailer，必须结束流，内容忽略
+        if (!m_headerEndStream) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        onStreamEnd(stream);
+        return Http2Error::NO_ERROR;
+    }
+    //客户端创建的流是奇数，并且必须递增
+    if ((id & 1) == 0 || id <= m_lastStreamId) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    m_lastStreamId = id;
+    {
+        MutexType::Lock lock(m_mutex);
+        //GOAWAY之后的新流直接忽略，客户端会在新连接上重试
+        if (m_goingAway) {
+            return Http2Error::NO_ERROR;
+        }
+        if (m_streams.size() >= m_maxConcurrentStreams) {
+            lock.unlock();
+            resetStream(id, Http2Error::REFUSED_STREAM);
+            return Http2Error::NO_ERROR;
+        }
+        stream.reset(new Http2Stream(id, m_peerInitialWindow, m_localInitialWindow));
+        m_streams[id] = stream;
+    }
+    stream->getHeaders().swap(headers);
+    if (m_headerEndStream) {
+        onStreamEnd(stream);
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onData(const FrameHeader& header, const char* data) {
+    uint32_t id = header.streamId;
+    if (id == 0) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    //整个帧(包括填充)都计入流量控制，流已经关闭时也要扣连接窗口
+    if ((int64_t)header.length > m_recvWindow) {
+        return Http2Error::FLOW_CONTROL_ERROR;
+    }
+    m_recvWindow -= header.length;
+    if (m_recvWindow <= m_localConnWindow / 2) {
+        MutexType::Lock lock(m_mutex);
+        AppendWindowUpdate(m_out, 0, m_localConnWindow - m_recvWindow);
+        m_recvWindow = m_localConnWindow;
+    }
+    size_t len = header.length;
+    if (!StripPadding(header, data, len)) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+
+    Http2Stream::ptr stream = getStream(id);
+    if (!stream || stream->getState() != Http2Stream::OPEN) {
+        //还没有创建过的流上收到DATA是连接错误
+        if (id > m_lastStreamId) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        resetStream(id, Http2Error::STREAM_CLOSED);
+        return Http2Error::NO_ERROR;
+    }
+    if (!stream->consumeRecvWindow(header.length)) {
+        resetStream(id, Http2Error::FLOW_CONTROL_ERROR);
+        return Http2Error::NO_ERROR;
+    }
+    std::string& body = stream->getBody();
+    if (body.size() + len > http::HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        SYLAR_LOG_DEBUG(g_logger) << "http2 stream=" << id << " body too large";
+        resetStream(id, Http2Error::CANCEL);
+        return Http2Error::NO_ERROR;
+    }
+    body.append(data, len);
+    if (header.hasFlag(FLAG_END_STREAM)) {
+        onStreamEnd(stream);
+    } else if (stream->getRecvWindow() <= m_localInitialWindow / 2) {
+        MutexType::Lock lock(m_mutex);
+        AppendWindowUpdate(m_out, id, stream->resetRecvWindow(m_localInitialWindow));
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onSettings(const FrameHeader& header, const char* data) {
+    if (header.streamId != 0) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    if (header.hasFlag(FLAG_ACK)) {
+        return header.length == 0 ? Http2Error::NO_ERROR : Http2Error::FRAME_SIZE_ERROR;
+    }
+    Settings settings;
+    if (!ParseSettings(data, header.length, settings)) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    Http2Error error = applySettings(settings);
+    if (error != Http2Error::NO_ERROR) {
+        return error;
+    }
+    MutexType::Lock lock(m_mutex);
+    AppendSettings(m_out, Settings(), true);
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::applySettings(const Settings& settings) {
+    MutexType::Lock lock(m_mutex);
+    for (auto& i : settings) {
+        switch ((SettingsId)i.first) {
+            case SettingsId::HEADER_TABLE_SIZE:
+                m_encoder.setMaxSize(i.second);
+                break;
+            case SettingsId::ENABLE_PUSH:
+                if (i.second > 1) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                break;
+            case SettingsId::INITIAL_WINDOW_SIZE: {
+                if (i.second > MAX_WINDOW_SIZE) {
+                    return Http2Error::FLOW_CONTROL_ERROR;
+                }
+                //已经打开的流的发送窗口按差值调整，可以变成负数
+                int64_t delta = (int64_t)i.second - m_peerInitialWindow;
+                for (auto& s : m_streams) {
+                    if (!s.second->updateSendWindow(delta)) {
+                        return Http2Error::FLOW_CONTROL_ERROR;
+                    }
+                }
+                m_peerInitialWindow = i.second;
+                break;
+            }
+            case SettingsId::MAX_FRAME_SIZE:
+                if (i.second < DEFAULT_MAX_FRAME_SIZE || i.second > MAX_MAX_FRAME_SIZE) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                m_peerMaxFrameSize = i.second;
+                break;
+            default:
+                //不推送，对端的MAX_CONCURRENT_STREAMS不需要；未知的设置忽略
+                break;
+        }
+    }
+    wakeWaiters();
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onWindowUpdate(const FrameHeader& header, const char* data) {
+    if (header.length != 4) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    uint32_t increment = ReadUint32(data) & 0x7fffffff;
+    if (header.streamId == 0) {
+        if (increment == 0) {
+            return Http2Error::PROTOCOL_ERROR;
+        }
+        MutexType::Lock lock(m_mutex);
+        if (m_sendWindow + increment > MAX_WINDOW_SIZE) {
+            return Http2Error::FLOW_CONTROL_ERROR;
+        }
+        m_sendWindow += increment;
+        wakeWaiters();
+        return Http2Error::NO_ERROR;
+    }
+    if (increment == 0) {
+        resetStream(header.streamId, Http2Error::PROTOCOL_ERROR);
+        return Http2Error::NO_ERROR;
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(header.streamId);
+    //刚关闭的流上还可能收到WINDOW_UPDATE，忽略
+    if (it == m_streams.end()) {
+        return Http2Error::NO_ERROR;
+    }
+    if (!it->second->updateSendWindow(increment)) {
+        lock.unlock();
+        resetStream(header.streamId, Http2Error::FLOW_CONTROL_ERROR);
+        return Http2Error::NO_ERROR;
+    }
+    wakeWaiters();
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onRstStream(const FrameHeader& header, const char* data) {
+    if (header.streamId == 0 || header.streamId > m_lastStreamId) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    if (header.length != 4) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    SYLAR_LOG_DEBUG(g_logger) << "http2 stream=" << header.streamId << " reset by peer: "
+        << Http2ErrorToString((Http2Error)ReadUint32(data));
+    MutexType::Lock lock(m_mutex);
+    eraseStream(header.streamId, true);
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onPing(const FrameHeader& header, const char* data) {
+    if (header.streamId != 0) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    if (header.length != 8) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    if (!header.hasFlag(FLAG_ACK)) {
+        MutexType::Lock lock(m_mutex);
+        AppendPing(m_out, data, true);
+    }
+    return Http2Error::NO_ERROR;
+}
+
+Http2Error Http2Session::onGoAway(const FrameHeader& header, const char* data) {
+    if (header.streamId != 0) {
+        return Http2Error::PROTOCOL_ERROR;
+    }
+    if (header.length < 8) {
+        return Http2Error::FRAME_SIZE_ERROR;
+    }
+    SYLAR_LOG_DEBUG(g_logger) << "http2 goaway from peer last_stream_id="
+        << (ReadUint32(data) & 0x7fffffff) << " error="
+        << Http2ErrorToString((Http2Error)ReadUint32(data + 4));
+    MutexType::Lock lock(m_mutex);
+    m_goingAway = true;
+    return Http2Error::NO_ERROR;
+}
+
+void Http2Session::onStreamEnd(Http2Stream::ptr stream) {
+    stream->setState(Http2Stream::HALF_CLOSED_REMOTE);
+    http::HttpRequest::ptr req = stream->createRequest();
+    if (!req) {
+        resetStream(stream->getId(), Http2Error::PROTOCOL_ERROR);
+        return;
+    }
+    //handleStream分发时没有HttpSession，客户端地址记在请求上
+    req->setRemoteAddress(m_socket->getRemoteAddress());
+    Http2Session::ptr self = shared_from_this();
+    m_worker->schedule([self, stream, req]() {
+        self->handleStream(stream, req);
+    });
+}
+
+void Http2Session::handleStream(Http2Stream::ptr stream, http::HttpRequest::ptr req) {
+    http::HttpResponse::ptr rsp(new http::HttpResponse(0x20, false));
+    m_dispatch->handle(req, rsp, nullptr);
+    http::HttpCompress::CompressResponse(req, rsp);
+    if (!sendResponse(stream, req, rsp)) {
+        SYLAR_LOG_DEBUG(g_logger) << "http2 stream=" << stream->getId() << " send response fail";
+    }
+    removeStream(stream->getId());
+}
+
+bool Http2Session::sendResponse(Http2Stream::ptr stream, http::HttpRequest::ptr req
+                                , http::HttpResponse::ptr rsp) {
+    http::HttpFileBody::ptr file = rsp->getFileBody();
+    uint64_t length = file ? file->getLength() : rsp->getBody().size();
+    HeaderList headers;
+    Http2Stream::BuildResponseHeaders(rsp, m_serverName, length, headers);
+    uint32_t status = (uint32_t)rsp->getStatus();
+    bool has_body = length > 0 && req->getMethod() != http::HttpMethod::HEAD
+                    && status != 204 && status != 304;
+    if (!sendHeaders(stream, headers, !has_body)) {
+        return false;
+    }
+    if (!has_body) {
+        return true;
+    }
+    if (file) {
+        return sendFileBody(stream, file);
+    }
+    const std::string& body = rsp->getBody();
+    return sendData(stream, body.data(), body.size(), true);
+}
+
+bool Http2Session::sendHeaders(Http2Stream::ptr stream, const HeaderList& headers, bool end_stream) {
+    std::string block;
+    MutexType::Lock lock(m_mutex);
+    if (m_closed || stream->isReset()) {
+        return false;
+    }
+    //编码和追加在同一把锁下，保证头部块的发送顺序和动态表的修改顺序一致
+    m_encoder.encode(headers, block);
+    size_t offset = 0;
+    bool first = true;
+    do {
+        size_t n = std::min<size_t>(block.size() - offset, m_peerMaxFrameSize);
+        uint8_t flags = 0;
+        if (offset + n == block.size()) {
+            flags |= FLAG_END_HEADERS;
+        }
+        if (first && end_stream) {
+            flags |= FLAG_END_STREAM;
+        }
+        AppendFrameHeader(m_out, first ? FrameType::HEADERS : FrameType::CONTINUATION
+                          , flags, stream->getId(), n);
+        m_out.append(block, offset, n);
+        offset += n;
+        first = false;
+    } while (offset < block.size());
+    lock.unlock();
+    flush();
+    return true;
+}
+
+bool Http2Session::sendData(Http2Stream::ptr stream, const char* data, size_t len, bool end_stream) {
+    while (len > 0) {
+        size_t n = 0;
+        {
+            MutexType::Lock lock(m_mutex);
+            while (true) {
+                if (m_closed || stream->isReset()) {
+                    return false;
+                }
+                int64_t window = std::min(m_sendWindow, stream->getSendWindow());
+                if (window > 0 && !(m_writing && m_out.size() >= MAX_PENDING_OUTPUT)) {
+                    n = std::min<int64_t>(window, m_peerMaxFrameSize);
+                    n = std::min(n, len);
+                    break;
+                }
+                //窗口用完或者积压太多，等待WINDOW_UPDATE或者发送完成
+                m_waiters.push_back(Fiber::GetThis());
+                lock.unlock();
+                Fiber::YieldToHold();
+                lock.lock();
+            }
+            m_sendWindow -= n;
+            stream->updateSendWindow(-(int64_t)n);
+            bool last = end_stream && n == len;
+            AppendFrameHeader(m_out, FrameType::DATA, last ? FLAG_END_STREAM : 0, stream->getId(), n);
+            m_out.append(data, n);
+        }
+        flush();
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool Http2Session::sendFileBody(Http2Stream::ptr stream, http::HttpFileBody::ptr body) {
+    std::string buf;
+    buf.resize(std::max<size_t>(m_peerMaxFrameSize, 64 * 1024));
+    off_t offset = body->getOffset();
+    size_t left = body->getLength();
+    while (left > 0) {
+        ssize_t rt = ::pread(body->getFd(), &buf[0], std::min(left, buf.size()), offset);
+        if (rt <= 0) {
+            SYLAR_LOG_ERROR(g_logger) << "http2 pread fd=" << body->getFd() << " rt=" << rt
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            resetStream(stream->getId(), Http2Error::INTERNAL_ERROR);
+            flush();
+            return false;
+        }
+        offset += rt;
+        left -= rt;
+        if (!sendData(stream, buf.data(), rt, left == 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Http2Stream::ptr Http2Session::getStream(uint32_t id) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(id);
+    return it == m_streams.end() ? nullptr : it->second;
+}
+
+void Http2Session::removeStream(uint32_t id) {
+    MutexType::Lock lock(m_mutex);
+    eraseStream(id, false);
+}
+
+void Http2Session::eraseStream(uint32_t id, bool reset) {
+    auto it = m_streams.find(id);
+    if (it != m_streams.end()) {
+        if (reset) {
+            it->second->setReset();
+            wakeWaiters();
+        }
+        m_streams.erase(it);
+    }
+    //GOAWAY之后最后一个流结束，关闭读方向，让阻塞在读上的读协程返回
+    if (m_goingAway && m_streams.empty() && !m_closed) {
+        ::shutdown(m_socket->getSocket(), SHUT_RD);
+    }
+}
+
+void Http2Session::resetStream(uint32_t id, Http2Error error) {
+    MutexType::Lock lock(m_mutex);
+    AppendRstStream(m_out, id, error);
+    eraseStream(id, true);
+}
+
+void Http2Session::goAway(Http2Error error, const std::string& debug) {
+    {
+        MutexType::Lock lock(m_mutex);
+        m_goingAway = true;
+        AppendGoAway(m_out, m_lastStreamId, error, debug);
+    }
+    flush();
+}
+
+void Http2Session::flush() {
+    std::string out;
+    MutexType::Lock lock(m_mutex);
+    //已经有协程在发送，追加的帧由它发出
+    if (m_writing) {
+        return;
+    }
+    m_writing = true;
+    while (!m_out.empty() && !m_closed) {
+        out.clear();
+        out.swap(m_out);
+        wakeWaiters();
+        lock.unlock();
+        bool ok = writeFixSize(out.data(), out.size()) > 0;
+        lock.lock();
+        if (!ok) {
+            m_closed = true;
+            wakeWaiters();
+            break;
+        }
+    }
+    m_writing = false;
+}
+
+void Http2Session::wakeWaiters() {
+    if (m_waiters.empty()) {
+        return;
+    }
+    for (auto& i : m_waiters) {
+        m_worker->schedule(i);
+    }
+    m_waiters.clear();
+}
+
+}
+}
@@ -0,0 +1,169 @@
+/**
+ * @file http2_session.h
+ * @brief HTTP/2服务端连接
+ * @date 2025-07-17
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 一条连接一个Http2Session，由HttpServer::handleClient在以下情况创建：
+//   TLS上ALPN协商出"h2"
+//   明文连接的前24字节是连接前言(prior knowledge，h2c)
+//   明文HTTP/1.1请求带Upgrade: h2c，回复101后升级，原请求作为流1
+// 读协程(handleClient所在的协程)循环读帧，维护连接状态、HPACK解码表和流量控制窗口，
+// 请求收完整后每个流调度到一个新协程上，经过ServletDispatch处理后把响应写回，
+// 多个流的处理并发进行，一个慢请求不会阻塞连接上的其他请求
+//
+// 写路径：所有帧在m_mutex下追加到m_out，谁追加完发现没有人在发送，谁负责把m_out发出去，
+// 其他协程只追加不等待，帧的顺序和HPACK编码的顺序一致
+// 流量控制：DATA发送前同时扣连接窗口和流窗口，窗口用完时协程挂起，收到WINDOW_UPDATE后唤醒
+//
+// 不支持的部分：服务端推送(SETTINGS_ENABLE_PUSH按0处理)、优先级(PRIORITY帧忽略)，
+// 请求消息体完整收下后才交给servlet，servlet不能调用HttpSession::startResponse做流式响应
+
+#ifndef __SYLAR_HTTP2_SESSION_H__
+#define __SYLAR_HTTP2_SESSION_H__
+
+#include <memory>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include "frame.h"
+#include "hpack.h"
+#include "http2_stream.h"
+#include "sylar/socket.h"
+#include "sylar/mutex.h"
+#include "sylar/fiber.h"
+#include "sylar/iomanager.h"
+#include "sylar/http/http_body.h"
+#include "sylar/http/servlet.h"
+#include "sylar/streams/socket_stream.h"
+
+namespace sylar {
+namespace http2 {
+
+class Http2Session : public SocketStream, public std::enable_shared_from_this<Http2Session> {
+public:
+    typedef std::shared_ptr<Http2Session> ptr;
+    typedef sylar::Mutex MutexType;
+    //idle为true表示连接上没有进行中的流，开始等待下一帧，false表示收到了帧
+    //返回false表示服务器正在drain
+    typedef std::function<bool(bool idle)> IdleCallback;
+
+    Http2Session(Socket::ptr sock, http::ServletDispatch::ptr dispatch);
+
+    //响应默认的server头部
+    void setServerName(const std::string& v) { m_serverName = v;}
+    void setIdleCallback(IdleCallback v) { m_idleCb = v;}
+
+    //连接建立前已经读到的数据(HTTP/1.1读缓冲区中剩下的部分)，放进读缓冲区开头
+    bool appendInput(const char* data, size_t len);
+    //h2c升级：settings为请求中HTTP2-Settings头部的值(base64url编码的SETTINGS负载)
+    //req为升级的请求，start后作为流1处理，失败返回false
+    bool upgrade(const std::string& settings, http::HttpRequest::ptr req);
+
+    //发送本端SETTINGS，读取客户端的连接前言，之后循环读帧直到连接关闭
+    //在handleClient的协程中调用，返回时连接已经关闭
+    void start();
+
+    //进行中的流的个数
+    size_t getStreamCount();
+
+    virtual void close() override;
+
+    //HTTP2-Settings头部的值解码成SETTINGS负载
+    static bool DecodeSettingsHeader(const std::string& value, std::string& payload);
+
+private:
+    //读一帧到m_buffer，返回1成功，0连接关闭，-1读出错，-2帧长度超过SETTINGS_MAX_FRAME_SIZE
+    int readFrame(FrameHeader& header);
+    bool readPreface();
+
+    //以下处理函数返回连接错误，NO_ERROR表示正常(流错误在内部发送RST_STREAM)
+    Http2Error handleFrame(const FrameHeader& header, const char* data);
+    Http2Error onHeaders(const FrameHeader& header, const char* data);
+    Http2Error onContinuation(const FrameHeader& header, const char* data);
+    Http2Error onHeaderBlock();
+    Http2Error onData(const FrameHeader& header, const char* data);
+    Http2Error onSettings(const FrameHeader& header, const char* data);
+    Http2Error onWindowUpdate(const FrameHeader& header, const char* data);
+    Http2Error onRstStream(const FrameHeader& header, const char* data);
+    Http2Error onPing(const FrameHeader& header, const char* data);
+    Http2Error onGoAway(const FrameHeader& header, const char* data);
+    Http2Error applySettings(const Settings& settings);
+
+    //请求收完整，调度到新协程处理
+    void onStreamEnd(Http2Stream::ptr stream);
+    void handleStream(Http2Stream::ptr stream, http::HttpRequest::ptr req);
+    bool sendResponse(Http2Stream::ptr stream, http::HttpRequest::ptr req, http::HttpResponse::ptr rsp);
+    bool sendHeaders(Http2Stream::ptr stream, const HeaderList& headers, bool end_stream);
+    //按流量控制窗口分帧发送DATA，窗口不够时挂起当前协程
+    bool sendData(Http2Stream::ptr stream, const char* data, size_t len, bool end_stream);
+    bool sendFileBody(Http2Stream::ptr stream, http::HttpFileBody::ptr body);
+
+    Http2Stream::ptr getStream(uint32_t id);
+    void removeStream(uint32_t id);
+    //从m_streams中移除(调用方持有m_mutex)，reset时标记流被取消并唤醒等待窗口的协程
+    void eraseStream(uint32_t id, bool reset);
+    //发送RST_STREAM并移除流
+    void resetStream(uint32_t id, Http2Error error);
+    //发送GOAWAY，之后不再接受新的流
+    void goAway(Http2Error error, const std::string& debug = "");
+
+    //把m_out发出去，已经有协程在发送时直接返回(由它接着发送新追加的帧)
+    void flush();
+    //唤醒等待发送窗口的协程(调用方持有m_mutex)
+    void wakeWaiters();
+
+private:
+    //读缓冲区，能放下一个最大的帧
+    http::HttpReadBuffer::ptr m_buffer;
+    http::ServletDispatch::ptr m_dispatch;
+    std::string m_serverName;
+    IdleCallback m_idleCb;
+    sylar::IOManager* m_worker;
+
+    //以下只在读协程中访问
+    HPackDecoder m_decoder;
+    //最后一个由客户端创建的流
+    uint32_t m_lastStreamId;
+    //正在接收CONTINUATION的流，0表示没有
+    uint32_t m_continuationId;
+    //HEADERS + CONTINUATION拼接的头部块
+    std::string m_headerBlock;
+    uint32_t m_headerStreamId;
+    bool m_headerEndStream;
+    //连接级接收窗口
+    int64_t m_recvWindow;
+    //本端通告的流初始窗口/连接窗口
+    int64_t m_localInitialWindow;
+    int64_t m_localConnWindow;
+    uint32_t m_maxConcurrentStreams;
+    uint32_t m_maxHeaderListSize;
+    //h2c升级的请求，start时作为流1处理
+    http::HttpRequest::ptr m_upgradeRequest;
+
+    //以下由m_mutex保护
+    MutexType m_mutex;
+    std::map<uint32_t, Http2Stream::ptr> m_streams;
+    HPackEncoder m_encoder;
+    //连接级发送窗口
+    int64_t m_sendWindow;
+    //对端的SETTINGS_INITIAL_WINDOW_SIZE/SETTINGS_MAX_FRAME_SIZE
+    int64_t m_peerInitialWindow;
+    uint32_t m_peerMaxFrameSize;
+    //待发送的帧
+    std::string m_out;
+    //有协程正在发送m_out
+    bool m_writing;
+    //发出或收到GOAWAY
+    bool m_goingAway;
+    bool m_closed;
+    //等待发送窗口的协程
+    std::list<Fiber::ptr> m_waiters;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include "http2_stream.h"
+#include <string.h>
+#include <strings.h>
+#include "sylar/log.h"
+
+namespace sylar {
+namespace http2 {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+Http2Stream::Http2Stream(uint32_t id, int64_t send_window, int64_t recv_window)
+    :m_id(id)
+    ,m_state(OPEN)
+    ,m_reset(false)
+    ,m_sendWindow(send_window)
+    ,m_recvWindow(recv_window) {
+}
+
+bool Http2Stream::updateSendWindow(int64_t delta) {
+    if (m_sendWindow + delta > MAX_WINDOW_SIZE) {
+        return false;
+    }
+    m_sendWindow += delta;
+    return true;
+}
+
+bool Http2Stream::consumeRecvWindow(uint32_t len) {
+    if ((int64_t)len > m_recvWindow) {
+        return false;
+    }
+    m_recvWindow -= len;
+    return true;
+}
+
+uint32_t Http2Stream::resetRecvWindow(int64_t v) {
+    uint32_t increment = v > m_recvWindow ? v - m_recvWindow : 0;
+    m_recvWindow = v;
+    return increment;
+}
+
+//HTTP/2中禁止出现的连接相关头部(RFC 7540 8.1.2.2)
+static bool IsConnectionHeader(const std::string& name) {
+    return strcasecmp(name.c_str(), "connection") == 0
+        || strcasecmp(name.c_str(), "keep-alive") == 0
+        || strcasecmp(name.c_str(), "proxy-connection") == 0
+        || strcasecmp(name.c_str(), "transfer-encoding") == 0
+        || strcasecmp(name.c_str(), "upgrade") == 0;
+}
+
+http::HttpRequest::ptr Http2Stream::createRequest() {
+    http::HttpRequest::ptr req(new http::HttpRequest(0x20, false));
+    std::string method;
+    std::string path;
+    std::string authority;
+    std::string scheme;
+    std::string cookie;
+    bool regular = false;
+    for (auto& i : m_headers) {
+        const std::string& name = i.first;
+        if (name.empty()) {
+            return nullptr;
+        }
+        for (auto c : name) {
+            if (c >= 'A' && c <= 'Z') {
+                return nullptr;
+            }
+        }
+        if (name[0] == ':') {
+            //伪头部必须都在普通头部之前，且每个只能出现一次
+            if (regular) {
+                return nullptr;
+            }
+            std::string* field = nullptr;
+            if (name == ":method") {
+                field = &method;
+            } else if (name == ":path") {
+                field = &path;
+            } else if (name == ":authority") {
+                field = &authority;
+            } else if (name == ":scheme") {
+                field = &scheme;
+            } else {
+                return nullptr;
+            }
+            if (!field->empty() || i.second.empty()) {
+                return nullptr;
+            }
+            *field = i.second;
+            continue;
+        }
+        regular = true;
+        if (IsConnectionHeader(name) || (name == "te" && i.second != "trailers")) {
+            return nullptr;
+        }
+        if (name == "cookie") {
+            //cookie可以拆成多个头部字段发送，合并时用"; "连接(8.1.2.5)
+            if (!cookie.empty()) {
+                cookie.append("; ");
+            }
+            cookie.append(i.second);
+            continue;
+        }
+        req->setHeader(name, i.second);
+    }
+    if (method.empty() || path.empty()) {
+        return nullptr;
+    }
+    http::HttpMethod m = http::StringToHttpMethod(method);
+    if (m == http::HttpMethod::INVALID_METHOD) {
+        SYLAR_LOG_DEBUG(g_logger) << "http2 stream=" << m_id << " invalid method: " << method;
+        return nullptr;
+    }
+    req->setMethod(m);
+
+    size_t pos = path.find('#');
+    if (pos != std::string::npos) {
+        req->setFragment(path.substr(pos + 1));
+        path.resize(pos);
+    }
+    pos = path.find('?');
+    if (pos != std::string::npos) {
+        req->setQuery(path.substr(pos + 1));
+        path.resize(pos);
+    }
+    req->setPath(path);
+
+    if (!authority.empty() && req->getHeader("host").empty()) {
+        req->setHeader("host", authority);
+    }
+    if (!cookie.empty()) {
+        req->setHeader("cookie", cookie);
+    }
+
+    std::string length = req->getHeader("content-length");
+    if (!length.empty() && strtoull(length.c_str(), nullptr, 10) != m_body.size()) {
+        return nullptr;
+    }
+    if (!m_body.empty()) {
+        req->setBody(m_body);
+        std::string().swap(m_body);
+    }
+    HeaderList().swap(m_headers);
+    return req;
+}
+
+void Http2Stream::BuildResponseHeaders(http::HttpResponse::ptr rsp, const std::string& server_name,
+                                       uint64_t body_length, HeaderList& headers) {
+    uint32_t status = (uint32_t)rsp->getStatus();
+    headers.push_back(std::make_pair(":status", std::to_string(status)));
+    bool has_server = false;
+    //HEAD响应没有消息体，servlet设置的Content-Length是GET时的长度
+    std::string head_length;
+    for (auto& i : rsp->getHeaders()) {
+        std::string name = i.first.str();
+        for (auto& c : name) {
+            if (c >= 'A' && c <= 'Z') {
+                c += 'a' - 'A';
+            }
+        }
+        //长度按实际发送的消息体重新计算
+        if (name == "content-length") {
+            head_length = i.second.str();
+            continue;
+        }
+        if (IsConnectionHeader(name)) {
+            continue;
+        }
+        if (name == "server") {
+            has_server = true;
+        }
+        headers.push_back(std::make_pair(name, i.second.str()));
+    }
+    if (!has_server && !server_name.empty()) {
+        headers.push_back(std::make_pair("server", server_name));
+    }
+    for (auto& i : rsp->getCookies()) {
+        headers.push_back(std::make_pair("set-cookie", i));
+    }
+    if (status >= 200 && status != 204 && status != 304) {
+        headers.push_back(std::make_pair("content-length", body_length || head_length.empty()
+                                         ? std::to_string(body_length) : head_length));
+    }
+}
+
+}
+}
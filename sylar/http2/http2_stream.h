@@ -0,0 +1,84 @@
+/**
+ * @file http2_stream.h
+ * @brief HTTP/2流
+ * @date 2025-07-17
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 一条HTTP/2连接上同时存在多个流，每个流承载一对请求/响应
+// 服务端只会经历 open -> half closed(remote) -> closed 这几个状态：
+//   收到HEADERS                          open
+//   收到END_STREAM(请求收完)             half closed(remote)，交给协程处理
+//   发出END_STREAM或者RST_STREAM         closed，从连接上移除
+// 流上的发送窗口由Http2Session在连接的锁下修改，接收窗口只在读协程里修改
+
+#ifndef __SYLAR_HTTP2_STREAM_H__
+#define __SYLAR_HTTP2_STREAM_H__
+
+#include <memory>
+#include <string>
+#include "hpack.h"
+#include "frame.h"
+#include "sylar/http/http.h"
+
+namespace sylar {
+namespace http2 {
+
+class Http2Stream {
+public:
+    typedef std::shared_ptr<Http2Stream> ptr;
+
+    enum State {
+        OPEN,
+        HALF_CLOSED_REMOTE,
+        CLOSED
+    };
+
+    //send_window：对端的SETTINGS_INITIAL_WINDOW_SIZE，recv_window：本端的
+    Http2Stream(uint32_t id, int64_t send_window, int64_t recv_window);
+
+    uint32_t getId() const { return m_id;}
+    State getState() const { return m_state;}
+    void setState(State v) { m_state = v;}
+
+    //被RST_STREAM取消(任意一端)
+    bool isReset() const { return m_reset;}
+    void setReset() { m_reset = true; m_state = CLOSED;}
+
+    HeaderList& getHeaders() { return m_headers;}
+    std::string& getBody() { return m_body;}
+
+    int64_t getSendWindow() const { return m_sendWindow;}
+    //调整发送窗口(WINDOW_UPDATE/SETTINGS变化/发出DATA)，超过2^31-1返回false
+    bool updateSendWindow(int64_t delta);
+
+    int64_t getRecvWindow() const { return m_recvWindow;}
+    //收到len字节的DATA，超出接收窗口返回false
+    bool consumeRecvWindow(uint32_t len);
+    //补充接收窗口到v，返回需要在WINDOW_UPDATE中通告的增量
+    uint32_t resetRecvWindow(int64_t v);
+
+    //把请求头部(伪头部 + 普通头部)和消息体转换为HttpRequest
+    //伪头部缺失/重复/出现在普通头部之后，或者出现了连接相关的头部时返回nullptr(流错误PROTOCOL_ERROR)
+    http::HttpRequest::ptr createRequest();
+
+    //把响应转换为HTTP/2的头部列表，:status在最前面，头部名转为小写
+    //去掉HTTP/2中禁止的连接相关头部，body_length为实际发送的消息体长度
+    static void BuildResponseHeaders(http::HttpResponse::ptr rsp, const std::string& server_name,
+                                     uint64_t body_length, HeaderList& headers);
+
+private:
+    uint32_t m_id;
+    State m_state;
+    bool m_reset;
+    //请求头部和消息体，请求交给协程处理后清空
+    HeaderList m_headers;
+    std::string m_body;
+    int64_t m_sendWindow;
+    int64_t m_recvWindow;
+};
+
+}
+}
+
+#endif
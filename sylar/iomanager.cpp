@@ -84,6 +84,8 @@ void IOManager::FdContext::resetContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.cb = nullptr;
+    ctx.trace = TraceContext();
+    ctx.trace_us = 0;
 }
 
 //触发事件：当fd的某个事件发生时，调用回调函数或调度协程
@@ -96,7 +98,19 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     EventContext& ctx = getContext(event);
     if (ctx.cb) {
         //如果注册了回调函数，则直接调度回调函数
-        ctx.scheduler->schedule(&ctx.cb);
+        if (ctx.trace.valid()) {
+            //回调在注册时的上下文里调度，排队和执行都算在这个trace里
+            if (ctx.trace_us) {
+                Tracer::Record(ctx.trace, "io", "io.wait", ctx.trace.span_id, Tracer::NewId()
+                               ,ctx.trace_us, Tracer::NowUS());
+            }
+            TraceScope scope(ctx.trace);
+            ctx.scheduler->schedule(&ctx.cb);
+        } else {
+            ctx.scheduler->schedule(&ctx.cb);
+        }
+        ctx.trace = TraceContext();
+        ctx.trace_us = 0;
     } else {
         //否则，恢复之前被挂起的协程，让他继续执行之前未完成的任务
         //例如：
@@ -138,11 +152,28 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name) :
     //初始化FdContext容器
     contextResize(32);    //预分配32个fd上下文
 
+    auto mgr = metrics::MetricsMgr::GetInstance();
+    metrics::Labels labels = {{"iomanager", name}};
+    m_wakeupCounter = mgr->getCounter("sylar_iomanager_epoll_wakeups_total", "epoll_wait returns", labels);
+    m_eventCounter = mgr->getCounter("sylar_iomanager_epoll_events_total", "events returned by epoll_wait", labels);
+    m_tickleCounter = mgr->getCounter("sylar_iomanager_tickles_total", "tickles written to wake epoll_wait", labels);
+    m_ioMetrics.push_back(mgr->addFunc("sylar_iomanager_pending_events", "io events waiting to trigger"
+                , labels, metrics::Metric::GAUGE, [this]() {
+        return (double)m_pendingEventCount;
+    }));
+    m_ioMetrics.push_back(mgr->addFunc("sylar_iomanager_timers", "timers waiting to expire"
+                , labels, metrics::Metric::GAUGE, [this]() {
+        return (double)getTimerCount();
+    }));
+
     start();   //启动scheduler
 }
 
 IOManager::~IOManager() {
     stop();
+    for (auto& i : m_ioMetrics) {
+        metrics::MetricsMgr::GetInstance()->remove(i);
+    }
     close(m_epfd);
     close(m_tickleFds[0]);
     close(m_tickleFds[1]);
@@ -216,6 +247,12 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     event_ctx.scheduler = Scheduler::GetThis();  //绑定调度器
     if (cb) {
         event_ctx.cb.swap(cb);   //绑定回调函数
+        //回调事件继承注册时的追踪上下文，触发时在这个上下文里调度
+        TraceContext* trace = Tracer::GetContext();
+        if (trace->valid()) {
+            event_ctx.trace = *trace;
+            event_ctx.trace_us = trace->sampled ? Tracer::NowUS() : 0;
+        }
     } else {
         //GetThis返回当前正在执行的协程，即调用addEvent的协程
         //event_ctx.fiber记录当前协程，当fd事件触发时，改协程会被IOManager重写调度执行（调用triggerEvent())
@@ -223,6 +260,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
         //确保协程状态为EXEC（正在执行）
         SYLAR_ASSERT2(event_ctx.fiber->getState() == Fiber::EXEC, "state= " << event_ctx.fiber->getState());
     }
+    return 0;
 }
 
 //在epoll事件监听机制中移除某个fd指定的事件，如果该文件描述符fd上不再有其他监听事件，则从epoll监视列表中完全删除该fd
@@ -365,6 +403,7 @@ void IOManager::tickle() {
 		return;
 	}
 	//写入T表示有新的任务或事件，向管道的读端写入，IOManager会监听到，从而被唤醒执行新的任务
+	m_tickleCounter->inc();
 	int rt = write(m_tickleFds[1], "T", 1);
 	SYLAR_ASSERT(rt == 1);
 }
@@ -432,6 +471,10 @@ void IOManager::idle() {
                 break;
             }
         } while (true);
+        m_wakeupCounter->inc();
+        if (rt > 0) {
+            m_eventCounter->inc(rt);
+        }
 
         // 处理超时任务
         std::vector<std::function<void()>> cbs;
@@ -51,6 +51,8 @@ private:
 			Scheduler* scheduler = nullptr;   //事件执行的调度器
 			Fiber::ptr fiber;                 //事件对应的协程
 			std::function<void()> cb;		  //事件的回调函数
+			TraceContext trace;               //回调事件注册时的追踪上下文
+			uint64_t trace_us = 0;            //采样时的注册时间(us)
 		};
 
 		//获取事件上下文：返回对应事件的上下文
@@ -134,6 +136,13 @@ private:
 	std::vector<FdContext*> m_fdContexts;
 
 	RWMutexType m_mutex;
+
+	//epoll_wait返回的次数、返回的事件数、tickle次数
+	metrics::Counter::ptr m_wakeupCounter;
+	metrics::Counter::ptr m_eventCounter;
+	metrics::Counter::ptr m_tickleCounter;
+	//注册的导出指标，析构时删除
+	std::vector<metrics::Metric::ptr> m_ioMetrics;
 };
 
 }
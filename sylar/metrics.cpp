@@ -0,0 +1,320 @@
+#include "metrics.h"
+#include "log.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <sstream>
+
+namespace sylar {
+namespace metrics {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+//[a-zA-Z_:][a-zA-Z0-9_:]*
+static bool IsValidName(const std::string& name) {
+    if (name.empty() || isdigit((unsigned char)name[0])) {
+        return false;
+    }
+    for (auto c : name) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != ':') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Escape(std::ostream& os, const std::string& v, bool quote) {
+    for (auto c : v) {
+        if (c == '\\') {
+            os << "\\\\";
+        } else if (c == '\n') {
+            os << "\\n";
+        } else if (c == '"' && quote) {
+            os << "\\\"";
+        } else {
+            os << c;
+        }
+    }
+}
+
+Metric::Metric(const std::string& name, const Labels& labels, Type type)
+    :m_name(name)
+    ,m_labels(FormatLabels(labels))
+    ,m_type(type) {
+}
+
+const char* Metric::TypeToString(Type type) {
+    switch (type) {
+        case COUNTER:
+            return "counter";
+        case GAUGE:
+            return "gauge";
+        case HISTOGRAM:
+            return "histogram";
+        default:
+            return "untyped";
+    }
+}
+
+std::string Metric::FormatLabels(const Labels& labels, const std::string& extra) {
+    if (labels.empty() && extra.empty()) {
+        return "";
+    }
+    std::stringstream ss;
+    ss << "{";
+    bool first = true;
+    for (auto& i : labels) {
+        if (!first) {
+            ss << ",";
+        }
+        first = false;
+        ss << i.first << "=\"";
+        Escape(ss, i.second, true);
+        ss << "\"";
+    }
+    if (!extra.empty()) {
+        ss << (first ? "" : ",") << extra;
+    }
+    ss << "}";
+    return ss.str();
+}
+
+std::string Metric::FormatValue(double v) {
+    if (isnan(v)) {
+        return "NaN";
+    }
+    if (isinf(v)) {
+        return v > 0 ? "+Inf" : "-Inf";
+    }
+    if (v == floor(v) && fabs(v) < 1e15) {
+        return std::to_string((int64_t)v);
+    }
+    std::stringstream ss;
+    ss.precision(12);
+    ss << v;
+    return ss.str();
+}
+
+Counter::Counter(const std::string& name, const Labels& labels)
+    :Metric(name, labels, COUNTER) {
+}
+
+uint32_t Counter::GetSlot() {
+    static std::atomic<uint32_t> s_next = {0};
+    static thread_local uint32_t t_slot = s_next++ % SLOTS;
+    return t_slot;
+}
+
+uint64_t Counter::value() const {
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < SLOTS; ++i) {
+        v += m_slots[i].value.load(std::memory_order_relaxed);
+    }
+    return v;
+}
+
+void Counter::write(std::ostream& os) {
+    os << m_name << m_labels << " " << value() << "\n";
+}
+
+Gauge::Gauge(const std::string& name, const Labels& labels)
+    :Metric(name, labels, GAUGE) {
+}
+
+void Gauge::write(std::ostream& os) {
+    os << m_name << m_labels << " " << value() << "\n";
+}
+
+FuncMetric::FuncMetric(const std::string& name, const Labels& labels, Type type, Callback cb)
+    :Metric(name, labels, type)
+    ,m_cb(cb) {
+}
+
+void FuncMetric::write(std::ostream& os) {
+    os << m_name << m_labels << " " << FormatValue(m_cb ? m_cb() : 0) << "\n";
+}
+
+HdrHistogram::HdrHistogram(const std::string& name, const Labels& labels, double unit)
+    :Metric(name, labels, HISTOGRAM)
+    ,m_labelMap(labels)
+    ,m_unit(unit) {
+    for (uint32_t i = 0; i < BUCKETS; ++i) {
+        m_buckets[i] = 0;
+    }
+}
+
+uint32_t HdrHistogram::BucketIndex(uint64_t v) {
+    if (v < (1u << SUB_BITS)) {
+        return v;
+    }
+    uint32_t msb = 63 - __builtin_clzll(v);
+    uint32_t shift = msb - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) + ((v >> shift) & ((1u << SUB_BITS) - 1));
+}
+
+uint64_t HdrHistogram::BucketUpper(uint32_t idx) {
+    if (idx < (1u << SUB_BITS)) {
+        return idx;
+    }
+    uint32_t shift = (idx >> SUB_BITS) - 1;
+    uint64_t lower = (uint64_t)((1u << SUB_BITS) + (idx & ((1u << SUB_BITS) - 1))) << shift;
+    return lower + ((1ull << shift) - 1);
+}
+
+void HdrHistogram::observe(uint64_t v) {
+    m_buckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(v, std::memory_order_relaxed);
+}
+
+uint64_t HdrHistogram::percentile(double p) const {
+    uint64_t count = m_count;
+    if (count == 0) {
+        return 0;
+    }
+    //第ceil(p * count)个值(从1开始)
+    uint64_t rank = (uint64_t)ceil(p * count);
+    rank = rank ? rank - 1 : 0;
+    uint64_t acc = 0;
+    for (uint32_t i = 0; i < BUCKETS; ++i) {
+        acc += m_buckets[i];
+        if (acc > rank) {
+            return BucketUpper(i);
+        }
+    }
+    return BucketUpper(BUCKETS - 1);
+}
+
+void HdrHistogram::write(std::ostream& os) {
+    //各个桶是分别读的，用桶的合计作为count，保证+Inf和最后一个桶一致
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BUCKETS; ++i) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    //每个2的幂区间导出两个le，到所有数据都被覆盖为止
+    uint64_t acc = 0;
+    for (uint32_t i = 0; i < BUCKETS; ++i) {
+        acc += counts[i];
+        if ((i & 3) != 3) {
+            continue;
+        }
+        os << m_name << "_bucket"
+           << FormatLabels(m_labelMap, "le=\"" + FormatValue(BucketUpper(i) * m_unit) + "\"")
+           << " " << acc << "\n";
+        if (acc == total) {
+            break;
+        }
+    }
+    os << m_name << "_bucket" << FormatLabels(m_labelMap, "le=\"+Inf\"") << " " << total << "\n";
+    os << m_name << "_sum" << m_labels << " " << FormatValue(m_sum * m_unit) << "\n";
+    os << m_name << "_count" << m_labels << " " << total << "\n";
+}
+
+Metric::ptr MetricsRegistry::get(const std::string& name, const std::string& help, const Labels& labels
+                                 ,Metric::Type type, std::function<Metric::ptr()> create, bool replace) {
+    std::string key = Metric::FormatLabels(labels);
+    if (!replace) {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_families.find(name);
+        if (it != m_families.end() && it->second.type == type) {
+            auto mit = it->second.metrics.find(key);
+            if (mit != it->second.metrics.end()) {
+                return mit->second;
+            }
+        }
+    }
+    if (!IsValidName(name)) {
+        SYLAR_LOG_ERROR(g_logger) << "invalid metric name: " << name;
+        return nullptr;
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    auto it = m_families.find(name);
+    if (it == m_families.end()) {
+        it = m_families.insert(std::make_pair(name, Family())).first;
+        it->second.help = help;
+        it->second.type = type;
+    } else if (it->second.type != type) {
+        SYLAR_LOG_ERROR(g_logger) << "metric " << name << " already registered as "
+            << Metric::TypeToString(it->second.type) << ", not " << Metric::TypeToString(type);
+        return nullptr;
+    }
+    Metric::ptr& metric = it->second.metrics[key];
+    if (!metric || replace) {
+        metric = create();
+    }
+    return metric;
+}
+
+Counter::ptr MetricsRegistry::getCounter(const std::string& name, const std::string& help
+                                         ,const Labels& labels) {
+    Counter::ptr rt = std::dynamic_pointer_cast<Counter>(get(name, help, labels, Metric::COUNTER, [&](){
+        return std::make_shared<Counter>(name, labels);
+    }, false));
+    return rt ? rt : std::make_shared<Counter>(name, labels);
+}
+
+Gauge::ptr MetricsRegistry::getGauge(const std::string& name, const std::string& help
+                                     ,const Labels& labels) {
+    Gauge::ptr rt = std::dynamic_pointer_cast<Gauge>(get(name, help, labels, Metric::GAUGE, [&](){
+        return std::make_shared<Gauge>(name, labels);
+    }, false));
+    return rt ? rt : std::make_shared<Gauge>(name, labels);
+}
+
+HdrHistogram::ptr MetricsRegistry::getHistogram(const std::string& name, const std::string& help
+                                                ,const Labels& labels, double unit) {
+    HdrHistogram::ptr rt = std::dynamic_pointer_cast<HdrHistogram>(get(name, help, labels, Metric::HISTOGRAM, [&](){
+        return std::make_shared<HdrHistogram>(name, labels, unit);
+    }, false));
+    return rt ? rt : std::make_shared<HdrHistogram>(name, labels, unit);
+}
+
+FuncMetric::ptr MetricsRegistry::addFunc(const std::string& name, const std::string& help
+                                         ,const Labels& labels, Metric::Type type, FuncMetric::Callback cb) {
+    FuncMetric::ptr metric = std::make_shared<FuncMetric>(name, labels, type, cb);
+    get(name, help, labels, type, [metric](){ return metric;}, true);
+    return metric;
+}
+
+void MetricsRegistry::remove(Metric::ptr metric) {
+    if (!metric) {
+        return;
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    auto it = m_families.find(metric->getName());
+    if (it == m_families.end()) {
+        return;
+    }
+    auto mit = it->second.metrics.find(metric->getLabels());
+    if (mit != it->second.metrics.end() && mit->second == metric) {
+        it->second.metrics.erase(mit);
+    }
+    if (it->second.metrics.empty()) {
+        m_families.erase(it);
+    }
+}
+
+std::ostream& MetricsRegistry::write(std::ostream& os) {
+    //FuncMetric的回调在读锁内执行，remove拿到写锁后回调不会再被调用
+    RWMutexType::ReadLock lock(m_mutex);
+    for (auto& i : m_families) {
+        os << "# HELP " << i.first << " ";
+        Escape(os, i.second.help, false);
+        os << "\n# TYPE " << i.first << " " << Metric::TypeToString(i.second.type) << "\n";
+        for (auto& m : i.second.metrics) {
+            m.second->write(os);
+        }
+    }
+    return os;
+}
+
+std::string MetricsRegistry::toString() {
+    std::stringstream ss;
+    write(ss);
+    return ss.str();
+}
+
+}
+}
@@ -0,0 +1,206 @@
+/**
+ * @file metrics.h
+ * @brief 运行指标(计数器、仪表、直方图)，按Prometheus文本格式导出
+ * @date 2025-07-23
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 指标由MetricsMgr统一注册，/_/metrics按Prometheus文本格式输出全部指标
+// 1.Counter: 只增不减的计数，每个线程固定写其中一个槽位(间隔128字节，不会共享缓存行)，不加锁也没有缓存行争用，导出时把槽位加起来
+// 2.Gauge: 可增可减的当前值
+// 3.FuncMetric: 导出时调用回调取值，用来导出已经在别处维护的数据(队列长度、连接数等)，
+//   回调在注册表的读锁内执行，不能再调用注册表；对象析构前要remove，remove会等正在进行的导出结束
+// 4.HdrHistogram: 对数-线性分桶(每个2的幂区间再等分8份)，相对误差不超过12.5%，不需要预先指定桶的范围
+//
+// 同名同标签的指标只创建一次，调用方应该保存返回的指针，不要在热路径上反复查找
+// 使用：
+//   static metrics::Counter::ptr s_req = metrics::MetricsMgr::GetInstance()->getCounter(
+//       "sylar_xxx_total", "help", {{"name", "a"}});
+//   s_req->inc();
+
+#ifndef __SYLAR_METRICS_H__
+#define __SYLAR_METRICS_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "mutex.h"
+#include "singleton.h"
+
+namespace sylar {
+namespace metrics {
+
+typedef std::map<std::string, std::string> Labels;
+
+class Metric {
+public:
+    typedef std::shared_ptr<Metric> ptr;
+
+    enum Type {
+        COUNTER = 0,
+        GAUGE = 1,
+        HISTOGRAM = 2
+    };
+
+    Metric(const std::string& name, const Labels& labels, Type type);
+    virtual ~Metric() {}
+
+    //输出样本行(不含HELP/TYPE)
+    virtual void write(std::ostream& os) = 0;
+
+    const std::string& getName() const { return m_name;}
+    //格式化后的标签，如{server="http",code="2xx"}，没有标签时为空
+    const std::string& getLabels() const { return m_labels;}
+    Type getType() const { return m_type;}
+
+    static const char* TypeToString(Type type);
+    //把标签格式化成{k="v",...}，extra追加在最后(直方图的le)
+    static std::string FormatLabels(const Labels& labels, const std::string& extra = "");
+    //指标值的文本形式，整数不带小数点，无穷大为+Inf
+    static std::string FormatValue(double v);
+protected:
+    std::string m_name;
+    std::string m_labels;
+    Type m_type;
+};
+
+class Counter : public Metric {
+public:
+    typedef std::shared_ptr<Counter> ptr;
+
+    Counter(const std::string& name, const Labels& labels);
+
+    void inc(uint64_t v = 1) {
+        m_slots[GetSlot()].value.fetch_add(v, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+    virtual void write(std::ostream& os) override;
+
+private:
+    static const uint32_t SLOTS = 32;
+    //线程对应的槽位，线程第一次写入时按顺序分配
+    static uint32_t GetSlot();
+
+    //C++11的make_shared/new不保证超过16字节的对齐，m_slots不一定从缓存行开头开始，
+    //每个槽位占128字节，不管起始地址在哪，相邻两个槽位的value都不会落在同一个缓存行(也不在相邻预取的同一对缓存行)
+    struct Slot {
+        std::atomic<uint64_t> value = {0};
+        char pad[128 - sizeof(std::atomic<uint64_t>)];
+    };
+    Slot m_slots[SLOTS];
+};
+
+class Gauge : public Metric {
+public:
+    typedef std::shared_ptr<Gauge> ptr;
+
+    Gauge(const std::string& name, const Labels& labels);
+
+    void set(int64_t v) { m_value.store(v, std::memory_order_relaxed);}
+    void inc(int64_t v = 1) { m_value.fetch_add(v, std::memory_order_relaxed);}
+    void dec(int64_t v = 1) { m_value.fetch_sub(v, std::memory_order_relaxed);}
+    int64_t value() const { return m_value;}
+
+    virtual void write(std::ostream& os) override;
+private:
+    std::atomic<int64_t> m_value = {0};
+};
+
+//导出时通过回调取值的计数器或仪表
+class FuncMetric : public Metric {
+public:
+    typedef std::shared_ptr<FuncMetric> ptr;
+    typedef std::function<double()> Callback;
+
+    FuncMetric(const std::string& name, const Labels& labels, Type type, Callback cb);
+
+    virtual void write(std::ostream& os) override;
+private:
+    Callback m_cb;
+};
+
+class HdrHistogram : public Metric {
+public:
+    typedef std::shared_ptr<HdrHistogram> ptr;
+
+    /**
+     * @param[in] unit 导出时值乘以unit，如按微秒记录、按秒导出时为1e-6
+     */
+    HdrHistogram(const std::string& name, const Labels& labels, double unit = 1);
+
+    void observe(uint64_t v);
+
+    uint64_t getCount() const { return m_count;}
+    //第p(0~1)分位所在桶的上界，没有数据时返回0
+    uint64_t percentile(double p) const;
+
+    virtual void write(std::ostream& os) override;
+
+    //v所在的桶
+    static uint32_t BucketIndex(uint64_t v);
+    //桶内的最大值
+    static uint64_t BucketUpper(uint32_t idx);
+
+private:
+    //每个2的幂区间分成(1 << SUB_BITS)个桶
+    static const uint32_t SUB_BITS = 3;
+    static const uint32_t BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    Labels m_labelMap;
+    double m_unit;
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+    std::atomic<uint64_t> m_count = {0};
+    std::atomic<uint64_t> m_sum = {0};
+};
+
+class MetricsRegistry {
+public:
+    typedef RWMutex RWMutexType;
+
+    //名字已经被其他类型的指标使用时记录错误日志，返回一个不导出的指标，调用方不需要判空
+    Counter::ptr getCounter(const std::string& name, const std::string& help
+                            ,const Labels& labels = Labels());
+    Gauge::ptr getGauge(const std::string& name, const std::string& help
+                        ,const Labels& labels = Labels());
+    HdrHistogram::ptr getHistogram(const std::string& name, const std::string& help
+                                   ,const Labels& labels = Labels(), double unit = 1);
+    //同名同标签的已存在时替换
+    FuncMetric::ptr addFunc(const std::string& name, const std::string& help
+                            ,const Labels& labels, Metric::Type type, FuncMetric::Callback cb);
+
+    //删除指标，已经被同名同标签的其他指标替换时不删除
+    void remove(Metric::ptr metric);
+
+    //按Prometheus文本格式(0.0.4)输出
+    std::ostream& write(std::ostream& os);
+    std::string toString();
+
+private:
+    struct Family {
+        std::string help;
+        Metric::Type type;
+        //格式化后的标签 -> 指标
+        std::map<std::string, Metric::ptr> metrics;
+    };
+
+    //找到或者创建name/labels对应的指标，create在写锁内调用
+    Metric::ptr get(const std::string& name, const std::string& help, const Labels& labels
+                    ,Metric::Type type, std::function<Metric::ptr()> create, bool replace);
+
+private:
+    RWMutexType m_mutex;
+    std::map<std::string, Family> m_families;
+};
+
+typedef sylar::Singleton<MetricsRegistry> MetricsMgr;
+
+}
+}
+
+#endif
@@ -0,0 +1,530 @@
+#include "profiler.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "macro.h"
+#include "mutex.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+//glibc分配器的实际实现，替换后的malloc等转调这些
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t nmemb, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+}
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_cpu_max_samples =
+    sylar::Config::Lookup("pprof.cpu_max_samples", (uint32_t)20000, "max samples of one cpu profile");
+
+static sylar::ConfigVar<uint64_t>::ptr g_heap_sample_bytes =
+    sylar::Config::Lookup("pprof.heap_sample_bytes", (uint64_t)0
+            , "average bytes allocated between two heap samples, 0 disable");
+
+//调用栈最大深度
+static const int MAX_DEPTH = 48;
+//信号处理函数里取到的调用栈，前两层是处理函数自己和信号返回的跳板(__restore_rt)
+static const uint32_t CPU_SKIP = 2;
+//堆采样的调用栈，前两层是HeapRecord和malloc/calloc/realloc/memalign等
+static const uint32_t HEAP_SKIP = 2;
+
+struct StackSample {
+    uint64_t fiber_id;
+    uint32_t depth;
+    //线程名(PR_GET_NAME，最多15个字符)
+    char thread[16];
+    void* pcs[MAX_DEPTH];
+};
+
+//只用系统调用和线程局部变量，可以在信号处理函数里调用
+static void FillThreadInfo(StackSample& sample) {
+    sample.fiber_id = Fiber::GetFiberId();
+    memset(sample.thread, 0, sizeof(sample.thread));
+    prctl(PR_GET_NAME, (unsigned long)sample.thread, 0, 0, 0);
+}
+
+//把调用栈解析成符号，相同的栈合并
+class StackFolder {
+public:
+    /**
+     * @param[in] skip 跳过最前面的几层
+     * @param[in] exact_leaf 第一层是精确的指令地址(被信号打断的位置)，否则每层都是返回地址
+     */
+    StackFolder(Profiler::GroupBy group, uint32_t skip, bool exact_leaf)
+        :m_group(group)
+        ,m_skip(skip)
+        ,m_exactLeaf(exact_leaf) {
+    }
+
+    void add(const StackSample& sample, double value) {
+        std::string stack;
+        if (m_group != Profiler::GROUP_NONE) {
+            stack = sample.thread[0] ? sample.thread : "unknown";
+            if (m_group == Profiler::GROUP_FIBER) {
+                stack += ";fiber-" + std::to_string(sample.fiber_id);
+            }
+        }
+        for (int i = (int)sample.depth - 1; i >= (int)m_skip; --i) {
+            if (!stack.empty()) {
+                stack += ';';
+            }
+            stack += symbol(sample.pcs[i], m_exactLeaf && i == (int)m_skip);
+        }
+        if (!stack.empty()) {
+            m_stacks[stack] += value;
+        }
+    }
+
+    void write(std::ostream& os) {
+        for (auto& i : m_stacks) {
+            uint64_t v = (uint64_t)llround(i.second);
+            if (v) {
+                os << i.first << " " << v << "\n";
+            }
+        }
+    }
+private:
+    const std::string& symbol(void* pc, bool exact) {
+        //返回地址指向call的下一条指令，减1才落在调用方的函数里
+        uintptr_t addr = (uintptr_t)pc - (exact ? 0 : 1);
+        auto it = m_symbols.find(addr);
+        if (it != m_symbols.end()) {
+            return it->second;
+        }
+        std::string name;
+        Dl_info info;
+        int rt = dladdr((void*)addr, &info);
+        if (rt && info.dli_sname) {
+            int status = 0;
+            char* v = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            name = (v && status == 0) ? v : info.dli_sname;
+            free(v);
+        } else if (rt && info.dli_fname) {
+            const char* base = strrchr(info.dli_fname, '/');
+            char buf[32];
+            snprintf(buf, sizeof(buf), "+0x%lx", (unsigned long)(addr - (uintptr_t)info.dli_fbase));
+            name = std::string(base ? base + 1 : info.dli_fname) + buf;
+        } else {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "0x%lx", (unsigned long)addr);
+            name = buf;
+        }
+        //';'是collapsed格式的分隔符
+        std::replace(name.begin(), name.end(), ';', ':');
+        return m_symbols[addr] = name;
+    }
+private:
+    Profiler::GroupBy m_group;
+    uint32_t m_skip;
+    bool m_exactLeaf;
+    std::map<std::string, double> m_stacks;
+    std::unordered_map<uintptr_t, std::string> m_symbols;
+};
+
+Profiler::GroupBy Profiler::ParseGroupBy(const std::string& v) {
+    if (v == "none") {
+        return GROUP_NONE;
+    }
+    if (v == "fiber") {
+        return GROUP_FIBER;
+    }
+    return GROUP_THREAD;
+}
+
+//CPU采样：样本数组在开始时分配，信号处理函数原子地取下标写入
+static StackSample* s_cpu_samples = nullptr;
+static uint32_t s_cpu_capacity = 0;
+static std::atomic<uint32_t> s_cpu_next = {0};
+static std::atomic<bool> s_cpu_enabled = {false};
+//正在执行的信号处理函数数量，停止后等它归0再读样本
+static std::atomic<int> s_cpu_in_handler = {0};
+//是否有采样在进行
+static std::atomic<bool> s_cpu_running = {false};
+static bool s_cpu_handler_installed = false;
+
+static void SigProfHandler(int sig, siginfo_t* info, void* context) {
+    int saved_errno = errno;
+    ++s_cpu_in_handler;
+    if (s_cpu_enabled) {
+        uint32_t idx = s_cpu_next.fetch_add(1, std::memory_order_relaxed);
+        if (idx < s_cpu_capacity) {
+            StackSample& sample = s_cpu_samples[idx];
+            sample.depth = backtrace(sample.pcs, MAX_DEPTH);
+            FillThreadInfo(sample);
+        }
+    }
+    --s_cpu_in_handler;
+    errno = saved_errno;
+}
+
+bool Profiler::IsCpuProfiling() {
+    return s_cpu_running;
+}
+
+bool Profiler::ProfileCpu(uint32_t seconds, uint32_t hz, GroupBy group, std::ostream& os) {
+    if (s_cpu_running.exchange(true)) {
+        SYLAR_LOG_WARN(g_logger) << "cpu profile is already running";
+        return false;
+    }
+    seconds = std::max(seconds, 1u);
+    hz = std::min(std::max(hz, 1u), 1000u);
+
+    //backtrace第一次调用时会加载libgcc_s，不能发生在信号处理函数里
+    void* warm[4];
+    backtrace(warm, 4);
+    //处理函数装上后不再卸载，停止后还没送达的SIGPROF不会按默认动作结束进程
+    if (!s_cpu_handler_installed) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = SigProfHandler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, nullptr)) {
+            SYLAR_LOG_ERROR(g_logger) << "sigaction(SIGPROF) fail, errno=" << errno
+                << " errstr=" << strerror(errno);
+            s_cpu_running = false;
+            return false;
+        }
+        s_cpu_handler_installed = true;
+    }
+
+    //ITIMER_PROF按整个进程的CPU时间计时，最多每个CPU每秒hz个样本
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t expect = (uint64_t)seconds * hz * (cpus > 0 ? cpus : 1) + hz;
+    s_cpu_capacity = (uint32_t)std::min<uint64_t>(expect, g_cpu_max_samples->getValue());
+    s_cpu_samples = new StackSample[s_cpu_capacity];
+    s_cpu_next = 0;
+    s_cpu_enabled = true;
+
+    uint64_t interval_us = 1000000 / hz;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    bool ok = setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+    if (!ok) {
+        SYLAR_LOG_ERROR(g_logger) << "setitimer(ITIMER_PROF) fail, errno=" << errno
+            << " errstr=" << strerror(errno);
+    } else {
+        //协程里sleep被hook，只挂起当前协程；线程里被SIGPROF打断时返回剩余的秒数
+        unsigned int left = seconds;
+        while (left) {
+            left = sleep(left);
+        }
+    }
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    s_cpu_enabled = false;
+    while (s_cpu_in_handler) {
+        sched_yield();
+    }
+
+    if (ok) {
+        uint32_t total = s_cpu_next;
+        uint32_t count = std::min(total, s_cpu_capacity);
+        StackFolder folder(group, CPU_SKIP, true);
+        for (uint32_t i = 0; i < count; ++i) {
+            folder.add(s_cpu_samples[i], 1);
+        }
+        folder.write(os);
+        SYLAR_LOG_INFO(g_logger) << "cpu profile seconds=" << seconds << " hz=" << hz
+            << " samples=" << count << " dropped=" << (total - count);
+    }
+
+    delete[] s_cpu_samples;
+    s_cpu_samples = nullptr;
+    s_cpu_capacity = 0;
+    s_cpu_running = false;
+    return ok;
+}
+
+//堆采样
+struct HeapSample {
+    StackSample stack;
+    //这个样本代表的字节数
+    double bytes;
+};
+
+struct HeapShard {
+    Spinlock mutex;
+    std::unordered_map<void*, HeapSample> samples;
+};
+
+static const uint32_t HEAP_SHARDS = 16;
+static const uint32_t HEAP_FILTER_BITS = 16;
+
+//平均采样间隔(字节)，0表示不采样
+static std::atomic<uint64_t> s_heap_rate = {0};
+//仍在使用的样本数，为0时free不查表
+static std::atomic<int64_t> s_heap_live = {0};
+//打开采样时分配，之后不释放(进程退出时静态对象析构后仍可能有free)
+static HeapShard* s_heap_shards = nullptr;
+//按指针哈希计数的过滤器，计数为0的指针一定没有被采样，free时不用加锁查表
+static std::atomic<uint32_t>* s_heap_filter = nullptr;
+
+//malloc里访问的线程局部变量用initial-exec模型，避免__tls_get_addr在malloc里再次分配内存
+static thread_local int64_t t_heap_left __attribute__((tls_model("initial-exec"))) = 0;
+static thread_local uint64_t t_heap_rand __attribute__((tls_model("initial-exec"))) = 0;
+//正在采样或者查表，期间的分配和释放都不处理，防止递归
+static thread_local bool t_in_heap_hook __attribute__((tls_model("initial-exec"))) = false;
+
+static inline uint32_t PtrHash(void* ptr) {
+    return (uint32_t)((((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull) >> (64 - HEAP_FILTER_BITS));
+}
+
+//下一次采样前要分配的字节数，服从均值为rate的指数分布
+static int64_t NextHeapInterval(uint64_t rate) {
+    if (t_heap_rand == 0) {
+        t_heap_rand = ((uintptr_t)&t_heap_rand * 0x9E3779B97F4A7C15ull) | 1;
+    }
+    t_heap_rand ^= t_heap_rand >> 12;
+    t_heap_rand ^= t_heap_rand << 25;
+    t_heap_rand ^= t_heap_rand >> 27;
+    double u = (double)(((t_heap_rand * 0x2545F4914F6CDD1Dull) >> 11) + 1) / 9007199254740993.0;
+    return (int64_t)(-log(u) * rate) + 1;
+}
+
+static inline bool HeapShouldSample(size_t size, uint64_t& rate) {
+    rate = s_heap_rate.load(std::memory_order_acquire);
+    if (SYLAR_LIKELY(rate == 0)) {
+        return false;
+    }
+    t_heap_left -= (int64_t)size;
+    if (SYLAR_LIKELY(t_heap_left > 0) || t_in_heap_hook) {
+        return false;
+    }
+    t_heap_left = NextHeapInterval(rate);
+    return true;
+}
+
+//记录放进表里，调用方设置t_in_heap_hook
+static void HeapInsert(void* ptr, const HeapSample& sample) {
+    uint32_t h = PtrHash(ptr);
+    HeapShard& shard = s_heap_shards[h % HEAP_SHARDS];
+    {
+        Spinlock::Lock lock(shard.mutex);
+        shard.samples[ptr] = sample;
+    }
+    ++s_heap_filter[h];
+    ++s_heap_live;
+}
+
+//不能内联，保证调用栈最前面固定是HeapRecord和malloc
+static void __attribute__((noinline)) HeapRecord(void* ptr, size_t size, uint64_t rate) {
+    t_in_heap_hook = true;
+    HeapSample sample;
+    sample.stack.depth = backtrace(sample.stack.pcs, MAX_DEPTH);
+    FillThreadInfo(sample.stack);
+    //大小为size的分配被采样的概率是1-exp(-size/rate)，用它的倒数反推代表的字节数
+    sample.bytes = size / (1 - exp(-(double)size / rate));
+    HeapInsert(ptr, sample);
+    t_in_heap_hook = false;
+}
+
+//删除ptr的采样记录，sample不为nullptr时把记录取出来，没有被采样时返回false
+static inline bool HeapTake(void* ptr, HeapSample* sample) {
+    if (SYLAR_LIKELY(s_heap_live.load(std::memory_order_relaxed) == 0) || t_in_heap_hook) {
+        return false;
+    }
+    uint32_t h = PtrHash(ptr);
+    if (s_heap_filter[h].load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    t_in_heap_hook = true;
+    HeapShard& shard = s_heap_shards[h % HEAP_SHARDS];
+    bool found = false;
+    {
+        Spinlock::Lock lock(shard.mutex);
+        auto it = shard.samples.find(ptr);
+        if (it != shard.samples.end()) {
+            if (sample) {
+                *sample = it->second;
+            }
+            shard.samples.erase(it);
+            found = true;
+        }
+    }
+    if (found) {
+        --s_heap_filter[h];
+        --s_heap_live;
+    }
+    t_in_heap_hook = false;
+    return found;
+}
+
+static inline void HeapForget(void* ptr) {
+    HeapTake(ptr, nullptr);
+}
+
+//把HeapTake取出的记录放回去(realloc失败，原来的内存还在使用)
+static void HeapRestore(void* ptr, const HeapSample& sample) {
+    t_in_heap_hook = true;
+    HeapInsert(ptr, sample);
+    t_in_heap_hook = false;
+}
+
+static void SetHeapSampleBytes(uint64_t rate) {
+    if (rate && !s_heap_shards) {
+        void* warm[4];
+        backtrace(warm, 4);
+        s_heap_filter = new std::atomic<uint32_t>[1u << HEAP_FILTER_BITS]();
+        s_heap_shards = new HeapShard[HEAP_SHARDS];
+    }
+    s_heap_rate.store(rate, std::memory_order_release);
+}
+
+struct _ProfilerIniter {
+    _ProfilerIniter() {
+        SetHeapSampleBytes(g_heap_sample_bytes->getValue());
+        g_heap_sample_bytes->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+            SYLAR_LOG_INFO(g_logger) << "heap sample bytes changed from "
+                << old_value << " to " << new_value;
+            SetHeapSampleBytes(new_value);
+        });
+    }
+};
+
+static _ProfilerIniter s_profiler_initer;
+
+bool Profiler::IsHeapEnabled() {
+    return s_heap_rate != 0;
+}
+
+void Profiler::WriteHeap(GroupBy group, std::ostream& os) {
+    if (!s_heap_shards) {
+        return;
+    }
+    std::vector<HeapSample> samples;
+    samples.reserve(std::max<int64_t>(s_heap_live, 0) + 64);
+    //持有分片锁时分配内存不能再被采样，否则会重复加锁
+    bool old = t_in_heap_hook;
+    t_in_heap_hook = true;
+    for (uint32_t i = 0; i < HEAP_SHARDS; ++i) {
+        Spinlock::Lock lock(s_heap_shards[i].mutex);
+        for (auto& it : s_heap_shards[i].samples) {
+            samples.push_back(it.second);
+        }
+    }
+    t_in_heap_hook = old;
+
+    StackFolder folder(group, HEAP_SKIP, false);
+    for (auto& i : samples) {
+        folder.add(i.stack, i.bytes);
+    }
+    folder.write(os);
+}
+
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    uint64_t rate;
+    if (ptr && sylar::HeapShouldSample(size, rate)) {
+        sylar::HeapRecord(ptr, size, rate);
+    }
+    return ptr;
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    void* ptr = __libc_calloc(nmemb, size);
+    uint64_t rate;
+    if (ptr && sylar::HeapShouldSample(nmemb * size, rate)) {
+        sylar::HeapRecord(ptr, nmemb * size, rate);
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    //先取出记录再realloc，搬移时旧地址被释放，可能马上被其他线程分配并采样
+    //realloc失败(size不为0时返回nullptr)时旧内存不变，把记录放回去
+    sylar::HeapSample old;
+    bool sampled = ptr && sylar::HeapTake(ptr, &old);
+    void* rt = __libc_realloc(ptr, size);
+    if (sampled && !rt && size) {
+        sylar::HeapRestore(ptr, old);
+    }
+    uint64_t rate;
+    if (rt && sylar::HeapShouldSample(size, rate)) {
+        sylar::HeapRecord(rt, size, rate);
+    }
+    return rt;
+}
+
+void free(void* ptr) {
+    if (ptr) {
+        sylar::HeapForget(ptr);
+    }
+    __libc_free(ptr);
+}
+
+//对齐分配也要替换，否则这些内存不会被采样；posix_memalign/aligned_alloc没有__libc_版本，用__libc_memalign实现
+void* memalign(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    uint64_t rate;
+    if (ptr && sylar::HeapShouldSample(size, rate)) {
+        sylar::HeapRecord(ptr, size, rate);
+    }
+    return ptr;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+    //alignment必须是2的幂并且是sizeof(void*)的倍数
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+        return EINVAL;
+    }
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    uint64_t rate;
+    if (sylar::HeapShouldSample(size, rate)) {
+        sylar::HeapRecord(ptr, size, rate);
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    uint64_t rate;
+    if (ptr && sylar::HeapShouldSample(size, rate)) {
+        sylar::HeapRecord(ptr, size, rate);
+    }
+    return ptr;
+}
+
+void* valloc(size_t size) {
+    void* ptr = __libc_valloc(size);
+    uint64_t rate;
+    if (ptr && sylar::HeapShouldSample(size, rate)) {
+        sylar::HeapRecord(ptr, size, rate);
+    }
+    return ptr;
+}
+
+}
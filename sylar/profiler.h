@@ -0,0 +1,63 @@
+/**
+ * @file profiler.h
+ * @brief 内置的采样CPU profiler和堆内存profiler，输出flamegraph用的collapsed格式
+ * @date 2025-07-25
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 不能用perf的环境里排查热点，/_/pprof/profile和/_/pprof/heap调用这里
+// 1.CPU: setitimer(ITIMER_PROF)按进程CPU时间定时发SIGPROF，信号处理函数在被打断的线程上取调用栈，
+//   写入预先分配好的样本数组(原子递增下标，不加锁不分配内存)，同时记录线程名和当前协程id
+//   调用栈用glibc的backtrace(libgcc的unwinder，按DWARF展开，不依赖帧指针)，开始前先调用一次完成初始化
+//   同一时间只能有一个采样，在协程里调用时通过hook的usleep等待，不阻塞线程
+// 2.堆: 替换malloc/free/calloc/realloc和memalign/posix_memalign/aligned_alloc/valloc(转调glibc的__libc_*)，
+//   pvalloc和直接mmap的内存不统计；每个线程平均每分配pprof.heap_sample_bytes字节
+//   采样一次(间隔服从指数分布)，记录调用栈；被采样的内存释放时删除记录
+//   输出的是仍在使用的内存按调用栈汇总的估算字节数；pprof.heap_sample_bytes为0(默认)时不采样，
+//   这时malloc只多一次原子读，free只在有采样记录时才查表
+//
+// 输出每行一个调用栈：根;...;叶子 值，可以直接交给flamegraph.pl或speedscope
+// 符号用dladdr解析，需要用-rdynamic链接才能看到可执行文件里的函数名，解析不到时输出模块+偏移
+
+#ifndef __SYLAR_PROFILER_H__
+#define __SYLAR_PROFILER_H__
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+
+namespace sylar {
+
+class Profiler {
+public:
+    //调用栈最前面加的标签
+    enum GroupBy {
+        //不加
+        GROUP_NONE = 0,
+        //线程名
+        GROUP_THREAD = 1,
+        //线程名和协程id
+        GROUP_FIBER = 2
+    };
+
+    //none/thread/fiber，其他值返回GROUP_THREAD
+    static GroupBy ParseGroupBy(const std::string& v);
+
+    /**
+     * @brief 采样CPU，结束后把collapsed格式的结果写到os
+     * @param[in] seconds 采样时长
+     * @param[in] hz 每秒CPU时间的采样次数
+     * @return 已经有采样在进行或者设置定时器失败时返回false
+     */
+    static bool ProfileCpu(uint32_t seconds, uint32_t hz, GroupBy group, std::ostream& os);
+    static bool IsCpuProfiling();
+
+    //堆采样是否打开(pprof.heap_sample_bytes大于0)
+    static bool IsHeapEnabled();
+    //输出仍在使用的被采样内存，值为估算的字节数
+    static void WriteHeap(GroupBy group, std::ostream& os);
+};
+
+}
+
+#endif
@@ -2,7 +2,7 @@
 #include "sylar/log.h"
 #include "sylar/config.h"
 #include "sylar/endian.h"
-#include "sylar/streams/zlib_stream.h"
+#include "sylar/streams/compress_codec.h"
 
 namespace sylar {
 
@@ -16,6 +16,31 @@ static sylar::ConfigVar<uint32_t>::ptr g_rock_protocol_gzip_min_length
     = sylar::Config::Lookup("rock.protocol.gzip_min_length",
                             (uint32_t)(1024 * 4), "rock protocol gizp min length");
 
+//发送时使用的压缩算法(gzip/lz4/zstd)，接收端按消息头中的codec id解压，两端不需要配置一致
+//但老版本只认识gzip，对端可能是老版本时只能用gzip
+static sylar::ConfigVar<std::string>::ptr g_rock_protocol_codec
+    = sylar::Config::Lookup("rock.protocol.codec",
+                            std::string("gzip"), "rock protocol compress codec(gzip/lz4/zstd), old peers only understand gzip");
+
+namespace {
+struct _RockCodecIniter {
+    static void Check(const std::string& v) {
+        auto codec = CompressCodecMgr::GetInstance()->get(v);
+        if(codec && codec->getId() != CompressCodec::GZIP) {
+            SYLAR_LOG_WARN(g_logger) << "rock.protocol.codec=" << v
+                << ", peers running old versions can only decompress gzip";
+        }
+    }
+    _RockCodecIniter() {
+        Check(g_rock_protocol_codec->getValue());
+        g_rock_protocol_codec->addListener([](const std::string& old_value, const std::string& new_value){
+            Check(new_value);
+        });
+    }
+};
+static _RockCodecIniter s_rock_codec_initer;
+}
+
 bool RockBody::serializeToByteArray(ByteArray::ptr bytearray) {
     bytearray->writeStringVint(m_body);
     return true;
@@ -200,17 +225,21 @@ Message::ptr RockMessageDecoder::parseFrom(Stream::ptr stream) {
         }
         //把 ByteArray 的读取指针重置为起始位置，以便后续反序列化。
         ba->setPosition(0);
-        if(header.flag & 0x1) { //gizp
-            auto zstream = sylar::ZlibStream::CreateGzip(false);
-            if(zstream->write(ba, -1) != Z_OK) {
-                SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder ungzip error";
+        uint8_t codec_id = header.flag & ROCK_FLAG_CODEC_MASK;
+        if(codec_id != CompressCodec::NONE) {
+            //按消息头中的codec id找到对应的解压算法，解压结果直接写进out的内存块
+            auto codec = CompressCodecMgr::GetInstance()->get(codec_id);
+            if(!codec) {
+                SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder unsupported codec=" << (int)codec_id;
                 return nullptr;
             }
-            if(zstream->flush() != Z_OK) {
-                SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder ungzip flush error";
+            sylar::ByteArray::ptr out(new sylar::ByteArray);
+            if(codec->decompress(ba, ba->getReadSize(), out) != 0) {
+                SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder " << codec->getName() << " decompress error";
                 return nullptr;
             }
-            ba = zstream->getByteArray();
+            out->setPosition(0);
+            ba = out;
         }
         //读取消息类型（Request、Response、Notify）
         uint8_t type = ba->readFuint8();
@@ -253,20 +282,24 @@ int32_t RockMessageDecoder::serializeTo(Stream::ptr stream, Message::ptr msg) {
 
     // 判断是否需要压缩（消息体长度超过配置的最小压缩长度）
     if((uint32_t)header.length >= g_rock_protocol_gzip_min_length->getValue()) {
-        auto zstream = sylar::ZlibStream::CreateGzip(true); // 创建 Gzip 压缩流（true 表示压缩）
-
-        if(zstream->write(ba, -1) != Z_OK) { // 将 ByteArray 数据写入压缩流
-            SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder serializeTo gizp error";
-            return -1;
+        // 按配置选择压缩算法，配置了不存在的算法时退回 gzip
+        auto codec = CompressCodecMgr::GetInstance()->get(g_rock_protocol_codec->getValue());
+        if(!codec) {
+            SYLAR_LOG_WARN(g_logger) << "RockMessageDecoder unknown codec "
+                                     << g_rock_protocol_codec->getValue() << ", use gzip";
+            codec = CompressCodecMgr::GetInstance()->get(CompressCodec::GZIP);
         }
 
-        if(zstream->flush() != Z_OK) { // 完成压缩，刷新数据
-            SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder serializeTo gizp flush error";
+        // 压缩结果直接写进 out 的内存块
+        sylar::ByteArray::ptr out(new sylar::ByteArray);
+        if(codec->compress(ba, ba->getReadSize(), out) != 0) {
+            SYLAR_LOG_ERROR(g_logger) << "RockMessageDecoder serializeTo " << codec->getName() << " error";
             return -2;
         }
 
-        ba = zstream->getByteArray();   // 获取压缩后的数据
-        header.flag |= 0x1;             // 设置压缩标志位（第 0 位表示 Gzip）
+        out->setPosition(0);
+        ba = out;                       // 获取压缩后的数据
+        header.flag = (header.flag & ~ROCK_FLAG_CODEC_MASK) | codec->getId(); // flag 低 4 位记录 codec id
         header.length = ba->getSize();  // 更新压缩后的数据长度
     }
 
@@ -109,6 +109,11 @@ public:
 
 static const uint8_t s_rock_magic[2] = {0xab, 0xcd};
 
+//flag的低4位是压缩算法的id(见CompressCodec::Id)，0表示不压缩
+//老版本只用bit0表示gzip，gzip的id正好是1，所以只有rock.protocol.codec为gzip时新老版本可以互通；
+//lz4/zstd压缩的消息老版本解不开，集群里还有老版本时不能改成其他codec(不做协商)
+static const uint8_t ROCK_FLAG_CODEC_MASK = 0x0F;
+
 struct RockMsgHeader {
     RockMsgHeader(); 
 
@@ -117,7 +122,7 @@ struct RockMsgHeader {
     uint8_t version;  // 协议版本号，用于兼容升级和版本控制
                       // 比如当前为版本 1，未来若有协议扩展可判断 version 决定解析逻辑
     uint8_t flag;     // 标志位，通常用于控制压缩、加密、是否响应等
-                      // 可用位操作表示多个布尔信息（如 bit 0: 是否压缩, bit 1: 是否加密）
+                      // 低 4 位: 压缩算法 id（见 ROCK_FLAG_CODEC_MASK），高 4 位保留
     int32_t length;   // 整个消息体（含头部之后的字节数）的长度，单位为字节
                       // 接收端可根据此字段决定读取多少数据构成完整消息
 };
@@ -31,10 +31,30 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) :
         m_rootThread = -1;
     }
     m_threadCount = threads;   //记录剩余的线程数量，不包括use_caller线程
+
+    auto mgr = metrics::MetricsMgr::GetInstance();
+    metrics::Labels labels = {{"scheduler", m_name}};
+    m_taskCounter = mgr->getCounter("sylar_scheduler_tasks_total", "tasks executed by scheduler", labels);
+    m_metrics.push_back(mgr->addFunc("sylar_scheduler_queue_size", "tasks waiting in scheduler queue"
+                , labels, metrics::Metric::GAUGE, [this]() {
+        MutexType::Lock lock(m_mutex);
+        return (double)m_fibers.size();
+    }));
+    m_metrics.push_back(mgr->addFunc("sylar_scheduler_active_threads", "scheduler threads running a task"
+                , labels, metrics::Metric::GAUGE, [this]() {
+        return (double)m_activeThreadCount;
+    }));
+    m_metrics.push_back(mgr->addFunc("sylar_scheduler_idle_threads", "scheduler threads in idle"
+                , labels, metrics::Metric::GAUGE, [this]() {
+        return (double)m_idleThreadCount;
+    }));
 }
 
 Scheduler::~Scheduler() {
     SYLAR_ASSERT(m_stopping);
+    for (auto& i : m_metrics) {
+        metrics::MetricsMgr::GetInstance()->remove(i);
+    }
     if (GetThis() == this) {
         t_scheduler = nullptr;
     }
@@ -156,6 +176,9 @@ void Scheduler::run() {
             }
             tickle_me |= it != m_fibers.end();
         }
+        if (ft.trace_us) {
+            traceDequeue(ft);
+        }
 
         //tickle_me=true说明有任务是给其他线程执行的，但他们可能还在等待任务，这时调用tickle()唤醒指定的线程
         if (tickle_me) {
@@ -164,6 +187,7 @@ void Scheduler::run() {
 
         //执行fiber任务
         if (ft.fiber && (ft.fiber->getState() != Fiber::TERM && ft.fiber->getState() != Fiber::EXCEPT)) {
+            m_taskCounter->inc();
             ft.fiber->swapIn();
             --m_activeThreadCount;
 
@@ -182,7 +206,9 @@ void Scheduler::run() {
             } else {
                 cb_fiber.reset(new Fiber(ft.cb));
             }
+            cb_fiber->m_trace = ft.trace;
             ft.reset();
+            m_taskCounter->inc();
             cb_fiber->swapIn();
             --m_activeThreadCount;
             if (cb_fiber->getState() ==Fiber::READY) {
@@ -217,6 +243,29 @@ void Scheduler::run() {
      }
 }
 
+void Scheduler::traceEnqueue(FiberAndThread& ft) {
+    //协程任务在协程自己的上下文里继续，回调任务继承调度它的协程的上下文
+    if (ft.fiber) {
+        if (ft.fiber->m_trace.sampled) {
+            ft.trace_us = Tracer::NowUS();
+        }
+        return;
+    }
+    TraceContext* ctx = Tracer::GetContext();
+    if (ctx->valid()) {
+        ft.trace = *ctx;
+        if (ctx->sampled) {
+            ft.trace_us = Tracer::NowUS();
+        }
+    }
+}
+
+void Scheduler::traceDequeue(FiberAndThread& ft) {
+    const TraceContext& ctx = ft.fiber ? ft.fiber->m_trace : ft.trace;
+    Tracer::Record(ctx, "sched", "sched.wait", ctx.span_id, Tracer::NewId()
+                   ,ft.trace_us, Tracer::NowUS());
+}
+
 //唤醒可能处于休眠状态的工作线程，让他们的继续执行调度任务
 void Scheduler::tickle() {
     SYLAR_LOG_INFO(g_logger) << "tickle";
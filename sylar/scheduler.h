@@ -15,6 +15,7 @@
 #include <iostream>
 #include "fiber.h"
 #include "thread.h"
+#include "metrics.h"
 
 namespace sylar {
 
@@ -46,6 +47,11 @@ public:
      */
     const std::string& getName() const { return m_name;}
 
+    /**
+     * @brief 返回调度器中所有线程的id(schedule时可以用来指定线程)
+     */
+    const std::vector<int>& getThreadIds() const { return m_threadIds;}
+
     /**
      * @brief 返回当前线程正在运行的的协程调度器
      */
@@ -70,6 +76,8 @@ public:
      * @brief 调度协程
      * @param[in] fc 协程或函数
      * @param[in] thread 协程执行的线程id,-1标识任意线程
+     * @details 可以在协程YieldToHold之前就把它schedule回来(先登记等待者、解锁，再让出)，
+     *          调度线程取到EXEC状态的协程会跳过，留在队列里等它让出后再执行
      */
     template<class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1) {
@@ -153,6 +161,7 @@ private:
         bool need_tickle = m_fibers.empty();
         FiberAndThread ft(fc, thread);
         if(ft.fiber || ft.cb) {
+            traceEnqueue(ft);
             m_fibers.push_back(ft);
         }
         return need_tickle;
@@ -168,6 +177,10 @@ private:
         std::function<void()> cb;
         /// 线程id
         int thread;
+        /// 回调任务继承的追踪上下文(协程任务用协程自己的)
+        TraceContext trace;
+        /// 采样时的入队时间(us)，用来记录排队耗时
+        uint64_t trace_us = 0;
 
         /**
          * @brief 构造函数
@@ -228,8 +241,19 @@ private:
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            trace = TraceContext();
+            trace_us = 0;
         }
     };
+
+    /**
+     * @brief 入队时处理追踪上下文，采样时记下入队时间
+     */
+    static void traceEnqueue(FiberAndThread& ft);
+    /**
+     * @brief 出队后记录排队耗时
+     */
+    static void traceDequeue(FiberAndThread& ft);
 private:
     /// Mutex
     MutexType m_mutex;
@@ -256,6 +280,10 @@ protected:
     bool m_autoStop = false;
     /// 主线程id(use_caller)
     int m_rootThread = 0;
+    /// 执行过的任务数
+    metrics::Counter::ptr m_taskCounter;
+    /// 注册的导出指标，析构时删除
+    std::vector<metrics::Metric::ptr> m_metrics;
 };
 
 
@@ -4,9 +4,13 @@
 #include "socket.h"
 #include "iomanager.h"
 #include "fd_manager.h"
+#include "config.h"
 
 #include <netinet/tcp.h>
+#include <sys/sendfile.h>
 #include <limits.h>
+#include <unistd.h>
+#include <algorithm>
 
 namespace sylar {
 
@@ -49,6 +53,18 @@ Socket::ptr Socket::CreateUDPSocket6() {
     return sock;
 }
 
+Socket::ptr Socket::CreateUnixTCPSocket() {
+    Socket::ptr sock(new Socket(UNIX, TCP, 0));
+    return sock;
+}
+
+Socket::ptr Socket::CreateUnixUDPSocket() {
+    Socket::ptr sock(new Socket(UNIX, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
+    return sock;
+}
+
 Socket::Socket(int family, int type, int protocol) 
     : m_sock(-1),
       m_family(family),
@@ -114,6 +130,10 @@ bool Socket::getOption(int level, int option, void* result, socklen_t* len) {
 
 bool Socket::setOption(int level, int option, const void* result, socklen_t len) {
     int rt = setsockopt(m_sock, level, option, result, (socklen_t)len);
+    if (rt) {
+        return false;
+    }
+    return true;
 }
 
 //accept()用于接受连接请求,accept会返回一个新的套接字connect_fd用于与客户端进行通信
@@ -131,6 +151,31 @@ Socket::ptr Socket::accept() {
     return nullptr;
 }
 
+int Socket::acceptMany(std::vector<Socket::ptr>& socks, size_t max) {
+    Socket::ptr first = accept();
+    if (!first) {
+        return -1;
+    }
+    socks.push_back(first);
+    size_t count = 1;
+    while (count < max) {
+        //accept4没有被hook，backlog为空时直接返回EAGAIN，不会挂起协程
+        int newsock = ::accept4(m_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newsock == -1) {
+            break;
+        }
+        sylar::FdMgr::GetInstance()->get(newsock, true);
+        Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+        if (!sock->init(newsock)) {
+            ::close(newsock);
+            continue;
+        }
+        socks.push_back(sock);
+        ++count;
+    }
+    return count;
+}
+
 //创建新套接字
 void Socket::newSock() {
     m_sock = socket(m_family, m_type, m_protocol);
@@ -171,6 +216,123 @@ bool Socket::init(int sock) {
     return false;
 }
 
+bool Socket::initListen(int sock) {
+    int val = 0;
+    socklen_t len = sizeof(val);
+    if (getsockopt(sock, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) || !val) {
+        SYLAR_LOG_ERROR(g_logger) << "initListen sock=" << sock << " is not a listening socket";
+        return false;
+    }
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(sock, true);
+    if (!ctx || !ctx->isSocket() || ctx->isClose()) {
+        return false;
+    }
+    int family = 0, type = 0, protocol = 0;
+    len = sizeof(int);
+    getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &family, &len);
+    len = sizeof(int);
+    getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &len);
+    len = sizeof(int);
+    getsockopt(sock, SOL_SOCKET, SO_PROTOCOL, &protocol, &len);
+    m_sock = sock;
+    m_family = family;
+    m_type = type;
+    m_protocol = protocol;
+    m_isConnected = false;
+    m_localAddress.reset();
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::shutdown(int how) {
+    if (!isValid()) {
+        return false;
+    }
+    return ::shutdown(m_sock, how) == 0;
+}
+
+int Socket::sendFds(const std::vector<int>& fds, const void* buffer, size_t length) {
+    if (!isConnected() || length == 0) {
+        return -1;
+    }
+    iovec iov;
+    iov.iov_base = (void*)buffer;
+    iov.iov_len = length;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control;
+    if (!fds.empty()) {
+        size_t fds_len = sizeof(int) * fds.size();
+        control.resize(CMSG_SPACE(fds_len));
+        msg.msg_control = &control[0];
+        msg.msg_controllen = control.size();
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fds_len);
+        memcpy(CMSG_DATA(cmsg), &fds[0], fds_len);
+    }
+    return ::sendmsg(m_sock, &msg, 0);
+}
+
+int Socket::recvFds(std::vector<int>& fds, void* buffer, size_t length, size_t max_fds) {
+    if (!isConnected()) {
+        return -1;
+    }
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = length;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * max_fds));
+    msg.msg_control = &control[0];
+    msg.msg_controllen = control.size();
+    int rt = ::recvmsg(m_sock, &msg, MSG_CMSG_CLOEXEC);
+    if (rt <= 0) {
+        return rt;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* p = (const int*)CMSG_DATA(cmsg);
+        for (size_t i = 0; i < n; ++i) {
+            fds.push_back(p[i]);
+        }
+    }
+    //控制信息被截断，说明对端发送的句柄比max_fds多，收到的那部分句柄不完整
+    if (msg.msg_flags & MSG_CTRUNC) {
+        SYLAR_LOG_ERROR(g_logger) << "recvFds control truncated, max_fds=" << max_fds;
+        for (auto fd : fds) {
+            ::close(fd);
+        }
+        fds.clear();
+        return -1;
+    }
+    return rt;
+}
+
+int64_t Socket::sendFile(int fd, off_t offset, size_t length) {
+    if (!isConnected()) {
+        return -1;
+    }
+    size_t total = 0;
+    while (total < length) {
+        //sendfile单次最多发送0x7ffff000字节，循环发完
+        ssize_t rt = ::sendfile(m_sock, fd, &offset, length - total);
+        if (rt <= 0) {
+            return total > 0 ? (int64_t)total : (int64_t)rt;
+        }
+        total += rt;
+    }
+    return total;
+}
+
 //send函数只有在套接字处于连接状态时才进行发送：这里的发送指的是通过m_sock发送数据到它所连接的另一端
 //返回值为发送的字节数或错误码
 //参数flags：标志
@@ -261,6 +423,128 @@ int Socket::recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags
 	return -1;
 }
 
+//GRO的控制信息是一个int，表示合并前每个报文的长度
+static const size_t s_datagram_control_size = CMSG_SPACE(sizeof(int));
+
+DatagramBatch::DatagramBatch(size_t capacity, size_t buffer_size)
+	: m_bufferSize(buffer_size),
+	  m_count(0),
+	  m_msgs(capacity),
+	  m_iovs(capacity),
+	  m_addrs(capacity),
+	  m_buffer(capacity * buffer_size),
+	  m_control(capacity * s_datagram_control_size),
+	  m_segments(capacity) {
+	memset(&m_msgs[0], 0, sizeof(mmsghdr) * capacity);
+}
+
+bool DatagramBatch::add(const void* data, size_t length, Address::ptr to) {
+	if (m_count >= m_msgs.size() || length > m_bufferSize) {
+		return false;
+	}
+	size_t i = m_count;
+	memcpy(getData(i), data, length);
+	m_iovs[i].iov_base = getData(i);
+	m_iovs[i].iov_len = length;
+	msghdr& hdr = m_msgs[i].msg_hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_iov = &m_iovs[i];
+	hdr.msg_iovlen = 1;
+	if (to) {
+		memcpy(&m_addrs[i], to->getAddr(), to->getAddrLen());
+		hdr.msg_name = &m_addrs[i];
+		hdr.msg_namelen = to->getAddrLen();
+	}
+	m_msgs[i].msg_len = 0;
+	++m_count;
+	return true;
+}
+
+Address::ptr DatagramBatch::getAddress(size_t i) const {
+	return Address::Create((const sockaddr*)&m_addrs[i], m_msgs[i].msg_hdr.msg_namelen);
+}
+
+void DatagramBatch::prepareRecv() {
+	m_count = 0;
+	for (size_t i = 0; i < m_msgs.size(); ++i) {
+		m_iovs[i].iov_base = getData(i);
+		m_iovs[i].iov_len = m_bufferSize;
+		msghdr& hdr = m_msgs[i].msg_hdr;
+		hdr.msg_iov = &m_iovs[i];
+		hdr.msg_iovlen = 1;
+		hdr.msg_name = &m_addrs[i];
+		hdr.msg_namelen = sizeof(sockaddr_storage);
+		hdr.msg_control = &m_control[i * s_datagram_control_size];
+		hdr.msg_controllen = s_datagram_control_size;
+		hdr.msg_flags = 0;
+		m_msgs[i].msg_len = 0;
+		m_segments[i] = 0;
+	}
+}
+
+void DatagramBatch::parseControl(size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		msghdr& hdr = m_msgs[i].msg_hdr;
+		for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+#ifdef UDP_GRO
+			if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+				int segment = 0;
+				memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+				m_segments[i] = segment;
+			}
+#endif
+		}
+	}
+}
+
+//recvmmsg/sendmmsg已经被hook，没有数据可读(发送缓冲区满)时会挂起当前协程，等待IOManager唤醒
+int Socket::recvMany(DatagramBatch& batch, int flags) {
+	if (!isConnected()) {
+		return -1;
+	}
+	batch.prepareRecv();
+	int rt = ::recvmmsg(m_sock, &batch.m_msgs[0], batch.m_msgs.size(), flags, nullptr);
+	if (rt > 0) {
+		batch.m_count = rt;
+		batch.parseControl(rt);
+	}
+	return rt;
+}
+
+int Socket::sendMany(DatagramBatch& batch, int flags) {
+	if (!isConnected()) {
+		return -1;
+	}
+	size_t sent = 0;
+	//sendmmsg可能只发送了一部分(比如发送缓冲区满)，剩下的继续发
+	while (sent < batch.m_count) {
+		int rt = ::sendmmsg(m_sock, &batch.m_msgs[sent], batch.m_count - sent, flags);
+		if (rt <= 0) {
+			return sent > 0 ? (int)sent : rt;
+		}
+		sent += rt;
+	}
+	return sent;
+}
+
+bool Socket::setUdpGso(uint16_t segment_size) {
+#ifdef UDP_SEGMENT
+	int v = segment_size;
+	return setOption(SOL_UDP, UDP_SEGMENT, v);
+#else
+	return false;
+#endif
+}
+
+bool Socket::setUdpGro(bool enable) {
+#ifdef UDP_GRO
+	int v = enable ? 1 : 0;
+	return setOption(SOL_UDP, UDP_GRO, v);
+#else
+	return false;
+#endif
+}
+
 bool Socket::isValid() const {
 	return m_sock != -1;
 }
@@ -405,6 +689,10 @@ bool Socket::bind(const Address::ptr addr) {
 			return false;
 		}
 	}
+	if (m_reusePort) {
+		int val = 1;
+		setOption(SOL_SOCKET, SO_REUSEPORT, val);
+	}
 	//检查地址族是否匹配
 	if (SYLAR_UNLIKELY(addr->getFamily() != m_family)) {
 		std::cout << "地址族不匹配" << std::endl;
@@ -563,6 +851,41 @@ SSLSocket::ptr SSLSocket::CreateTCPSocket6() {
     return sock;
 }
 
+static sylar::ConfigVar<bool>::ptr g_ssl_ktls
+    = sylar::Config::Lookup("ssl.ktls", false, "enable kernel tls offload");
+static sylar::ConfigVar<bool>::ptr g_ssl_session_ticket
+    = sylar::Config::Lookup("ssl.session_ticket", true, "enable tls session ticket");
+static sylar::ConfigVar<uint32_t>::ptr g_ssl_session_cache_size
+    = sylar::Config::Lookup("ssl.session_cache_size", (uint32_t)20480, "server side tls session cache size");
+static sylar::ConfigVar<uint32_t>::ptr g_ssl_session_timeout
+    = sylar::Config::Lookup("ssl.session_timeout", (uint32_t)300, "tls session timeout in seconds");
+
+//服务端和客户端共用的选项
+static void InitSSLContext(SSL_CTX* ctx) {
+#ifdef SSL_OP_ENABLE_KTLS
+    //握手完成后把密钥交给内核，之后的记录加解密由内核(或网卡)完成，并且可以用sendfile
+    if (g_ssl_ktls->getValue()) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+    if (!g_ssl_session_ticket->getValue()) {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+    SSL_CTX_set_timeout(ctx, g_ssl_session_timeout->getValue());
+}
+
+//客户端的SSL_CTX所有连接共用一个，不用每次connect都重新创建
+static std::shared_ptr<SSL_CTX> GetClientSSLContext() {
+    static std::shared_ptr<SSL_CTX> s_ctx = []() {
+        std::shared_ptr<SSL_CTX> ctx(SSL_CTX_new(SSLv23_client_method()), SSL_CTX_free);
+        InitSSLContext(ctx.get());
+        //会话由调用方(比如HttpConnectionPool)按目标地址保存，不需要openssl内部再存一份
+        SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        return ctx;
+    }();
+    return s_ctx;
+}
+
 bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string& key_file) {
     //创建一个新的SSL上下文对象
     //SSLv23_server_method会创建一个向后兼容的TLS/SSL服务端方法
@@ -583,9 +906,59 @@ bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string
         SYLAR_LOG_ERROR(g_logger) << "SSL_CTX_check_private_key cert_file=" << cert_file << " key_file=" << key_file;
         return false;
     }
+    InitSSLContext(m_ctx.get());
+    //服务端会话缓存：客户端带着session id重连时可以直接恢复会话，不用完整握手
+    static const unsigned char s_session_id_ctx[] = "sylar";
+    SSL_CTX_set_session_id_context(m_ctx.get(), s_session_id_ctx, sizeof(s_session_id_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(m_ctx.get(), SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(m_ctx.get(), g_ssl_session_cache_size->getValue());
+    return true;
+}
+
+//服务端ALPN选择回调，arg为m_alpn
+static int AlpnSelectCb(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                        const unsigned char* in, unsigned int inlen, void* arg) {
+    const std::string* protos = (const std::string*)arg;
+    unsigned char* selected = nullptr;
+    unsigned char selected_len = 0;
+    //按服务端的优先级选第一个客户端也支持的协议
+    if (SSL_select_next_proto(&selected, &selected_len, (const unsigned char*)protos->data(),
+                              protos->size(), in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    *outlen = selected_len;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+bool SSLSocket::setAlpnProtocols(const std::vector<std::string>& protos) {
+    std::shared_ptr<std::string> alpn = std::make_shared<std::string>();
+    for (auto& i : protos) {
+        if (i.empty() || i.size() > 255) {
+            SYLAR_LOG_ERROR(g_logger) << "invalid alpn protocol: " << i;
+            return false;
+        }
+        alpn->push_back((char)i.size());
+        alpn->append(i);
+    }
+    m_alpn = alpn;
+    //监听socket：设置到SSL_CTX上，之后accept的连接都会协商
+    if (m_ctx && !m_ssl) {
+        SSL_CTX_set_alpn_select_cb(m_ctx.get(), AlpnSelectCb, m_alpn.get());
+    }
     return true;
 }
 
+std::string SSLSocket::getAlpnProtocol() const {
+    if (!m_ssl) {
+        return "";
+    }
+    const unsigned char* data = nullptr;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(m_ssl.get(), &data, &len);
+    return data ? std::string((const char*)data, len) : "";
+}
+
 //初始化一个SSL套接字，将给定的文件描述符转为支持SSL的连接，并完成握手SSL_accept
 //该函通常在服务端接收到客户端连接之后被调用，属于服务端SSL套接字的初始化逻辑
 bool SSLSocket::init(int sock) {
@@ -619,21 +992,38 @@ Socket::ptr SSLSocket::accept() {
         return nullptr;
     }
     sock->m_ctx = m_ctx;
+    sock->m_alpn = m_alpn;
     if (sock->init(newsock)) {
         return sock;
     }
     return nullptr;
 }
 
+int SSLSocket::acceptMany(std::vector<Socket::ptr>& socks, size_t max) {
+    Socket::ptr sock = accept();
+    if (!sock) {
+        return -1;
+    }
+    socks.push_back(sock);
+    return 1;
+}
+
 //连接一个远程地址，并在连接成功后，升级为SSL加密通信
 bool SSLSocket::connect(const Address::ptr addr, uint64_t timeout_ms) {
     bool v = Socket::connect(addr, timeout_ms);
     if (v) {
         //连接成功后进行SSL初始化
         //创建一个新的客户端SSL上下文
-        m_ctx.reset(SSL_CTX_new(SSLv23_client_method()), SSL_CTX_free);
+        m_ctx = GetClientSSLContext();
         m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
         SSL_set_fd(m_ssl.get(), m_sock);
+        if (m_session) {
+            //尝试恢复之前的会话，服务端不接受时会自动退化为完整握手
+            SSL_set_session(m_ssl.get(), m_session.get());
+        }
+        if (m_alpn) {
+            SSL_set_alpn_protos(m_ssl.get(), (const unsigned char*)m_alpn->data(), m_alpn->size());
+        }
         //发送客户端问候消息，触发TLS握手
         v = (SSL_connect(m_ssl.get()) == 1);
     }
@@ -714,6 +1104,71 @@ int SSLSocket::recvFrom(iovec* buffers, size_t length, Address::ptr from, int fl
     return -1;
 }
 
+std::shared_ptr<SSL_SESSION> SSLSocket::getSession() const {
+    if (!m_ssl) {
+        return nullptr;
+    }
+    SSL_SESSION* session = SSL_get1_session(m_ssl.get());
+    if (!session) {
+        return nullptr;
+    }
+    return std::shared_ptr<SSL_SESSION>(session, SSL_SESSION_free);
+}
+
+bool SSLSocket::isSessionReused() const {
+    return m_ssl && SSL_session_reused(m_ssl.get()) == 1;
+}
+
+bool SSLSocket::isKTLSSend() const {
+#ifdef BIO_get_ktls_send
+    return m_ssl && BIO_get_ktls_send(SSL_get_wbio(m_ssl.get()));
+#else
+    return false;
+#endif
+}
+
+bool SSLSocket::isKTLSRecv() const {
+#ifdef BIO_get_ktls_recv
+    return m_ssl && BIO_get_ktls_recv(SSL_get_rbio(m_ssl.get()));
+#else
+    return false;
+#endif
+}
+
+int64_t SSLSocket::sendFile(int fd, off_t offset, size_t length) {
+    if (!m_ssl) {
+        return -1;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (isKTLSSend()) {
+        size_t total = 0;
+        while (total < length) {
+            ossl_ssize_t rt = SSL_sendfile(m_ssl.get(), fd, offset + total, length - total, 0);
+            if (rt <= 0) {
+                return total > 0 ? (int64_t)total : -1;
+            }
+            total += rt;
+        }
+        return total;
+    }
+#endif
+    //没有kTLS，只能读到用户态再加密
+    std::vector<char> buf(std::min(length, (size_t)(64 * 1024)));
+    size_t total = 0;
+    while (total < length) {
+        ssize_t n = pread(fd, &buf[0], std::min(buf.size(), length - total), offset + total);
+        if (n <= 0) {
+            break;
+        }
+        int rt = SSL_write(m_ssl.get(), &buf[0], n);
+        if (rt <= 0) {
+            return total > 0 ? (int64_t)total : rt;
+        }
+        total += rt;
+    }
+    return total;
+}
+
 std::ostream& operator<<(std::ostream& os, const Socket& sock) {
     return sock.dump(os);
 }
@@ -12,15 +12,77 @@
 #include "noncopyable.h"
 
 #include <memory>
+#include <vector>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 
 namespace sylar
 {
 
+// DatagramBatch 是一组预先分配好的数据报缓冲区，配合 Socket::recvMany/sendMany 使用。
+// mmsghdr/iovec/地址/控制信息缓冲区都在构造时一次分配好，可以在循环里反复使用，收发过程中不再分配内存。
+// 接收：recvMany 填满后用 getData(i)/getLength(i)/getAddress(i) 读取第 i 个数据报
+// 发送：add() 追加数据报后调用 sendMany，发送完 clear() 复用
+class DatagramBatch : Noncopyable
+{
+    friend class Socket;
+public:
+    typedef std::shared_ptr<DatagramBatch> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 最多容纳的数据报个数(一次系统调用收发的上限)
+     * @param[in] buffer_size 每个数据报的缓冲区大小，开启GRO/GSO时一个"数据报"可能是多个报文拼起来的，最大64KB
+     */
+    DatagramBatch(size_t capacity, size_t buffer_size = 2048);
+
+    size_t getCapacity() const { return m_msgs.size(); }
+    size_t getBufferSize() const { return m_bufferSize; }
+    /**
+     * @brief 当前有效的数据报个数(recvMany收到的，或add追加的)
+     */
+    size_t getCount() const { return m_count; }
+    void clear() { m_count = 0; }
+
+    /**
+     * @brief 追加一个待发送的数据报(数据会被拷贝到预分配的缓冲区)
+     * @param[in] to 目标地址，为空时使用socket已connect的对端地址
+     * @return 批已满或length超过buffer_size时返回false
+     */
+    bool add(const void *data, size_t length, Address::ptr to = nullptr);
+
+    char *getData(size_t i) { return &m_buffer[i * m_bufferSize]; }
+    size_t getLength(size_t i) const { return m_msgs[i].msg_len; }
+    /**
+     * @brief 第i个数据报的发送端地址(只对recvMany有效)
+     */
+    Address::ptr getAddress(size_t i) const;
+    /**
+     * @brief 开启GRO时，内核合并的数据报中每个原始报文的长度，为0表示没有合并
+     */
+    uint16_t getSegmentSize(size_t i) const { return m_segments[i]; }
+
+private:
+    // 接收前把每个mmsghdr恢复成完整的缓冲区大小
+    void prepareRecv();
+    // 接收后解析控制信息(GRO段大小)
+    void parseControl(size_t count);
+
+private:
+    size_t m_bufferSize;
+    size_t m_count;
+    std::vector<mmsghdr> m_msgs;
+    std::vector<iovec> m_iovs;
+    std::vector<sockaddr_storage> m_addrs;
+    std::vector<char> m_buffer;
+    std::vector<char> m_control;
+    std::vector<uint16_t> m_segments;
+};
+
 // Socket 类封装了底层 Socket API，提供 TCP、UDP、IPv4、IPv6、Unix 等多种类型的创建、
 // 连接、绑定、监听、发送、接收等操作，支持超时控制、错误处理和 RAII 资源管理，
 // 并结合协程调度器，简化网络编程，提高代码的可读性和健壮性。
@@ -119,6 +181,58 @@ public:
      */
     virtual Socket::ptr accept();
 
+    /**
+     * @brief 批量接收连接
+     * @details 先用accept等待第一个连接(没有连接时挂起协程)，然后用accept4(SOCK_NONBLOCK|SOCK_CLOEXEC)
+     *          把backlog里已经完成三次握手的连接一次取完，减少每个连接一次唤醒的开销
+     * @param[out] socks 接收到的连接追加到这里
+     * @param[in] max 本次最多接收的连接数
+     * @return 本次接收到的连接数，<=0表示出错
+     */
+    virtual int acceptMany(std::vector<Socket::ptr> &socks, size_t max);
+
+    /**
+     * @brief 设置SO_REUSEPORT，多个socket可以bind同一个地址，由内核在它们之间分配新连接
+     * @attention 需要在bind之前设置
+     */
+    void setReusePort(bool v) { m_reusePort = v; }
+
+    /**
+     * @brief 用一个已经处于listen状态的句柄初始化(比如从其他进程接管的监听socket)
+     * @details 协议族/类型/协议从句柄上读取，句柄会注册到FdManager
+     * @return 句柄不是监听socket时返回false，此时句柄不归Socket所有
+     */
+    bool initListen(int sock);
+
+    /**
+     * @brief 关闭连接的读/写方向，相当于shutdown()
+     * @details 对端会读到EOF；本端阻塞在读上的协程也会被唤醒并读到0，
+     *          可以在其他线程安全地结束一个连接，真正的close仍由持有连接的协程完成
+     */
+    bool shutdown(int how = SHUT_RDWR);
+
+    /**
+     * @brief 通过Unix域socket发送文件描述符(SCM_RIGHTS)，同时发送一段普通数据
+     * @param[in] fds 要发送的句柄，发送的是句柄的副本，本进程的句柄不受影响
+     * @param[in] buffer 随句柄一起发送的数据，至少1字节
+     * @return 发送的数据字节数，<=0表示出错
+     */
+    int sendFds(const std::vector<int>& fds, const void *buffer, size_t length);
+
+    /**
+     * @brief 接收sendFds发送的文件描述符和数据
+     * @param[out] fds 接收到的句柄(已设置CLOEXEC)，由调用方负责关闭
+     * @param[in] max_fds 最多接收的句柄数，超过的部分会被内核丢弃并返回错误
+     * @return 接收到的数据字节数，<=0表示出错
+     */
+    int recvFds(std::vector<int>& fds, void *buffer, size_t length, size_t max_fds = 64);
+
+    /**
+     * @brief 把文件fd中[offset, offset + length)的内容发送出去(sendfile，数据不经过用户态)
+     * @return 发送的字节数，<0表示出错；文件可能超过2GB，所以是int64_t
+     */
+    virtual int64_t sendFile(int fd, off_t offset, size_t length);
+
     /**
      * @brief 绑定地址
      * @param[in] addr 地址
@@ -248,6 +362,40 @@ public:
      */
     virtual int recvFrom(iovec *buffers, size_t length, Address::ptr from, int flags = 0);
 
+    /**
+     * @brief 批量接收数据报(recvmmsg)，一次系统调用最多收 batch.getCapacity() 个
+     * @param[in,out] batch 预分配的数据报缓冲区，收到的个数见 batch.getCount()
+     * @param[in] flags 标志字
+     * @return
+     *      @retval >0 接收到的数据报个数
+     *      @retval =0 socket被关闭
+     *      @retval <0 socket出错
+     * @attention 没有数据可读时挂起当前协程(hook)，不会阻塞线程
+     */
+    int recvMany(DatagramBatch &batch, int flags = 0);
+
+    /**
+     * @brief 批量发送 batch 中的数据报(sendmmsg)，内核一次没发完会继续发
+     * @return
+     *      @retval >=0 发送出去的数据报个数
+     *      @retval <0 socket出错
+     */
+    int sendMany(DatagramBatch &batch, int flags = 0);
+
+    /**
+     * @brief 设置UDP GSO段大小(UDP_SEGMENT)，之后发送的大数据报由内核/网卡切成 segment_size 大小的报文
+     * @param[in] segment_size 为0表示关闭
+     * @return 内核不支持时返回false
+     */
+    bool setUdpGso(uint16_t segment_size);
+
+    /**
+     * @brief 开启/关闭UDP GRO(UDP_GRO)，开启后内核会把同一流的多个报文合并成一个大数据报上交，
+     *        每个原始报文长度见 DatagramBatch::getSegmentSize
+     * @return 内核不支持时返回false
+     */
+    bool setUdpGro(bool enable);
+
     /**
      * @brief 获取远端地址
      */
@@ -336,6 +484,7 @@ protected:
     bool m_isConnected;           // 是否已连接
     Address::ptr m_localAddress;  // 本机地址
     Address::ptr m_remoteAddress; // 远端地址
+    bool m_reusePort = false;     // bind前是否设置SO_REUSEPORT
 };
 
 // 在网络通信中，我们常用的socket实现是基于TCP/IP协议的，但是，TCP是明文传输的，不安全的
@@ -392,6 +541,8 @@ public:
     virtual bool listen(int backlog = SOMAXCONN) override;
     virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1) override;
     virtual Socket::ptr accept() override;
+    // SSL握手在accept里完成，不做批量，一次只接收一个连接
+    virtual int acceptMany(std::vector<Socket::ptr> &socks, size_t max) override;
     virtual bool close() override;
 
     virtual int send(const void *buffer, size_t length, int flags = 0) override;
@@ -411,9 +562,33 @@ public:
     // key_file：私钥文件如server.key
     // 客户端连接时，服务器会把server.crt发送过去，客户端可以验证这个证书是否合法(通过CA签名)，
     //  然后进行SSL握手，建立加密通道，后续所有send/recv数据都会自动加密解密
+    // 加载成功后会按配置开启服务端会话缓存、session ticket以及kTLS
     bool loadCertificates(const std::string &cert_file, const std::string &key_file);
     virtual std::ostream &dump(std::ostream &os) const override;
 
+    // 客户端会话复用：connect之前设置上一次连接保存下来的会话，握手时会尝试恢复会话(省掉证书交换和密钥协商)
+    void setSession(std::shared_ptr<SSL_SESSION> session) { m_session = session; }
+    // 获取当前连接可以用于下次恢复的会话，TLS1.3的ticket在握手后才到，最好在收到过数据之后再取
+    std::shared_ptr<SSL_SESSION> getSession() const;
+    // 本次握手是否复用了之前的会话
+    bool isSessionReused() const;
+
+    // ALPN协议协商，protos按优先级排列，如{"h2", "http/1.1"}
+    // 服务端在loadCertificates之后调用，握手时从客户端的列表中选出自己最优先的协议
+    // 客户端在connect之前调用，握手时把列表发给服务端
+    bool setAlpnProtocols(const std::vector<std::string>& protos);
+    // 握手协商出的协议，没有协商时为空
+    std::string getAlpnProtocol() const;
+
+    // 发送/接收方向是否已经由内核完成TLS记录加解密(kTLS)
+    bool isKTLSSend() const;
+    bool isKTLSRecv() const;
+
+    // 把文件fd中[offset, offset + length)的内容加密发送
+    // 开启kTLS时走SSL_sendfile，数据不经过用户态；否则退化为read + SSL_write
+    // 返回发送的字节数，<0表示出错
+    virtual int64_t sendFile(int fd, off_t offset, size_t length) override;
+
 protected:
     virtual bool init(int sock) override;
 
@@ -422,6 +597,10 @@ private:
     std::shared_ptr<SSL_CTX> m_ctx;
     // 当前连接的SSL会话，用于实际加解密通信
     std::shared_ptr<SSL> m_ssl;
+    // 客户端要尝试恢复的会话
+    std::shared_ptr<SSL_SESSION> m_session;
+    // ALPN协议列表(长度前缀格式)，服务端由accept出来的连接共享，保证选择回调使用时仍然有效
+    std::shared_ptr<std::string> m_alpn;
 };
 
 std::ostream &operator<<(std::ostream &os, const Socket &sock);
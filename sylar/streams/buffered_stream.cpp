@@ -0,0 +1,249 @@
+#include "buffered_stream.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+
+#include <string.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_buffered_stream_read_buffer_size
+    = sylar::Config::Lookup("stream.buffered.read_buffer_size",
+                            (uint32_t)(16 * 1024), "buffered stream read-ahead buffer size");
+
+static sylar::ConfigVar<uint32_t>::ptr g_buffered_stream_write_buffer_size
+    = sylar::Config::Lookup("stream.buffered.write_buffer_size",
+                            (uint32_t)(16 * 1024), "buffered stream write buffer size");
+
+BufferedStream::BufferedStream(Stream::ptr stream, size_t read_buffer_size, size_t write_buffer_size)
+    : m_stream(stream),
+      m_rpos(0),
+      m_rend(0),
+      m_wlen(0) {
+    if (read_buffer_size == 0) {
+        read_buffer_size = g_buffered_stream_read_buffer_size->getValue();
+    }
+    if (write_buffer_size == 0) {
+        write_buffer_size = g_buffered_stream_write_buffer_size->getValue();
+    }
+    m_rbuf.resize(read_buffer_size);
+    m_wbuf.resize(write_buffer_size);
+}
+
+BufferedStream::~BufferedStream() {
+    if (m_wlen > 0) {
+        SYLAR_LOG_WARN(g_logger) << "BufferedStream destroyed with " << m_wlen
+                                 << " bytes not flushed";
+    }
+}
+
+void BufferedStream::consume(size_t len) {
+    m_rpos += std::min(len, getReadAvailable());
+    if (m_rpos == m_rend) {
+        m_rpos = m_rend = 0;
+    }
+}
+
+int BufferedStream::fill() {
+    if (m_rpos == m_rend) {
+        m_rpos = m_rend = 0;
+    } else if (m_rend == m_rbuf.size() && m_rpos > 0) {
+        //缓冲区尾部没有空间了，把还没消费的数据挪到头部
+        memmove(&m_rbuf[0], &m_rbuf[m_rpos], m_rend - m_rpos);
+        m_rend -= m_rpos;
+        m_rpos = 0;
+    }
+    if (m_rend == m_rbuf.size()) {
+        return -1;
+    }
+    int rt = m_stream->read(&m_rbuf[m_rend], m_rbuf.size() - m_rend);
+    if (rt > 0) {
+        m_rend += rt;
+    }
+    return rt;
+}
+
+int64_t BufferedStream::find(const char* delim, size_t delim_len, size_t offset) const {
+    const char* begin = getReadBegin();
+    size_t avail = getReadAvailable();
+    while (offset + delim_len <= avail) {
+        //先用memchr找分隔符的第一个字节，glibc的memchr是向量化实现的，比逐字节比较快得多
+        const char* p = (const char*)memchr(begin + offset, delim[0], avail - offset - delim_len + 1);
+        if (!p) {
+            return -1;
+        }
+        if (delim_len == 1 || memcmp(p + 1, delim + 1, delim_len - 1) == 0) {
+            return p - begin;
+        }
+        offset = p - begin + 1;
+    }
+    return -1;
+}
+
+int BufferedStream::read(void* buffer, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (getReadAvailable() == 0) {
+        if (length >= m_rbuf.size()) {
+            return m_stream->read(buffer, length);
+        }
+        int rt = fill();
+        if (rt <= 0) {
+            return rt;
+        }
+    }
+    size_t n = std::min(length, getReadAvailable());
+    memcpy(buffer, getReadBegin(), n);
+    consume(n);
+    return n;
+}
+
+int BufferedStream::read(ByteArray::ptr ba, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (getReadAvailable() == 0) {
+        if (length >= m_rbuf.size()) {
+            return m_stream->read(ba, length);
+        }
+        int rt = fill();
+        if (rt <= 0) {
+            return rt;
+        }
+    }
+    size_t n = std::min(length, getReadAvailable());
+    ba->write(getReadBegin(), n);
+    consume(n);
+    return n;
+}
+
+int BufferedStream::readFixSize(void* buffer, size_t length) {
+    size_t n = std::min(length, getReadAvailable());
+    if (n > 0) {
+        memcpy(buffer, getReadBegin(), n);
+        consume(n);
+    }
+    if (n == length) {
+        return length;
+    }
+    int rt = Stream::readFixSize((char*)buffer + n, length - n);
+    return rt < 0 ? rt : length;
+}
+
+int BufferedStream::readFixSize(ByteArray::ptr ba, size_t length) {
+    size_t n = std::min(length, getReadAvailable());
+    if (n > 0) {
+        ba->write(getReadBegin(), n);
+        consume(n);
+    }
+    if (n == length) {
+        return length;
+    }
+    int rt = Stream::readFixSize(ba, length - n);
+    return rt < 0 ? rt : length;
+}
+
+int BufferedStream::peek(void* buffer, size_t length) {
+    if (length > m_rbuf.size()) {
+        length = m_rbuf.size();
+    }
+    while (getReadAvailable() < length) {
+        int rt = fill();
+        if (rt < 0) {
+            return rt;
+        }
+        if (rt == 0) {
+            break;
+        }
+    }
+    size_t n = std::min(length, getReadAvailable());
+    memcpy(buffer, getReadBegin(), n);
+    return n;
+}
+
+int BufferedStream::readUntil(std::string& out, const std::string& delim, size_t max_size) {
+    if (delim.empty()) {
+        return -1;
+    }
+    size_t offset = 0;
+    do {
+        int64_t pos = find(delim.c_str(), delim.size(), offset);
+        if (pos >= 0) {
+            out.assign(getReadBegin(), pos + delim.size());
+            consume(pos + delim.size());
+            return out.size();
+        }
+        size_t avail = getReadAvailable();
+        if (avail >= max_size) {
+            return -2;
+        }
+        //已经扫描过的部分不再重复扫描，只需回退delim.size() - 1个字节，防止分隔符跨两次read
+        offset = avail >= delim.size() ? avail - delim.size() + 1 : 0;
+        if (avail == m_rbuf.size()) {
+            //一整块缓冲区都放不下一行，扩容(受max_size约束)
+            m_rbuf.resize(std::min(m_rbuf.size() * 2, max_size + delim.size()));
+        }
+        int rt = fill();
+        if (rt <= 0) {
+            return rt;
+        }
+    } while (true);
+}
+
+int BufferedStream::readUntil(std::string& out, char delim, size_t max_size) {
+    return readUntil(out, std::string(1, delim), max_size);
+}
+
+int BufferedStream::write(const void* buffer, size_t length) {
+    if (m_wlen + length > m_wbuf.size()) {
+        int rt = flush();
+        if (rt < 0) {
+            return rt;
+        }
+    }
+    if (length >= m_wbuf.size()) {
+        //比整个写缓冲区还大，直接写到底层流
+        int rt = m_stream->writeFixSize(buffer, length);
+        return rt < 0 ? rt : length;
+    }
+    memcpy(&m_wbuf[m_wlen], buffer, length);
+    m_wlen += length;
+    return length;
+}
+
+int BufferedStream::write(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getReadBuffers(iovs, length);
+    size_t total = 0;
+    for (auto& i : iovs) {
+        int rt = write(i.iov_base, i.iov_len);
+        if (rt < 0) {
+            return rt;
+        }
+        total += rt;
+    }
+    ba->setPosition(ba->getPosition() + total);
+    return total;
+}
+
+int BufferedStream::flush() {
+    if (m_wlen == 0) {
+        return 0;
+    }
+    int rt = m_stream->writeFixSize(&m_wbuf[0], m_wlen);
+    if (rt < 0) {
+        return rt;
+    }
+    rt = m_wlen;
+    m_wlen = 0;
+    return rt;
+}
+
+void BufferedStream::close() {
+    flush();
+    m_stream->close();
+}
+
+}
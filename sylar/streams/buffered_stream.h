@@ -0,0 +1,112 @@
+/**
+ * @file buffered_stream.h
+ * @brief 带预读/写缓冲的流装饰器
+ * @date 2025-07-02
+ * @copyright Copyright (c) 2025年 All rights reserved
+ */
+
+//BufferedStream本身不产生数据，而是包装在任意一个Stream(比如SocketStream)外面：
+//读：一次从底层流尽量多读一些数据(预读)到内部缓冲区，后续的小块read直接从缓冲区拷贝，
+//   这样像RockMessageDecoder那种先读4字节头、再读body的解析方式，就不需要每个字段都走一次系统调用，
+//   对端如果一次发来了多个(pipeline)消息，也可以在一次recv后连续解析出来
+//写：小块write先攒在写缓冲区里，攒满或者显式调用flush()时才真正写到底层流
+//
+//   +-----------+   read/peek/readUntil   +----------------+   read(大块)   +--------------+
+//   |  解析器    | <---------------------- | BufferedStream | <------------ | SocketStream |
+//   +-----------+   write/flush           +----------------+   write       +--------------+
+
+#ifndef __SYLAR_STREAMS_BUFFERED_STREAM_H__
+#define __SYLAR_STREAMS_BUFFERED_STREAM_H__
+
+#include "sylar/stream.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace sylar {
+
+class BufferedStream : public Stream {
+public:
+    typedef std::shared_ptr<BufferedStream> ptr;
+
+    //stream：被包装的底层流
+    //read_buffer_size：预读缓冲区大小，为0时使用配置stream.buffered.read_buffer_size
+    //write_buffer_size：写缓冲区大小，为0时使用配置stream.buffered.write_buffer_size
+    BufferedStream(Stream::ptr stream, size_t read_buffer_size = 0, size_t write_buffer_size = 0);
+    ~BufferedStream();
+
+    //优先从预读缓冲区中拷贝数据，缓冲区为空时才去底层流读
+    //如果要读的长度比整个缓冲区还大，就绕过缓冲区直接读到用户内存，省一次拷贝
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    //覆盖基类的实现，缓冲区中已有的部分直接拷贝，不足的部分再循环读
+    virtual int readFixSize(void* buffer, size_t length) override;
+    virtual int readFixSize(ByteArray::ptr ba, size_t length) override;
+
+    //数据先写进写缓冲区，写缓冲区满了才写到底层流，返回值总是length(出错时<0)
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    //先flush再关闭底层流
+    virtual void close() override;
+
+    /**
+     * @brief 窥视length字节的数据，数据不会被消费，下次read还能读到
+     * @return
+     *      @retval >0 实际拷贝的字节数(流被关闭时可能小于length)
+     *      @retval =0 被关闭
+     *      @retval <0 出现流错误
+     * @attention length最多为预读缓冲区大小
+     */
+    int peek(void* buffer, size_t length);
+
+    /**
+     * @brief 一直读到分隔符delim出现为止，out中包含分隔符本身
+     * @param[out] out 读到的数据
+     * @param[in] delim 分隔符，比如"\r\n\r\n"
+     * @param[in] max_size 最多读取的长度，超过仍未找到分隔符时返回-2
+     * @return
+     *      @retval >0 out的长度
+     *      @retval =0 被关闭
+     *      @retval -1 出现流错误
+     *      @retval -2 超过max_size仍未找到分隔符
+     */
+    int readUntil(std::string& out, const std::string& delim, size_t max_size = 64 * 1024);
+    int readUntil(std::string& out, char delim, size_t max_size = 64 * 1024);
+
+    //把写缓冲区中的数据全部写到底层流，返回写出的字节数，<0表示出错
+    int flush();
+
+    //预读缓冲区中还未被消费的数据
+    const char* getReadBegin() const { return &m_rbuf[0] + m_rpos; }
+    size_t getReadAvailable() const { return m_rend - m_rpos; }
+    //消费掉预读缓冲区中的len字节(配合getReadBegin直接在缓冲区上解析时使用)
+    void consume(size_t len);
+    //写缓冲区中还未flush的数据长度
+    size_t getWritePending() const { return m_wlen; }
+
+    Stream::ptr getStream() const { return m_stream; }
+
+private:
+    //从底层流读一次数据追加到预读缓冲区尾部，必要时先把未消费的数据挪到缓冲区头部
+    //返回值同Stream::read
+    int fill();
+    //在预读缓冲区[m_rpos + offset, m_rend)中查找delim，找到返回相对m_rpos的位置，否则返回-1
+    int64_t find(const char* delim, size_t delim_len, size_t offset) const;
+
+private:
+    //被包装的底层流
+    Stream::ptr m_stream;
+    //预读缓冲区，有效数据为[m_rpos, m_rend)
+    std::vector<char> m_rbuf;
+    size_t m_rpos;
+    size_t m_rend;
+    //写缓冲区，有效数据为[0, m_wlen)
+    std::vector<char> m_wbuf;
+    size_t m_wlen;
+};
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "compress_codec.h"
+#include "zlib_stream.h"
+#include "lz4_stream.h"
+#include "zstd_stream.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<int32_t>::ptr g_lz4_level
+    = sylar::Config::Lookup("lz4.level", (int32_t)0, "lz4 compression level, >=3 use lz4hc");
+
+namespace {
+
+class GzipCodec : public CompressCodec {
+public:
+    GzipCodec()
+        : CompressCodec(GZIP, "gzip") {}
+
+    virtual int compress(ByteArray::ptr in, size_t length, ByteArray::ptr out) override {
+        return process(true, in, length, out);
+    }
+    virtual int decompress(ByteArray::ptr in, size_t length, ByteArray::ptr out) override {
+        return process(false, in, length, out);
+    }
+
+private:
+    int process(bool encode, ByteArray::ptr in, size_t length, ByteArray::ptr out) {
+        //zlib上下文由ZlibStreamPool按线程复用
+        auto zs = ZlibStreamPool::GetGzip(encode);
+        if (!zs) {
+            return -1;
+        }
+        return zs->writeTo(in, length, out, true) == Z_OK ? 0 : -1;
+    }
+};
+
+//lz4/zstd的上下文创建代价不大，但每条消息都创建也没必要，每个线程缓存一个，用完reset
+class Lz4Codec : public CompressCodec {
+public:
+    Lz4Codec()
+        : CompressCodec(LZ4, "lz4") {}
+
+    virtual int compress(ByteArray::ptr in, size_t length, ByteArray::ptr out) override {
+        static thread_local Lz4Stream::ptr t_stream;
+        return process(t_stream, true, in, length, out);
+    }
+    virtual int decompress(ByteArray::ptr in, size_t length, ByteArray::ptr out) override {
+        static thread_local Lz4Stream::ptr t_stream;
+        return process(t_stream, false, in, length, out);
+    }
+
+private:
+    int process(Lz4Stream::ptr& stream, bool encode, ByteArray::ptr in, size_t length, ByteArray::ptr out) {
+        if (!stream) {
+            stream = Lz4Stream::Create(encode, 64 * 1024, g_lz4_level->getValue());
+            if (!stream) {
+                return -1;
+            }
+        }
+        int rt = stream->writeTo(in, length, out, true);
+        stream->reset();
+        return rt;
+    }
+};
+
+class ZstdCodec : public CompressCodec {
+public:
+    ZstdCodec()
+        : CompressCodec(ZSTD, "zstd") {}
+
+    virtual int compress(ByteArray::ptr in, size_t length, ByteArray::ptr out) override {
+        static thread_local ZstdStream::ptr t_stream;
+        return process(t_stream, true, in, length, out);
+    }
+    virtual int decompress(ByteArray::ptr in, size_t length, ByteArray::ptr out) override {
+        static thread_local ZstdStream::ptr t_stream;
+        return process(t_stream, false, in, length, out);
+    }
+
+private:
+    int process(ZstdStream::ptr& stream, bool encode, ByteArray::ptr in, size_t length, ByteArray::ptr out) {
+        //全局字典被替换后，缓存的上下文还引用着旧字典，需要重建
+        if (!stream || stream->getDict() != ZstdStream::GetDictionary()) {
+            stream = ZstdStream::Create(encode);
+            if (!stream) {
+                return -1;
+            }
+        }
+        int rt = stream->writeTo(in, length, out, true);
+        stream->reset();
+        return rt;
+    }
+};
+
+}
+
+CompressCodecManager::CompressCodecManager() {
+    add(std::make_shared<GzipCodec>());
+    add(std::make_shared<Lz4Codec>());
+    add(std::make_shared<ZstdCodec>());
+}
+
+void CompressCodecManager::add(CompressCodec::ptr codec) {
+    if (codec->getId() == CompressCodec::NONE || codec->getId() > CompressCodec::MAX_ID) {
+        SYLAR_LOG_ERROR(g_logger) << "CompressCodecManager add invalid codec id="
+                                  << (int)codec->getId() << " name=" << codec->getName();
+        return;
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    m_codecs[codec->getId()] = codec;
+    m_names[codec->getName()] = codec;
+}
+
+CompressCodec::ptr CompressCodecManager::get(uint8_t id) {
+    if (id > CompressCodec::MAX_ID) {
+        return nullptr;
+    }
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_codecs[id];
+}
+
+CompressCodec::ptr CompressCodecManager::get(const std::string& name) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_names.find(name);
+    return it == m_names.end() ? nullptr : it->second;
+}
+
+}
@@ -0,0 +1,82 @@
+/**
+ * @file compress_codec.h
+ * @brief 压缩算法注册表
+ * @date 2025-07-06
+ * @copyright Copyright (c) 2025年 All rights reserved
+ */
+
+//把不同的压缩流(ZlibStream/Lz4Stream/ZstdStream)统一成"整块压缩/解压"的接口，并按id注册
+//协议层(比如Rock)只需要在消息头里带上codec id，接收端按id找到对应的codec解压，
+//新增压缩算法时只需要实现CompressCodec并注册，协议代码不用改
+//
+//id占用RockMsgHeader.flag的低4位：
+//  0 不压缩  1 gzip(兼容老版本flag bit0)  2 lz4  3 zstd  4~15 保留给自定义codec
+
+#ifndef __SYLAR_STREAMS_COMPRESS_CODEC_H__
+#define __SYLAR_STREAMS_COMPRESS_CODEC_H__
+
+#include "sylar/bytearray.h"
+#include "sylar/mutex.h"
+#include "sylar/singleton.h"
+
+#include <memory>
+#include <string>
+#include <map>
+#include <stdint.h>
+
+namespace sylar {
+
+class CompressCodec {
+public:
+    typedef std::shared_ptr<CompressCodec> ptr;
+
+    enum Id {
+        NONE = 0,
+        GZIP = 1,
+        LZ4  = 2,
+        ZSTD = 3,
+        MAX_ID = 15
+    };
+
+    CompressCodec(uint8_t id, const std::string& name)
+        : m_id(id), m_name(name) {}
+    virtual ~CompressCodec() {}
+
+    //压缩in中[position, position + length)的数据，结果追加写入out，成功返回0
+    virtual int compress(ByteArray::ptr in, size_t length, ByteArray::ptr out) = 0;
+    //解压in中[position, position + length)的数据，结果追加写入out，成功返回0
+    virtual int decompress(ByteArray::ptr in, size_t length, ByteArray::ptr out) = 0;
+
+    uint8_t getId() const { return m_id; }
+    const std::string& getName() const { return m_name; }
+
+protected:
+    uint8_t m_id;
+    std::string m_name;
+};
+
+//codec管理器，构造时注册内置的gzip/lz4/zstd
+class CompressCodecManager {
+public:
+    typedef RWMutex RWMutexType;
+
+    CompressCodecManager();
+
+    //注册codec，相同id或名字的会被覆盖
+    void add(CompressCodec::ptr codec);
+    //按id查找，找不到返回nullptr
+    CompressCodec::ptr get(uint8_t id);
+    //按名字查找(gzip/lz4/zstd)，找不到返回nullptr
+    CompressCodec::ptr get(const std::string& name);
+
+private:
+    RWMutexType m_mutex;
+    CompressCodec::ptr m_codecs[CompressCodec::MAX_ID + 1];
+    std::map<std::string, CompressCodec::ptr> m_names;
+};
+
+typedef sylar::Singleton<CompressCodecManager> CompressCodecMgr;
+
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include "lz4_stream.h"
+#include "sylar/log.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+Lz4Stream::ptr Lz4Stream::Create(bool encode, uint32_t buff_size, int level) {
+    Lz4Stream::ptr rt(new Lz4Stream(encode, buff_size));
+    if (rt->init(level) == 0) {
+        return rt;
+    }
+    return nullptr;
+}
+
+Lz4Stream::Lz4Stream(bool encode, uint32_t buff_size)
+    : m_encode(encode),
+      m_bufferSize(buff_size),
+      m_begin(false),
+      m_hint(0),
+      m_cctx(nullptr),
+      m_dctx(nullptr),
+      m_result(new ByteArray) {
+    memset(&m_prefs, 0, sizeof(m_prefs));
+}
+
+Lz4Stream::~Lz4Stream() {
+    if (m_cctx) {
+        LZ4F_freeCompressionContext(m_cctx);
+    }
+    if (m_dctx) {
+        LZ4F_freeDecompressionContext(m_dctx);
+    }
+}
+
+int Lz4Stream::init(int level) {
+    size_t rt = 0;
+    if (m_encode) {
+        m_prefs.compressionLevel = level;
+        //整条消息一个frame，块之间可以互相引用，压缩率更高
+        m_prefs.frameInfo.blockMode = LZ4F_blockLinked;
+        rt = LZ4F_createCompressionContext(&m_cctx, LZ4F_VERSION);
+        //compressUpdate要求输出缓冲区不小于输入长度对应的最坏情况
+        m_cbuf.resize(std::max(LZ4F_compressBound(m_bufferSize, &m_prefs),
+                               (size_t)LZ4F_HEADER_SIZE_MAX));
+    } else {
+        rt = LZ4F_createDecompressionContext(&m_dctx, LZ4F_VERSION);
+    }
+    if (LZ4F_isError(rt)) {
+        SYLAR_LOG_ERROR(g_logger) << "Lz4Stream init error: " << LZ4F_getErrorName(rt);
+        return -1;
+    }
+    return 0;
+}
+
+int Lz4Stream::read(void* buffer, size_t length) {
+    throw std::logic_error("Lz4Stream::read is invalid");
+}
+
+int Lz4Stream::read(ByteArray::ptr ba, size_t length) {
+    throw std::logic_error("Lz4Stream::read is invalid");
+}
+
+int Lz4Stream::write(const void* buffer, size_t length) {
+    iovec iov;
+    iov.iov_base = (void*)buffer;
+    iov.iov_len = length;
+    if (m_encode) {
+        return encode(&iov, 1, m_result, false);
+    } else {
+        return decode(&iov, 1, m_result, false);
+    }
+}
+
+int Lz4Stream::write(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> buffers;
+    ba->getReadBuffers(buffers, length);
+    if (m_encode) {
+        return encode(&buffers[0], buffers.size(), m_result, false);
+    } else {
+        return decode(&buffers[0], buffers.size(), m_result, false);
+    }
+}
+
+void Lz4Stream::close() {
+    flush();
+}
+
+int Lz4Stream::flush() {
+    iovec iov;
+    iov.iov_base = nullptr;
+    iov.iov_len = 0;
+    if (m_encode) {
+        return encode(&iov, 1, m_result, true);
+    } else {
+        return decode(&iov, 1, m_result, true);
+    }
+}
+
+int Lz4Stream::writeTo(ByteArray::ptr in, size_t length, ByteArray::ptr out, bool finish) {
+    std::vector<iovec> ivs;
+    if (length > 0) {
+        in->getReadBuffers(ivs, length);
+    }
+    if (ivs.empty()) {
+        iovec iov;
+        iov.iov_base = nullptr;
+        iov.iov_len = 0;
+        ivs.push_back(iov);
+    }
+    if (m_encode) {
+        return encode(&ivs[0], ivs.size(), out, finish);
+    } else {
+        return decode(&ivs[0], ivs.size(), out, finish);
+    }
+}
+
+int Lz4Stream::reset() {
+    m_result.reset(new ByteArray);
+    m_hint = 0;
+    if (m_encode) {
+        //下一次encode时LZ4F_compressBegin会重新开始一个frame
+        m_begin = false;
+    } else {
+        LZ4F_resetDecompressionContext(m_dctx);
+    }
+    return 0;
+}
+
+int Lz4Stream::encode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish) {
+    size_t rt = 0;
+    if (!m_begin) {
+        rt = LZ4F_compressBegin(m_cctx, &m_cbuf[0], m_cbuf.size(), &m_prefs);
+        if (LZ4F_isError(rt)) {
+            SYLAR_LOG_ERROR(g_logger) << "LZ4F_compressBegin error: " << LZ4F_getErrorName(rt);
+            return -1;
+        }
+        out->write(&m_cbuf[0], rt);
+        m_begin = true;
+    }
+    for (uint64_t i = 0; i < size; ++i) {
+        const char* p = (const char*)v[i].iov_base;
+        size_t left = v[i].iov_len;
+        while (left > 0) {
+            //每次最多喂m_bufferSize字节，保证m_cbuf能放下最坏情况的输出
+            size_t n = std::min(left, (size_t)m_bufferSize);
+            rt = LZ4F_compressUpdate(m_cctx, &m_cbuf[0], m_cbuf.size(), p, n, nullptr);
+            if (LZ4F_isError(rt)) {
+                SYLAR_LOG_ERROR(g_logger) << "LZ4F_compressUpdate error: " << LZ4F_getErrorName(rt);
+                return -1;
+            }
+            if (rt > 0) {
+                out->write(&m_cbuf[0], rt);
+            }
+            p += n;
+            left -= n;
+        }
+    }
+    if (finish) {
+        rt = LZ4F_compressEnd(m_cctx, &m_cbuf[0], m_cbuf.size(), nullptr);
+        if (LZ4F_isError(rt)) {
+            SYLAR_LOG_ERROR(g_logger) << "LZ4F_compressEnd error: " << LZ4F_getErrorName(rt);
+            return -1;
+        }
+        out->write(&m_cbuf[0], rt);
+        m_begin = false;
+    }
+    return 0;
+}
+
+int Lz4Stream::decode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish) {
+    std::vector<iovec> ovs;
+    for (uint64_t i = 0; i < size; ++i) {
+        const char* p = (const char*)v[i].iov_base;
+        size_t left = v[i].iov_len;
+        if (left == 0) {
+            //上一次调用结束时输出缓冲区没有写满，说明没有积压的输出，空输入不需要再调用
+            continue;
+        }
+        size_t dst_len = 0;
+        size_t cap = 0;
+        do {
+            //解压结果直接写进out的内存块
+            ovs.clear();
+            out->getWriteBuffers(ovs, m_bufferSize);
+            cap = dst_len = ovs[0].iov_len;
+            size_t src_len = left;
+            size_t rt = LZ4F_decompress(m_dctx, ovs[0].iov_base, &dst_len, p, &src_len, nullptr);
+            if (LZ4F_isError(rt)) {
+                SYLAR_LOG_ERROR(g_logger) << "LZ4F_decompress error: " << LZ4F_getErrorName(rt);
+                return -1;
+            }
+            m_hint = rt;
+            out->setPosition(out->getPosition() + dst_len);
+            p += src_len;
+            left -= src_len;
+        } while (left > 0 || dst_len == cap);
+    }
+    //LZ4F_decompress返回0表示一个frame已经完整解压
+    if (finish && m_hint != 0) {
+        SYLAR_LOG_ERROR(g_logger) << "Lz4Stream decode incomplete frame, need more "
+                                  << m_hint << " bytes";
+        return -2;
+    }
+    return 0;
+}
+
+std::string Lz4Stream::getResult() const {
+    std::string rt;
+    rt.resize(m_result->getSize());
+    if (!rt.empty()) {
+        m_result->read(&rt[0], rt.size(), 0);
+    }
+    return rt;
+}
+
+sylar::ByteArray::ptr Lz4Stream::getByteArray() {
+    sylar::ByteArray::ptr ba(new ByteArray);
+    std::string rt = getResult();
+    ba->write(rt.c_str(), rt.size());
+    ba->setPosition(0);
+    return ba;
+}
+
+}
@@ -0,0 +1,82 @@
+/**
+ * @file lz4_stream.h
+ * @brief 基于LZ4 frame格式的压缩/解压流
+ * @date 2025-07-06
+ * @copyright Copyright (c) 2025年 All rights reserved
+ */
+
+//Lz4Stream的用法和ZlibStream一致：write写入原始数据(压缩)或压缩数据(解压)，
+//flush结束当前frame，getResult/getByteArray取结果；也可以用writeTo直接输出到目标ByteArray
+//LZ4压缩率低于gzip，但压缩/解压速度快一个数量级，适合机房内部对延迟敏感的RPC流量
+
+#ifndef __SYLAR_STREAMS_LZ4_STREAM_H__
+#define __SYLAR_STREAMS_LZ4_STREAM_H__
+
+#include "sylar/stream.h"
+#include "sylar/bytearray.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <lz4frame.h>
+
+namespace sylar {
+
+class Lz4Stream : public Stream {
+public:
+    typedef std::shared_ptr<Lz4Stream> ptr;
+
+    //encode：压缩还是解压
+    //buff_size：每次喂给LZ4F_compressUpdate的最大输入长度
+    //level：压缩级别，<=0为快速模式，>=3为LZ4HC
+    static Lz4Stream::ptr Create(bool encode, uint32_t buff_size = 64 * 1024, int level = 0);
+    Lz4Stream(bool encode, uint32_t buff_size = 64 * 1024);
+    ~Lz4Stream();
+
+    //不支持读，和ZlibStream一样会抛异常
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    //压缩/解压buffer中的数据，结果追加到内部结果缓冲区，成功返回0
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    virtual void close() override;
+
+    //压缩时结束当前frame(写入frame尾)，解压时检查frame是否完整
+    int flush();
+    //把in中[position, position + length)的数据处理后直接写到out，finish表示最后一批数据
+    int writeTo(ByteArray::ptr in, size_t length, ByteArray::ptr out, bool finish);
+    //重置上下文，可以开始处理下一个frame
+    int reset();
+
+    std::string getResult() const;
+    sylar::ByteArray::ptr getByteArray();
+
+    bool isEncode() const { return m_encode; }
+
+private:
+    int init(int level);
+    int encode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish);
+    int decode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish);
+
+private:
+    bool m_encode;
+    uint32_t m_bufferSize;
+    //压缩时是否已经写入了frame头
+    bool m_begin;
+    //解压时LZ4F_decompress返回的下一次期望的输入长度，为0表示frame已完整
+    size_t m_hint;
+    LZ4F_preferences_t m_prefs;
+    LZ4F_cctx* m_cctx;
+    LZ4F_dctx* m_dctx;
+    //压缩输出的临时缓冲区，大小为LZ4F_compressBound(m_bufferSize)
+    std::vector<char> m_cbuf;
+    //write/flush的结果
+    ByteArray::ptr m_result;
+};
+
+}
+
+#endif
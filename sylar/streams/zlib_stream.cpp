@@ -1,25 +1,34 @@
 #include "zlib_stream.h"
 #include "sylar/macro.h"
+#include "sylar/config.h"
 
 #include <stdexcept>
+#include <unordered_map>
 
 namespace sylar {
 
-ZlibStream::ptr ZlibStream::CreateGzip(bool encode, uint32_t buff_size = 4096) {
+static sylar::ConfigVar<bool>::ptr g_zlib_pool_enable
+    = sylar::Config::Lookup("zlib.pool.enable", true, "zlib stream pool enable");
+
+static sylar::ConfigVar<uint32_t>::ptr g_zlib_pool_max_per_thread
+    = sylar::Config::Lookup("zlib.pool.max_per_thread", (uint32_t)32,
+                            "max idle zlib streams of each kind cached per thread");
+
+ZlibStream::ptr ZlibStream::CreateGzip(bool encode, uint32_t buff_size) {
     return Create(encode, buff_size, GZIP);
 }
 
-ZlibStream::ptr ZlibStream::CreateZlib(bool encode, uint32_t buff_size = 4096) {
+ZlibStream::ptr ZlibStream::CreateZlib(bool encode, uint32_t buff_size) {
     return Create(encode, buff_size, ZLIB);
 }
 
-ZlibStream::ptr ZlibStream::CreateDeflate(bool encode, uint32_t buff_size = 4096) {
+ZlibStream::ptr ZlibStream::CreateDeflate(bool encode, uint32_t buff_size) {
     return Create(encode, buff_size, DEFLATE);
 }
 
-ZlibStream::ptr ZlibStream::Create(bool encode, uint32_t buff_size = 4096, Type type = DEFLATE,
-                                int level = DEFAULT_COMPRESSION, int window_bits = 15,
-                                int memlevel = 8, Strategy strategy = DEFAULT) {
+ZlibStream::ptr ZlibStream::Create(bool encode, uint32_t buff_size, Type type,
+                                int level, int window_bits,
+                                int memlevel, Strategy strategy) {
     ZlibStream::ptr rt(new ZlibStream(encode, buff_size));
     if (rt->init(type, level, window_bits, memlevel, strategy) == Z_OK) {
         return rt;
@@ -60,9 +69,9 @@ int ZlibStream::write(const void* buffer, size_t length) {
     iov.iov_base = (void*)buffer;
     iov.iov_len = length;
     if (m_encode) {
-        encode(&iov, 1, false);
+        return encode(&iov, 1, false);
     } else {
-        decode(&iov, 1, false);
+        return decode(&iov, 1, false);
     }
 }
 
@@ -80,8 +89,10 @@ void ZlibStream::close() {
     flush();
 }
 
-int ZlibStream::init(Type type = DEFLATE, int level = DEFAULT_COMPRESSION, int window_bits = 15,
-                     int memlevel = 8, Strategy strategy = DEFAULT) {
+int ZlibStream::init(Type type, int level, int window_bits,
+                     int memlevel, Strategy strategy) {
+    m_type = type;
+    m_level = level;
     memset(&m_zstream, 0, sizeof(m_zstream));
     //不自定义内存分配/释放函数，使用默认的malloc/free
     m_zstream.zalloc = Z_NULL;
@@ -91,7 +102,7 @@ int ZlibStream::init(Type type = DEFLATE, int level = DEFAULT_COMPRESSION, int w
     //zlib对不同格式的压缩文件的window_bits有大小限制
     switch (type) {
         case DEFLATE:
-            window_bits -= window_bits;
+            window_bits = -window_bits;
             break;
         case GZIP:
             window_bits += 16;
@@ -115,7 +126,7 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish) {
         // 我要压缩的数据在哪里（next_in） v[i].iov_base 是第i块输入数据的起始地址，
         m_zstream.avail_in = v[i].iov_len;
         m_zstream.next_in = (Bytef*)v[i].iov_base;
-        flush = finish ? (i == size - i ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
+        flush = finish ? (i == size - 1 ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
         iovec* ivc = nullptr;
         do {
             //iov_len表示当前已经写入了多少字节，该判断用于看m_buffs最后一iovec块是否还能写入数据
@@ -140,10 +151,7 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish) {
             ivc->iov_len = m_bufferSize - m_zstream.avail_out;
         } while (m_zstream.avail_out == 0);
     }
-    //当完成最后一次压缩时，如果是finish则需要再调用下deflateEnd，来释放内部用来压缩的临时资源
-    if (flush == Z_FINISH) {
-        deflateEnd(&m_zstream);
-    }
+    //finish后不再调用deflateEnd，内部状态留给reset()复用，统一在析构时释放
     return Z_OK;
 }
 
@@ -174,9 +182,6 @@ int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish) {
             ivc->iov_len = m_bufferSize - m_zstream.avail_out;
         } while (m_zstream.avail_out == 0);
     }
-    if (flush = Z_FINISH) {
-        inflateEnd(&m_zstream);
-    }
     return Z_OK;
 }
 
@@ -209,6 +214,166 @@ sylar::ByteArray::ptr ZlibStream::getByteArray() {
     return ba;
 }
 
+int ZlibStream::writeTo(ByteArray::ptr in, size_t length, ByteArray::ptr out, bool finish) {
+    std::vector<iovec> ivs;
+    if (length > 0) {
+        in->getReadBuffers(ivs, length);
+    }
+    if (ivs.empty()) {
+        //没有输入数据时也要走一次，finish时把zlib内部剩余的数据输出
+        iovec iov;
+        iov.iov_base = nullptr;
+        iov.iov_len = 0;
+        ivs.push_back(iov);
+    }
+    int ret = 0;
+    std::vector<iovec> ovs;
+    for (size_t i = 0; i < ivs.size(); ++i) {
+        m_zstream.avail_in = ivs[i].iov_len;
+        m_zstream.next_in = (Bytef*)ivs[i].iov_base;
+        int flush = (finish && i == ivs.size() - 1) ? Z_FINISH : Z_NO_FLUSH;
+        do {
+            //直接拿out的可写内存块作为zlib的输出缓冲区，每次只用第一块，保证next_out是连续内存
+            ovs.clear();
+            out->getWriteBuffers(ovs, m_bufferSize);
+            m_zstream.avail_out = ovs[0].iov_len;
+            m_zstream.next_out = (Bytef*)ovs[0].iov_base;
+            ret = m_encode ? deflate(&m_zstream, flush) : inflate(&m_zstream, flush);
+            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR
+                    || ret == Z_MEM_ERROR || ret == Z_NEED_DICT) {
+                return ret;
+            }
+            //只移动position，数据已经在out的内存块里了，setPosition会同步更新out的size
+            out->setPosition(out->getPosition() + ovs[0].iov_len - m_zstream.avail_out);
+        } while (m_zstream.avail_out == 0);
+    }
+    //解压到最后一批数据还没读到流的结尾，说明输入被截断了
+    if (finish && !m_encode && ret != Z_STREAM_END) {
+        return Z_DATA_ERROR;
+    }
+    return Z_OK;
 }
 
+int ZlibStream::encodeTo(const void* data, size_t len, std::string& out, bool finish) {
+    if (!m_encode) {
+        return Z_STREAM_ERROR;
+    }
+    m_zstream.avail_in = len;
+    m_zstream.next_in = (Bytef*)data;
+    int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    do {
+        //直接输出到out的尾部，写满了就扩容继续
+        size_t old = out.size();
+        out.resize(old + m_bufferSize);
+        m_zstream.avail_out = m_bufferSize;
+        m_zstream.next_out = (Bytef*)&out[old];
+        int ret = deflate(&m_zstream, flush);
+        out.resize(old + m_bufferSize - m_zstream.avail_out);
+        if (ret == Z_STREAM_ERROR) {
+            return ret;
+        }
+    } while (m_zstream.avail_out == 0);
+    return Z_OK;
+}
 
+int ZlibStream::decodeTo(const void* data, size_t len, std::string& out, size_t max_size) {
+    if (m_encode) {
+        return Z_STREAM_ERROR;
+    }
+    m_zstream.avail_in = len;
+    m_zstream.next_in = (Bytef*)data;
+    do {
+        size_t old = out.size();
+        out.resize(old + m_bufferSize);
+        m_zstream.avail_out = m_bufferSize;
+        m_zstream.next_out = (Bytef*)&out[old];
+        int ret = inflate(&m_zstream, Z_SYNC_FLUSH);
+        out.resize(old + m_bufferSize - m_zstream.avail_out);
+        //Z_BUF_ERROR表示没有可以继续处理的输入，不是错误
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            return ret;
+        }
+        if (max_size && out.size() > max_size) {
+            return Z_BUF_ERROR;
+        }
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+    } while (m_zstream.avail_out == 0);
+    return Z_OK;
+}
+
+int ZlibStream::reset() {
+    if (m_free) {
+        for (auto& i : m_buffs) {
+            free(i.iov_base);
+        }
+    }
+    m_buffs.clear();
+    return m_encode ? deflateReset(&m_zstream) : inflateReset(&m_zstream);
+}
+
+namespace {
+
+//当前线程缓存的空闲ZlibStream，key由encode/type/level组合而成
+struct ZlibStreamFreeList {
+    ~ZlibStreamFreeList() {
+        for (auto& i : streams) {
+            for (auto& s : i.second) {
+                delete s;
+            }
+        }
+    }
+    std::unordered_map<uint32_t, std::vector<ZlibStream*> > streams;
+};
+
+static thread_local ZlibStreamFreeList t_zlib_free_list;
+
+static uint32_t ZlibStreamKey(bool encode, int type, int level) {
+    //level取值为[-1, 9]，+1后保证非负
+    return ((uint32_t)encode << 16) | ((uint32_t)type << 8) | (uint32_t)(level + 1);
+}
+
+}
+
+ZlibStream::ptr ZlibStreamPool::Get(bool encode, ZlibStream::Type type, int level, uint32_t buff_size) {
+    if (!g_zlib_pool_enable->getValue()) {
+        return ZlibStream::Create(encode, buff_size, type, level);
+    }
+    auto& vec = t_zlib_free_list.streams[ZlibStreamKey(encode, type, level)];
+    ZlibStream* zs = nullptr;
+    if (!vec.empty()) {
+        //后进先出，最近用过的对象内存还在cache里
+        zs = vec.back();
+        vec.pop_back();
+        zs->m_bufferSize = buff_size;
+    } else {
+        zs = new ZlibStream(encode, buff_size);
+        if (zs->init(type, level, 15, 8, ZlibStream::DEFAULT) != Z_OK) {
+            delete zs;
+            return nullptr;
+        }
+    }
+    return ZlibStream::ptr(zs, &ZlibStreamPool::Release);
+}
+
+void ZlibStreamPool::Release(ZlibStream* ptr) {
+    //协程可能在别的线程上被恢复，这里归还到执行析构的线程的对象池，zlib上下文本身不绑定线程
+    auto& vec = t_zlib_free_list.streams[ZlibStreamKey(ptr->m_encode, ptr->m_type, ptr->m_level)];
+    if (vec.size() >= g_zlib_pool_max_per_thread->getValue()
+            || ptr->reset() != Z_OK) {
+        delete ptr;
+        return;
+    }
+    vec.push_back(ptr);
+}
+
+size_t ZlibStreamPool::GetIdleCount() {
+    size_t rt = 0;
+    for (auto& i : t_zlib_free_list.streams) {
+        rt += i.second.size();
+    }
+    return rt;
+}
+
+}
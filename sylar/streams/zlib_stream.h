@@ -21,6 +21,7 @@
 namespace sylar {
 
 class ZlibStream : public Stream {
+friend class ZlibStreamPool;
 public:
     typedef std::shared_ptr<ZlibStream> ptr;
 
@@ -89,6 +90,26 @@ public:
     //获取当前ZlibStream中已经压缩或这解压的数据，以ByteArray形式返回
     sylar::ByteArray::ptr getByteArray();
 
+    //流式处理：把in中[position, position + length)的数据压缩/解压后直接写进out的内存块中，
+    //不经过m_buffs中转，out的position会随写入的数据后移
+    //finish为true时表示这是最后一批数据，会把zlib内部剩余的数据全部输出
+    //返回Z_OK表示成功，其他值为zlib的错误码；解压时finish为true但没有到达流的结尾返回Z_DATA_ERROR
+    int writeTo(ByteArray::ptr in, size_t length, ByteArray::ptr out, bool finish);
+
+    //流式压缩：把[data, data + len)压缩后追加到out，不经过m_buffs
+    //finish为false时用Z_SYNC_FLUSH把已经输入的数据全部输出，对端收到后可以立即解压；为true时输出结束标志
+    //只能用于压缩模式，返回Z_OK表示成功，其他值为zlib的错误码
+    int encodeTo(const void* data, size_t len, std::string& out, bool finish);
+
+    //流式解压：把[data, data + len)解压后追加到out，不经过m_buffs，解压上下文在多次调用之间保留
+    //max_size不为0时，out超过max_size返回Z_BUF_ERROR(防止压缩炸弹)
+    //只能用于解压模式，返回Z_OK表示成功，其他值为zlib的错误码
+    int decodeTo(const void* data, size_t len, std::string& out, size_t max_size = 0);
+
+    //重置zlib的内部状态(deflateReset/inflateReset)并清空已输出的数据，
+    //重置后可以用同样的参数开始处理下一条消息，省掉deflateInit2/inflateInit2的开销
+    int reset();
+
 private:
     //初始化zlib的内部状态(m_zstream)
     int init(Type type = DEFLATE, int level = DEFAULT_COMPRESSION, int window_bits = 15,
@@ -115,6 +136,36 @@ private:
     bool m_free;
     //保存压缩或解压结果的数据块
     std::vector<iovec> m_buffs;
+    //init时的参数，ZlibStreamPool用它们来区分不同种类的上下文
+    Type m_type = DEFLATE;
+    int m_level = DEFAULT_COMPRESSION;
+};
+
+//ZlibStream对象池，每个线程一份
+//deflateInit2/inflateInit2每次都要分配约256KB的内部状态，对于每条消息都要压缩/解压的RPC来说开销很大，
+//这里把用完的ZlibStream通过deflateReset/inflateReset重置后缓存起来，下次同样参数的请求直接复用
+//使用示例：
+//  auto zs = ZlibStreamPool::Get(true, ZlibStream::GZIP);
+//  zs->writeTo(in, in->getReadSize(), out, true);
+//  //zs析构(引用计数归零)时自动归还到当前线程的对象池
+class ZlibStreamPool {
+public:
+    //从当前线程的对象池中取一个ZlibStream，没有可用的就新建
+    //配置zlib.pool.enable为false时退化为ZlibStream::Create
+    static ZlibStream::ptr Get(bool encode, ZlibStream::Type type = ZlibStream::GZIP,
+                               int level = ZlibStream::DEFAULT_COMPRESSION, uint32_t buff_size = 4096);
+    static ZlibStream::ptr GetGzip(bool encode, uint32_t buff_size = 4096) {
+        return Get(encode, ZlibStream::GZIP, ZlibStream::DEFAULT_COMPRESSION, buff_size);
+    }
+    static ZlibStream::ptr GetDeflate(bool encode, uint32_t buff_size = 4096) {
+        return Get(encode, ZlibStream::DEFLATE, ZlibStream::DEFAULT_COMPRESSION, buff_size);
+    }
+    //当前线程对象池中缓存的ZlibStream数量
+    static size_t GetIdleCount();
+
+private:
+    //shared_ptr的删除器，重置后放回当前线程的对象池，池满或重置失败时直接释放
+    static void Release(ZlibStream* ptr);
 };
 
 
@@ -0,0 +1,300 @@
+#include "zstd_stream.h"
+#include "sylar/config.h"
+#include "sylar/log.h"
+#include "sylar/mutex.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<int32_t>::ptr g_zstd_level
+    = sylar::Config::Lookup("zstd.level", (int32_t)1, "zstd compression level");
+
+static sylar::ConfigVar<std::string>::ptr g_zstd_dict_path
+    = sylar::Config::Lookup("zstd.dict_path", std::string(""), "zstd shared dictionary file path");
+
+static RWMutex s_dict_mutex;
+static ZstdDict::ptr s_dict;
+
+namespace {
+//字典路径改变时重新加载字典
+struct _ZstdDictIniter {
+    _ZstdDictIniter() {
+        g_zstd_dict_path->addListener([](const std::string& old_value, const std::string& new_value) {
+            if (new_value.empty()) {
+                ZstdStream::SetDictionary(nullptr);
+                return;
+            }
+            if (!ZstdStream::LoadDictionary(new_value)) {
+                SYLAR_LOG_ERROR(g_logger) << "load zstd dictionary " << new_value << " fail";
+            }
+        });
+    }
+};
+static _ZstdDictIniter s_zstd_dict_initer;
+}
+
+ZstdDict::ZstdDict()
+    : m_cdict(nullptr),
+      m_ddict(nullptr),
+      m_id(0) {
+}
+
+ZstdDict::~ZstdDict() {
+    if (m_cdict) {
+        ZSTD_freeCDict(m_cdict);
+    }
+    if (m_ddict) {
+        ZSTD_freeDDict(m_ddict);
+    }
+}
+
+ZstdDict::ptr ZstdDict::Create(const std::string& dict, int level) {
+    if (dict.empty()) {
+        return nullptr;
+    }
+    ZstdDict::ptr rt(new ZstdDict);
+    rt->m_cdict = ZSTD_createCDict(dict.c_str(), dict.size(), level);
+    rt->m_ddict = ZSTD_createDDict(dict.c_str(), dict.size());
+    if (!rt->m_cdict || !rt->m_ddict) {
+        SYLAR_LOG_ERROR(g_logger) << "ZstdDict create fail, dict size=" << dict.size();
+        return nullptr;
+    }
+    rt->m_id = ZSTD_getDictID_fromDict(dict.c_str(), dict.size());
+    return rt;
+}
+
+void ZstdStream::SetDictionary(ZstdDict::ptr dict) {
+    RWMutex::WriteLock lock(s_dict_mutex);
+    s_dict = dict;
+}
+
+ZstdDict::ptr ZstdStream::GetDictionary() {
+    RWMutex::ReadLock lock(s_dict_mutex);
+    return s_dict;
+}
+
+bool ZstdStream::LoadDictionary(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        SYLAR_LOG_ERROR(g_logger) << "open zstd dictionary " << path << " fail";
+        return false;
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    ZstdDict::ptr dict = ZstdDict::Create(ss.str(), g_zstd_level->getValue());
+    if (!dict) {
+        return false;
+    }
+    SYLAR_LOG_INFO(g_logger) << "load zstd dictionary " << path << " id=" << dict->getId();
+    SetDictionary(dict);
+    return true;
+}
+
+ZstdStream::ptr ZstdStream::Create(bool encode, uint32_t buff_size, int level, bool use_dict) {
+    ZstdStream::ptr rt(new ZstdStream(encode, buff_size));
+    if (rt->init(level, use_dict) == 0) {
+        return rt;
+    }
+    return nullptr;
+}
+
+ZstdStream::ZstdStream(bool encode, uint32_t buff_size)
+    : m_encode(encode),
+      m_bufferSize(buff_size),
+      m_hint(0),
+      m_cctx(nullptr),
+      m_dctx(nullptr),
+      m_result(new ByteArray) {
+}
+
+ZstdStream::~ZstdStream() {
+    if (m_cctx) {
+        ZSTD_freeCCtx(m_cctx);
+    }
+    if (m_dctx) {
+        ZSTD_freeDCtx(m_dctx);
+    }
+}
+
+int ZstdStream::init(int level, bool use_dict) {
+    if (level == 0) {
+        level = g_zstd_level->getValue();
+    }
+    if (use_dict) {
+        m_dict = GetDictionary();
+    }
+    size_t rt = 0;
+    if (m_encode) {
+        m_cctx = ZSTD_createCCtx();
+        if (!m_cctx) {
+            return -1;
+        }
+        rt = ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, level);
+        if (!ZSTD_isError(rt) && m_dict) {
+            rt = ZSTD_CCtx_refCDict(m_cctx, m_dict->getCDict());
+        }
+    } else {
+        m_dctx = ZSTD_createDCtx();
+        if (!m_dctx) {
+            return -1;
+        }
+        if (m_dict) {
+            rt = ZSTD_DCtx_refDDict(m_dctx, m_dict->getDDict());
+        }
+    }
+    if (ZSTD_isError(rt)) {
+        SYLAR_LOG_ERROR(g_logger) << "ZstdStream init error: " << ZSTD_getErrorName(rt);
+        return -1;
+    }
+    return 0;
+}
+
+int ZstdStream::read(void* buffer, size_t length) {
+    throw std::logic_error("ZstdStream::read is invalid");
+}
+
+int ZstdStream::read(ByteArray::ptr ba, size_t length) {
+    throw std::logic_error("ZstdStream::read is invalid");
+}
+
+int ZstdStream::write(const void* buffer, size_t length) {
+    iovec iov;
+    iov.iov_base = (void*)buffer;
+    iov.iov_len = length;
+    if (m_encode) {
+        return encode(&iov, 1, m_result, false);
+    } else {
+        return decode(&iov, 1, m_result, false);
+    }
+}
+
+int ZstdStream::write(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> buffers;
+    ba->getReadBuffers(buffers, length);
+    if (m_encode) {
+        return encode(&buffers[0], buffers.size(), m_result, false);
+    } else {
+        return decode(&buffers[0], buffers.size(), m_result, false);
+    }
+}
+
+void ZstdStream::close() {
+    flush();
+}
+
+int ZstdStream::flush() {
+    iovec iov;
+    iov.iov_base = nullptr;
+    iov.iov_len = 0;
+    if (m_encode) {
+        return encode(&iov, 1, m_result, true);
+    } else {
+        return decode(&iov, 1, m_result, true);
+    }
+}
+
+int ZstdStream::writeTo(ByteArray::ptr in, size_t length, ByteArray::ptr out, bool finish) {
+    std::vector<iovec> ivs;
+    if (length > 0) {
+        in->getReadBuffers(ivs, length);
+    }
+    if (ivs.empty()) {
+        iovec iov;
+        iov.iov_base = nullptr;
+        iov.iov_len = 0;
+        ivs.push_back(iov);
+    }
+    if (m_encode) {
+        return encode(&ivs[0], ivs.size(), out, finish);
+    } else {
+        return decode(&ivs[0], ivs.size(), out, finish);
+    }
+}
+
+int ZstdStream::reset() {
+    m_result.reset(new ByteArray);
+    m_hint = 0;
+    //只重置会话，压缩级别和引用的字典保留
+    size_t rt = m_encode ? ZSTD_CCtx_reset(m_cctx, ZSTD_reset_session_only)
+                         : ZSTD_DCtx_reset(m_dctx, ZSTD_reset_session_only);
+    return ZSTD_isError(rt) ? -1 : 0;
+}
+
+int ZstdStream::encode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish) {
+    std::vector<iovec> ovs;
+    for (uint64_t i = 0; i < size; ++i) {
+        ZSTD_inBuffer input = { v[i].iov_base, v[i].iov_len, 0 };
+        ZSTD_EndDirective mode = (finish && i == size - 1) ? ZSTD_e_end : ZSTD_e_continue;
+        size_t rt = 0;
+        do {
+            //压缩结果直接写进out的内存块
+            ovs.clear();
+            out->getWriteBuffers(ovs, m_bufferSize);
+            ZSTD_outBuffer output = { ovs[0].iov_base, ovs[0].iov_len, 0 };
+            rt = ZSTD_compressStream2(m_cctx, &output, &input, mode);
+            if (ZSTD_isError(rt)) {
+                SYLAR_LOG_ERROR(g_logger) << "ZSTD_compressStream2 error: " << ZSTD_getErrorName(rt);
+                return -1;
+            }
+            out->setPosition(out->getPosition() + output.pos);
+        //ZSTD_e_end时返回0表示frame已经全部输出，ZSTD_e_continue时只需要把输入消费完
+        } while (mode == ZSTD_e_end ? rt != 0 : input.pos < input.size);
+    }
+    return 0;
+}
+
+int ZstdStream::decode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish) {
+    std::vector<iovec> ovs;
+    for (uint64_t i = 0; i < size; ++i) {
+        if (v[i].iov_len == 0) {
+            continue;
+        }
+        ZSTD_inBuffer input = { v[i].iov_base, v[i].iov_len, 0 };
+        size_t cap = 0;
+        size_t produced = 0;
+        do {
+            ovs.clear();
+            out->getWriteBuffers(ovs, m_bufferSize);
+            ZSTD_outBuffer output = { ovs[0].iov_base, ovs[0].iov_len, 0 };
+            size_t rt = ZSTD_decompressStream(m_dctx, &output, &input);
+            if (ZSTD_isError(rt)) {
+                SYLAR_LOG_ERROR(g_logger) << "ZSTD_decompressStream error: " << ZSTD_getErrorName(rt);
+                return -1;
+            }
+            m_hint = rt;
+            cap = output.size;
+            produced = output.pos;
+            out->setPosition(out->getPosition() + produced);
+        //输出缓冲区被写满时，zstd内部可能还有没吐出来的数据
+        } while (input.pos < input.size || produced == cap);
+    }
+    if (finish && m_hint != 0) {
+        SYLAR_LOG_ERROR(g_logger) << "ZstdStream decode incomplete frame";
+        return -2;
+    }
+    return 0;
+}
+
+std::string ZstdStream::getResult() const {
+    std::string rt;
+    rt.resize(m_result->getSize());
+    if (!rt.empty()) {
+        m_result->read(&rt[0], rt.size(), 0);
+    }
+    return rt;
+}
+
+sylar::ByteArray::ptr ZstdStream::getByteArray() {
+    sylar::ByteArray::ptr ba(new ByteArray);
+    std::string rt = getResult();
+    ba->write(rt.c_str(), rt.size());
+    ba->setPosition(0);
+    return ba;
+}
+
+}
@@ -0,0 +1,116 @@
+/**
+ * @file zstd_stream.h
+ * @brief 基于Zstandard的压缩/解压流，支持共享的预训练字典
+ * @date 2025-07-06
+ * @copyright Copyright (c) 2025年 All rights reserved
+ */
+
+//ZstdStream的用法和ZlibStream一致：write写入数据，flush结束当前frame，getResult/getByteArray取结果；
+//也可以用writeTo直接把结果写进目标ByteArray的内存块
+//Zstd在低级别(1~3)下速度接近LZ4，压缩率接近甚至超过gzip
+//
+//RPC里大量是几百字节的小消息，单条消息内部重复的内容很少，通用压缩几乎压不动
+//这类场景可以用`zstd --train`离线训练一个字典，两端通过配置zstd.dict_path加载同一个字典，
+//压缩时以字典内容作为"历史数据"，小消息也能得到不错的压缩率
+//字典在进程内只加载一次(ZSTD_CDict/ZSTD_DDict)，所有ZstdStream共享，引用字典不需要再拷贝/解析
+
+#ifndef __SYLAR_STREAMS_ZSTD_STREAM_H__
+#define __SYLAR_STREAMS_ZSTD_STREAM_H__
+
+#include "sylar/stream.h"
+#include "sylar/bytearray.h"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <zstd.h>
+
+namespace sylar {
+
+//预训练的zstd字典，压缩和解压各自一份已经解析好的结构
+class ZstdDict {
+public:
+    typedef std::shared_ptr<ZstdDict> ptr;
+    //dict：字典文件的内容，level：用字典压缩时的压缩级别
+    static ZstdDict::ptr Create(const std::string& dict, int level);
+    ~ZstdDict();
+
+    ZSTD_CDict* getCDict() const { return m_cdict; }
+    ZSTD_DDict* getDDict() const { return m_ddict; }
+    //字典id，会写进每个frame头中，解压时用来校验两端用的是不是同一个字典
+    uint32_t getId() const { return m_id; }
+
+private:
+    ZstdDict();
+
+private:
+    ZSTD_CDict* m_cdict;
+    ZSTD_DDict* m_ddict;
+    uint32_t m_id;
+};
+
+class ZstdStream : public Stream {
+public:
+    typedef std::shared_ptr<ZstdStream> ptr;
+
+    //encode：压缩还是解压
+    //buff_size：每次向输出ByteArray申请的内存块大小
+    //level：压缩级别，为0时使用配置zstd.level
+    //use_dict：是否使用全局共享字典(如果已配置zstd.dict_path)
+    static ZstdStream::ptr Create(bool encode, uint32_t buff_size = 64 * 1024,
+                                 int level = 0, bool use_dict = true);
+    ZstdStream(bool encode, uint32_t buff_size = 64 * 1024);
+    ~ZstdStream();
+
+    //设置/获取全局共享字典，传入nullptr表示不再使用字典
+    static void SetDictionary(ZstdDict::ptr dict);
+    static ZstdDict::ptr GetDictionary();
+    //从文件加载字典并设置为全局共享字典
+    static bool LoadDictionary(const std::string& path);
+
+    //不支持读，和ZlibStream一样会抛异常
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    //压缩/解压buffer中的数据，结果追加到内部结果缓冲区，成功返回0
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    virtual void close() override;
+
+    //压缩时结束当前frame，解压时检查frame是否完整
+    int flush();
+    //把in中[position, position + length)的数据处理后直接写到out，finish表示最后一批数据
+    int writeTo(ByteArray::ptr in, size_t length, ByteArray::ptr out, bool finish);
+    //重置会话(保留压缩参数和字典)，可以开始处理下一个frame
+    int reset();
+
+    std::string getResult() const;
+    sylar::ByteArray::ptr getByteArray();
+
+    bool isEncode() const { return m_encode; }
+    //当前引用的字典，没有使用字典时为nullptr
+    ZstdDict::ptr getDict() const { return m_dict; }
+
+private:
+    int init(int level, bool use_dict);
+    int encode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish);
+    int decode(const iovec* v, const uint64_t& size, ByteArray::ptr out, bool finish);
+
+private:
+    bool m_encode;
+    uint32_t m_bufferSize;
+    //解压时ZSTD_decompressStream的返回值，为0表示frame已完整
+    size_t m_hint;
+    ZSTD_CCtx* m_cctx;
+    ZSTD_DCtx* m_dctx;
+    //引用的字典，持有引用保证字典在使用期间不会被替换释放
+    ZstdDict::ptr m_dict;
+    //write/flush的结果
+    ByteArray::ptr m_result;
+};
+
+}
+
+#endif
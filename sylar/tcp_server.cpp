@@ -3,12 +3,26 @@
 #include "tcp_server.h"
 #include "config.h"
 #include "log.h"
+#include "util.h"
+#include "hook.h"
 
 namespace sylar {
 
 static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout = 
         sylar::Config::Lookup("tcp_server.read_tieout", (uint64_t)(60 * 1000 * 2),
                                 "tcp server read timeout");
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_acceptor_count =
+        sylar::Config::Lookup("tcp_server.acceptor_count", (uint32_t)1,
+                                "tcp server accept fibers per address (SO_REUSEPORT)");
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+        sylar::Config::Lookup("tcp_server.accept_batch", (uint32_t)64,
+                                "tcp server max connections accepted per wakeup");
+static sylar::ConfigVar<uint32_t>::ptr g_tcp_server_max_connections =
+        sylar::Config::Lookup("tcp_server.max_connections", (uint32_t)0,
+                                "tcp server max connections, 0 means unlimited");
+static sylar::ConfigVar<std::string>::ptr g_tcp_server_dispatch =
+        sylar::Config::Lookup("tcp_server.dispatch", std::string("round_robin"),
+                                "tcp server dispatch mode: round_robin/least_loaded");
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
 TcpServer::TcpServer(sylar::IOManager* worker,
@@ -19,10 +33,15 @@ TcpServer::TcpServer(sylar::IOManager* worker,
       m_acceptWorker(accept_worker),
       m_recvTimeout(g_tcp_server_read_timeout->getValue()),
       m_name("sylar.1.0.0"),
-      m_isStop(true){
+      m_isStop(true),
+      m_acceptorCount(std::max(g_tcp_server_acceptor_count->getValue(), (uint32_t)1)),
+      m_acceptBatch(std::max(g_tcp_server_accept_batch->getValue(), (uint32_t)1)),
+      m_maxConnections(g_tcp_server_max_connections->getValue()),
+      m_dispatchMode(g_tcp_server_dispatch->getValue() == "least_loaded" ? LEAST_LOADED : ROUND_ROBIN) {
 }
 
 TcpServer::~TcpServer() {
+    unregisterMetrics();
     if (!m_socks.empty()) {
         for (auto& i : m_socks) {
             i->close();
@@ -43,26 +62,36 @@ bool TcpServer::bind(sylar::Address::ptr addr, bool ssl) {
 }
 
 bool TcpServer::bind(const std::vector<Address::ptr>& addrs,
-                        const std::vector<Address::ptr>& fails,
-                        bool ssl = false) {
+                        std::vector<Address::ptr>& fails,
+                        bool ssl) {
     m_ssl = ssl;
     for (auto& addr : addrs) {
-        Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        if(!sock->bind(addr)) {
-            SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
-                << errno << " errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
-        }
-        if(!sock->listen()) {
-            SYLAR_LOG_ERROR(g_logger) << "listen fail errno="
-                << errno << " errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
+        //同一个地址开多个SO_REUSEPORT监听socket，每个socket一个accept协程，由内核分配新连接
+        //同一个fd上只能有一个协程等待READ事件，所以多个accept协程必须对应多个监听socket
+        //unix域套接字不支持SO_REUSEPORT
+        bool is_unix = addr->getFamily() == AF_UNIX;
+        uint32_t count = is_unix ? 1 : m_acceptorCount;
+        for (uint32_t n = 0; n < count; ++n) {
+            Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+            if (count > 1) {
+                sock->setReusePort(true);
+            }
+            if(!sock->bind(addr)) {
+                SYLAR_LOG_ERROR(g_logger) << "bind fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            if(!sock->listen()) {
+                SYLAR_LOG_ERROR(g_logger) << "listen fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            m_socks.push_back(sock);
         }
-        m_socks.push_back(sock);
     }
     if (!fails.empty()) {
         m_socks.clear();
@@ -78,16 +107,87 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs,
 }
 
 void TcpServer::startAccept(Socket::ptr sock) {
+    std::vector<Socket::ptr> clients;
     while (!m_isStop) {
-        Socket::ptr client = sock->accept();
-        if (client) {
-            client->setRecvTimeout(m_recvTimeout);
-            m_ioWorker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client));
-        } else {
-            SYLAR_LOG_ERROR(g_logger) << "accept errno=" << errno
-                << " errstr=" << strerror(errno);
+        clients.clear();
+        //每次唤醒把backlog中已完成握手的连接一次取完
+        int rt = sock->acceptMany(clients, m_acceptBatch);
+        if (rt <= 0) {
+            if (!m_isStop) {
+                SYLAR_LOG_ERROR(g_logger) << "accept errno=" << errno
+                    << " errstr=" << strerror(errno);
+            }
+            continue;
+        }
+        m_acceptCount += clients.size();
+        for (auto& client : clients) {
+            dispatch(client);
+        }
+    }
+}
+
+void TcpServer::dispatch(Socket::ptr client) {
+    //超过最大连接数，不进入io线程直接关闭，尽早释放fd
+    //多个accept协程并发调用，先占一个名额再检查，超过时退回，避免判断和递增之间被别的协程插入
+    int64_t conns = ++m_connections;
+    if (m_maxConnections && conns > (int64_t)m_maxConnections) {
+        --m_connections;
+        ++m_rejectCount;
+        client->close();
+        return;
+    }
+    {
+        Mutex::Lock lock(m_mutex);
+        m_clients[client] = false;
+    }
+    client->setRecvTimeout(m_recvTimeout);
+    int idx = selectIOThread();
+    if (idx >= 0) {
+        ++m_threadLoads[idx];
+    }
+    auto self = shared_from_this();
+    //handleClient返回时连接处理结束，更新计数
+    //注意协程yield后可能在其他线程恢复，这里的线程负载只统计连接最初分配到的线程
+    m_ioWorker->schedule([self, client, idx]() {
+        self->handleClient(client);
+        self->removeClient(client);
+        --self->m_connections;
+        if (idx >= 0) {
+            --self->m_threadLoads[idx];
         }
+    }, idx >= 0 ? m_ioThreads[idx] : -1);
+}
+
+int TcpServer::selectIOThread() {
+    size_t n = m_ioThreads.size();
+    if (n == 0) {
+        return -1;
     }
+    if (m_dispatchMode == LEAST_LOADED) {
+        size_t idx = 0;
+        int64_t min = m_threadLoads[0];
+        for (size_t i = 1; i < n; ++i) {
+            int64_t v = m_threadLoads[i];
+            if (v < min) {
+                min = v;
+                idx = i;
+            }
+        }
+        return idx;
+    }
+    return m_rrIndex++ % n;
+}
+
+double TcpServer::getAcceptRate() {
+    uint64_t now = sylar::GetCurrentMS();
+    uint64_t count = m_acceptCount;
+    double rate = 0;
+    if (m_lastRateTime && now > m_lastRateTime) {
+        rate = (count - m_lastRateCount) * 1000.0 / (now - m_lastRateTime);
+    }
+    m_lastRateTime = now;
+    m_lastRateCount = count;
+    return rate;
 }
 
 bool TcpServer::start() {
@@ -95,12 +195,45 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
+    registerMetrics();
+    if (!m_threadLoads) {
+        m_ioThreads = m_ioWorker->getThreadIds();
+        m_threadLoads.reset(new std::atomic<int64_t>[m_ioThreads.size()]);
+        for (size_t i = 0; i < m_ioThreads.size(); ++i) {
+            m_threadLoads[i] = 0;
+        }
+    }
     for (auto& sock : m_socks) {
         m_acceptWorker->schedule(std::bind(&TcpServer::startAccept, shared_from_this(), sock));
     }
     return true;
 }
 
+void TcpServer::registerMetrics() {
+    unregisterMetrics();
+    auto mgr = metrics::MetricsMgr::GetInstance();
+    metrics::Labels labels = {{"server", m_name}, {"type", m_type}};
+    m_metrics.push_back(mgr->addFunc("sylar_tcp_server_accepted_total", "connections accepted"
+                , labels, metrics::Metric::COUNTER, [this]() {
+        return (double)m_acceptCount;
+    }));
+    m_metrics.push_back(mgr->addFunc("sylar_tcp_server_rejected_total", "connections closed by max_connections"
+                , labels, metrics::Metric::COUNTER, [this]() {
+        return (double)m_rejectCount;
+    }));
+    m_metrics.push_back(mgr->addFunc("sylar_tcp_server_connections", "connections being handled"
+                , labels, metrics::Metric::GAUGE, [this]() {
+        return (double)m_connections;
+    }));
+}
+
+void TcpServer::unregisterMetrics() {
+    for (auto& i : m_metrics) {
+        metrics::MetricsMgr::GetInstance()->remove(i);
+    }
+    m_metrics.clear();
+}
+
 
 
 
@@ -123,6 +256,198 @@ void TcpServer::stop() {
     });
 }
 
+//空闲连接上是否已经有数据到达(请求已经发出一部分)，有的话不能直接关闭
+//用原始的recv，避免被hook挂起
+static bool HasPendingData(Socket::ptr client) {
+    char c;
+    return sylar::recv_f(client->getSocket(), &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+void TcpServer::drain(uint64_t timeout_ms, std::function<void()> cb) {
+    std::vector<Socket::ptr> idles;
+    bool done = false;
+    {
+        Mutex::Lock lock(m_mutex);
+        if (m_draining) {
+            return;
+        }
+        m_draining = true;
+        for (auto& i : m_clients) {
+            if (i.second && !HasPendingData(i.first)) {
+                idles.push_back(i.first);
+            }
+        }
+        done = m_clients.empty();
+        if (!done) {
+            m_drainCb = cb;
+            auto self = shared_from_this();
+            m_drainTimer = m_ioWorker->addTimer(timeout_ms, [self]() {
+                self->forceCloseClients();
+            });
+        }
+    }
+    stop();
+    SYLAR_LOG_INFO(g_logger) << "server name=" << m_name << " draining, connections="
+        << m_connections << " idle=" << idles.size() << " timeout=" << timeout_ms;
+    //shutdown让阻塞在读上的协程读到EOF自己结束，不在这里close，避免和连接所在的协程竞争句柄
+    for (auto& i : idles) {
+        i->shutdown();
+    }
+    if (done && cb) {
+        cb();
+    }
+}
+
+bool TcpServer::setClientIdle(Socket::ptr client, bool idle) {
+    Mutex::Lock lock(m_mutex);
+    auto it = m_clients.find(client);
+    if (it != m_clients.end()) {
+        it->second = idle;
+    }
+    return !m_draining;
+}
+
+void TcpServer::removeClient(Socket::ptr client) {
+    std::function<void()> cb;
+    {
+        Mutex::Lock lock(m_mutex);
+        m_clients.erase(client);
+        if (!m_draining || !m_clients.empty()) {
+            return;
+        }
+        if (m_drainTimer) {
+            m_drainTimer->cancel();
+            m_drainTimer = nullptr;
+        }
+        cb.swap(m_drainCb);
+    }
+    SYLAR_LOG_INFO(g_logger) << "server name=" << m_name << " drained";
+    if (cb) {
+        cb();
+    }
+}
+
+void TcpServer::forceCloseClients() {
+    std::vector<Socket::ptr> clients;
+    {
+        Mutex::Lock lock(m_mutex);
+        m_drainTimer = nullptr;
+        for (auto& i : m_clients) {
+            clients.push_back(i.first);
+        }
+    }
+    SYLAR_LOG_WARN(g_logger) << "server name=" << m_name << " drain timeout, force close "
+        << clients.size() << " connections";
+    for (auto& i : clients) {
+        i->shutdown();
+    }
+}
+
+bool TcpServer::startHandoff(const std::string& path, uint64_t drain_timeout_ms,
+                             std::function<void()> cb) {
+    UnixAddress::ptr addr(new UnixAddress(path));
+    Socket::ptr sock = Socket::CreateUnixTCPSocket();
+    //上次进程异常退出时留下的socket文件会导致bind失败(EADDRINUSE)
+    ::unlink(path.c_str());
+    if (!sock->bind(addr) || !sock->listen()) {
+        SYLAR_LOG_ERROR(g_logger) << "handoff listen fail errno=" << errno
+            << " errstr=" << strerror(errno) << " path=" << path;
+        return false;
+    }
+    m_handoffSock = sock;
+    m_acceptWorker->schedule(std::bind(&TcpServer::handleHandoff, shared_from_this(),
+                                       sock, path, drain_timeout_ms, cb));
+    return true;
+}
+
+void TcpServer::handleHandoff(Socket::ptr sock, const std::string& path, uint64_t drain_timeout_ms,
+                              std::function<void()> cb) {
+    while (!m_isStop) {
+        Socket::ptr peer = sock->accept();
+        if (!peer) {
+            break;
+        }
+        peer->setRecvTimeout(5000);
+        std::vector<int> fds;
+        for (auto& i : m_socks) {
+            fds.push_back(i->getSocket());
+        }
+        //先发句柄数，新进程接管所有监听socket后回复'A'
+        uint32_t count = fds.size();
+        if (fds.empty() || peer->sendFds(fds, &count, sizeof(count)) != sizeof(count)) {
+            SYLAR_LOG_ERROR(g_logger) << "handoff send fds fail, count=" << count
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            continue;
+        }
+        char ack = 0;
+        if (peer->recv(&ack, 1) != 1 || ack != 'A') {
+            //新进程没有接管成功，继续由本进程服务
+            SYLAR_LOG_ERROR(g_logger) << "handoff no ack from peer " << *peer;
+            continue;
+        }
+        SYLAR_LOG_INFO(g_logger) << "server name=" << m_name << " handed off "
+            << count << " listeners to " << *peer;
+        sock->close();
+        m_handoffSock = nullptr;
+        ::unlink(path.c_str());
+        drain(drain_timeout_ms, cb);
+        return;
+    }
+    //服务停止，不再等待交接
+    ::unlink(path.c_str());
+}
+
+bool TcpServer::takeover(const std::string& path, bool ssl, uint64_t timeout_ms) {
+    m_ssl = ssl;
+    UnixAddress::ptr addr(new UnixAddress(path));
+    Socket::ptr sock = Socket::CreateUnixTCPSocket();
+    if (!sock->connect(addr, timeout_ms)) {
+        SYLAR_LOG_ERROR(g_logger) << "takeover connect fail errno=" << errno
+            << " errstr=" << strerror(errno) << " path=" << path;
+        return false;
+    }
+    sock->setRecvTimeout(timeout_ms);
+    std::vector<int> fds;
+    uint32_t count = 0;
+    int rt = sock->recvFds(fds, &count, sizeof(count));
+    if (rt != sizeof(count) || fds.empty() || fds.size() != count) {
+        SYLAR_LOG_ERROR(g_logger) << "takeover recv fds fail rt=" << rt
+            << " count=" << count << " fds=" << fds.size() << " path=" << path;
+        for (auto fd : fds) {
+            ::close(fd);
+        }
+        return false;
+    }
+    std::vector<Socket::ptr> socks;
+    for (auto fd : fds) {
+        //协议族等参数由initListen从句柄上读取
+        Socket::ptr s(ssl ? new SSLSocket(AF_INET, SOCK_STREAM, 0)
+                          : new Socket(AF_INET, SOCK_STREAM, 0));
+        if (!s->initListen(fd)) {
+            ::close(fd);
+            continue;
+        }
+        socks.push_back(s);
+    }
+    char ack = 'A';
+    if (socks.size() != fds.size() || sock->send(&ack, 1) != 1) {
+        SYLAR_LOG_ERROR(g_logger) << "takeover fail, path=" << path;
+        //收到的是副本，关闭不影响旧进程继续服务
+        for (auto& i : socks) {
+            i->close();
+        }
+        return false;
+    }
+    m_socks.insert(m_socks.end(), socks.begin(), socks.end());
+    for (auto& i : socks) {
+        SYLAR_LOG_INFO(g_logger) << "type=" << m_type
+            << " name=" << m_name
+            << " ssl=" << m_ssl
+            << " server takeover success: " << *i;
+    }
+    return true;
+}
+
 void TcpServer::handleClient(Socket::ptr client) {
     SYLAR_LOG_INFO(g_logger)  << "handle client;" << *client;
 }
@@ -134,18 +459,37 @@ bool TcpServer::loadCertificates(const std::string& cert_file, const std::string
             if (!ssl_sock->loadCertificates(cert_file, key_file)) {
                 return false;
             }
+            if (!m_alpnProtocols.empty()) {
+                ssl_sock->setAlpnProtocols(m_alpnProtocols);
+            }
         }
     }
     return true;
 }
 
+void TcpServer::setAlpnProtocols(const std::vector<std::string>& protos) {
+    m_alpnProtocols = protos;
+    for (auto& i : m_socks) {
+        auto ssl_sock = std::dynamic_pointer_cast<SSLSocket>(i);
+        if (ssl_sock) {
+            ssl_sock->setAlpnProtocols(protos);
+        }
+    }
+}
+
 std::string TcpServer::toString(const std::string& prefix) {
     std::stringstream ss;
     ss << prefix << "[type=" << m_type
        << " name=" << m_name << " ssl=" << m_ssl
        << " worker=" << (m_worker ? m_worker->getName() : "")
        << " accept=" << (m_acceptWorker ? m_acceptWorker->getName() : "")
-       << " recv_timeout=" << m_recvTimeout << "]" << std::endl;
+       << " recv_timeout=" << m_recvTimeout
+       << " acceptors=" << m_acceptorCount
+       << " max_connections=" << m_maxConnections
+       << " dispatch=" << (m_dispatchMode == LEAST_LOADED ? "least_loaded" : "round_robin")
+       << " connections=" << m_connections
+       << " accepted=" << m_acceptCount
+       << " rejected=" << m_rejectCount << "]" << std::endl;
     std::string pfx = prefix.empty() ? "    " : prefix;
     for(auto& i : m_socks) {
         ss << pfx << pfx << *i << std::endl;
@@ -33,12 +33,14 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <atomic>
 #include <yaml-cpp/yaml.h>
 #include "address.h"
 #include "iomanager.h"
 #include "socket.h"
 #include "noncopyable.h"
 #include "config.h"
+#include "metrics.h"
 
 namespace sylar {
 
@@ -154,11 +156,19 @@ public:
 //TcpServer服务器封装
 class TcpServer : public std::enable_shared_from_this<TcpServer>, Noncopyable {
 public:
+    //新连接分配给io线程的方式
+    enum DispatchMode {
+        //轮询
+        ROUND_ROBIN = 0,
+        //分配给当前连接数最少的线程
+        LEAST_LOADED = 1
+    };
+
     //worker：执行业务逻辑
     //io_worker：执行io操作
     //accept_worker：执行接收连接的操作
     //通过分离三种操作，提升服务器的并发性能和资源利用率
-    TcpServer::TcpServer(sylar::IOManager* worker = sylar::IOManager::GetThis(),
+    TcpServer(sylar::IOManager* worker = sylar::IOManager::GetThis(),
                          sylar::IOManager* io_worker = sylar::IOManager::GetThis(),
                          sylar::IOManager* accept_worker = sylar::IOManager::GetThis());
     virtual ~TcpServer();
@@ -167,16 +177,35 @@ public:
     virtual bool bind(sylar::Address::ptr addr, bool ssl = false);
     //绑定地址数组，返回绑定成功与否的同时返回可能绑定失败的地址
     virtual bool bind(const std::vector<Address::ptr>& addrs,
-                      const std::vector<Address::ptr>& fails,
+                      std::vector<Address::ptr>& fails,
                       bool ssl = false);
     //加载证书
     bool loadCertificates(const std::string& cert_file, const std::string& key_file);
+    //SSL监听socket的ALPN协议列表，loadCertificates时设置，已经加载过证书时立即生效
+    void setAlpnProtocols(const std::vector<std::string>& protos);
+    const std::vector<std::string>& getAlpnProtocols() const { return m_alpnProtocols;}
 
     //启动服务，需在绑定成功后执行
     virtual bool start();
     //停止服务
     virtual void stop();
 
+    //优雅停止：停止accept，正在处理请求的连接继续执行到结束，空闲的长连接直接关闭
+    //超过timeout_ms还没结束的连接会被强制关闭(shutdown)，所有连接结束后调用cb
+    //cb在最后一个连接结束的协程中调用，不要在里面做阻塞太久的操作
+    void drain(uint64_t timeout_ms, std::function<void()> cb = nullptr);
+    //是否处于drain状态，handleClient在处理完当前请求后应检查并结束连接
+    bool isDraining() const { return m_draining;}
+
+    //零停机重启(旧进程)：在Unix域socket path上等待新进程连接，把所有监听socket通过SCM_RIGHTS
+    //交给新进程，收到新进程的确认后对自己执行drain(drain_timeout_ms, cb)
+    //交接期间新旧进程共用同一个监听队列，不会有连接被拒绝或重置
+    //path上遗留的socket文件(上次异常退出)在bind前删除，交接结束后也会删除
+    bool startHandoff(const std::string& path, uint64_t drain_timeout_ms,
+                      std::function<void()> cb = nullptr);
+    //零停机重启(新进程)：连接旧进程的path，接管它的监听socket，代替bind，成功后直接start
+    bool takeover(const std::string& path, bool ssl = false, uint64_t timeout_ms = 5000);
+
     //返回读取超时时间(毫秒)
     uint64_t getRecvTimeout() const { return m_recvTimeout;}
 
@@ -200,6 +229,24 @@ public:
 
     std::vector<Socket::ptr> getSocks() const { return m_socks;}
 
+    //每个监听地址的accept协程数，>1时用SO_REUSEPORT为同一地址创建多个监听socket，需在bind之前设置
+    void setAcceptorCount(uint32_t v) { m_acceptorCount = v ? v : 1;}
+    uint32_t getAcceptorCount() const { return m_acceptorCount;}
+    //最大连接数，超过时新连接accept后立即关闭，0表示不限制
+    void setMaxConnections(uint32_t v) { m_maxConnections = v;}
+    uint32_t getMaxConnections() const { return m_maxConnections;}
+    void setDispatchMode(DispatchMode v) { m_dispatchMode = v;}
+    DispatchMode getDispatchMode() const { return m_dispatchMode;}
+
+    //累计接收的连接数
+    uint64_t getAcceptCount() const { return m_acceptCount;}
+    //因超过最大连接数被拒绝的连接数
+    uint64_t getRejectCount() const { return m_rejectCount;}
+    //当前正在处理的连接数
+    int64_t getConnectionCount() const { return m_connections;}
+    //距离上次调用以来平均每秒接收的连接数
+    double getAcceptRate();
+
 
 protected:
     //负责处理新建立的客户端连接(由服务端accept返回的socket)
@@ -210,6 +257,23 @@ protected:
     virtual void handleClient(Socket::ptr client);
     //开始接受连接
     virtual void startAccept(Socket::ptr sock);
+    //把新连接分配到io线程上执行handleClient，超过最大连接数时直接关闭
+    void dispatch(Socket::ptr client);
+    //按m_dispatchMode选择一个io线程，返回m_ioThreads的下标，没有可选线程时返回-1
+    int selectIOThread();
+    //标记连接是否空闲(长连接在等待下一个请求)，drain时空闲的连接会被直接关闭
+    //返回false表示服务器正在drain，调用方应结束这个连接
+    bool setClientIdle(Socket::ptr client, bool idle);
+    //连接处理结束，drain时最后一个连接结束后回调drain的cb
+    void removeClient(Socket::ptr client);
+    //drain超时，强制关闭剩余的连接
+    void forceCloseClients();
+    //等待新进程连接并交接监听socket
+    void handleHandoff(Socket::ptr sock, const std::string& path, uint64_t drain_timeout_ms,
+                       std::function<void()> cb);
+    //按当前的名称注册连接数等导出指标，start时调用
+    void registerMetrics();
+    void unregisterMetrics();
     
 protected:
     //监听socket数组,注意这里存储的是当前服务器监听的IP:port(自己的服务器上的)，而不是已连接的远端socket
@@ -230,8 +294,42 @@ protected:
     bool m_isStop;
     //是否启用SSL/TLS
     bool m_ssl = false;
+    //ALPN协议列表
+    std::vector<std::string> m_alpnProtocols;
 
     TcpServerConf::ptr m_conf;
+
+    //每个监听地址的accept协程数
+    uint32_t m_acceptorCount;
+    //一次唤醒最多accept的连接数
+    uint32_t m_acceptBatch;
+    //最大连接数，0表示不限制
+    uint32_t m_maxConnections;
+    DispatchMode m_dispatchMode;
+    //m_ioWorker的线程id，以及每个线程上正在处理的连接数
+    std::vector<int> m_ioThreads;
+    std::unique_ptr<std::atomic<int64_t>[]> m_threadLoads;
+    std::atomic<uint64_t> m_rrIndex = {0};
+    //统计
+    std::atomic<uint64_t> m_acceptCount = {0};
+    std::atomic<uint64_t> m_rejectCount = {0};
+    std::atomic<int64_t> m_connections = {0};
+    //getAcceptRate上次调用时的时间(毫秒)和累计连接数
+    uint64_t m_lastRateTime = 0;
+    uint64_t m_lastRateCount = 0;
+
+    //是否正在drain，在m_mutex里修改，isDraining不加锁读
+    std::atomic<bool> m_draining = {false};
+    //保护m_clients/m_drainCb
+    Mutex m_mutex;
+    //正在处理的连接 -> 是否空闲
+    std::map<Socket::ptr, bool> m_clients;
+    std::function<void()> m_drainCb;
+    Timer::ptr m_drainTimer;
+    //交接监听socket用的Unix域socket
+    Socket::ptr m_handoffSock;
+    //注册的导出指标，析构时删除
+    std::vector<metrics::Metric::ptr> m_metrics;
 };
 
 
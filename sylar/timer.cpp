@@ -1,8 +1,12 @@
 #include "timer.h"
 #include "util.h"
+#include "metrics.h"
 
 namespace sylar {
 
+static metrics::Counter::ptr s_timer_expired = metrics::MetricsMgr::GetInstance()->getCounter(
+        "sylar_timer_expired_total", "timers expired");
+
 //为TimerManager的timer集合提供一个比较函数。使set按照定时器的触发时间先后排序
 bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const {
     //两个指针相同，返回false，（set不允许重复元素）
@@ -206,6 +210,7 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
     //移除所有已到期的定时器,并移动到expired中
     expired.insert(expired.begin(), m_timers.begin(), it);
     m_timers.erase(m_timers.begin(), it);
+    s_timer_expired->inc(expired.size());
 
     cbs.resize(expired.size());
     for (auto& timer : expired) {
@@ -249,4 +254,9 @@ bool TimerManager::hasTimer() {
     return !m_timers.empty();
 }
 
+size_t TimerManager::getTimerCount() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_timers.size();
+}
+
 }
\ No newline at end of file
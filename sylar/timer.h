@@ -95,6 +95,9 @@ public:
     //是否有定时器
     bool hasTimer();
 
+    //当前的定时器数量
+    size_t getTimerCount();
+
 protected:
     //当有新的定时器插入到定时器的首部（新插入的timer执行时间最早，所以被排在了最前面），执行此函数
     virtual void onTimerInsertedAtFront() = 0;
@@ -0,0 +1,462 @@
+#include "trace.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "macro.h"
+#include "mutex.h"
+#include "thread.h"
+#include "util.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<double>::ptr g_trace_sample_rate =
+    sylar::Config::Lookup("trace.sample_rate", 0.01, "trace sample rate of new requests, 0 disable");
+
+static sylar::ConfigVar<uint32_t>::ptr g_trace_ring_size =
+    sylar::Config::Lookup("trace.ring_size", (uint32_t)2048, "span ring buffer size per thread");
+
+//随机数小于这个值时采样，0表示不采样
+static std::atomic<uint64_t> s_sample_threshold = {0};
+
+static uint64_t ToThreshold(double rate) {
+    if (!(rate > 0)) {
+        return 0;
+    }
+    if (rate >= 1) {
+        return UINT64_MAX;
+    }
+    return (uint64_t)(rate * 18446744073709551616.0);
+}
+
+struct _TraceIniter {
+    _TraceIniter() {
+        s_sample_threshold = ToThreshold(g_trace_sample_rate->getValue());
+        g_trace_sample_rate->addListener([](const double& old_value, const double& new_value) {
+            SYLAR_LOG_INFO(g_logger) << "trace sample rate changed from "
+                << old_value << " to " << new_value;
+            s_sample_threshold = ToThreshold(new_value);
+        });
+    }
+};
+
+static _TraceIniter s_trace_initer;
+
+//单个线程的span缓冲区，只有所属线程写，导出时其他线程读
+//每个槽位带一个序号(seqlock)，写的过程中序号为0，读到前后序号一致才认为数据完整
+class TraceRing {
+public:
+    typedef std::shared_ptr<TraceRing> ptr;
+
+    TraceRing(uint32_t size)
+        :m_tid(sylar::GetThreadId())
+        ,m_threadName(sylar::Thread::GetName()) {
+        uint64_t cap = 64;
+        while (cap < size) {
+            cap <<= 1;
+        }
+        m_mask = cap - 1;
+        m_slots.reset(new Slot[cap]);
+    }
+
+    void push(const SpanRecord& span) {
+        uint64_t h = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[h & m_mask];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.span = span;
+        slot.seq.store(h + 1, std::memory_order_release);
+        m_head.store(h + 1, std::memory_order_release);
+    }
+
+    void collect(std::vector<SpanRecord>& spans, const TraceContext* filter) {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t begin = m_floor.load(std::memory_order_acquire);
+        if (head > m_mask + 1 && head - m_mask - 1 > begin) {
+            begin = head - m_mask - 1;
+        }
+        SpanRecord span;
+        for (uint64_t i = begin; i < head; ++i) {
+            Slot& slot = m_slots[i & m_mask];
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != i + 1) {
+                continue;
+            }
+            span = slot.span;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq) {
+                //读的过程中被覆盖了
+                continue;
+            }
+            if (filter && (span.trace_hi != filter->trace_hi
+                        || span.trace_lo != filter->trace_lo)) {
+                continue;
+            }
+            spans.push_back(span);
+        }
+    }
+
+    void clear() {
+        m_floor.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    uint32_t getTid() const { return m_tid;}
+    const std::string& getThreadName() const { return m_threadName;}
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq = {0};
+        SpanRecord span;
+    };
+
+    uint32_t m_tid;
+    std::string m_threadName;
+    uint64_t m_mask = 0;
+    std::unique_ptr<Slot[]> m_slots;
+    //下一个写入的序号
+    std::atomic<uint64_t> m_head = {0};
+    //Clear时的m_head，之前的不再导出
+    std::atomic<uint64_t> m_floor = {0};
+};
+
+//所有线程的缓冲区，线程退出时删除
+static Mutex s_rings_mutex;
+static std::vector<TraceRing::ptr> s_rings;
+
+struct TraceRingHolder {
+    TraceRing::ptr ring;
+
+    TraceRing* get() {
+        if (!ring) {
+            ring = std::make_shared<TraceRing>(g_trace_ring_size->getValue());
+            Mutex::Lock lock(s_rings_mutex);
+            s_rings.push_back(ring);
+        }
+        return ring.get();
+    }
+
+    ~TraceRingHolder() {
+        if (ring) {
+            Mutex::Lock lock(s_rings_mutex);
+            s_rings.erase(std::remove(s_rings.begin(), s_rings.end(), ring), s_rings.end());
+        }
+    }
+};
+
+static thread_local TraceRingHolder t_ring;
+
+//xorshift64*，每个线程独立，不需要加锁
+static uint64_t Random() {
+    static thread_local uint64_t s_state = 0;
+    if (SYLAR_UNLIKELY(s_state == 0)) {
+        s_state = sylar::GetCurrentUS() ^ ((uint64_t)sylar::GetThreadId() << 32)
+                  ^ (uint64_t)(uintptr_t)&s_state;
+        if (s_state == 0) {
+            s_state = 0x9E3779B97F4A7C15ull;
+        }
+    }
+    s_state ^= s_state >> 12;
+    s_state ^= s_state << 25;
+    s_state ^= s_state >> 27;
+    return s_state * 0x2545F4914F6CDD1Dull;
+}
+
+TraceContext* Tracer::GetContext() {
+    return Fiber::GetTraceContext();
+}
+
+uint64_t Tracer::NewId() {
+    uint64_t id = 0;
+    while (id == 0) {
+        id = Random();
+    }
+    return id;
+}
+
+uint64_t Tracer::NowUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+bool Tracer::NewTrace(TraceContext& ctx) {
+    uint64_t threshold = s_sample_threshold.load(std::memory_order_relaxed);
+    if (threshold == 0 || (threshold != UINT64_MAX && Random() >= threshold)) {
+        return false;
+    }
+    ctx.trace_hi = NewId();
+    ctx.trace_lo = NewId();
+    ctx.span_id = 0;
+    ctx.sampled = true;
+    return true;
+}
+
+static bool ParseHex(const char* p, size_t len, uint64_t& v) {
+    v = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char c = p[i];
+        uint64_t d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            d = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        v = (v << 4) | d;
+    }
+    return true;
+}
+
+bool Tracer::ParseTraceParent(const std::string& v, TraceContext& ctx) {
+    //00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01
+    if (v.size() < 55 || v[2] != '-' || v[35] != '-' || v[52] != '-'
+            || (v.size() > 55 && v[55] != '-')) {
+        return false;
+    }
+    uint64_t version = 0;
+    uint64_t flags = 0;
+    TraceContext rt;
+    if (!ParseHex(v.c_str(), 2, version) || version == 0xff
+            || !ParseHex(v.c_str() + 3, 16, rt.trace_hi)
+            || !ParseHex(v.c_str() + 19, 16, rt.trace_lo)
+            || !ParseHex(v.c_str() + 36, 16, rt.span_id)
+            || !ParseHex(v.c_str() + 53, 2, flags)) {
+        return false;
+    }
+    //版本00后面不能再有其他字段
+    if (version == 0 && v.size() != 55) {
+        return false;
+    }
+    if (!rt.valid() || rt.span_id == 0) {
+        return false;
+    }
+    rt.sampled = flags & 0x01;
+    ctx = rt;
+    return true;
+}
+
+std::string Tracer::FormatTraceParent(const TraceContext& ctx) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "00-%016llx%016llx-%016llx-%02x"
+             ,(unsigned long long)ctx.trace_hi, (unsigned long long)ctx.trace_lo
+             ,(unsigned long long)(ctx.span_id ? ctx.span_id : NewId())
+             ,ctx.sampled ? 1 : 0);
+    return buf;
+}
+
+std::string Tracer::FormatTraceId(const TraceContext& ctx) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%016llx%016llx"
+             ,(unsigned long long)ctx.trace_hi, (unsigned long long)ctx.trace_lo);
+    return buf;
+}
+
+static void FillRecord(SpanRecord& span, const TraceContext& ctx, const char* cat
+                       ,uint64_t parent_id, uint64_t span_id, uint64_t start_us, uint64_t end_us) {
+    span.trace_hi = ctx.trace_hi;
+    span.trace_lo = ctx.trace_lo;
+    span.span_id = span_id;
+    span.parent_id = parent_id;
+    span.start_us = start_us;
+    span.dur_us = end_us > start_us ? end_us - start_us : 0;
+    span.fiber_id = sylar::GetFiberId();
+    span.tid = sylar::GetThreadId();
+    span.cat = cat;
+}
+
+static void CopyName(char* dst, const char* name) {
+    size_t len = strnlen(name, SpanRecord::NAME_SIZE - 1);
+    memcpy(dst, name, len);
+    dst[len] = '\0';
+}
+
+void Tracer::Record(const TraceContext& ctx, const char* cat, const char* name
+                    ,uint64_t parent_id, uint64_t span_id
+                    ,uint64_t start_us, uint64_t end_us) {
+    if (!ctx.sampled) {
+        return;
+    }
+    SpanRecord span;
+    FillRecord(span, ctx, cat, parent_id, span_id, start_us, end_us);
+    CopyName(span.name, name);
+    t_ring.get()->push(span);
+}
+
+std::function<void()> Tracer::Wrap(const char* cat, std::function<void()> cb) {
+    TraceContext* cur = GetContext();
+    if (!cur->sampled || !cb) {
+        return cb;
+    }
+    TraceContext ctx = *cur;
+    uint64_t enqueue = NowUS();
+    return [ctx, enqueue, cat, cb]() {
+        uint64_t start = NowUS();
+        std::string name = cat;
+        Record(ctx, cat, (name + ".wait").c_str(), ctx.span_id, NewId(), enqueue, start);
+        TraceScope scope(ctx);
+        TraceSpan span(cat, name + ".run");
+        cb();
+    };
+}
+
+void Tracer::Collect(std::vector<SpanRecord>& spans, const std::string& trace_id) {
+    TraceContext filter;
+    if (!trace_id.empty()) {
+        if (trace_id.size() != 32
+                || !ParseHex(trace_id.c_str(), 16, filter.trace_hi)
+                || !ParseHex(trace_id.c_str() + 16, 16, filter.trace_lo)) {
+            return;
+        }
+    }
+    std::vector<TraceRing::ptr> rings;
+    {
+        Mutex::Lock lock(s_rings_mutex);
+        rings = s_rings;
+    }
+    for (auto& i : rings) {
+        i->collect(spans, trace_id.empty() ? nullptr : &filter);
+    }
+}
+
+static void WriteString(std::ostream& os, const std::string& v) {
+    os << '"';
+    for (auto c : v) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+            os << buf;
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+static void WriteHexField(std::ostream& os, const char* key, uint64_t v) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+    os << ",\"" << key << "\":\"" << buf << "\"";
+}
+
+std::ostream& Tracer::WriteJson(std::ostream& os, const std::string& trace_id) {
+    std::vector<SpanRecord> spans;
+    Collect(spans, trace_id);
+    std::sort(spans.begin(), spans.end(), [](const SpanRecord& a, const SpanRecord& b) {
+        return a.start_us < b.start_us;
+    });
+    std::vector<std::pair<uint32_t, std::string> > threads;
+    {
+        Mutex::Lock lock(s_rings_mutex);
+        for (auto& i : s_rings) {
+            threads.push_back(std::make_pair(i->getTid(), i->getThreadName()));
+        }
+    }
+    int pid = getpid();
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (auto& i : threads) {
+        os << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+           << ",\"tid\":" << i.first << ",\"args\":{\"name\":";
+        WriteString(os, i.second);
+        os << "}}";
+        first = false;
+    }
+    for (auto& i : spans) {
+        TraceContext ctx;
+        ctx.trace_hi = i.trace_hi;
+        ctx.trace_lo = i.trace_lo;
+        os << (first ? "" : ",") << "\n{\"name\":";
+        WriteString(os, i.name);
+        os << ",\"cat\":\"" << i.cat << "\",\"ph\":\"X\",\"ts\":" << i.start_us
+           << ",\"dur\":" << i.dur_us << ",\"pid\":" << pid << ",\"tid\":" << i.tid
+           << ",\"args\":{\"trace_id\":\"" << FormatTraceId(ctx) << "\"";
+        WriteHexField(os, "span_id", i.span_id);
+        WriteHexField(os, "parent_id", i.parent_id);
+        os << ",\"fiber_id\":" << i.fiber_id << "}}";
+        first = false;
+    }
+    os << "\n]}\n";
+    return os;
+}
+
+bool Tracer::WriteToFile(const std::string& path, const std::string& trace_id) {
+    std::ofstream ofs(path, std::ios::trunc);
+    if (!ofs) {
+        SYLAR_LOG_ERROR(g_logger) << "open trace file " << path << " fail, errno="
+            << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    WriteJson(ofs, trace_id);
+    return (bool)ofs;
+}
+
+void Tracer::Clear() {
+    Mutex::Lock lock(s_rings_mutex);
+    for (auto& i : s_rings) {
+        i->clear();
+    }
+}
+
+TraceSpan::TraceSpan(const char* cat, const char* name)
+    :m_ctx(Tracer::GetContext()) {
+    if (!m_ctx->sampled) {
+        m_ctx = nullptr;
+        return;
+    }
+    begin(cat, name);
+}
+
+TraceSpan::TraceSpan(const char* cat, const std::string& name)
+    :m_ctx(Tracer::GetContext()) {
+    if (!m_ctx->sampled) {
+        m_ctx = nullptr;
+        return;
+    }
+    begin(cat, name.c_str());
+}
+
+TraceSpan::TraceSpan(const char* cat, const char* prefix, const std::string& suffix)
+    :m_ctx(Tracer::GetContext()) {
+    if (!m_ctx->sampled) {
+        m_ctx = nullptr;
+        return;
+    }
+    begin(cat, prefix);
+    size_t len = strlen(m_name);
+    size_t n = std::min(suffix.size(), SpanRecord::NAME_SIZE - 1 - len);
+    memcpy(m_name + len, suffix.data(), n);
+    m_name[len + n] = '\0';
+}
+
+void TraceSpan::begin(const char* cat, const char* name) {
+    m_cat = cat;
+    CopyName(m_name, name);
+    m_parentId = m_ctx->span_id;
+    m_spanId = Tracer::NewId();
+    m_ctx->span_id = m_spanId;
+    m_start = Tracer::NowUS();
+}
+
+TraceSpan::~TraceSpan() {
+    if (!m_ctx) {
+        return;
+    }
+    SpanRecord span;
+    FillRecord(span, *m_ctx, m_cat, m_parentId, m_spanId, m_start, Tracer::NowUS());
+    memcpy(span.name, m_name, sizeof(m_name));
+    t_ring.get()->push(span);
+    m_ctx->span_id = m_parentId;
+}
+
+}
@@ -0,0 +1,142 @@
+/**
+ * @file trace.h
+ * @brief 协程感知的请求追踪，span记录在每个线程自己的无锁环形缓冲区里
+ * @date 2025-07-24
+ * @copyright Copyright (c) All rights reserved
+ */
+
+// 一个请求慢的时候需要知道时间花在哪里：在调度队列里排队、在do_io里等fd、在FoxThread队列里排队，还是真的在执行
+// 1.TraceContext: 追踪上下文(trace id、当前span id、是否采样)，跟着协程走，
+//   协程切换到别的线程后上下文不变，没有协程的线程(FoxThread)每个线程一份
+// 2.传播：
+//   - Scheduler::schedule: 回调任务继承调用方的上下文，采样时记录sched.wait(入队到开始执行)
+//   - IOManager::addEvent: 回调事件继承注册时的上下文，采样时记录io.wait；协程等待的io在do_io里记录
+//   - FoxThread::dispatch: 采样时包装回调，记录fox.wait和fox.run
+//   - HTTP: TraceFilter从traceparent头(W3C Trace Context)继续上游的追踪，或按trace.sample_rate新建，
+//     HttpConnection发请求时带上traceparent
+// 3.记录：span结束时写入当前线程的环形缓冲区(trace.ring_size条，默认2048，写满后覆盖最旧的)，只有本线程写，不加锁
+// 4.导出：Chrome trace event格式的JSON，/_/trace返回，或者Tracer::WriteToFile写到文件，
+//   用chrome://tracing或者https://ui.perfetto.dev打开
+//
+// 没有采样的请求上下文为空，每个埋点只多一次线程局部变量读取和判断
+// 使用：
+//   sylar::TraceSpan span("db", "query user");
+//   ...   //span析构时记录，期间新建的span和调度的回调都是它的子span
+
+#ifndef __SYLAR_TRACE_H__
+#define __SYLAR_TRACE_H__
+
+#include <stdint.h>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "noncopyable.h"
+
+namespace sylar {
+
+struct TraceContext {
+    //128位trace id
+    uint64_t trace_hi = 0;
+    uint64_t trace_lo = 0;
+    //当前所在的span，新建的span以它为父span
+    uint64_t span_id = 0;
+    bool sampled = false;
+
+    bool valid() const { return trace_hi || trace_lo;}
+};
+
+//一条记录下来的span，定长，写入环形缓冲区不分配内存
+struct SpanRecord {
+    static const size_t NAME_SIZE = 48;
+
+    uint64_t trace_hi;
+    uint64_t trace_lo;
+    uint64_t span_id;
+    uint64_t parent_id;
+    //开始时间和持续时间(us，单调时钟)
+    uint64_t start_us;
+    uint64_t dur_us;
+    uint64_t fiber_id;
+    uint32_t tid;
+    //分类，必须是静态字符串
+    const char* cat;
+    //名字，超长截断
+    char name[NAME_SIZE];
+};
+
+class Tracer {
+public:
+    //当前协程(没有协程时是当前线程)的追踪上下文，不会返回nullptr
+    static TraceContext* GetContext();
+
+    //按trace.sample_rate决定是否采样，采样时填好新的trace id返回true
+    static bool NewTrace(TraceContext& ctx);
+    //随机的非0 id
+    static uint64_t NewId();
+    //单调时钟(us)
+    static uint64_t NowUS();
+
+    //解析traceparent头(00-<32位hex trace id>-<16位hex span id>-<2位hex flags>)
+    static bool ParseTraceParent(const std::string& v, TraceContext& ctx);
+    static std::string FormatTraceParent(const TraceContext& ctx);
+    static std::string FormatTraceId(const TraceContext& ctx);
+
+    //记录一个span到当前线程的环形缓冲区，ctx没有采样时什么都不做
+    static void Record(const TraceContext& ctx, const char* cat, const char* name
+                       ,uint64_t parent_id, uint64_t span_id
+                       ,uint64_t start_us, uint64_t end_us);
+
+    //当前上下文采样时把cb包装成在上下文里执行，并记录<cat>.wait(排队)和<cat>.run(执行)，否则原样返回
+    static std::function<void()> Wrap(const char* cat, std::function<void()> cb);
+
+    //收集所有线程的span，trace_id(32位hex)不为空时只收集这个trace的
+    static void Collect(std::vector<SpanRecord>& spans, const std::string& trace_id = "");
+    //Chrome trace event格式输出
+    static std::ostream& WriteJson(std::ostream& os, const std::string& trace_id = "");
+    static bool WriteToFile(const std::string& path, const std::string& trace_id = "");
+    //丢弃已经记录的span
+    static void Clear();
+};
+
+//作用域内的span，当前上下文没有采样时不做任何事
+class TraceSpan : Noncopyable {
+public:
+    TraceSpan(const char* cat, const char* name);
+    TraceSpan(const char* cat, const std::string& name);
+    //名字为prefix + suffix，采样时才拼接，没有采样的埋点不构造临时字符串
+    TraceSpan(const char* cat, const char* prefix, const std::string& suffix);
+    ~TraceSpan();
+
+    uint64_t getSpanId() const { return m_spanId;}
+private:
+    void begin(const char* cat, const char* name);
+private:
+    //采样时为开始时的上下文(属于协程，协程换线程后仍然有效)，否则为nullptr
+    TraceContext* m_ctx;
+    const char* m_cat = nullptr;
+    uint64_t m_parentId = 0;
+    uint64_t m_spanId = 0;
+    uint64_t m_start = 0;
+    char m_name[SpanRecord::NAME_SIZE];
+};
+
+//作用域内把当前上下文替换为ctx，结束时恢复
+class TraceScope : Noncopyable {
+public:
+    TraceScope(const TraceContext& ctx)
+        :m_ctx(Tracer::GetContext())
+        ,m_old(*m_ctx) {
+        *m_ctx = ctx;
+    }
+    ~TraceScope() {
+        *m_ctx = m_old;
+    }
+private:
+    TraceContext* m_ctx;
+    TraceContext m_old;
+};
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace sylar {
+
+//块头的大小，保证块内数据按8字节对齐
+static const size_t s_block_header = (sizeof(void*) + 7) & ~(size_t)7;
+
+Arena::Arena(size_t block_size)
+    :m_blockSize(block_size < 64 ? 64 : block_size)
+    ,m_ptr(nullptr)
+    ,m_end(nullptr)
+    ,m_head(nullptr)
+    ,m_blockCount(0)
+    ,m_used(0) {
+}
+
+Arena::~Arena() {
+    reset();
+}
+
+char* Arena::newBlock(size_t size, bool current) {
+    Block* b = (Block*)malloc(s_block_header + size);
+    if (!b) {
+        throw std::bad_alloc();
+    }
+    char* data = (char*)b + s_block_header;
+    if (current || !m_head) {
+        b->next = m_head;
+        m_head = b;
+    } else {
+        //大块挂在当前块后面，当前块剩下的空间继续使用
+        b->next = m_head->next;
+        m_head->next = b;
+    }
+    if (current) {
+        m_ptr = data;
+        m_end = data + size;
+    }
+    ++m_blockCount;
+    return data;
+}
+
+char* Arena::allocateChars(size_t n) {
+    m_used += n;
+    if ((size_t)(m_end - m_ptr) >= n) {
+        char* p = m_ptr;
+        m_ptr += n;
+        return p;
+    }
+    if (n > m_blockSize / 4) {
+        return newBlock(n, false);
+    }
+    newBlock(m_blockSize, true);
+    char* p = m_ptr;
+    m_ptr += n;
+    return p;
+}
+
+void* Arena::allocate(size_t n) {
+    size_t pad = (8 - ((uintptr_t)m_ptr & 7)) & 7;
+    if (m_ptr && (size_t)(m_end - m_ptr) >= n + pad) {
+        m_ptr += pad;
+        m_used += pad;
+    } else if (n > m_blockSize / 4) {
+        m_used += n;
+        return newBlock(n, false);
+    } else {
+        //新块的起始地址是对齐的
+        newBlock(m_blockSize, true);
+    }
+    return allocateChars(n);
+}
+
+StringView Arena::copy(const char* data, size_t len) {
+    if (len == 0) {
+        return StringView();
+    }
+    char* p = allocateChars(len);
+    memcpy(p, data, len);
+    return StringView(p, len);
+}
+
+void Arena::reset() {
+    while (m_head) {
+        Block* next = m_head->next;
+        free(m_head);
+        m_head = next;
+    }
+    m_ptr = m_end = nullptr;
+    m_used = 0;
+    m_blockCount = 0;
+}
+
+}
@@ -0,0 +1,60 @@
+/**
+ * @file arena.h
+ * @brief 按块分配的bump内存池，整体释放
+ * @date 2025-07-19
+ */
+
+#ifndef __SYLAR_UTIL_ARENA_H__
+#define __SYLAR_UTIL_ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sylar/noncopyable.h"
+#include "sylar/util/string_view.h"
+
+namespace sylar {
+
+/**
+ * @brief 生命周期相同的小对象从一块内存上顺序切分，不单独释放，析构或者reset时一起释放
+ * @details 第一次分配时才申请第一个块；超过块大小1/4的分配单独申请一个块，不浪费当前块剩下的空间
+ *          非线程安全，一个Arena只在一个协程里使用
+ */
+class Arena : Noncopyable {
+public:
+    Arena(size_t block_size = 1024);
+    ~Arena();
+
+    //分配n字节，按8字节对齐
+    void* allocate(size_t n);
+    //分配n字节，不对齐(字符串)
+    char* allocateChars(size_t n);
+    //把data拷贝进arena，返回指向拷贝的视图
+    StringView copy(const char* data, size_t len);
+    StringView copy(const StringView& v) { return copy(v.data(), v.size());}
+
+    //释放所有块，之前返回的内存全部失效
+    void reset();
+
+    //向系统申请内存的次数
+    size_t getBlockCount() const { return m_blockCount;}
+    //已经分配出去的字节数
+    size_t getUsedSize() const { return m_used;}
+
+private:
+    struct Block {
+        Block* next;
+    };
+    char* newBlock(size_t size, bool current);
+
+private:
+    size_t m_blockSize;
+    char* m_ptr;
+    char* m_end;
+    Block* m_head;
+    size_t m_blockCount;
+    size_t m_used;
+};
+
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include "hash_util.h"
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+namespace sylar {
+
+std::string base64encode(const std::string& data) {
+    return base64encode(data.data(), data.size());
+}
+
+std::string base64encode(const void* data, size_t len) {
+    std::string out;
+    //每3字节编码成4字节，EVP_EncodeBlock会在末尾多写一个'\0'
+    out.resize((len + 2) / 3 * 4 + 1);
+    int n = EVP_EncodeBlock((unsigned char*)&out[0], (const unsigned char*)data, len);
+    out.resize(n);
+    return out;
+}
+
+std::string base64decode(const std::string& src) {
+    if (src.size() % 4) {
+        return "";
+    }
+    std::string out;
+    out.resize(src.size() / 4 * 3 + 1);
+    int n = EVP_DecodeBlock((unsigned char*)&out[0], (const unsigned char*)src.data(), src.size());
+    if (n < 0) {
+        return "";
+    }
+    //EVP_DecodeBlock不处理填充，按结尾'='的个数去掉多出来的0
+    size_t pad = 0;
+    if (!src.empty() && src[src.size() - 1] == '=') {
+        ++pad;
+        if (src.size() > 1 && src[src.size() - 2] == '=') {
+            ++pad;
+        }
+    }
+    out.resize(n - pad);
+    return out;
+}
+
+std::string sha1sum(const std::string& data) {
+    return sha1sum(data.data(), data.size());
+}
+
+std::string sha1sum(const void* data, size_t len) {
+    std::string out;
+    out.resize(SHA_DIGEST_LENGTH);
+    SHA1((const unsigned char*)data, len, (unsigned char*)&out[0]);
+    return out;
+}
+
+}
@@ -0,0 +1,34 @@
+/**
+ * @file hash_util.h
+ * @brief 摘要和编码工具(sha1/base64)
+ * @date 2025-07-18
+ */
+
+#ifndef __SYLAR_UTIL_HASH_UTIL_H__
+#define __SYLAR_UTIL_HASH_UTIL_H__
+
+#include <string>
+
+namespace sylar {
+
+/**
+ * @brief 标准base64编码(带'='填充)
+ */
+std::string base64encode(const std::string& data);
+std::string base64encode(const void* data, size_t len);
+
+/**
+ * @brief 标准base64解码
+ * @return 输入不合法时返回空串
+ */
+std::string base64decode(const std::string& src);
+
+/**
+ * @brief sha1摘要，返回20字节的二进制结果
+ */
+std::string sha1sum(const std::string& data);
+std::string sha1sum(const void* data, size_t len);
+
+}
+
+#endif
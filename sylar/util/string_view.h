@@ -0,0 +1,86 @@
+/**
+ * @file string_view.h
+ * @brief 只读字符串视图(C++11下std::string_view的简化版)
+ * @date 2025-07-19
+ * @copyright Copyright (c) All rights reserved
+ */
+
+#ifndef __SYLAR_UTIL_STRING_VIEW_H__
+#define __SYLAR_UTIL_STRING_VIEW_H__
+
+#include <string.h>
+#include <strings.h>
+#include <ostream>
+#include <string>
+
+namespace sylar {
+
+//指向一段外部内存，不拥有数据，不保证以'\0'结尾
+//使用方保证视图在被引用的内存有效期间使用
+class StringView {
+public:
+    StringView()
+        :m_data(""), m_size(0) {
+    }
+    StringView(const char* data, size_t size)
+        :m_data(data), m_size(size) {
+    }
+    StringView(const char* str)
+        :m_data(str), m_size(strlen(str)) {
+    }
+    StringView(const std::string& str)
+        :m_data(str.data()), m_size(str.size()) {
+    }
+
+    const char* data() const { return m_data;}
+    size_t size() const { return m_size;}
+    bool empty() const { return m_size == 0;}
+    char operator[](size_t i) const { return m_data[i];}
+    const char* begin() const { return m_data;}
+    const char* end() const { return m_data + m_size;}
+
+    std::string str() const { return std::string(m_data, m_size);}
+    operator std::string() const { return str();}
+
+    StringView substr(size_t pos, size_t n = std::string::npos) const {
+        if (pos > m_size) {
+            pos = m_size;
+        }
+        return StringView(m_data + pos, n < m_size - pos ? n : m_size - pos);
+    }
+
+    size_t find(char c, size_t pos = 0) const {
+        if (pos >= m_size) {
+            return std::string::npos;
+        }
+        const char* p = (const char*)memchr(m_data + pos, c, m_size - pos);
+        return p ? p - m_data : std::string::npos;
+    }
+
+    bool equals(const char* data, size_t size) const {
+        return m_size == size && memcmp(m_data, data, size) == 0;
+    }
+    //忽略大小写比较(HTTP头部名)
+    bool iequals(const char* data, size_t size) const {
+        return m_size == size && strncasecmp(m_data, data, size) == 0;
+    }
+    bool iequals(const StringView& v) const { return iequals(v.m_data, v.m_size);}
+
+    bool operator==(const StringView& v) const { return equals(v.m_data, v.m_size);}
+    bool operator!=(const StringView& v) const { return !(*this == v);}
+private:
+    const char* m_data;
+    size_t m_size;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const StringView& v) {
+    return os.write(v.data(), v.size());
+}
+
+inline std::string& operator+=(std::string& str, const StringView& v) {
+    return str.append(v.data(), v.size());
+}
+
+}
+
+#endif